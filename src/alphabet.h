@@ -136,6 +136,9 @@ Revision 1.6  2007/12/20 23:25:45Z  Alun
 #ifndef MAFBASE_INCLUDED
 #include "mafbase.h"
 #endif
+#ifndef MAFTHREAD_INCLUDED
+#include "mafthread.h"
+#endif
 
 typedef String Glyph; /* Human format */
 
@@ -221,7 +224,7 @@ class Alphabet
     Ordinal nr_levels;
     Word_Ordering word_ordering;
     Ordinal coset_symbol;
-    mutable unsigned long reference_count;
+    mutable Atomic_Counter reference_count; // every FSA attaches its alphabets
     mutable Private_Byte_Buffer gt_state;
     const bool need_operator_symbol;
   public:
@@ -253,11 +256,11 @@ class Alphabet
     virtual ~Alphabet();
     void attach() const
     {
-      reference_count++;
+      reference_count.increment();
     }
     void detach() const
     {
-      if (!--reference_count)
+      if (!reference_count.decrement())
         delete (Alphabet *) this;
     }
     // Function to instantiate alphabet
@@ -0,0 +1,113 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: arena.cpp $
+//
+
+/* Implementation of class Arena declared in arena.h */
+
+#ifdef WIN32
+#include "awwin.h"
+#endif
+#include <stdlib.h>
+#include "awcc.h"
+#include "arena.h"
+
+#define align_type double
+
+struct Arena::Chunk
+{
+  /* Each chunk starts with this header. The union makes sure the memory
+     after it is suitably aligned */
+  union
+  {
+    Chunk * previous;
+    align_type alignment;
+  };
+};
+
+static size_t aligned_size(size_t size)
+{
+  return (size + sizeof(align_type)-1)/sizeof(align_type)*sizeof(align_type);
+}
+
+Arena::Arena(size_t chunk_size_) :
+  chunks(0),
+  next(0),
+  end(0),
+  in_use(0),
+  peak(0),
+  chunk_size(chunk_size_)
+{}
+
+Arena::~Arena()
+{
+  Mark empty;
+  empty.chunk = 0;
+  empty.next = empty.end = 0;
+  empty.in_use = 0;
+  release(empty);
+}
+
+void * Arena::allocate(size_t size)
+{
+  size = aligned_size(size ? size : 1);
+  if (size > size_t(end - next))
+  {
+    /* We need a new chunk. Any space left at the end of the current chunk
+       is wasted. Allocations bigger than chunk_size get a chunk to
+       themselves */
+    size_t new_size = sizeof(Chunk) + (size > chunk_size ? size : chunk_size);
+#ifdef WIN32
+    Chunk * chunk = (Chunk *) HeapAlloc(GetProcessHeap(),0,new_size);
+#else
+    Chunk * chunk = (Chunk *) ::malloc(new_size);
+#endif
+    if (!chunk)
+    {
+      /* The global new() would exit in this case, so we do the same */
+      exit(3);
+    }
+    chunk->previous = chunks;
+    chunks = chunk;
+    next = (char *) (chunk + 1);
+    end = (char *) chunk + new_size;
+  }
+  void * answer = next;
+  next += size;
+  in_use += size;
+  if (in_use > peak)
+    peak = in_use;
+  return answer;
+}
+
+void Arena::release(const Mark & mark)
+{
+  while (chunks != mark.chunk)
+  {
+    Chunk * chunk = chunks;
+    chunks = chunk->previous;
+#ifdef WIN32
+    HeapFree(GetProcessHeap(),0,chunk);
+#else
+    ::free(chunk);
+#endif
+  }
+  next = mark.next;
+  end = mark.end;
+  in_use = mark.in_use;
+}
@@ -0,0 +1,90 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: arena.h $
+*/
+#pragma once
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED 1
+
+/* An Arena is a very simple allocator for scratch memory that is needed
+   for the duration of some operation and can then be thrown away all at
+   once. Memory is allocated simply by advancing a pointer through a chunk
+   of memory, and individual allocations are never freed. The chunks are
+   obtained with malloc() (HeapAlloc() on Windows) rather than from MAF's
+   own heap, so that the big temporary arrays that operations such as FSA
+   minimisation need do not fragment it, and each chunk is freed as soon as
+   it is no longer needed.
+
+   Memory can be given back before the Arena is destroyed by taking a Mark
+   and later calling release() with it, which frees everything allocated
+   since the Mark was taken.
+
+   An Arena must only be used by one thread at a time. Memory obtained
+   from an Arena must not be passed to delete.
+*/
+
+#ifndef AWDEFS_INCLUDED
+#include "awdefs.h"
+#endif
+
+class Arena
+{
+  BLOCKED(Arena)
+  private:
+    struct Chunk;
+    Chunk * chunks;
+    char * next;
+    char * end;
+    size_t in_use;
+    size_t peak;
+    const size_t chunk_size;
+  public:
+    struct Mark
+    {
+      Chunk * chunk;
+      char * next;
+      char * end;
+      size_t in_use;
+    };
+    Arena(size_t chunk_size_ = 0x10000);
+    ~Arena();
+    void * allocate(size_t size);
+    template<class T> T * allocate_array(size_t count)
+    {
+      return (T *) allocate(count*sizeof(T));
+    }
+    Mark mark() const
+    {
+      Mark answer;
+      answer.chunk = chunks;
+      answer.next = next;
+      answer.end = end;
+      answer.in_use = in_use;
+      return answer;
+    }
+    void release(const Mark & mark);
+    // peak_usage() returns the largest amount of memory that has been
+    // allocated from the Arena at any one time
+    size_t peak_usage() const
+    {
+      return peak;
+    }
+};
+
+#endif
@@ -337,6 +337,10 @@ template<class T> class Array_Of : public Unknown_Collection
     {
       return data;
     }
+    const T * buffer() const
+    {
+      return data;
+    }
 };
 
 class Array_Of_Data : public Array_Of<Byte_Buffer>
@@ -118,6 +118,8 @@ int main(int argc,char ** argv)
   MAF::Options options;
   int exit_code = 0;
   unsigned exclude = EXCLUDE;
+  char * telemetry_filename = 0;
+  unsigned telemetry_interval = 10;
 #if defined(IS_KBPROG) && IS_KBPROG
   bool both = false;
 #endif
@@ -155,6 +157,11 @@ int main(int argc,char ** argv)
         fsa = FSA_Factory::create(argv[i+1],&container);
         i += 2;
       }
+      else if (arg.is_equal("-checkpoint"))
+      {
+        options.checkpoint = true;
+        i++;
+      }
       else if (so.present(arg,"-check_inverses"))
       {
         options.check_inverses = true;
@@ -352,6 +359,11 @@ int main(int argc,char ** argv)
         so.parse_total_length(&options.pool_above,argv[i+1],0,arg);
         i += 2;
       }
+      else if (so.present(arg,"-pool_memory"))
+      {
+        so.parse_natural(&options.pool_memory,argv[i+1],0,arg);
+        i += 2;
+      }
       else if (so.present(arg,"-probe_style"))
       {
         so.parse_natural(&options.probe_style,argv[i+1],3,arg);
@@ -505,6 +517,24 @@ int main(int argc,char ** argv)
         options.swap_bad = true;
         i++;
       }
+      else if (arg.is_equal("-telemetry"))
+      {
+        if (i+1 < argc)
+          telemetry_filename = argv[i+1];
+        else
+          bad_usage = true;
+        i += 2;
+      }
+      else if (arg.is_equal("-telemetry_interval"))
+      {
+        so.parse_natural(&telemetry_interval,argv[i+1],0,arg);
+        i += 2;
+      }
+      else if (arg.is_equal("-threads"))
+      {
+        so.parse_natural(&options.threads,argv[i+1],256,arg);
+        i += 2;
+      }
       else if (arg.is_equal("-tight"))
       {
         options.tight = true;
@@ -608,6 +638,8 @@ int main(int argc,char ** argv)
                                  &container,flags,&options);
     if (fsa)
       maf->set_validation_fsa(fsa);
+    if (telemetry_filename)
+      maf->start_telemetry(telemetry_filename,telemetry_interval);
     signal(SIGINT,signal_handler);
     signal(SIGTERM,signal_handler);
     global_maf = maf;
@@ -133,6 +133,18 @@ version of C2.DLL is OK)
 #endif
 #endif
 
+/* THREAD_LOCAL declares a variable of which each thread has its own copy.
+   Both compilers only support this for variables of POD type with a
+   constant initialiser, and static data members, so there must be no
+   constructor or destructor. Anything that uses THREAD_LOCAL variables
+   that own memory must provide some way for a thread to release it before
+   the thread exits. */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 #ifndef imported
 #define imported
 #endif
@@ -33,7 +33,10 @@ all tabs removed from source files
 
 /* Because the reduction machine changes over time reduction information
    can become invalid. Certificates are used to check whether a word
-   that is supposedly reduced or has a state actually does so. */
+   that is supposedly reduced or has a state actually does so.
+   The tree_changed member counts every change to the tree at all, including
+   changes of RHS and links. If it is the same in two certificates then any
+   computation that only reads the tree will get the same result for both. */
 
 enum Certificate_Validity
 {
@@ -48,6 +51,7 @@ class Certificate
   private:
     unsigned long reduction_added;
     unsigned long node_freed;
+    unsigned long tree_changed;
     Certificate_Validity check(const Certificate & other) const
     {
       /* Return value indicates whether "other" certificate is still valid
@@ -59,10 +63,15 @@ class Certificate
         return CV_INVALID;
       return CV_CHECKABLE;
     }
+    bool same_tree(const Certificate & other) const
+    {
+      return tree_changed == other.tree_changed;
+    }
   public:
     Certificate() :
       reduction_added(0),
-      node_freed(0)
+      node_freed(0),
+      tree_changed(0)
     {}
 };
 
@@ -0,0 +1,251 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: checkpoint.cpp $
+//
+
+/* Implementation of the classes declared in checkpoint.h */
+
+#include <string.h>
+#include "awcc.h"
+#include "checkpoint.h"
+#include "container.h"
+#include "mafword.h"
+
+const size_t CHECKPOINT_BUFFER_SIZE = 0x10000;
+
+/* The checksum is 32-bit FNV-1a. It is there to detect truncated or
+   damaged files, not to resist tampering. */
+const unsigned FNV_OFFSET_BASIS = 2166136261u;
+const unsigned FNV_PRIME = 16777619u;
+
+inline unsigned fnv_update(unsigned checksum,const Byte * data,size_t size)
+{
+  for (size_t i = 0; i < size;i++)
+    checksum = (checksum ^ data[i]) * FNV_PRIME;
+  return checksum;
+}
+
+/**/
+
+Checkpoint_Writer::Checkpoint_Writer(Container & container_,String filename_) :
+  container(container_),
+  stream(0),
+  buffer(new Byte[CHECKPOINT_BUFFER_SIZE]),
+  used(0),
+  written(0),
+  checksum(FNV_OFFSET_BASIS),
+  ok(false)
+{
+  String_Buffer sb;
+  filename = filename_;
+  temp_filename = sb.make_filename("",filename_,".tmp");
+  stream = container.open_binary_output_file(temp_filename);
+  ok = stream != 0;
+}
+
+/**/
+
+Checkpoint_Writer::~Checkpoint_Writer()
+{
+  if (stream)
+  {
+    /* commit() was not called, or failed. Don't leave the debris lying
+       around */
+    container.close_output_file(stream);
+    container.delete_file(temp_filename);
+  }
+  delete [] buffer;
+}
+
+/**/
+
+void Checkpoint_Writer::flush()
+{
+  if (ok && used)
+    ok = container.write(stream,buffer,used) == used;
+  used = 0;
+}
+
+/**/
+
+void Checkpoint_Writer::put(const void * data,size_t size)
+{
+  const Byte * bytes = (const Byte *) data;
+  checksum = fnv_update(checksum,bytes,size);
+  written += size;
+  while (size)
+  {
+    if (used == CHECKPOINT_BUFFER_SIZE)
+      flush();
+    size_t chunk = CHECKPOINT_BUFFER_SIZE - used;
+    if (chunk > size)
+      chunk = size;
+    memcpy(buffer+used,bytes,chunk);
+    used += chunk;
+    bytes += chunk;
+    size -= chunk;
+  }
+}
+
+/**/
+
+void Checkpoint_Writer::put_word(const Word & word)
+{
+  Word_Length length = word.length();
+  put(length);
+  put(word.buffer(),length*sizeof(Ordinal));
+}
+
+/**/
+
+bool Checkpoint_Writer::commit()
+{
+  /* The checksum itself is not included in the checksum, so it is
+     written directly into the buffer */
+  if (used + sizeof(checksum) > CHECKPOINT_BUFFER_SIZE)
+    flush();
+  memcpy(buffer+used,&checksum,sizeof(checksum));
+  used += sizeof(checksum);
+  flush();
+  if (!container.close_output_file(stream))
+    ok = false;
+  stream = 0;
+  if (ok && !container.rename_file(temp_filename,filename))
+  {
+    /* The platform could not replace the file atomically. The best we
+       can do is to remove the old checkpoint first */
+    container.delete_file(filename);
+    ok = container.rename_file(temp_filename,filename);
+  }
+  if (!ok)
+    container.delete_file(temp_filename);
+  return ok;
+}
+
+/**/
+
+Checkpoint_Reader::Checkpoint_Reader(Container & container_,String filename) :
+  container(container_),
+  stream(0),
+  buffer(new Byte[CHECKPOINT_BUFFER_SIZE]),
+  used(0),
+  available(0),
+  ok(false)
+{
+  /* Verify the checksum before anything is restored, so that a damaged
+     file is rejected before any damage is done. The last four bytes
+     of the file are the checksum of everything before them, so we keep
+     the most recent four bytes out of the calculation until we have
+     reached the end of the file. */
+  stream = container.open_input_file(filename,0);
+  if (!stream)
+    return;
+  unsigned checksum = FNV_OFFSET_BASIS;
+  Byte tail[sizeof(unsigned)];
+  size_t tail_length = 0;
+  size_t got;
+  while ((got = container.read(stream,buffer,CHECKPOINT_BUFFER_SIZE))!=0)
+  {
+    /* Conceptually the data is the held over bytes followed by the
+       new ones. All but the last four of these can go in the checksum. */
+    size_t total = tail_length + got;
+    if (total <= sizeof(tail))
+    {
+      memcpy(tail+tail_length,buffer,got);
+      tail_length = total;
+      continue;
+    }
+    size_t to_do = total - sizeof(tail);
+    size_t from_tail = to_do < tail_length ? to_do : tail_length;
+    checksum = fnv_update(checksum,tail,from_tail);
+    checksum = fnv_update(checksum,buffer,to_do - from_tail);
+    Byte new_tail[sizeof(tail)];
+    for (size_t i = 0; i < sizeof(tail);i++)
+    {
+      size_t position = to_do + i;
+      new_tail[i] = position < tail_length ? tail[position] :
+                                             buffer[position-tail_length];
+    }
+    memcpy(tail,new_tail,sizeof(tail));
+    tail_length = sizeof(tail);
+  }
+  container.close_input_file(stream);
+  stream = 0;
+  unsigned saved_checksum;
+  memcpy(&saved_checksum,tail,sizeof(saved_checksum));
+  if (tail_length != sizeof(tail) || saved_checksum != checksum)
+  {
+    container.error_output("Checkpoint file %s is damaged and has been ignored\n",
+                           filename.string());
+    return;
+  }
+  stream = container.open_input_file(filename,0);
+  ok = stream != 0;
+}
+
+/**/
+
+Checkpoint_Reader::~Checkpoint_Reader()
+{
+  if (stream)
+    container.close_input_file(stream);
+  delete [] buffer;
+}
+
+/**/
+
+bool Checkpoint_Reader::fill()
+{
+  used = 0;
+  available = ok ? container.read(stream,buffer,CHECKPOINT_BUFFER_SIZE) : 0;
+  return available != 0;
+}
+
+/**/
+
+bool Checkpoint_Reader::get(void * data,size_t size)
+{
+  Byte * bytes = (Byte *) data;
+  while (size)
+  {
+    if (used == available && !fill())
+    {
+      ok = false;
+      memset(bytes,0,size);
+      return false;
+    }
+    size_t chunk = available - used;
+    if (chunk > size)
+      chunk = size;
+    memcpy(bytes,buffer+used,chunk);
+    used += chunk;
+    bytes += chunk;
+    size -= chunk;
+  }
+  return ok;
+}
+
+/**/
+
+bool Checkpoint_Reader::get_word(Word * word)
+{
+  Word_Length length = 0;
+  get(&length);
+  word->set_length(length);
+  return get(word->buffer(),length*sizeof(Ordinal));
+}
@@ -0,0 +1,124 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: checkpoint.h $
+*/
+#pragma once
+#ifndef CHECKPOINT_INCLUDED
+#define CHECKPOINT_INCLUDED 1
+
+/* A checkpoint is a binary image of the complete state of a
+   Rewriter_Machine, from which Knuth-Bendix completion can be resumed
+   exactly where it left off. Unlike the .kbprog and .pkbprog files
+   that -resume normally uses, nothing has to be re-derived when a
+   checkpoint is restored: the node tree, the queues of outstanding work,
+   the pool and the word-difference tracker are all put back as they were.
+
+   The format is private to a particular build of MAF. It is not portable
+   between machines or between versions, and the header contains enough
+   information (the sizes of the important structures, and a fingerprint
+   of the alphabet) to detect most attempts to restore a checkpoint that
+   does not belong to the current program and input file. The file is
+   protected by a checksum, and Checkpoint_Writer writes it to a temporary
+   file which is renamed into place only when it is complete, so a
+   checkpoint is never left half written if MAF is killed.
+
+   Checkpoint_Writer and Checkpoint_Reader only know how to move bytes
+   around. Each class whose state is saved has its own checkpoint() and
+   restore() methods that decide what the bytes mean.
+*/
+
+#ifndef AWDEFS_INCLUDED
+#include "awdefs.h"
+#endif
+#ifndef MAFBASE_INCLUDED
+#include "mafbase.h"
+#endif
+
+// Classes referred to but defined elsewhere
+class Container;
+class Input_Stream;
+class Output_Stream;
+class Word;
+
+class Checkpoint_Writer
+{
+  BLOCKED(Checkpoint_Writer)
+  private:
+    Container & container;
+    Owned_String filename;
+    Owned_String temp_filename;
+    Output_Stream * stream;
+    Byte * buffer;
+    size_t used;
+    size_t written;
+    unsigned checksum;
+    bool ok;
+  public:
+    Checkpoint_Writer(Container & container_,String filename_);
+    ~Checkpoint_Writer();
+    bool is_ok() const
+    {
+      return ok;
+    }
+    void put(const void * data,size_t size);
+    template<class T> void put(const T & t)
+    {
+      put(&t,sizeof(T));
+    }
+    void put_word(const Word & word);
+    // size() returns the size the file will have once it is committed
+    size_t size() const
+    {
+      return written + sizeof(checksum);
+    }
+    // commit() finishes the file and renames it into place
+    bool commit();
+  private:
+    void flush();
+};
+
+class Checkpoint_Reader
+{
+  BLOCKED(Checkpoint_Reader)
+  private:
+    Container & container;
+    Input_Stream * stream;
+    Byte * buffer;
+    size_t used;
+    size_t available;
+    bool ok;
+  public:
+    // The constructor checks the checksum before anything is read
+    Checkpoint_Reader(Container & container_,String filename);
+    ~Checkpoint_Reader();
+    bool is_ok() const
+    {
+      return ok;
+    }
+    bool get(void * data,size_t size);
+    template<class T> bool get(T * t)
+    {
+      return get(t,sizeof(T));
+    }
+    bool get_word(Word * word);
+  private:
+    bool fill();
+};
+
+#endif
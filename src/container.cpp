@@ -75,15 +75,23 @@ bool Container::close_output_file(Output_Stream * stream)
   return true;
 }
 
+unsigned long long Container::elapsed_time()
+{
+  return platform.elapsed_time();
+}
+
+/**/
+
 void Container::error_output(const char * control,Variadic_Arguments &args)
 {
+  Mutex_Lock lock(output_mutex);
   platform.output(stderr_stream,control,args);
 }
 
 void Container::error_output(const char * control,...)
 {
   DECLARE_VA(va,control);
-  platform.output(stderr_stream,control,va);
+  error_output(control,va);
 }
 
 void Container::input_error(const char * control,...)
@@ -190,6 +198,13 @@ bool Container::delete_file(String filename)
 
 /**/
 
+bool Container::flush(Output_Stream * stream)
+{
+  return platform.flush(stream);
+}
+
+/**/
+
 size_t Container::output(Output_Stream * stream,const char * control,
                         Variadic_Arguments & args)
 {
@@ -219,6 +234,7 @@ bool Container::vprogress(unsigned level,const char * control,Variadic_Arguments
 {
   if (level <= log_level)
   {
+    Mutex_Lock lock(output_mutex);
     platform.log_output(control,args);
     return true;
   }
@@ -247,6 +263,20 @@ size_t Container::read(Input_Stream *stream,Byte * buffer,size_t buf_size)
 
 /**/
 
+bool Container::rename_file(String from,String to)
+{
+  return platform.rename_file(from,to);
+}
+
+/**/
+
+size_t Container::write(Output_Stream *stream,const Byte * buffer,size_t nr_bytes)
+{
+  return platform.write(stream,buffer,nr_bytes);
+}
+
+/**/
+
 void Container::set_gap_stdout(bool on)
 {
   platform.set_gap_stdout(on);
@@ -267,7 +297,7 @@ bool Container::status(unsigned level,int gap,const char * control,...)
 
 bool Container::status(unsigned level,int gap,const char * control,Variadic_Arguments &args)
 {
-  if (platform.status_needed(gap))
+  if (status_needed(gap))
   {
     if (log_level >= 2)
     {
@@ -276,7 +306,16 @@ bool Container::status(unsigned level,int gap,const char * control,Variadic_Argu
         progress(2,"Heap use so far: In use %zu Reserved %zu, Utilisation %d%%\n",
                  hs->total_allocation,hs->os_allocation,
                  int(hs->total_allocation/(hs->os_allocation/100)));
+      const Heap_Profile * hp = hs ? Heap::get_global_heap()->profile() : 0;
+      if (hp)
+        for (int i = 0; i < HC_Count;i++)
+          if (hp->category[i].nr_allocations)
+            progress(2,"  %s: In use %zu Peak %zu Items %zu\n",
+                     Heap::category_name(Heap_Category(i)),
+                     hp->category[i].in_use,hp->category[i].peak,
+                     hp->category[i].nr_live);
     }
+    Mutex_Lock lock(output_mutex);
     if (level <= log_level)
       platform.log_output(control,args);
     else
@@ -288,6 +327,7 @@ bool Container::status(unsigned level,int gap,const char * control,Variadic_Argu
 
 bool Container::status_needed(int gap)
 {
+  Mutex_Lock lock(output_mutex);
   return platform.status_needed(gap);
 }
 
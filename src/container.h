@@ -68,6 +68,9 @@ See platform.h for further details.
 #ifndef AWDEFS_INCLUDED
 #include "awdefs.h"
 #endif
+#ifndef MAFTHREAD_INCLUDED
+#include "mafthread.h"
+#endif
 
 //Classes referred to but defined elsewhere
 class Platform;
@@ -98,6 +101,9 @@ class Container : public Parse_Error_Handler
     Output_Stream * log_stream;
     unsigned log_level;
     bool interactive;
+    /* Progress and error messages may be written by worker threads, so
+       the calls that write them are serialised with this */
+    Mutex output_mutex;
     Container(Platform & platform_);
   public:
     virtual ~Container();
@@ -106,6 +112,7 @@ class Container : public Parse_Error_Handler
     virtual bool close_output_file(Output_Stream * stream);
     virtual bool delete_file(String filename);
     MS_ATTRIBUTE(__declspec(noreturn)) virtual void die() __attribute__((noreturn));
+    virtual unsigned long long elapsed_time();
     virtual void error_output(const char * control,...) __attribute__((format(printf,2,3)));
     virtual void error_output(const char * control,Variadic_Arguments &args);
     virtual void input_error(const char * control,...) __attribute__((format(printf,2,3)));
@@ -119,6 +126,7 @@ class Container : public Parse_Error_Handler
                                                            OIF_NULL_IS_STDIN);
     virtual Output_Stream * open_text_output_file(String filename,
                                                   bool null_is_stdout = true);
+    virtual bool flush(Output_Stream * stream);
     virtual size_t output(Output_Stream * stream,const char * control,...) __attribute__((format(printf,3,4)));
     virtual size_t output(Output_Stream * stream,const char * control,
                   Variadic_Arguments & args);
@@ -129,8 +137,10 @@ class Container : public Parse_Error_Handler
     virtual void result(const char * control,...) __attribute__((format(printf,2,3)));
     virtual void vresult(const char * control,Variadic_Arguments &args);
     virtual size_t read(Input_Stream *stream,Byte * buffer,size_t buf_size);
+    virtual bool rename_file(String from,String to);
     virtual void set_gap_stdout(bool on = true);
     virtual void set_interactive(bool on = true);
+    virtual size_t write(Output_Stream * stream,const Byte * buffer,size_t nr_bytes);
     virtual bool status(unsigned level,int gap,const char * control,...) __attribute__((format(printf,4,5)));
     virtual bool status(unsigned level,int gap,const char * control,Variadic_Arguments &args);
     virtual bool status_needed(int gap);
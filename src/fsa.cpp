@@ -78,6 +78,31 @@
 #include "maf_spl.h"
 #include "maf_wdb.h"
 #include "maf_ss.h"
+#include "arena.h"
+
+/**/
+
+/* FSA_Factory methods that need big temporary arrays get them from a
+   Scratch_Arena rather than from the heap, so that long pipelines of FSA
+   operations do not leave the heap fragmented. At log level 2 we report
+   how much scratch memory an operation needed, if it was significant */
+class Scratch_Arena : public Arena
+{
+  private:
+    Container & container;
+    const char * const operation;
+  public:
+    Scratch_Arena(Container & container_,const char * operation_) :
+      container(container_),
+      operation(operation_)
+    {}
+    ~Scratch_Arena()
+    {
+      if (peak_usage() >= 0x100000)
+        container.progress(2,"Peak scratch memory use for %s was %zu bytes\n",
+                           operation,peak_usage());
+    }
+};
 
 /**/
 
@@ -3124,7 +3149,8 @@ FSA_Simple * FSA_Factory::binop(const FSA & fsa_0,const FSA & fsa_1,
   if (key[1] == fail_1)
     key[1]++;
   Pair_Packer key_packer(key);
-  State_ID *transition = new State_ID[nr_symbols];
+  Scratch_Arena arena(container,"binop");
+  State_ID *transition = arena.allocate_array<State_ID>(nr_symbols);
   Keyed_FSA factory(container,fsa_0.base_alphabet,nr_symbols,
                     max(fsa_0.state_count()+fsa_1.state_count(),
                         State_Count(1024*1024+7)),
@@ -3249,8 +3275,6 @@ FSA_Simple * FSA_Factory::binop(const FSA & fsa_0,const FSA & fsa_1,
       factory.set_is_accepting(binop_state,true);
     factory.set_label_nr(binop_state,fsa_0.get_label_nr(key[0]));
   }
-  if (transition)
-    delete [] transition;
   factory.remove_keys();
   return trim_only ? trim(factory) : minimise(factory);
 }
@@ -3746,13 +3770,15 @@ FSA_Simple * FSA_Factory::composite(const FSA & fsa0,const FSA & fsa1,bool label
   Ordinal_Word base_word(base_alphabet);
   Ordinal_Word label_word(label_alphabet);
   Transition_ID nr_transitions = fsa0.alphabet_size();
-  State_ID * transition = new State_ID[nr_transitions];
+  Container & container = fsa0.container;
+  Scratch_Arena arena(container,"composite");
+  Arena::Mark mark = arena.mark();
+  State_ID * transition = arena.allocate_array<State_ID>(nr_transitions);
   State_ID state;
   bool is_coset_multiplier = labelled_multiplier &&
                              label_alphabet.letter_count() > base_alphabet.letter_count() ||
                              fsa0.has_multiple_initial_states() ||
                              fsa1.has_multiple_initial_states();
-  Container & container = fsa0.container;
   Ordinal nr_generators = base_alphabet.letter_count();
 
   State_Count count,initial_end;     //Declaring this here so that I don't
@@ -3907,7 +3933,7 @@ FSA_Simple * FSA_Factory::composite(const FSA & fsa0,const FSA & fsa1,bool label
     factory.set_transitions(state,transition);
   }
   /* we don't need this any more */
-  delete [] transition;
+  arena.release(mark);
 
   /* Set the labels,and initial and accept states in the new FSA */
   bool label01_is_identity = false;
@@ -4114,7 +4140,8 @@ FSA_Simple * FSA_Factory::exists(const FSA &fsa_start,bool sticky,bool swapped)
   Ordinal nr_generators = alphabet.letter_count();
   Keyed_FSA factory(container,alphabet,nr_generators,
                     nr_product_states,0);
-  State_ID * transition = new State_ID[nr_generators];
+  Scratch_Arena arena(container,"exists");
+  State_ID * transition = arena.allocate_array<State_ID>(nr_generators);
   Transition_Realiser tr(fsa_start);
 
   /* Insert and skip failure state */
@@ -4264,7 +4291,6 @@ FSA_Simple * FSA_Factory::exists(const FSA &fsa_start,bool sticky,bool swapped)
   }
   tr.unrealise();
   factory.remove_keys();
-  delete [] transition;
   container.progress(1,"Exists FSA with " FMT_ID " states prior to"
                        " minimisation constructed.\n",factory.state_count());
   FSA_Simple * answer = minimise(factory);
@@ -4536,12 +4562,17 @@ FSA_Simple * FSA_Factory::minimise(const FSA & fsa_start,
 
   Label_ID nr_labels = fsa_start.label_count();
   const Transition_ID nr_symbols = fsa_start.alphabet_size();
-  State_ID * key = new State_ID[nr_symbols+1];
+  Container & container = fsa_start.container;
+  Scratch_Arena arena(container,"minimise");
+  State_ID * key = arena.allocate_array<State_ID>(nr_symbols+1);
   State_ID i;
   const State_Count nr_states = fsa_start.state_count();
-  State_ID * states_0 = new State_ID[nr_states];
-  State_ID * states_1 = new State_ID[nr_states];
-  Container & container = fsa_start.container;
+  State_ID * states_1 = arena.allocate_array<State_ID>(nr_states);
+  State_ID * const first_states_1 = states_1;
+  /* states_0 and the other arrays allocated after mark are not needed once
+     the minimisation proper is complete */
+  Arena::Mark mark = arena.mark();
+  State_ID * states_0 = arena.allocate_array<State_ID>(nr_states);
   Transition_Realiser tr(fsa_start);
   Transition_Compressor tc(nr_symbols+1);
   State_ID trim_label;
@@ -4635,7 +4666,7 @@ FSA_Simple * FSA_Factory::minimise(const FSA & fsa_start,
      that the hash created will be very big though.
   */
 
-  State_ID * clone = new State_ID[nr_states];
+  State_ID * clone = arena.allocate_array<State_ID>(nr_states);
   if (trim)
     for (i = 0; i < nr_states;i++)
       clone[i] = states_1[i] ? i : 0;
@@ -4722,7 +4753,7 @@ FSA_Simple * FSA_Factory::minimise(const FSA & fsa_start,
       flag_count = trim_label+1;  //trim_label we need to make sure flags is big 
                                   //enough when lots of labelled states got
                                   // pruned by the trim
-    Byte * flags = new Byte[flag_count];
+    Byte * flags = arena.allocate_array<Byte>(flag_count);
     /* We need two flags per state and both and old and new set of
        flags. Instead of flipping two variables we will flip the
        bits we use. This saves space and probably helps with cache utilisation
@@ -4867,9 +4898,14 @@ FSA_Simple * FSA_Factory::minimise(const FSA & fsa_start,
       hash_size = final_count + (final_count-initial_count)*2;
     }
     while (final_count > initial_count);
-    delete [] flags;
-    delete [] clone;
-    delete [] states_0;
+    /* The arrays are swapped round during the passes, so the final
+       state numbers may be in one of the arrays we are about to release */
+    if (states_1 != first_states_1)
+    {
+      memcpy(first_states_1,states_1,nr_states*sizeof(State_ID));
+      states_1 = first_states_1;
+    }
+    arena.release(mark);
   }
 
   tr.unrealise();
@@ -4966,8 +5002,6 @@ FSA_Simple * FSA_Factory::minimise(const FSA & fsa_start,
   }
   if (accept == SSF_Singleton)
     new_fsa->set_single_accepting(states_1[fsa_start.accepting_state()]);
-  delete [] key;
-  delete [] states_1;
   if (!fudged)
     if (nr_labels)
       new_fsa->change_flags(GFF_TRIM|GFF_ACCESSIBLE,0);
@@ -0,0 +1,948 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: fsacompile.cpp $
+//
+
+/* fsacompile writes a C++ source file that implements one particular
+   automaton, so that a program which only needs to accept or reduce words
+   with it does not have to link with MAF or read any files at startup.
+
+   Three kinds of input are supported:
+     A word-acceptor, or any other 1-variable FSA with a single initial
+     state. The generated code has read_word() and accepts() functions.
+
+     A rewriting system, read from a .kbprog file and its index automaton.
+     The generated code has a Reducer class which performs the same
+     reductions as RWS_Reducer.
+
+     The general multiplier of a group. The generated code has a Reducer
+     class which performs the same reductions as General_Multiplier.
+
+   The transitions are compiled into a static table using the smallest
+   integer type that can hold the state numbers, or, for FSAs with only a
+   few states, into a switch statement. The generated code only uses
+   <string.h> and <stdlib.h>, and does not need any recent features of
+   C++, so it can be compiled by anything that can compile MAF itself. */
+
+#include <string.h>
+#include "awcc.h"
+#include "mafctype.h"
+#include "mafword.h"
+#include "hash.h"
+#include "fsa.h"
+#include "container.h"
+#include "maf.h"
+#include "maf_rws.h"
+#include "maf_so.h"
+
+class FSA_Compiler
+{
+  BLOCKED(FSA_Compiler)
+  private:
+    Container & container;
+    Output_Stream * os;
+    const FSA & fsa;
+    const Alphabet & alphabet;
+    String name;
+    State_Count switch_limit;
+    const Ordinal nr_generators;
+    const State_Count nr_states;
+    const Transition_ID nr_symbols;
+  public:
+    FSA_Compiler(Container & container_,Output_Stream * os_,const FSA & fsa_,
+                 String name_,State_Count switch_limit_) :
+      container(container_),
+      os(os_),
+      fsa(fsa_),
+      alphabet(fsa_.base_alphabet),
+      name(name_),
+      switch_limit(switch_limit_),
+      nr_generators(fsa_.base_alphabet.letter_count()),
+      nr_states(fsa_.state_count()),
+      nr_symbols(fsa_.alphabet_size())
+    {}
+    void compile_acceptor(String source);
+    void compile_rws(const Rewriting_System & rws,String source);
+    void compile_gm(const General_Multiplier & gm,String source);
+  private:
+    void put(String text)
+    {
+      container.output(os,"%s",text.string());
+    }
+    void write_declarations(String source,String description,
+                            String reducer_text);
+    void write_letters();
+    void write_new_state();
+    void write_table(String table_name,const long * values,size_t count,
+                     size_t row_length = 0);
+    void write_end();
+};
+
+int main(int argc,char ** argv);
+  static int inner(Container & container,String input_file,String output_file,
+                   String name,bool rws,unsigned switch_limit);
+
+int main(int argc,char ** argv)
+{
+  int i = 1;
+  bool bad_usage = false;
+  char * input_file = 0;
+  char * output_file = 0;
+  char * name = 0;
+  bool rws = false;
+  unsigned switch_limit = 64;
+  Container & container = *Container::create();
+  Standard_Options so(container,0);
+#define cprintf container.error_output
+
+  while (i < argc && !bad_usage)
+  {
+    if (argv[i][0] == '-')
+    {
+      String arg = argv[i];
+      if (arg.is_equal("-name"))
+      {
+        name = argv[i+1];
+        if (!name)
+          bad_usage = true;
+        i += 2;
+      }
+      else if (arg.is_equal("-rws"))
+      {
+        rws = true;
+        i++;
+      }
+      else if (arg.is_equal("-switch"))
+      {
+        if (!so.parse_natural(&switch_limit,argv[i+1],0,arg))
+          bad_usage = true;
+        i += 2;
+      }
+      else if (!so.recognised(argv,i))
+        bad_usage = true;
+    }
+    else if (input_file == 0)
+      input_file = argv[i++];
+    else if (output_file == 0)
+      output_file = argv[i++];
+    else
+      bad_usage = true;
+  }
+  int exit_code = 1;
+  if (!bad_usage && input_file)
+    exit_code = inner(container,input_file,output_file,name,rws,switch_limit);
+  else
+  {
+    cprintf("Usage: fsacompile [loglevel] [-name id] [-switch n] [-rws]"
+            " input_file [output_file]\n"
+            "where input_file contains a GASP FSA, which must be either a"
+            " 1-variable FSA\nwith one initial state, such as a"
+            " word-acceptor, or the general multiplier\nof a group. If"
+            " -rws is specified input_file is instead a rewriting system,"
+            " such\nas a .kbprog file, and its index automaton is read from"
+            " the matching .reduce\nfile.\n"
+            "fsacompile writes a C++ source file to output_file, or to"
+            " input_file.cpp if no\noutput_file is specified, which"
+            " implements the automaton without needing MAF.\n"
+            "For a 1-variable FSA it provides read_word() and accepts()"
+            " functions, and\notherwise a Reducer class that reduces words.\n"
+            "-name id sets the name of the namespace the code is placed in."
+            " The default is\nmade from the name of the input file.\n"
+            "-switch n causes the transition function of FSAs with fewer"
+            " than n states to\nbe written as a switch statement rather than"
+            " a table. The default is 64.\n");
+    so.usage();
+  }
+  delete &container;
+  return exit_code;
+}
+
+/**/
+
+static String make_name(String_Buffer * sb,String filename)
+{
+  /* Makes a C++ identifier out of the last part of a filename */
+  const char * start = filename.string();
+  for (const char * s = start; *s;s++)
+    if (*s == '/' || *s == '\\' || *s == ':')
+      start = s+1;
+  sb->set(*start >= '0' && *start <= '9' ? "fsa_" : "");
+  for (const char * s = start; *s;s++)
+  {
+    Letter c = *s;
+    sb->append(is_upper(c) || is_lower(c) || is_digit(c) ? c : '_');
+  }
+  return sb->get();
+}
+
+/**/
+
+static int inner(Container & container,String input_file,String output_file,
+                 String name,bool rws,unsigned switch_limit)
+{
+  String_Buffer sb1;
+  String_Buffer sb2;
+  String_Buffer sb3;
+  if (!name)
+    name = make_name(&sb1,input_file);
+  output_file = sb2.make_destination(output_file,input_file,".cpp");
+  int exit_code = 1;
+
+  if (rws)
+  {
+    String fsa_file = 0;
+    size_t l = input_file.length();
+    if (l > 6 && String(input_file.string()+l-6).is_equal("kbprog"))
+    {
+      sb3.set(input_file);
+      sb3.truncate(String_Length(l-6));
+      sb3.append("reduce");
+      fsa_file = sb3.get();
+    }
+    Rewriting_System * rs = Rewriting_System::create(input_file,fsa_file,
+                                                     &container);
+    if (rs)
+    {
+      Output_Stream * os = container.open_text_output_file(output_file);
+      FSA_Compiler compiler(container,os,*rs,name,switch_limit);
+      compiler.compile_rws(*rs,input_file);
+      container.close_output_file(os);
+      delete rs;
+      exit_code = 0;
+    }
+    return exit_code;
+  }
+
+  FSA_Simple * fsa = FSA_Factory::create(input_file,&container);
+  if (!fsa)
+    return 1;
+  if (fsa->nr_initial_states() > 1)
+    container.error_output("fsacompile cannot compile an FSA with more than"
+                           " one initial state\n");
+  else if (fsa->alphabet_size() == fsa->base_alphabet.letter_count())
+  {
+    Output_Stream * os = container.open_text_output_file(output_file);
+    FSA_Compiler compiler(container,os,*fsa,name,switch_limit);
+    compiler.compile_acceptor(input_file);
+    container.close_output_file(os);
+    exit_code = 0;
+  }
+  else
+  {
+    /* General_Multiplier takes ownership of the FSA */
+    General_Multiplier gm(*fsa,true);
+    fsa = 0;
+    bool ok = gm.fsa() != 0;
+    if (ok)
+    {
+      /* The multiplier must support the identity and every generator */
+      Ordinal_Word ow(gm.base_alphabet,1);
+      ok = gm.is_multiplier(Subword(ow,0,0));
+      for (Ordinal g = 0; ok && g < gm.base_alphabet.letter_count();g++)
+      {
+        ow.set_code(0,g);
+        ok = gm.is_multiplier(ow);
+      }
+    }
+    if (ok)
+    {
+      Output_Stream * os = container.open_text_output_file(output_file);
+      FSA_Compiler compiler(container,os,gm,name,switch_limit);
+      compiler.compile_gm(gm,input_file);
+      container.close_output_file(os);
+      exit_code = 0;
+    }
+    else
+      container.error_output("%s is neither a 1-variable FSA nor a general"
+                             " multiplier\n",input_file.string());
+  }
+  if (fsa)
+    delete fsa;
+  return exit_code;
+}
+
+/**/
+
+void FSA_Compiler::write_declarations(String source,String description,
+                                      String reducer_text)
+{
+  container.output(os,
+"/* Generated by fsacompile from %s,\n"
+"   which is %s.\n"
+"   Do not edit this file, but run fsacompile again if the automaton\n"
+"   changes.\n\n"
+"   Compile this file as part of your program. Other files that use the\n"
+"   functions it defines can include it after defining\n"
+"   %s_DECLARATIONS_ONLY, to get just the declarations.\n"
+"   Words are arrays of generator numbers, which run from 0 to\n"
+"   nr_generators-1 in the order of the generators in the automaton. */\n\n",
+                   source.string(),description.string(),name.string());
+  container.output(os,
+"#ifndef %s_INCLUDED\n"
+"#define %s_INCLUDED 1\n\n"
+"namespace %s\n"
+"{\n"
+"  const int nr_generators = %d;\n"
+"  const int nr_states = %ld; /* including the failure state 0 */\n"
+"  const int initial_state = %ld;\n",
+                   name.string(),name.string(),name.string(),nr_generators,
+                   long(nr_states),long(fsa.initial_state()));
+  put(
+"  /* letter() returns the number of the generator called name, or -1 if\n"
+"     there is no such generator */\n"
+"  int letter(const char * name);\n"
+"  const char * letter_name(int g);\n"
+"  /* parse() converts text such as \"a*b^2*A\" into at most max_length\n"
+"     generator numbers, and returns the length of the word, or -1 if the\n"
+"     text is not a word or is too long */\n"
+"  int parse(int * word,int max_length,const char * text);\n");
+  put(reducer_text);
+  container.output(os,
+"}\n\n"
+"#endif\n\n"
+"#if !defined(%s_DECLARATIONS_ONLY) && !defined(%s_DEFINED)\n"
+"#define %s_DEFINED 1\n"
+"#include <string.h>\n"
+"#include <stdlib.h>\n\n"
+"namespace %s\n"
+"{\n",
+                   name.string(),name.string(),name.string(),name.string());
+  write_letters();
+  write_new_state();
+}
+
+/**/
+
+void FSA_Compiler::write_letters()
+{
+  /* The generator names are looked up with a switch on their first
+     character, which leaves at most a few names to compare */
+  put("  static const char * const letter_names[nr_generators] =\n  {\n");
+  String_Buffer sb;
+  for (Ordinal g = 0; g < nr_generators;g++)
+  {
+    sb.set("\"");
+    for (const char * s = alphabet.glyph(g).string(); *s;s++)
+    {
+      if (*s == '"' || *s == '\\')
+        sb.append('\\');
+      sb.append(*s);
+    }
+    sb.append("\"");
+    container.output(os,"    %s%s\n",sb.get().string(),
+                     g+1 < nr_generators ? "," : "");
+  }
+  put("  };\n\n"
+      "  static int find_letter(const char * name,size_t length)\n"
+      "  {\n"
+      "    if (!length)\n"
+      "      return -1;\n"
+      "    switch ((unsigned char) name[0])\n"
+      "    {\n");
+  bool * done = new bool[nr_generators];
+  for (Ordinal g = 0; g < nr_generators;g++)
+    done[g] = false;
+  for (Ordinal g = 0; g < nr_generators;g++)
+  {
+    if (done[g])
+      continue;
+    unsigned char first = alphabet.glyph(g).string()[0];
+    container.output(os,"      case %u:\n",unsigned(first));
+    for (Ordinal h = g; h < nr_generators;h++)
+    {
+      String glyph = alphabet.glyph(h);
+      if ((unsigned char) glyph.string()[0] == first)
+      {
+        done[h] = true;
+        container.output(os,"        if (length == %lu && !memcmp(name,"
+                            "letter_names[%d],%lu))\n"
+                            "          return %d;\n",
+                         (unsigned long) glyph.length(),h,
+                         (unsigned long) glyph.length(),h);
+      }
+    }
+    put("        break;\n");
+  }
+  delete [] done;
+  put("    }\n"
+      "    return -1;\n"
+      "  }\n\n"
+      "  int letter(const char * name)\n"
+      "  {\n"
+      "    return find_letter(name,strlen(name));\n"
+      "  }\n\n"
+      "  const char * letter_name(int g)\n"
+      "  {\n"
+      "    return g >= 0 && g < nr_generators ? letter_names[g] : 0;\n"
+      "  }\n\n"
+      "  int parse(int * word,int max_length,const char * text)\n"
+      "  {\n"
+      "    int length = 0;\n"
+      "    if (!*text || !strcmp(text,\"IdWord\"))\n"
+      "      return 0;\n"
+      "    for (;;)\n"
+      "    {\n"
+      "      const char * end = strchr(text,'*');\n"
+      "      size_t token = end ? size_t(end - text) : strlen(text);\n"
+      "      int g = find_letter(text,token);\n"
+      "      long power = 1;\n"
+      "      if (g < 0)\n"
+      "      {\n"
+      "        size_t i = token;\n"
+      "        while (i > 0 && text[i-1] != '^')\n"
+      "          i--;\n"
+      "        if (i < 2)\n"
+      "          return -1;\n"
+      "        char * stop;\n"
+      "        g = find_letter(text,i-1);\n"
+      "        power = strtol(text+i,&stop,10);\n"
+      "        if (g < 0 || stop != text+token || power < 0)\n"
+      "          return -1;\n"
+      "      }\n"
+      "      for (;power > 0;power--)\n"
+      "      {\n"
+      "        if (length == max_length)\n"
+      "          return -1;\n"
+      "        word[length++] = g;\n"
+      "      }\n"
+      "      if (!end)\n"
+      "        return length;\n"
+      "      text = end+1;\n"
+      "    }\n"
+      "  }\n\n");
+}
+
+/**/
+
+static String table_type(long low,long high)
+{
+  if (low >= 0)
+    return high <= 255 ? "unsigned char" : high <= 65535 ? "unsigned short" :
+                                                           "int";
+  return low >= -128 && high <= 127 ? "signed char" :
+         low >= -32768 && high <= 32767 ? "short" : "int";
+}
+
+/**/
+
+void FSA_Compiler::write_table(String table_name,const long * values,
+                               size_t count,size_t row_length)
+{
+  long low = 0;
+  long high = 0;
+  for (size_t i = 0; i < count;i++)
+  {
+    if (values[i] < low)
+      low = values[i];
+    if (values[i] > high)
+      high = values[i];
+  }
+  if (row_length)
+    container.output(os,"  static const %s %s[%lu][%lu] =\n  {\n",
+                     table_type(low,high).string(),table_name.string(),
+                     (unsigned long) (count/row_length),
+                     (unsigned long) row_length);
+  else
+    container.output(os,"  static const %s %s[%lu] =\n  {\n",
+                     table_type(low,high).string(),table_name.string(),
+                     (unsigned long) (count ? count : 1));
+  if (!count)
+    put("    0\n");
+  size_t column = 0;
+  for (size_t i = 0; i < count;i++)
+  {
+    if (row_length && i % row_length == 0)
+    {
+      put("    {");
+      column = 0;
+    }
+    else if (!row_length && column == 0)
+      put("    ");
+    container.output(os,"%ld",values[i]);
+    bool row_end = row_length ? (i+1) % row_length == 0 : i+1 == count;
+    if (row_length && row_end)
+      put(i+1 < count ? "},\n" : "}\n");
+    else if (i+1 < count)
+    {
+      if (++column == 16)
+      {
+        put(row_length ? ",\n     " : ",\n");
+        column = 0;
+      }
+      else
+        put(",");
+    }
+    else
+      put("\n");
+  }
+  put("  };\n\n");
+}
+
+/**/
+
+void FSA_Compiler::write_new_state()
+{
+  State_ID * buffer = new State_ID[nr_symbols];
+  if (nr_states <= State_Count(switch_limit))
+  {
+    put("  static inline int new_state(int state,int symbol)\n"
+        "  {\n"
+        "    switch (state)\n"
+        "    {\n");
+    for (State_ID si = 1; si < nr_states;si++)
+    {
+      fsa.get_transitions(buffer,si);
+      container.output(os,"      case %ld:\n"
+                          "        switch (symbol)\n"
+                          "        {\n",long(si));
+      for (Transition_ID ti = 0; ti < nr_symbols;ti++)
+        if (buffer[ti])
+          container.output(os,"          case %ld: return %ld;\n",long(ti),
+                           long(buffer[ti]));
+      put("        }\n"
+          "        break;\n");
+    }
+    put("    }\n"
+        "    return 0;\n"
+        "  }\n\n");
+  }
+  else
+  {
+    size_t count = size_t(nr_states)*nr_symbols;
+    long * values = new long[count];
+    for (size_t i = 0; i < size_t(nr_symbols);i++)
+      values[i] = 0;
+    for (State_ID si = 1; si < nr_states;si++)
+    {
+      fsa.get_transitions(buffer,si);
+      for (Transition_ID ti = 0; ti < nr_symbols;ti++)
+        values[size_t(si)*nr_symbols+ti] = buffer[ti];
+      if (!(char) si)
+        container.status(2,1,"Writing transitions (" FMT_ID " of " FMT_ID
+                         ")\n",si,nr_states);
+    }
+    write_table("transition",values,count,nr_symbols);
+    delete [] values;
+    put("  static inline int new_state(int state,int symbol)\n"
+        "  {\n"
+        "    return transition[state][symbol];\n"
+        "  }\n\n");
+  }
+  delete [] buffer;
+}
+
+/**/
+
+void FSA_Compiler::write_end()
+{
+  put("}\n\n#endif\n");
+}
+
+/**/
+
+void FSA_Compiler::compile_acceptor(String source)
+{
+  write_declarations(source,"a 1-variable FSA",
+"  /* read_word() returns the state reached from state by reading word,\n"
+"     or 0 if the FSA fails on one of its letters */\n"
+"  int read_word(const int * word,int length,int state = initial_state);\n"
+"  bool accepts(const int * word,int length);\n");
+
+  long * values = new long[nr_states];
+  for (State_ID si = 0; si < nr_states;si++)
+    values[si] = si && fsa.is_accepting(si);
+  write_table("accepting",values,nr_states);
+  delete [] values;
+  put("  int read_word(const int * word,int length,int state)\n"
+      "  {\n"
+      "    for (int i = 0; state && i < length;i++)\n"
+      "    {\n"
+      "      if ((unsigned) word[i] >= (unsigned) nr_generators)\n"
+      "        return 0;\n"
+      "      state = new_state(state,word[i]);\n"
+      "    }\n"
+      "    return state;\n"
+      "  }\n\n"
+      "  bool accepts(const int * word,int length)\n"
+      "  {\n"
+      "    return accepting[read_word(word,length)] != 0;\n"
+      "  }\n");
+  write_end();
+}
+
+/**/
+
+void FSA_Compiler::compile_rws(const Rewriting_System & rws,String source)
+{
+  /* The generated reduce() works like Aho_Corasick_Reducer::reduce(). The
+     index automaton state reached after each letter of the output is kept
+     on a stack, and when a left hand side is found its right hand side is
+     put back onto the input, so the word is never rescanned. The reductions
+     are the same as those RWS_Reducer makes. */
+  write_declarations(source,"a rewriting system",
+"  /* Reducer reduces words using the rewriting system. It keeps work areas\n"
+"     between calls, so a program that reduces words in several threads\n"
+"     needs one Reducer for each thread. */\n"
+"  class Reducer\n"
+"  {\n"
+"    private:\n"
+"      int * state;\n"
+"      int * input;\n"
+"      int max_state;\n"
+"      int max_input;\n"
+"      Reducer(const Reducer &);\n"
+"      Reducer & operator=(const Reducer &);\n"
+"      void reserve_input(int needed);\n"
+"    public:\n"
+"      Reducer() :\n"
+"        state(0),\n"
+"        input(0),\n"
+"        max_state(0),\n"
+"        max_input(0)\n"
+"      {}\n"
+"      ~Reducer()\n"
+"      {\n"
+"        delete [] state;\n"
+"        delete [] input;\n"
+"      }\n"
+"      /* reduce() replaces the length letters in word by the reduced word\n"
+"         and returns its length, or -1 if the reduced word, or some\n"
+"         intermediate word, would be longer than max_length */\n"
+"      int reduce(int * word,int length,int max_length);\n"
+"  };\n");
+
+  State_Count nr_equations = rws.equation_count();
+  long * lhs_length = new long[nr_equations];
+  long * rhs_start = new long[nr_equations+1];
+  Total_Length total = 0;
+  Ordinal_Word rhs(alphabet);
+  Element_ID eqn_nr;
+  lhs_length[0] = 0;
+  rhs_start[0] = rhs_start[1] = 0;
+  for (eqn_nr = 1; eqn_nr < nr_equations;eqn_nr++)
+  {
+    lhs_length[eqn_nr] = rws.lhs_length(eqn_nr);
+    total += rws.read_rhs(&rhs,eqn_nr);
+    rhs_start[eqn_nr+1] = long(total);
+  }
+  long * rhs_letters = new long[total ? total : 1];
+  for (eqn_nr = 1; eqn_nr < nr_equations;eqn_nr++)
+  {
+    Word_Length l = rws.read_rhs(&rhs,eqn_nr);
+    const Ordinal * values = rhs.buffer();
+    for (Word_Length i = 0; i < l;i++)
+      rhs_letters[rhs_start[eqn_nr]+i] = values[i];
+  }
+  write_table("lhs_length",lhs_length,nr_equations);
+  write_table("rhs_start",rhs_start,nr_equations+1);
+  write_table("rhs_letters",rhs_letters,size_t(total));
+  delete [] lhs_length;
+  delete [] rhs_start;
+  delete [] rhs_letters;
+
+  put("  void Reducer::reserve_input(int needed)\n"
+      "  {\n"
+      "    if (needed <= max_input)\n"
+      "      return;\n"
+      "    int new_size = max_input ? max_input*2 : 64;\n"
+      "    if (new_size < needed)\n"
+      "      new_size = needed;\n"
+      "    int * new_input = new int[new_size];\n"
+      "    if (input)\n"
+      "    {\n"
+      "      memcpy(new_input,input,max_input*sizeof(int));\n"
+      "      delete [] input;\n"
+      "    }\n"
+      "    input = new_input;\n"
+      "    max_input = new_size;\n"
+      "  }\n\n"
+      "  int Reducer::reduce(int * word,int length,int max_length)\n"
+      "  {\n"
+      "    if (max_state < max_length)\n"
+      "    {\n"
+      "      delete [] state;\n"
+      "      state = new int[(max_state = max_length)+1];\n"
+      "    }\n"
+      "    int read_pos = 0;\n"
+      "    int valid_length = 0;\n"
+      "    int input_top = 0;\n"
+      "    state[0] = initial_state;\n"
+      "    for (;;)\n"
+      "    {\n"
+      "      int g;\n"
+      "      if (input_top)\n"
+      "        g = input[--input_top];\n"
+      "      else if (read_pos < length)\n"
+      "        g = word[read_pos++];\n"
+      "      else\n"
+      "        break;\n"
+      "      if (valid_length == max_length ||\n"
+      "          (unsigned) g >= (unsigned) nr_generators)\n"
+      "        return -1;\n"
+      "      word[valid_length] = g;\n"
+      "      int si = new_state(state[valid_length],g);\n"
+      "      if (si >= 0)\n"
+      "        state[++valid_length] = si;\n"
+      "      else\n"
+      "      {\n"
+      "        int e = -si;\n"
+      "        int rhs_length = rhs_start[e+1] - rhs_start[e];\n"
+      "        valid_length += 1 - lhs_length[e];\n"
+      "        if (rhs_length > lhs_length[e] && read_pos < length)\n"
+      "        {\n"
+      "          /* The unread part of the word has to go onto the input\n"
+      "             beneath the right hand side, since the output may now\n"
+      "             overtake it */\n"
+      "          int tail = length - read_pos;\n"
+      "          reserve_input(input_top + tail);\n"
+      "          memmove(input+tail,input,input_top*sizeof(int));\n"
+      "          for (int i = 0; i < tail;i++)\n"
+      "            input[i] = word[length-1-i];\n"
+      "          input_top += tail;\n"
+      "          length = read_pos;\n"
+      "        }\n"
+      "        reserve_input(input_top + rhs_length);\n"
+      "        for (int i = rhs_start[e+1]; i > rhs_start[e];)\n"
+      "          input[input_top++] = rhs_letters[--i];\n"
+      "      }\n"
+      "    }\n"
+      "    return valid_length;\n"
+      "  }\n");
+  write_end();
+}
+
+/**/
+
+void FSA_Compiler::compile_gm(const General_Multiplier & gm,String source)
+{
+  /* The generated reduce() follows General_Multiplier::reduce(). The word
+     is read along the diagonal of the multiplier until it fails, which
+     happens at the first letter g such that the prefix u before g is
+     reduced but ug is not. ug is then replaced by the unique v that the
+     multiplier accepts with u and the label for g, which is found by
+     exploring all the possible v a level at a time, as in
+     Multiplier::multiply(). Unlike that function the generated code keeps
+     only the first v prefix that reaches each state. Any v found by a
+     later prefix would also be found by the first one, and earlier, so the
+     answer is the same. */
+  write_declarations(source,"the general multiplier of a group",
+"  /* Reducer reduces words using the general multiplier. It keeps work\n"
+"     areas between calls, so a program that reduces words in several\n"
+"     threads needs one Reducer for each thread. */\n"
+"  class Reducer\n"
+"  {\n"
+"    private:\n"
+"      int * node_state;\n"
+"      int * node_prefix;\n"
+"      int * node_rvalue;\n"
+"      int max_nodes;\n"
+"      int * level_start;\n"
+"      int max_levels;\n"
+"      int * product;\n"
+"      unsigned * mark;\n"
+"      unsigned stamp;\n"
+"      Reducer(const Reducer &);\n"
+"      Reducer & operator=(const Reducer &);\n"
+"      void reserve_nodes(int needed);\n"
+"      void reserve_levels(int needed);\n"
+"      int multiply(const int * u,int length,int g);\n"
+"    public:\n"
+"      Reducer();\n"
+"      ~Reducer();\n"
+"      /* reduce() replaces the length letters in word by the reduced word\n"
+"         and returns its length. It returns -1 if the reduced word, or\n"
+"         some intermediate word, would be longer than max_length, or if\n"
+"         the multiplier is unable to reduce the word */\n"
+"      int reduce(int * word,int length,int max_length);\n"
+"  };\n");
+
+  /* Each accepting state is given the number of its label plus 1, so that
+     0 can mean that a state is not accepting */
+  Label_Count nr_labels = gm.label_count();
+  long * values = new long[nr_states];
+  for (State_ID si = 0; si < nr_states;si++)
+    values[si] = si && gm.is_accepting(si) ? gm.get_label_nr(si)+1 : 0;
+  write_table("label_of",values,nr_states);
+  delete [] values;
+  size_t count = size_t(nr_labels+1)*nr_generators;
+  values = new long[count];
+  for (Ordinal g = 0; g < nr_generators;g++)
+    values[g] = 0;
+  for (Label_ID label = 0; label < nr_labels;label++)
+    for (Ordinal g = 0; g < nr_generators;g++)
+      values[size_t(label+1)*nr_generators+g] = gm.label_for_generator(label,g);
+  write_table("label_has_generator",values,count,nr_generators);
+  /* If the labels are consistent any generators in the label of the
+     initial state are trivial */
+  Label_ID initial_label = gm.get_label_nr(gm.initial_state());
+  for (Ordinal g = 0; g < nr_generators;g++)
+    values[g] = gm.labels_consistent() &&
+                gm.label_for_generator(initial_label,g);
+  write_table("trivial",values,nr_generators);
+  delete [] values;
+
+  put("  Reducer::Reducer() :\n"
+      "    node_state(0),\n"
+      "    node_prefix(0),\n"
+      "    node_rvalue(0),\n"
+      "    max_nodes(0),\n"
+      "    level_start(0),\n"
+      "    max_levels(0),\n"
+      "    product(0),\n"
+      "    mark(new unsigned[nr_states]),\n"
+      "    stamp(0)\n"
+      "  {\n"
+      "    memset(mark,0,nr_states*sizeof(unsigned));\n"
+      "  }\n\n"
+      "  Reducer::~Reducer()\n"
+      "  {\n"
+      "    delete [] node_state;\n"
+      "    delete [] node_prefix;\n"
+      "    delete [] node_rvalue;\n"
+      "    delete [] level_start;\n"
+      "    delete [] product;\n"
+      "    delete [] mark;\n"
+      "  }\n\n"
+      "  static void grow(int ** array,int old_size,int new_size)\n"
+      "  {\n"
+      "    int * new_array = new int[new_size];\n"
+      "    if (*array)\n"
+      "    {\n"
+      "      memcpy(new_array,*array,old_size*sizeof(int));\n"
+      "      delete [] *array;\n"
+      "    }\n"
+      "    *array = new_array;\n"
+      "  }\n\n"
+      "  void Reducer::reserve_nodes(int needed)\n"
+      "  {\n"
+      "    if (needed <= max_nodes)\n"
+      "      return;\n"
+      "    int new_size = max_nodes ? max_nodes*2 : 256;\n"
+      "    if (new_size < needed)\n"
+      "      new_size = needed;\n"
+      "    grow(&node_state,max_nodes,new_size);\n"
+      "    grow(&node_prefix,max_nodes,new_size);\n"
+      "    grow(&node_rvalue,max_nodes,new_size);\n"
+      "    max_nodes = new_size;\n"
+      "  }\n\n"
+      "  void Reducer::reserve_levels(int needed)\n"
+      "  {\n"
+      "    if (needed <= max_levels)\n"
+      "      return;\n"
+      "    int new_size = max_levels ? max_levels*2 : 64;\n"
+      "    if (new_size < needed)\n"
+      "      new_size = needed;\n"
+      "    grow(&level_start,max_levels,new_size);\n"
+      "    delete [] product;\n"
+      "    product = new int[new_size];\n"
+      "    max_levels = new_size;\n"
+      "  }\n\n"
+      "  int Reducer::multiply(const int * u,int length,int g)\n"
+      "  {\n"
+      "    /* Puts the v such that ug=v into product, and returns its\n"
+      "       length, or -1 if there is no such v */\n"
+      "    if (!length && label_has_generator[label_of[initial_state]][g])\n"
+      "      return 0;\n"
+      "    reserve_nodes(1);\n"
+      "    reserve_levels(length+2);\n"
+      "    node_state[0] = initial_state;\n"
+      "    node_prefix[0] = -1;\n"
+      "    node_rvalue[0] = -1;\n"
+      "    level_start[0] = 0;\n"
+      "    int nr_nodes = 1;\n"
+      "    for (int i = 0;;)\n"
+      "    {\n"
+      "      int lvalue = i < length ? u[i] : nr_generators;\n"
+      "      int first_g2 = i < length ? -1 : 0;\n"
+      "      int start = level_start[i];\n"
+      "      int end = nr_nodes;\n"
+      "      if (++i > length + nr_states)\n"
+      "        return -1;\n"
+      "      reserve_levels(i+2);\n"
+      "      level_start[i] = end;\n"
+      "      if (!++stamp)\n"
+      "      {\n"
+      "        memset(mark,0,nr_states*sizeof(unsigned));\n"
+      "        stamp = 1;\n"
+      "      }\n"
+      "      for (int prefix = start; prefix < end;prefix++)\n"
+      "        for (int g2 = first_g2; g2 < nr_generators;g2++)\n"
+      "        {\n"
+      "          int si = new_state(node_state[prefix],\n"
+      "                             lvalue*(nr_generators+1) +\n"
+      "                             (g2 < 0 ? nr_generators : g2));\n"
+      "          if (!si || mark[si] == stamp)\n"
+      "            continue;\n"
+      "          mark[si] = stamp;\n"
+      "          reserve_nodes(nr_nodes+1);\n"
+      "          node_state[nr_nodes] = si;\n"
+      "          node_prefix[nr_nodes] = prefix;\n"
+      "          node_rvalue[nr_nodes] = g2;\n"
+      "          if (i >= length && label_has_generator[label_of[si]][g])\n"
+      "          {\n"
+      "            int v_length = 0;\n"
+      "            for (int n = nr_nodes; n > 0;n = node_prefix[n])\n"
+      "              if (node_rvalue[n] >= 0)\n"
+      "                v_length++;\n"
+      "            int j = v_length;\n"
+      "            for (int n = nr_nodes; n > 0;n = node_prefix[n])\n"
+      "              if (node_rvalue[n] >= 0)\n"
+      "                product[--j] = node_rvalue[n];\n"
+      "            return v_length;\n"
+      "          }\n"
+      "          nr_nodes++;\n"
+      "        }\n"
+      "      if (nr_nodes == end)\n"
+      "        return -1;\n"
+      "    }\n"
+      "  }\n\n"
+      "  int Reducer::reduce(int * word,int length,int max_length)\n"
+      "  {\n"
+      "    for (;;)\n"
+      "    {\n"
+      "      int state = initial_state;\n"
+      "      int valid_length = 0;\n"
+      "      for (;valid_length < length;valid_length++)\n"
+      "      {\n"
+      "        int g = word[valid_length];\n"
+      "        if ((unsigned) g >= (unsigned) nr_generators)\n"
+      "          return -1;\n"
+      "        state = new_state(state,g*(nr_generators+2));\n"
+      "        if (!state)\n"
+      "          break;\n"
+      "      }\n"
+      "      if (valid_length == length)\n"
+      "        return length;\n"
+      "      int g = word[valid_length];\n"
+      "      int tail = length - valid_length - 1;\n"
+      "      if (trivial[g])\n"
+      "      {\n"
+      "        memmove(word+valid_length,word+valid_length+1,tail*sizeof(int));\n"
+      "        length--;\n"
+      "        continue;\n"
+      "      }\n"
+      "      int v_length = multiply(word,valid_length,g);\n"
+      "      if (v_length < 0 || v_length + tail > max_length)\n"
+      "        return -1;\n"
+      "      memmove(word+v_length,word+valid_length+1,tail*sizeof(int));\n"
+      "      memcpy(word,product,v_length*sizeof(int));\n"
+      "      length = v_length + tail;\n"
+      "    }\n"
+      "  }\n");
+  write_end();
+}
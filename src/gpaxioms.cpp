@@ -47,9 +47,10 @@ int main(int argc,char ** argv)
   char * group_filename = 0;
   char * sub_suffix = 0;
   Container & container = *MAF::create_container();
-  Standard_Options so(container,SO_FSA_KBMAG_COMPATIBILITY);
+  Standard_Options so(container,SO_FSA_KBMAG_COMPATIBILITY|SO_MULTIPLIER_CACHE);
   bool bad_usage = false;
   Compositor_Algorithm algorithm = CA_Hybrid;
+  unsigned threads = 1;
 #define cprintf container.error_output
 
   while (i < argc && !bad_usage)
@@ -85,6 +86,11 @@ int main(int argc,char ** argv)
         algorithm = CA_Parallel;
         i++;
       }
+      else if (arg.is_equal("-threads"))
+      {
+        so.parse_natural(&threads,argv[i+1],256,arg);
+        i += 2;
+      }
       else if (!so.recognised(argv,i))
         bad_usage = true;
     }
@@ -105,6 +111,8 @@ int main(int argc,char ** argv)
   if (group_filename && !bad_usage)
   {
     MAF * maf = MAF::create_from_input(cosets,group_filename,sub_suffix,&container,0);
+    maf->options.threads = threads;
+    so.start_multiplier_cache(*maf);
     time_t now = time(0);
     exit_code = inner(*maf,midfa,algorithm);
     container.progress(1,"Elapsed time %ld\n",long(time(0) - now));
@@ -114,7 +122,7 @@ int main(int argc,char ** argv)
   {
     cprintf("Usage:\n"
             "gpaxioms [loglevel] [-midfa] [-serial | -hybrid | -parallel]"
-            " groupname\n[-cos [cossuffix | subsuffix]]\n\n"
+            " [-threads n]\ngroupname [-cos [cossuffix | subsuffix]]\n\n"
             "where groupname contains a GASP rewriting system for a group,"
             " and, if the -cos\noption is used, groupname.cossuffix"
             " is a coset system.\n"
@@ -127,7 +135,10 @@ int main(int argc,char ** argv)
             " the default option, -hybrid, a multiplier is\nbuilt for all"
             " words of length 2 that may be needed, but for longer words\n"
             "individual multipliers are constructed. It is not possible to"
-            " know which\nof these algorithms will be quickest.\n");
+            " know which\nof these algorithms will be quickest.\n"
+            "If -threads n is specified with n greater than 1, and the"
+            " algorithm is not\n-parallel, up to n relations are checked at"
+            " once in separate threads.\n");
     so.usage();
     exit_code = 1;
   }
@@ -88,7 +88,7 @@ int main(int argc,char ** argv)
       cprintf("Unable to load word-acceptor\n");
       delete &maf;
     }
-    else if (!maf.load_reduction_method(so.reduction_method))
+    else if (!maf.load_reduction_method(so.reduction_method,so.use_trie))
     {
       cprintf("Unable to reduce words using selected mechanism\n");
       delete &maf;
@@ -51,7 +51,8 @@ int main(int argc,char ** argv)
   bool cosets = false;
   bool midfa = false;
   Container & container = *MAF::create_container();
-  Standard_Options so(container,SO_FSA_FORMAT|SO_FSA_KBMAG_COMPATIBILITY);
+  Standard_Options so(container,SO_FSA_FORMAT|SO_FSA_KBMAG_COMPATIBILITY|
+                      SO_MULTIPLIER_CACHE);
   bool bad_usage = false;
 #define cprintf container.error_output
 
@@ -91,6 +92,7 @@ int main(int argc,char ** argv)
   {
     MAF * maf = MAF::create_from_input(cosets,group_filename,subgroup_suffix,
                                  &container,0);
+    so.start_multiplier_cache(*maf);
     exit_code = inner(*maf,midfa,so.fsa_format_flags);
     delete maf;
   }
@@ -70,7 +70,8 @@ int main(int argc,char ** argv)
   String one_word = 0;
   int chosen = 0;
   Container & container = *MAF::create_container();
-  Standard_Options so(container,SO_FSA_FORMAT|SO_FSA_KBMAG_COMPATIBILITY);
+  Standard_Options so(container,SO_FSA_FORMAT|SO_FSA_KBMAG_COMPATIBILITY|
+                      SO_MULTIPLIER_CACHE);
   bool bad_usage = false;
 #define cprintf container.error_output
 
@@ -137,6 +138,7 @@ int main(int argc,char ** argv)
   {
     MAF & maf = * MAF::create_from_input(cosets,group_filename,sub_suffix,
                                          &container,0);
+    so.start_multiplier_cache(maf);
     exit_code = inner(maf,one_word,two,sub,pres,migm,sub_suffix,so.fsa_format_flags);
     delete &maf;
   }
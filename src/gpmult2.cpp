@@ -47,7 +47,8 @@ int main(int argc,char ** argv)
   char * group_filename = 0;
   char * sub_suffix = 0;
   Container & container = *MAF::create_container();
-  Standard_Options so(container,SO_FSA_FORMAT|SO_FSA_KBMAG_COMPATIBILITY);
+  Standard_Options so(container,SO_FSA_FORMAT|SO_FSA_KBMAG_COMPATIBILITY|
+                      SO_MULTIPLIER_CACHE);
   bool bad_usage = false;
 #define cprintf container.error_output
 
@@ -100,6 +101,7 @@ int main(int argc,char ** argv)
   {
     MAF * maf = MAF::create_from_input(cosets,group_filename,sub_suffix,
                                          &container,0);
+    so.start_multiplier_cache(*maf);
     Ordinal max_g = cosets ? maf->properties().coset_symbol :
                              maf->properties().nr_generators;
     if (g1 <= max_g && g2 <= max_g)
@@ -102,7 +102,8 @@ int main(int argc,char ** argv)
     const FSA * wa = maf->load_fsas(GA_WA);
     if (wa && wa->language_size(false) != LS_INFINITE)
       wa = 0;
-    if (!maf->load_reduction_method(so.reduction_method))
+    if (!maf->load_reduction_method(so.reduction_method,so.use_trie,
+                                    so.prefix_cache))
     {
       cprintf("Unable to reduce words using selected mechanism\n");
       delete maf;
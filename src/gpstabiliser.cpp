@@ -81,7 +81,7 @@ int main(int argc,char ** argv)
     MAF * maf = MAF::create_from_input(cosets,group_filename,subgroup_suffix,
                                        container);
 
-    if (!maf->load_reduction_method(so.reduction_method))
+    if (!maf->load_reduction_method(so.reduction_method,so.use_trie))
     {
       cprintf("Unable to reduce words using selected mechanism\n");
       delete maf;
@@ -60,7 +60,7 @@ int main(int argc,char ** argv)
   char * sub_suffix = 0;
   String prefix = "_x";
   Container & container = *MAF::create_container();
-  Standard_Options so(container,SO_REDUCTION_METHOD);
+  Standard_Options so(container,SO_REDUCTION_METHOD|SO_MULTIPLIER_CACHE);
   bool change_alphabet = true;
   unsigned method = 0;
   bool pres = false;
@@ -128,6 +128,7 @@ int main(int argc,char ** argv)
   {
     MAF & maf = * MAF::create_from_input(true,group_filename,sub_suffix,&container,
                                          CFI_DEFAULT,&options);
+    so.start_multiplier_cache(maf);
     signal(SIGINT,signal_handler);
     signal(SIGTERM,signal_handler);
     global_maf = &maf;
@@ -86,7 +86,8 @@ int main(int argc,char ** argv)
   {
     MAF & maf = * MAF::create_from_input(true,group_filename,sub_suffix,
                                          &container,0);
-    if (!maf.load_reduction_method(so.reduction_method))
+    if (!maf.load_reduction_method(so.reduction_method,so.use_trie,
+                                   so.prefix_cache))
     {
       cprintf("Unable to reduce words using selected mechanism\n");
       delete &maf;
@@ -108,6 +108,11 @@ and complicate the code quite a bit.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WIN32
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "heap.h"
 
 #define align_type double
@@ -166,6 +171,7 @@ struct Heap_Node
   signed char bf[2];
   short available;
   short used;
+  unsigned char category; // Heap_Category of items, or HC_UNTRACKED
   Heap_Node *left[2];
   Heap_Node *right[2];
   size_t usable_size;
@@ -211,12 +217,129 @@ struct Heap_Node
   }
 };
 
+/* Thread support.
+   Until Heap::begin_threading() is called the global heap is used without
+   any locking at all. After that every access to the global heap is
+   protected by heap_lock. To keep the number of times the lock is taken to a
+   minimum each thread has a Thread_Cache. This holds a few items of each of
+   the commonest sizes, which the thread can allocate without taking the lock,
+   and a list of the items the thread has freed. The freed items are returned
+   to the global heap in a batch when the list fills up. While the batch is
+   being returned any items that are of a size the thread caches are kept in
+   its cache, provided there is room (we don't know the size of a freed item
+   until the heap has found it). As far as the global heap is concerned items
+   in a thread cache are still allocated, so they are counted as in use in
+   the heap statistics.
+
+   In DEBUG builds frees are not deferred, so that an invalid free still
+   causes instant death in the call to delete that caused it.
+*/
+
+const size_t CACHED_SIZE = 128;   // largest item size held in thread caches
+const unsigned CACHE_DEPTH = 32;  // maximum items of each size in a cache
+const unsigned CACHE_REFILL = CACHE_DEPTH/2;
+const unsigned PENDING_FREES = 256;
+
+struct Thread_Cache
+{
+  void * item[CACHED_SIZE+1][CACHE_DEPTH];
+  unsigned nr_items[CACHED_SIZE+1];
+  void * pending[PENDING_FREES];
+  unsigned nr_pending;
+};
+
+static bool threads_active = false;
+static THREAD_LOCAL Thread_Cache * thread_cache;
+#ifdef WIN32
+static CRITICAL_SECTION heap_lock;
+#else
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cache_key;
+#endif
+
+class Heap_Guard
+{
+  /* Heap_Guard locks the global heap for its lifetime, if more than one
+     thread might be using it */
+  private:
+    bool locked;
+  public:
+    Heap_Guard() :
+      locked(threads_active)
+    {
+      if (locked)
+#ifdef WIN32
+        EnterCriticalSection(&heap_lock);
+#else
+        pthread_mutex_lock(&heap_lock);
+#endif
+    }
+    ~Heap_Guard()
+    {
+      if (locked)
+#ifdef WIN32
+        LeaveCriticalSection(&heap_lock);
+#else
+        pthread_mutex_unlock(&heap_lock);
+#endif
+    }
+};
+
+/* Profiling support.
+   When the heap is being profiled every page of fixed size items only
+   contains items of one category, and the category of a big block is kept
+   in the top bits of size[1] of its Memory_Header. Items and blocks that
+   were allocated before profiling began have category HC_UNTRACKED, and
+   are ignored when they are freed, because they were never counted. */
+
+const unsigned HC_UNTRACKED = HC_Count;
+const int CATEGORY_SHIFT = sizeof(size_t)*CHAR_BIT - 4;
+const size_t SIZE_MASK = (size_t(1) << CATEGORY_SHIFT) - 1;
+static THREAD_LOCAL unsigned char current_category = HC_General;
+
+/* The default trim policy keeps up to 64MB of free memory, and never
+   releases spans of less than 256K, since these are likely to be needed
+   again soon. */
+static Heap_Trim_Policy current_trim_policy = {0x4000000,0x40000};
+
 // class Heap::Implementation;
 static Heap::Implementation * global_heap;
 static bool leak_dump_allowed = true;
 
+static void print_usage(const char * name,const Heap_Usage & usage)
+{
+  fprintf(stderr,"%-10s %12zu %12zu %12zu %14zu\n",name,usage.in_use,
+          usage.peak,usage.nr_live,usage.nr_allocations);
+}
+
+static void print_profile()
+{
+  const Heap_Profile * profile = Heap::get_global_heap()->profile();
+  const Heap_Status * s = Heap::get_global_heap()->status(false);
+  if (!profile)
+    return;
+  fprintf(stderr,"Heap profile. Peak use %zu. Peak reserved %zu\n",
+          s->peak_allocation,s->peak_os_allocation);
+  fprintf(stderr,"%-10s %12s %12s %12s %14s\n","Category","In use","Peak",
+          "Live","Allocations");
+  for (int i = 0; i < HC_Count;i++)
+    if (profile->category[i].nr_allocations)
+      print_usage(Heap::category_name(Heap_Category(i)),profile->category[i]);
+  fprintf(stderr,"%-10s %12s %12s %12s %14s\n","Size","In use","Peak",
+          "Live","Allocations");
+  for (int i = 0; i < HEAP_SIZE_CLASSES;i++)
+    if (profile->size_class[i].nr_allocations)
+    {
+      char name[16];
+      sprintf(name,"<=%zu",size_t(1) << i);
+      print_usage(name,profile->size_class[i]);
+    }
+}
+
 static void detect_leak()
 {
+  Heap::end_thread();
+  print_profile();
   if (leak_dump_allowed)
   {
     const Heap_Status * s = Heap::get_global_heap()->status(false);
@@ -237,6 +360,7 @@ class Heap::Implementation : public Heap
     size_t critical_size;
     Heap_Node **use;
     Heap_Node **address_hash;
+    Heap_Profile *profile;
     Heap_Node *merged_node;
     void *spare_block;
     Memory_Header *recent[RECENT];
@@ -278,7 +402,8 @@ class Heap::Implementation : public Heap
         while (true_block_size <= headed_size(heap->critical_size)*c);
         size_area -= sizeof(Heap::Implementation);
         heap->add(base,size_area,false);
-        size_t temp = heap->critical_size*sizeof(Heap_Node*);
+        heap->profile = 0;
+        size_t temp = (HC_UNTRACKED+1)*heap->critical_size*sizeof(Heap_Node*);
         size_t temp2 = temp;
         heap->use = (Heap_Node **) heap->allocate(temp2);
         heap->merged_node = 0;
@@ -336,6 +461,8 @@ class Heap::Implementation : public Heap
           if (heap->status.os_allocation && size < heap->critical_size)
             heap->status.needed = true;
           heap->status.os_allocation += nsize + sizeof(Memory_Header);
+          if (heap->status.os_allocation > heap->status.peak_os_allocation)
+            heap->status.peak_os_allocation = heap->status.os_allocation;
         }
         else
         {
@@ -346,17 +473,286 @@ class Heap::Implementation : public Heap
       }
       heap->status.total_allocation += size;
       heap->status.nr_allocations++;
+      if (heap->status.total_allocation > heap->status.peak_allocation)
+        heap->status.peak_allocation = heap->status.total_allocation;
+      if (heap->profile)
+      {
+        if (size >= heap->critical_size)
+          ((Memory_Header *) ptr - 1)->size[1] |=
+            size_t(current_category+1) << CATEGORY_SHIFT;
+        heap->record(current_category,size,true);
+      }
       return ptr;
     }
 
     size_t free(void * ptr)
     {
       status.nr_allocations--;
-      size_t retcode = heap_free(ptr);
+      unsigned category;
+      size_t retcode = heap_free(ptr,category);
       status.total_allocation -= retcode;
+      if (category != HC_UNTRACKED)
+        record(category,retcode,false);
       return retcode;
     }
 
+    void start_profiling()
+    {
+      if (!profile)
+      {
+        size_t size = sizeof(Heap_Profile);
+        profile = (Heap_Profile *) allocate(size);
+        memset(profile,0,sizeof(Heap_Profile));
+      }
+    }
+
+    const Heap_Profile * read_profile() const
+    {
+      return profile;
+    }
+
+  private:
+    void record(unsigned category,size_t size,bool allocated)
+    {
+      int size_class = 0;
+      while (size_class < HEAP_SIZE_CLASSES-1 && size > size_t(1) << size_class)
+        size_class++;
+      Heap_Usage * usage[2];
+      usage[0] = &profile->category[category];
+      usage[1] = &profile->size_class[size_class];
+      for (int i = 0; i < 2;i++)
+        if (allocated)
+        {
+          usage[i]->nr_allocations++;
+          usage[i]->nr_live++;
+          usage[i]->in_use += size;
+          if (usage[i]->in_use > usage[i]->peak)
+            usage[i]->peak = usage[i]->in_use;
+        }
+        else
+        {
+          usage[i]->nr_live--;
+          usage[i]->in_use -= size;
+        }
+    }
+
+  public:
+
+    static void * cached_malloc(size_t size)
+    {
+      /* Allocate memory from the global heap when more than one thread
+         might be using it */
+      if (size <= CACHED_SIZE && !global_heap->profile)
+      {
+        if (!size)
+          size = 1;
+        Thread_Cache * tc = thread_cache ? thread_cache : create_thread_cache();
+        unsigned & nr_items = tc->nr_items[size];
+        if (!nr_items)
+        {
+          Heap_Guard guard;
+          while (nr_items < CACHE_REFILL)
+            tc->item[size][nr_items++] = malloc(global_heap,size);
+        }
+        return tc->item[size][--nr_items];
+      }
+      Heap_Guard guard;
+      return malloc(global_heap,size);
+    }
+
+    static void cached_free(void * mem)
+    {
+#ifndef DEBUG
+      if (!global_heap->profile)
+      {
+        Thread_Cache * tc = thread_cache ? thread_cache : create_thread_cache();
+        tc->pending[tc->nr_pending++] = mem;
+        if (tc->nr_pending == PENDING_FREES)
+          flush(tc,false);
+        return;
+      }
+#endif
+      Heap_Guard guard;
+      global_heap->free(mem);
+    }
+
+    static void flush(Thread_Cache * tc,bool release_all)
+    {
+      /* Return the items in a thread's list of frees to the global heap,
+         except for those we can keep in its cache. If release_all is true
+         then the cache is being destroyed so everything goes back */
+      Heap_Guard guard;
+      for (unsigned i = 0; i < tc->nr_pending;i++)
+      {
+        void * mem = tc->pending[i];
+        size_t size = release_all ? 0 : global_heap->cacheable_size(mem);
+        if (size && tc->nr_items[size] < CACHE_DEPTH)
+          tc->item[size][tc->nr_items[size]++] = mem;
+        else
+          global_heap->free(mem);
+      }
+      tc->nr_pending = 0;
+      if (release_all)
+      {
+        for (size_t size = 1; size <= CACHED_SIZE;size++)
+          while (tc->nr_items[size])
+            global_heap->free(tc->item[size][--tc->nr_items[size]]);
+        global_heap->free(tc);
+      }
+    }
+
+    static void release_thread_cache(void * tc)
+    {
+      /* called when a thread ends */
+      if (tc)
+      {
+        flush((Thread_Cache *) tc,true);
+        thread_cache = 0;
+      }
+    }
+
+    static void begin_threading()
+    {
+      if (!threads_active)
+      {
+#ifdef WIN32
+        InitializeCriticalSection(&heap_lock);
+#else
+        pthread_key_create(&cache_key,release_thread_cache);
+#endif
+        if (!global_heap)
+        {
+          void * mem = malloc(global_heap,1);
+          global_heap->free(mem);
+        }
+        threads_active = true;
+      }
+    }
+
+    static void end_thread()
+    {
+      if (threads_active && thread_cache)
+      {
+#ifndef WIN32
+        pthread_setspecific(cache_key,0);
+#endif
+        release_thread_cache(thread_cache);
+      }
+    }
+
+    size_t trim(const Heap_Trim_Policy & policy)
+    {
+      /* Return memory we are not using to the OS. First of all we return
+         unused pages and recently freed big blocks to the free spans,
+         and get rid of the spare block */
+      size_t released = 0;
+      weed();
+      if (spare_block)
+      {
+        released += HUGE_SIZE;
+#ifdef WIN32
+        HeapFree(GetProcessHeap(),0,spare_block);
+#else
+        ::free(spare_block);
+#endif
+        spare_block = 0;
+      }
+      if (status.os_allocation - status.total_allocation > policy.keep)
+        released += trim_inner(root[By_Size],policy.min_span);
+      return released;
+    }
+
+  private:
+    size_t trim_inner(Heap_Node * h,size_t min_span)
+    {
+      /* Release the memory in the free spans in the subtree of the By_Size
+         tree rooted at h that are at least min_span in size. The free spans
+         are the nodes with item_size 0, which are ordered by size, so we can
+         avoid looking at most of the tree. */
+      size_t released = 0;
+      while (h)
+      {
+        if (h->item_size)
+          h = h->left[By_Size];
+        else
+        {
+          if (h->block_size >= min_span)
+          {
+            released += trim_inner(h->left[By_Size],min_span);
+            released += release_span(h);
+          }
+          h = h->right[By_Size];
+        }
+      }
+      return released;
+    }
+
+    static size_t release_span(Heap_Node * h)
+    {
+      /* Tell the OS it can have the whole pages in a free span, except
+         for the one containing its Heap_Node. The pages stay in our
+         address space and will be zero filled if we use them again */
+      static size_t os_page_size;
+      if (!os_page_size)
+      {
+#ifdef WIN32
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        os_page_size = si.dwPageSize;
+#else
+        os_page_size = size_t(sysconf(_SC_PAGESIZE));
+#endif
+      }
+      size_t start = ((size_t) (h+1) + os_page_size - 1) & ~(os_page_size-1);
+      size_t end = ((size_t) h + h->block_size) & ~(os_page_size-1);
+      if (end <= start)
+        return 0;
+#ifdef WIN32
+      VirtualAlloc((void *) start,end-start,MEM_RESET,PAGE_READWRITE);
+#elif defined(__APPLE__)
+      madvise((void *) start,end-start,MADV_FREE);
+#else
+      madvise((void *) start,end-start,MADV_DONTNEED);
+#endif
+      return end-start;
+    }
+
+    static Thread_Cache * create_thread_cache()
+    {
+      Thread_Cache * tc;
+      {
+        Heap_Guard guard;
+        tc = (Thread_Cache *) malloc(global_heap,sizeof(Thread_Cache));
+      }
+      memset(tc->nr_items,0,sizeof(tc->nr_items));
+      tc->nr_pending = 0;
+#ifndef WIN32
+      pthread_setspecific(cache_key,tc);
+#endif
+      return thread_cache = tc;
+    }
+
+    size_t cacheable_size(void * mem)
+    {
+      /* If mem is an item in a node with a size small enough to be kept in
+         a thread cache return its size, otherwise return 0 and let free()
+         deal with it. Since the item will not be freed we must check it
+         is valid here */
+      Heap_Node * h = find_node(mem);
+      if (!h || h->item_size > CACHED_SIZE)
+        return 0;
+      int i = h->index((unsigned char *) mem);
+      if ((unsigned char  *) mem != h->data() + i*h->item_size || i < 0 ||
+          !(h->status()[i/CHAR_BIT] & (1 << (i % CHAR_BIT))))
+      {
+        printf("Invalid free %p\n",mem);
+        * (char *) 0 = 0;
+        return 0;
+      }
+      return h->item_size;
+    }
+
+  public:
     const Heap_Status * read_status(bool status_only)
     {
       if (!status_only || status.needed)
@@ -450,35 +846,29 @@ class Heap::Implementation : public Heap
       if (count)
       {
         unsigned char * answer;
+        unsigned category = profile ? current_category : HC_UNTRACKED;
+        Heap_Node * &in_use = use[category*critical_size + size];
         do
         {
-          if (use[size])
-            h = use[size];
+          if (in_use)
+            h = in_use;
           else
-          {
-            for (h = root[By_Size];h && h->item_size != size;)
-            {
-              if (size < h->item_size)
-                h = h->left[By_Size];
-              else
-                h = h->right[By_Size];
-            }
-          }
+            h = find_page(root[By_Size],size,category);
 
           if (!h)
           {
-            h = node_create(size,count);
+            h = node_create(size,count,category);
             if (!h)
               return 0;
           }
-          use[size] = h;
+          in_use = h;
           answer = h->first_available();
           if (!answer)
           {
             // we remove a fully used node from the By_Size tree
             // since no more allocations from it are possible. It
             // will get put back as soon as an item is freed.
-            use[size] = 0;
+            in_use = 0;
             delete_node(root[By_Size],h,By_Size);
             h->bf[By_Size] = 2;
           }
@@ -517,10 +907,33 @@ class Heap::Implementation : public Heap
 
     /**/
 
-    size_t heap_free(void * mem)
+    static Heap_Node * find_page(Heap_Node * h,size_t size,unsigned category)
     {
-      Heap_Node * h;
-      h = quick_find(mem);
+      /* Find a page of items of the required size and category in the
+         By_Size tree. Unless the heap is being profiled all the pages
+         have the same category, so the first page of the right size
+         will do */
+      while (h)
+        if (size < h->item_size)
+          h = h->left[By_Size];
+        else if (size > h->item_size)
+          h = h->right[By_Size];
+        else if (h->category == category)
+          return h;
+        else
+        {
+          Heap_Node * answer = find_page(h->left[By_Size],size,category);
+          if (answer)
+            return answer;
+          h = h->right[By_Size];
+        }
+      return 0;
+    }
+
+    Heap_Node * find_node(void * mem)
+    {
+      /* Find the node of fixed size items that contains mem, if any */
+      Heap_Node * h = quick_find(mem);
       if (!h)
       {
         for (h = root[By_Address];h;)
@@ -531,9 +944,16 @@ class Heap::Implementation : public Heap
           else
             break;
       }
+      return h;
+    }
+
+    size_t heap_free(void * mem,unsigned & category)
+    {
+      Heap_Node * h = find_node(mem);
 
       if (h)
       {
+        category = h->category;
         /* In this case we are freeing a block with items */
         int i = h->index((unsigned char *) mem);
         int j = i/CHAR_BIT;
@@ -561,7 +981,7 @@ class Heap::Implementation : public Heap
           * (char *) 0 = 0;
           return 0;
         }
-        if (!h->used && use[h->item_size] != h)
+        if (!h->used && use[h->category*critical_size + h->item_size] != h)
         {
           /* we unformat a completely empty node unless it is the one that will
              be allocated from */
@@ -580,14 +1000,18 @@ class Heap::Implementation : public Heap
       {
         Memory_Header * m = (Memory_Header *) mem - 1;
         size_t retcode = m->size[0];
+        size_t requested = m->size[1] & SIZE_MASK;
+        category = unsigned(m->size[1] >> CATEGORY_SHIFT);
+        category = category ? category - 1 : HC_UNTRACKED;
         if ((size_t) m != aligned_size((size_t) m) ||
             retcode != aligned_size(retcode) ||
-            m->size[1] > retcode )
+            requested > retcode )
         {
           printf("Invalid free %p\n",mem);
           * (char *) 0 = 0;
           return 0;
         }
+        m->size[1] = requested;
         if (retcode > HUGE_SIZE)
         {
           status.os_allocation -= retcode - sizeof(Memory_Header);
@@ -783,7 +1207,7 @@ class Heap::Implementation : public Heap
       *true_block_size = aligned_size(*true_block_size);
     }
 
-    Heap_Node * node_create(size_t item_size,int nr_items)
+    Heap_Node * node_create(size_t item_size,int nr_items,unsigned category)
     {
       Heap_Node * h;
       size_t usable_size,true_block_size;
@@ -805,6 +1229,7 @@ class Heap::Implementation : public Heap
           }
         }
         h->item_size = (unsigned short) item_size;
+        h->category = (unsigned char) category;
         h->usable_size = usable_size;
         h->available = 0;
         h->used = 0;
@@ -876,12 +1301,12 @@ class Heap::Implementation : public Heap
          next allocation that might want it. From time to time we call weed()
          to get rid of such blocks that are still entirely empty, on the basis
          that allocations of that size are probably not happening any more.*/
-      for (size_t size = 1;size < critical_size;size++)
+      for (size_t i = 0;i < (HC_UNTRACKED+1)*critical_size;i++)
       {
-        Heap_Node *h = use[size];
+        Heap_Node *h = use[i];
         if (h && !h->used)
         {
-          use[size] = 0;
+          use[i] = 0;
           erase_node(h);
         }
       }
@@ -1461,11 +1886,21 @@ Heap * Heap::get_global_heap()
 
 void * Heap::malloc(size_t nr_bytes)
 {
+  if (this == global_heap)
+  {
+    Heap_Guard guard;
+    return Heap::Implementation::malloc(global_heap,nr_bytes);
+  }
   return Heap::Implementation::malloc((Heap::Implementation *)this,nr_bytes);
 }
 
 size_t Heap::free(void * mem)
 {
+  if (this == global_heap)
+  {
+    Heap_Guard guard;
+    return global_heap->free(mem);
+  }
   return ((Heap::Implementation *)this)->free(mem);
 }
 
@@ -1474,8 +1909,14 @@ const Heap_Status * Heap::status(bool status_only)
   return ((Heap::Implementation *)this)->read_status(status_only);
 };
 
+const Heap_Profile * Heap::profile()
+{
+  return ((Heap::Implementation *)this)->read_profile();
+}
+
 void Heap::walk(bool crash)
 {
+  Heap_Guard guard;
   ((Heap::Implementation *)this)->walk(crash);
 };
 
@@ -1483,25 +1924,100 @@ void Heap::walk(bool crash)
 
 void * operator new(size_t block_size)
 {
+  if (threads_active)
+    return Heap::Implementation::cached_malloc(block_size);
   return Heap::Implementation::malloc(global_heap,block_size);
 }
 
 void operator delete(void * address)
 {
-  global_heap->free(address);
+  if (threads_active)
+    Heap::Implementation::cached_free(address);
+  else
+    global_heap->free(address);
 }
 
 void * operator new [](size_t block_size)
 {
+  if (threads_active)
+    return Heap::Implementation::cached_malloc(block_size);
   return Heap::Implementation::malloc(global_heap,block_size);
 }
 
 void operator delete [](void * address)
 {
-  global_heap->free(address);
+  if (threads_active)
+    Heap::Implementation::cached_free(address);
+  else
+    global_heap->free(address);
 }
 
 void Heap::prevent_leak_dump()
 {
   leak_dump_allowed = false;
 }
+
+void Heap::begin_threading()
+{
+  Heap::Implementation::begin_threading();
+}
+
+void Heap::end_thread()
+{
+  Heap::Implementation::end_thread();
+}
+
+void Heap::start_profiling()
+{
+  if (!global_heap)
+  {
+    void * mem = Heap::Implementation::malloc(global_heap,1);
+    global_heap->free(mem);
+  }
+  Heap_Guard guard;
+  global_heap->start_profiling();
+}
+
+const char * Heap::category_name(Heap_Category category)
+{
+  static const char * const names[HC_Count] =
+  {
+    "General",
+    "Nodes",
+    "Equations",
+    "Hash",
+    "Cosets"
+  };
+  return names[category];
+}
+
+Heap_Category Heap::set_category(Heap_Category category)
+{
+  Heap_Category saved = Heap_Category(current_category);
+  if (saved == HC_General)
+    current_category = (unsigned char) category;
+  return saved;
+}
+
+void Heap::restore_category(Heap_Category category)
+{
+  current_category = (unsigned char) category;
+}
+
+size_t Heap::trim()
+{
+  if (!global_heap)
+    return 0;
+  Heap_Guard guard;
+  return global_heap->trim(current_trim_policy);
+}
+
+void Heap::set_trim_policy(const Heap_Trim_Policy & policy)
+{
+  current_trim_policy = policy;
+}
+
+const Heap_Trim_Policy & Heap::trim_policy()
+{
+  return current_trim_policy;
+}
@@ -76,6 +76,42 @@ Revision 1.2  2007/10/24 21:15:32Z  Alun
    2) Unless you install a new handler an allocation that is about to return
    0 will cause your program to call exit(3) and abort with an error message.
 
+   Threads:
+   The global heap can be used by several threads at once, but only once
+   begin_threading() has been called. Before that it is assumed that the
+   program is single threaded and no locking is performed at all. Once
+   threading has begun, new() and delete() are served from small per-thread
+   caches of the commonest item sizes, and the global heap is only locked
+   when a cache needs refilling or when a batch of freed items is returned
+   to it. Each thread should call end_thread() just before it exits, so that
+   anything left in its cache is given back. (The Thread class in
+   mafthread.h does this for you). Private heaps are never locked, and so
+   must only be used by one thread at a time.
+
+   Profiling:
+   If start_profiling() is called the global heap keeps a histogram of the
+   memory in use by size class (the sizes in each class being from one more
+   than a power of 2 up to the next power of 2), and also keeps track of the
+   memory in use by each of a small number of subsystems, which are
+   identified by the Heap_Category values below. Code that wants its memory
+   to be accounted for separately declares a Heap_Tag for the duration of
+   the code that does the allocations. Only the outermost Heap_Tag counts,
+   so for example the items of a Hash that belongs to an Equation_DB are
+   accounted for as equations. Memory allocated before profiling began is
+   accounted for as general memory. High water marks of the memory in use
+   are maintained in Heap_Status whether or not profiling is on.
+   Profiling makes the heap slower, somewhat less compact, and bypasses the
+   per-thread caches, so it should only be used for diagnosis.
+
+   Trimming:
+   Memory obtained from the OS is normally kept until the program ends,
+   unless an entire block becomes free. trim() releases the physical memory
+   behind large free spans inside partly used blocks (the address space is
+   kept, so the memory can be re-used without any further OS call), and
+   frees the spare OS block kept in reserve. What is released is governed by
+   a Heap_Trim_Policy. Long running code should call trim() at points where
+   a lot of memory has probably just been freed.
+
    Limitations:
    1) Currently this heap manager should not be used in a DLL that is
    loaded and unload within the lifetime of a process. This might well cause
@@ -93,11 +129,46 @@ struct Heap_Status
 {
   size_t total_allocation;
   size_t os_allocation;
+  size_t peak_allocation;     // high water mark of total_allocation
+  size_t peak_os_allocation;  // high water mark of os_allocation
   int nr_allocations;
   bool needed; // ignore this member - it is used internally
                // and reset when you read the status
 };
 
+enum Heap_Category
+{
+  HC_General,   // anything not allocated under a Heap_Tag
+  HC_Nodes,     // Node_Manager
+  HC_Equations, // Equation_DB, including the pool
+  HC_Hash,      // Hash, including the keys of a Keyed_FSA
+  HC_Cosets,    // Coset_Enumerator
+  HC_Count
+};
+
+const int HEAP_SIZE_CLASSES = 32;
+
+struct Heap_Usage
+{
+  size_t in_use;            // bytes currently allocated
+  size_t peak;              // high water mark of in_use
+  size_t nr_live;           // number of allocations not yet freed
+  size_t nr_allocations;    // number of allocations ever made
+};
+
+struct Heap_Profile
+{
+  Heap_Usage category[HC_Count];
+  Heap_Usage size_class[HEAP_SIZE_CLASSES]; // size_class[n] is for sizes
+                                            // up to 2^n
+};
+
+struct Heap_Trim_Policy
+{
+  size_t keep;      // trim() does nothing unless more memory than this is free
+  size_t min_span;  // free spans smaller than this are never released
+};
+
 /* we would like class Heap to be a pure virtual class with "virtual = 0"
 for all its non-static methods. That is you you should think of it. However it
 is extremely awkward to implement it like that, because it can't be constructed
@@ -143,4 +214,42 @@ class Heap
        function is to assist with the diagnosis of memory leaks */
     void walk(bool crash);
     static void prevent_leak_dump();
+    /* begin_threading() must be called before a second thread that might
+       use the global heap is started. It cannot be undone */
+    static void begin_threading();
+    /* end_thread() returns any memory held in the calling thread's cache
+       to the global heap. It does nothing if threading has not begun. */
+    static void end_thread();
+    /* start_profiling() turns on profiling of the global heap. It cannot be
+       turned off again. At exit the profile is printed to stderr */
+    static void start_profiling();
+    /* profile() returns 0 if the heap is not being profiled */
+    const Heap_Profile * profile();
+    static const char * category_name(Heap_Category category);
+    /* trim() returns free memory in the global heap to the OS according to
+       the current policy, and returns the number of bytes released */
+    static size_t trim();
+    static void set_trim_policy(const Heap_Trim_Policy & policy);
+    static const Heap_Trim_Policy & trim_policy();
+    /* set_category() and restore_category() are used by Heap_Tag */
+    static Heap_Category set_category(Heap_Category category);
+    static void restore_category(Heap_Category category);
+};
+
+/* Declare a Heap_Tag to have the memory allocated by the current thread
+   while it is in scope accounted for under the given category when the
+   heap is being profiled. Heap_Tag does nothing useful otherwise, but
+   it costs very little, so there is no need to make it conditional */
+class Heap_Tag
+{
+  private:
+    Heap_Category saved;
+  public:
+    Heap_Tag(Heap_Category category) :
+      saved(Heap::set_category(category))
+    {}
+    ~Heap_Tag()
+    {
+      Heap::restore_category(saved);
+    }
 };
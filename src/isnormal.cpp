@@ -83,7 +83,7 @@ int main(int argc,char ** argv)
   {
     MAF * maf = 0;
     maf = MAF::create_from_input(true,group_filename,subgroup_suffix,container);
-    if (!maf->load_reduction_method(so.reduction_method))
+    if (!maf->load_reduction_method(so.reduction_method,so.use_trie))
     {
       cprintf("Unable to reduce words using selected mechanism\n");
       delete maf;
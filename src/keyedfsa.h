@@ -132,6 +132,15 @@ class Keyed_FSA : public FSA_Common
         state = 0;
       return state;
     }
+    /* look_up_state() finds an existing state, and returns 0 if there is
+       no state with the specified key. Since it does not change the FSA
+       several threads may call it at once, provided that nothing else is
+       changing the FSA while they do so */
+    State_ID look_up_state(const void *key,size_t key_size = 0) const
+    {
+      Element_ID state;
+      return ind.find(key,key_size,&state) ? State_ID(state) : 0;
+    }
     bool get_state_key(void * key,State_ID state) const
     {
       return ind.get_key(key,state);
@@ -232,10 +232,15 @@
 #include "container.h"
 #include "maf_rm.h"
 #include "maf_rws.h"
+#include "maf_acr.h"
 #include "maf_dr.h"
 #include "maf_we.h"
 #include "rubik.h"
 #include "mafcoset.h"
+#include "mafnode.h"
+#include "checkpoint.h"
+#include "telemetry.h"
+#include "maf_mcache.h"
 
 bool Word_Reducer::reducible(const Word & word,Word_Length length)
 {
@@ -243,6 +248,21 @@ bool Word_Reducer::reducible(const Word & word,Word_Length length)
   return reduce(&test,test,WR_CHECK_ONLY)!=0;
 }
 
+/**/
+
+void Word_Reducer::reduce_batch(Word_List * answers,const Word_List & words,
+                                unsigned flags,unsigned)
+{
+  Ordinal_Word test(words.alphabet);
+  Element_Count count = words.count();
+  for (Element_ID i = 0; i < count;i++)
+  {
+    words.get(&test,i);
+    reduce(&test,test,flags);
+    answers->add(test);
+  }
+}
+
 Container * MAF::create_container(Platform * platform)
 {
   return Container::create(platform);
@@ -266,6 +286,8 @@ MAF::MAF(Container & container,Alphabet_Type alphabet_type,
          const Options * options_) :
   Presentation(container,alphabet_type,presentation_type,delete_container),
   aborting(false),
+  telemetry(0),
+  multiplier_cache(0),
   fsas(real_fsas),
   rm(0),
   automata(0),
@@ -281,6 +303,16 @@ MAF::MAF(Container & container,Alphabet_Type alphabet_type,
 
 MAF::~MAF()
 {
+  if (telemetry)
+  {
+    Telemetry_Sample sample;
+    if (rm)
+      rm->telemetry_sample(&sample);
+    telemetry->record("end",sample);
+    delete telemetry;
+  }
+  if (multiplier_cache)
+    delete multiplier_cache;
   if (automata)
     delete automata;
   if (rm)
@@ -412,6 +444,26 @@ unsigned MAF::reduce(Word * rword,const Word & word,unsigned flags) const
 
 /**/
 
+void MAF::reduce_batch(Word_List * answers,const Word_List & words,
+                       unsigned flags) const
+{
+  if (wr)
+    wr->reduce_batch(answers,words,flags,options.threads);
+  else
+  {
+    Ordinal_Word test(words.alphabet);
+    Element_Count count = words.count();
+    for (Element_ID i = 0; i < count;i++)
+    {
+      words.get(&test,i);
+      reduce(&test,test,flags);
+      answers->add(test);
+    }
+  }
+}
+
+/**/
+
 bool MAF::reducible(const Word &word,Word_Length length) const
 {
   if (wr)
@@ -473,9 +525,15 @@ void MAF::grow_automata(FSA_Buffer * buffer,
     rm->start();
     int action;
     automata = new Group_Automata;
+    set_telemetry_phase("kb");
     while ((action = rm->expand_machine())!=0)
     {
-      if (automata->build_vital(rm,false,action))
+      bool provisional = action == 2 || action == -1;
+      set_telemetry_phase(provisional ? "provisional" : "automata");
+      bool built = automata->build_vital(rm,false,action);
+      if (options.checkpoint && provisional)
+        save_checkpoint();
+      if (built)
       {
         if (aborting || action != 2)
           break;
@@ -483,16 +541,188 @@ void MAF::grow_automata(FSA_Buffer * buffer,
         automata->grow_automata(rm,buffer,GA_PDIFF2|GA_DIFF2|GA_RWS,0,exclude_flags);
       }
       automata->erase();
+      set_telemetry_phase("kb");
     }
     if (action == 0)
+    {
+      set_telemetry_phase("automata");
       automata->build_vital(rm,true,action);
+    }
   }
+  set_telemetry_phase("output");
   automata->grow_automata(rm,buffer,save_flags,retain_flags,exclude_flags);
   automata->transfer(&real_fsas);
 }
 
 /**/
 
+bool MAF::start_telemetry(String filename,unsigned interval)
+{
+  if (telemetry)
+    delete telemetry;
+  telemetry = Telemetry::create(container,filename,interval);
+  return telemetry != 0;
+}
+
+/**/
+
+bool MAF::start_multiplier_cache(String directory,unsigned max_megabytes)
+{
+  if (multiplier_cache)
+    delete multiplier_cache;
+  multiplier_cache = new Multiplier_Cache(container,directory,
+                                          Unsigned_Long_Long(max_megabytes) << 20);
+  if (multiplier_cache->is_ok())
+    return true;
+  delete multiplier_cache;
+  multiplier_cache = 0;
+  return false;
+}
+
+/**/
+
+void MAF::set_telemetry_phase(String phase)
+{
+  if (telemetry && !String(telemetry->current_phase()).is_equal(phase))
+  {
+    Telemetry_Sample sample;
+    if (rm)
+      rm->telemetry_sample(&sample);
+    telemetry->set_phase(phase,&sample);
+  }
+}
+
+/**/
+
+/* A checkpoint begins with a header that identifies the build of MAF that
+   wrote it, followed by the generators and their inverses, so that we do
+   not try to restore a checkpoint for a different rewriting system */
+
+const unsigned CHECKPOINT_VERSION = 4;
+
+struct Checkpoint_Header
+{
+  char magic[8];
+  unsigned version;
+  unsigned node_size;
+  unsigned node_id_size;
+  unsigned status_size;
+  unsigned options_size;
+  Ordinal nr_generators;
+  Word_Ordering word_ordering;
+  Checkpoint_Header(const MAF & maf)
+  {
+    memset(this,0,sizeof(*this));
+    strcpy(magic,"MAFCKPT");
+    version = CHECKPOINT_VERSION;
+    node_size = sizeof(Node);
+    node_id_size = sizeof(Node_ID);
+    status_size = sizeof(Rewriter_Machine::Status);
+    options_size = sizeof(MAF::Options);
+    nr_generators = maf.generator_count();
+    word_ordering = maf.alphabet.order_type();
+  }
+};
+
+/**/
+
+void MAF::save_checkpoint()
+{
+#if MAF_USE_LOOKUP
+  String_Buffer sb;
+  String checkpoint_filename = sb.make_filename("",filename,".kbckpt");
+  Checkpoint_Writer cw(container,checkpoint_filename);
+  Checkpoint_Header header(*this);
+  cw.put(header);
+  for (Ordinal g = 0; g < nr_generators;g++)
+  {
+    String glyph = alphabet.glyph(g);
+    size_t length = glyph.length();
+    cw.put(length);
+    cw.put(glyph.string(),length);
+    cw.put(inverse(g));
+  }
+  cw.put(options);
+  if (rm->checkpoint(cw) && cw.commit())
+    container.progress(1,"Checkpoint saved to %s\n",checkpoint_filename.string());
+  else
+    container.error_output("Unable to save checkpoint to %s\n",
+                           checkpoint_filename.string());
+#endif
+}
+
+/**/
+
+bool MAF::restore_checkpoint()
+{
+#if MAF_USE_LOOKUP
+  String_Buffer sb;
+  String checkpoint_filename = sb.make_filename("",filename,".kbckpt");
+  Checkpoint_Reader cr(container,checkpoint_filename);
+  if (!cr.is_ok())
+    return false;
+  Checkpoint_Header header(*this);
+  Checkpoint_Header saved_header(*this);
+  cr.get(&saved_header);
+  bool ok = memcmp(&header,&saved_header,sizeof(header))==0;
+  String_Buffer glyph_sb;
+  for (Ordinal g = 0; ok && g < nr_generators;g++)
+  {
+    size_t length = 0;
+    Ordinal saved_inverse;
+    cr.get(&length);
+    char * glyph = glyph_sb.reserve(length);
+    cr.get(glyph,length);
+    glyph[length] = 0;
+    cr.get(&saved_inverse);
+    ok = cr.is_ok() && alphabet.glyph(g).is_equal(glyph) &&
+         saved_inverse == inverse(g);
+  }
+  if (!ok)
+  {
+    container.error_output("Checkpoint file %s does not belong to this"
+                           " rewriting system or program and has been"
+                           " ignored\n",checkpoint_filename.string());
+    return false;
+  }
+
+  /* The options that affect KB were probably modified by
+     Rewriter_Machine::start() so we want the saved ones. Options that
+     control how long to run, or what to report, come from the command line */
+  Options saved_options;
+  cr.get(&saved_options);
+  saved_options.log_flags = options.log_flags;
+  saved_options.log_level = options.log_level;
+  saved_options.max_equations = options.max_equations;
+  saved_options.max_time = options.max_time;
+  saved_options.threads = options.threads;
+  saved_options.checkpoint = options.checkpoint;
+  saved_options.validate = options.validate;
+  saved_options.validate_inverses = options.validate_inverses;
+  saved_options.write_success = options.write_success;
+  options = saved_options;
+
+  if (!flags_set)
+    set_flags();
+  rm = new Rewriter_Machine(*this);
+  if (!rm->restore(cr))
+  {
+    /* The checksum was correct, so the file is not damaged, but we
+       could not make sense of it, and we have no way of undoing
+       the partial restore */
+    container.error_output("Checkpoint file %s could not be restored\n",
+                           checkpoint_filename.string());
+    container.die();
+  }
+  container.progress(1,"Resuming from checkpoint %s\n",checkpoint_filename.string());
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**/
+
 void MAF::set_validation_fsa(FSA_Simple * fsa)
 {
   if (validator)
@@ -749,7 +979,8 @@ bool MAF::polish_equation(Simple_Equation * se) const
 
 /**/
 
-bool MAF::load_reduction_method(Group_Automaton_Type flag)
+bool MAF::load_reduction_method(Group_Automaton_Type flag,bool use_trie,
+                                unsigned prefix_cache)
 {
   const FSA * fsa = 0;
   if (wr)
@@ -778,7 +1009,7 @@ bool MAF::load_reduction_method(Group_Automaton_Type flag)
       };
 
       for (int i = 0; path[i] != GAT_Auto_Select;i++)
-        if (load_reduction_method(path[i]))
+        if (load_reduction_method(path[i],use_trie,prefix_cache))
           return true;
       return false;
     }
@@ -788,7 +1019,12 @@ bool MAF::load_reduction_method(Group_Automaton_Type flag)
     case GAT_Provisional_RWS:
       fsa = load_fsas(1 << flag);
       if (fsa)
-        wr = new RWS_Reducer(* (Rewriting_System *) fsa);
+      {
+        if (use_trie)
+          wr = new Aho_Corasick_Reducer(* (const Rewriting_System *) fsa);
+        else
+          wr = new RWS_Reducer(* (Rewriting_System *) fsa);
+      }
       return wr != 0;
 
     case GAT_Coset_Table:
@@ -804,7 +1040,11 @@ bool MAF::load_reduction_method(Group_Automaton_Type flag)
     case GAT_Provisional_DM2:
       fsa = load_fsas(1 << flag);
       if (fsa)
-        wr = new Diff_Reduce(fsa);
+      {
+        Diff_Reduce * dr = new Diff_Reduce(fsa);
+        dr->set_prefix_cache(size_t(prefix_cache) << 20);
+        wr = dr;
+      }
       return wr != 0;
 
     case GAT_General_Multiplier:
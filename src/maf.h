@@ -78,6 +78,7 @@ struct Generator_Permutation;
 struct TC_Enumeration_Options;
 class Group_Automata;
 class Linked_Packed_Equation;
+class Multiplier_Cache;
 class Node_Manager;
 class Ordinal_Word;
 class Packed_Equation_List;
@@ -87,6 +88,7 @@ class Rewriter_Machine;
 class Rewriting_System;
 class Simple_Equation;
 class Subalgebra_Descriptor;
+class Telemetry;
 class Word;
 class Word_Collection;
 class Word_List;
@@ -508,6 +510,12 @@ class Word_Reducer
     virtual unsigned reduce(Word * word,const Word & start_word,
                             unsigned flags = 0,const FSA * wa = 0) = 0;
     virtual bool reducible(const Word & word,Word_Length length = WHOLE_WORD);
+    /* reduce_batch() reduces each word in words and adds the answers to
+       answers in the same order. Implementations may reduce the words in
+       another order, or in up to nr_threads threads, if that is quicker.
+       The default implementation just calls reduce() for each word. */
+    virtual void reduce_batch(Word_List * answers,const Word_List & words,
+                              unsigned flags = 0,unsigned nr_threads = 1);
     // this method is used internally in programs that construct automata when
     // reduction is through a provisional Word_Reducer. In such cases it may
     // be necessary for a Word_Reducer to be deleted and recreated.
@@ -572,10 +580,14 @@ class MAF : public Presentation
                                        // multiplier after word_acceptor stabilises
       // options used by maf_rm.cpp and associated modules
       Element_Count max_equations;
+      Element_Count pool_memory; // maximum pool size before spilling to disk
       unsigned min_time;
       unsigned timeout;
       unsigned max_time;
       unsigned strategy;
+      unsigned threads; // number of threads that may be used for KB,
+                        // for exploring the tree with automata, for
+                        // checking axioms, and for reducing lists of words
       Byte filters;
       Byte probe_style;
       Byte expansion_order;
@@ -630,6 +642,8 @@ class MAF : public Presentation
       // used by subpres.cpp
       bool eliminate;
       bool no_composite;
+      // used by maf.cpp
+      bool checkpoint; // true if the Rewriter_Machine is to be saved periodically
       Total_Length pool_above;
       Total_Length max_overlap_length;
       Word_Length no_pool_below;
@@ -638,11 +652,13 @@ class MAF : public Presentation
         log_flags(0),
         log_level(1),
         max_equations(0),
+        pool_memory(0),
         max_multiplier_attempts(10),
         max_time(0),
         min_time(0),
         timeout(20),
         strategy(~0u),
+        threads(1),
         filters(7),
         probe_style(BYTE_OPTION_UNSET),
         expansion_order(0),
@@ -657,6 +673,7 @@ class MAF : public Presentation
         special_overlaps(1),
         assume_confluent(false),
         check_inverses(false),
+        checkpoint(false),
         consider_secondary(false),
         dense_rm(false),
         detect_finite_index(false),
@@ -816,6 +833,9 @@ class MAF : public Presentation
   public:
     bool aborting;
     Options options;
+    Telemetry * telemetry; // 0 unless start_telemetry() has been called
+    // multiplier_cache is 0 unless start_multiplier_cache() has been called
+    Multiplier_Cache * multiplier_cache;
     const FSA_Buffer &fsas;
   public:
     static Container * create_container(Platform * platform = 0);
@@ -891,6 +911,21 @@ class MAF : public Presentation
        a Rewriter_Machine instance into one with one */
     APIMETHOD void realise_rm();
 
+    /* start_telemetry() arranges for a machine readable record of the
+       progress of Knuth-Bendix and automata construction to be written
+       to the specified file, at most every interval seconds.
+       See telemetry.h */
+    APIMETHOD bool start_telemetry(String filename,unsigned interval);
+
+    /* start_multiplier_cache() arranges for composite multipliers to be
+       kept in the specified directory, which must already exist, so that
+       later runs against the same multiplier can use them instead of
+       building them again. If max_megabytes is non-zero the least recently
+       used entries are deleted to keep the cache within that size.
+       See maf_mcache.h */
+    APIMETHOD bool start_multiplier_cache(String directory,
+                                          unsigned max_megabytes);
+
     /* grow_automata() works as follows:
        1) As many of the automata indicated by the value
           (save_flags | retain_flags)
@@ -932,7 +967,15 @@ class MAF : public Presentation
         return load_fsas(flags);
       return real_group_fsas.load(&container,original_filename,flags,false,this);
     }
-    APIMETHOD bool load_reduction_method(Group_Automaton_Type flag);
+    /* If use_trie is true and a rewriting system is selected, reduction
+       is performed by an Aho_Corasick_Reducer built from the equations,
+       rather than by the index automaton. Other methods ignore it.
+       If prefix_cache is non zero and a word-difference machine is
+       selected, the Diff_Reduce may use up to prefix_cache MB for a cache
+       of the states reached by the prefixes of the words it has reduced */
+    APIMETHOD bool load_reduction_method(Group_Automaton_Type flag,
+                                         bool use_trie = false,
+                                         unsigned prefix_cache = 0);
 
     Word_Reducer * take_word_reducer()
     {
@@ -991,6 +1034,10 @@ class MAF : public Presentation
     APIMETHOD void read_word_list(Word_List *wl,String filename) const;
     APIMETHOD bool reduce(String_Buffer * rword,String word) const;
     APIMETHOD unsigned reduce(Word * rword,const Word & word,unsigned flags = 0) const;
+    /* reduce_batch() reduces a list of words, using up to options.threads
+       threads if the word reducer supports this */
+    APIMETHOD void reduce_batch(Word_List * answers,const Word_List & words,
+                                unsigned flags = 0) const;
     APIMETHOD FSA_Simple *translate_acceptor(const MAF & maf_start,
                                              const FSA & fsa_start,
                                              const Word_List &xlat_wl) const;
@@ -1019,7 +1066,9 @@ class MAF : public Presentation
                                                   bool geodesic = false,
                                                   bool force_group_acceptor = false,
                                                   Word_Length max_context = 0,
-                                                  State_Count max_states = 0);
+                                                  State_Count max_states = 0,
+                                                  State_Count divergence_floor = 0,
+                                                  bool * truncated = 0);
     APIMETHOD FSA_Simple * build_acceptor_from_coset_table(const FSA & coset_table);
     APIMETHOD FSA_Simple * labelled_product_fsa(const FSA &fsa,
                                                 bool accept_only = false) const;
@@ -1054,6 +1103,13 @@ class MAF : public Presentation
         bool container_ours,const Options * options);
     // virtual method from Presentation we have to implement
     bool insert_axiom(const Word & lhs,const Word & rhs,unsigned flags);
+    /* maf.cpp. save_checkpoint() writes the state of the Rewriter_Machine
+       to the .kbckpt file, and restore_checkpoint() creates a new one
+       from it if there is a usable checkpoint */
+    void save_checkpoint();
+    bool restore_checkpoint();
+    // set_telemetry_phase() does nothing unless telemetry is wanted
+    void set_telemetry_phase(String phase);
 
     FSA_Simple * reducer(const General_Multiplier & multiplier,
                         const FSA & difference_machine,
@@ -1079,6 +1135,7 @@ class Multiplier : public Delegated_FSA
     mutable Word_Length max_depth;
     mutable Word_Length valid_length;
     mutable Node_List * stack;
+    mutable Unsigned_Long_Long content_fingerprint; // 0 until fingerprint() is called
   public:
     Multiplier(const Multiplier & other);
     Multiplier(FSA &other,bool owner_);
@@ -1152,6 +1209,9 @@ class Multiplier : public Delegated_FSA
     // Compute the multiplier for the inverses of the elements in this
     // multiplier
     FSA_Simple *inverse(const MAF &maf) const;
+    /* fingerprint() returns a hash of the contents of the multiplier,
+       which Multiplier_Cache uses to identify it */
+    Unsigned_Long_Long fingerprint() const;
   private:
     void set_multipliers();
 };
@@ -1169,6 +1229,22 @@ class General_Multiplier : public Multiplier
     ~General_Multiplier();
     bool label_for_generator(Label_ID label,Ordinal g) const;
     unsigned reduce(Word * answer,const Word & start_word,unsigned flags = 0) const;
+    /* reduce_batch() reduces a list of words, and adds the answers to
+       answers in the same order. The words are sorted first so that words
+       with a common prefix are reduced one after the other, and the
+       multiplier states reached by the prefix are reused. If nr_threads is
+       more than 1 the sorted list is divided among that many threads,
+       each of which uses its own copy of the multiplier. */
+    void reduce_batch(Word_List * answers,const Word_List & words,
+                      unsigned flags = 0,unsigned nr_threads = 1) const;
+    /* prefix_reduce() is the same as reduce(), except that path[i] holds
+       the state reached by the first i letters of start_word, for i up to
+       *known, and on exit *known has been changed to show how much of
+       path is now valid. path must have room for start_word.length()+1
+       states */
+    unsigned prefix_reduce(Word * answer,const Word & start_word,
+                           unsigned flags,State_ID * path,
+                           Word_Length * known) const;
   private:
     void set_multiplier_nrs();
 };
@@ -1185,6 +1261,11 @@ class GM_Reducer : public Word_Reducer
     {
       return gm.reduce(word,start_word,flags);
     }
+    void reduce_batch(Word_List * answers,const Word_List & words,
+                      unsigned flags,unsigned nr_threads)
+    {
+      gm.reduce_batch(answers,words,flags,nr_threads);
+    }
 };
 #endif
 
@@ -85,6 +85,7 @@ all: \
   $(BIN)/fsaandnot.exe \
   $(BIN)/fsabfs.exe \
   $(BIN)/fsacartesian.exe \
+  $(BIN)/fsacompile.exe \
   $(BIN)/fsacompose.exe \
   $(BIN)/fsaconcat.exe \
   $(BIN)/fsacount.exe \
@@ -143,6 +144,8 @@ all: \
   $(BIN)/makecosfile.exe  \
   $(BIN)/isconjugate.exe \
   $(BIN)/isnormal.exe \
+  $(BIN)/mafstat.exe \
+  $(BIN)/mafstress.exe \
   $(BIN)/simplify.exe \
   dummy
 
@@ -160,7 +163,7 @@ MAFLIB = \
   mafload.$O \
   mafread.$O \
   alphabet.$O \
-  maf_avl.$O \
+  maf_acr.$O \
   maf_cfp.$O \
   maf_dr.$O \
   maf_dt.$O \
@@ -168,12 +171,14 @@ MAFLIB = \
   maf_em.$O \
   maf_ew.$O \
   maf_jm.$O \
+  maf_mcache.$O \
   maf_mult.$O \
   maf_nm.$O \
   maf_rm.$O \
   maf_rws.$O \
   maf_spl.$O \
   maf_so.$O \
+  maf_spool.$O \
   maf_ss.$O \
   maf_sub.$O \
   maf_subwa.$O \
@@ -185,6 +190,10 @@ MAFLIB = \
   keyedfsa.$O \
   bitarray.$O \
   heap.$W \
+  mafthread.$W \
+  arena.$W \
+  checkpoint.$O \
+  telemetry.$O \
   rubik.$O \
   fsa.$O \
   mafauto.$O  \
@@ -292,6 +301,14 @@ FSAPRODUCT_EXE = \
 $(BIN)/fsaproduct.exe: $(FSAPRODUCT_EXE) 
 	$(LINK32) $(FSAPRODUCT_EXE) $(L32EXE) -out:$@ -map:$M 
 
+FSACOMPILE_EXE = \
+  fsacompile.$O \
+  fsacompile.rbj \
+  $(LIBS)
+
+$(BIN)/fsacompile.exe: $(FSACOMPILE_EXE) 
+	$(LINK32) $(FSACOMPILE_EXE) $(L32EXE) -out:$@ -map:$M 
+
 FSACOUNT_EXE = \
   fsacount.$O \
   fsacount.rbj \
@@ -758,6 +775,22 @@ SIMPLIFY_EXE = \
 $(BIN)/simplify.exe: $(SIMPLIFY_EXE) 
 	$(LINK32) $(SIMPLIFY_EXE) $(L32EXE) -out:$@ -map:$M 
 
+MAFSTAT_EXE = \
+  mafstat.$O \
+  mafstat.rbj \
+  $(LIBS)
+
+$(BIN)/mafstat.exe: $(MAFSTAT_EXE) 
+	$(LINK32) $(MAFSTAT_EXE) $(L32EXE) -out:$@ -map:$M 
+
+MAFSTRESS_EXE = \
+  mafstress.$O \
+  mafstress.rbj \
+  $(LIBS)
+
+$(BIN)/mafstress.exe: $(MAFSTRESS_EXE) 
+	$(LINK32) $(MAFSTRESS_EXE) $(L32EXE) -out:$@ -map:$M 
+
 STARTUP = \
   CRT0TCON.$W \
   CRT0TWIN.$W \
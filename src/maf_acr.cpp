@@ -0,0 +1,356 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: maf_acr.cpp $
+//
+
+/* Implementation of the class declared in maf_acr.h */
+
+#include <string.h>
+#include "awcc.h"
+#include "maf.h"
+#include "hash.h"
+#include "mafword.h"
+#include "maf_rws.h"
+#include "maf_acr.h"
+#include "container.h"
+
+/**/
+
+Aho_Corasick_Reducer::Aho_Corasick_Reducer(const Rewriting_System & rws_) :
+  rws(rws_),
+  base(0),
+  check(0),
+  fail(0),
+  match(0),
+  array_size(0),
+  nr_nodes(1),
+  state(0),
+  max_state(0),
+  input(0),
+  max_input(0)
+{
+  Container & container = rws.container;
+  const Ordinal nr_symbols = rws.base_alphabet.letter_count();
+  const State_Count nr_equations = rws.equation_count();
+  Ordinal_Word lhs(rws.base_alphabet);
+
+  /* First build an ordinary trie, in which the children of each node are
+     kept in a list, since we cannot place a node in the double array until
+     we know all its children. */
+  Total_Length total_length = 1;
+  Element_ID eqn_nr;
+  for (eqn_nr = 1; eqn_nr < nr_equations;eqn_nr++)
+    total_length += rws.lhs_length(eqn_nr);
+  State_ID * first_child = new State_ID[total_length];
+  State_ID * next_sibling = new State_ID[total_length];
+  Ordinal * letter = new Ordinal[total_length];
+  Element_ID * terminal = new Element_ID[total_length];
+  first_child[0] = 0;
+  terminal[0] = 0;
+  for (eqn_nr = 1; eqn_nr < nr_equations;eqn_nr++)
+  {
+    Word_Length l = rws.read_lhs(&lhs,eqn_nr);
+    const Ordinal * values = lhs.buffer();
+    State_ID ni = 0;
+    for (Word_Length i = 0; i < l;i++)
+    {
+      State_ID ci = first_child[ni];
+      while (ci && letter[ci] != values[i])
+        ci = next_sibling[ci];
+      if (!ci)
+      {
+        ci = State_ID(nr_nodes++);
+        letter[ci] = values[i];
+        first_child[ci] = 0;
+        terminal[ci] = 0;
+        next_sibling[ci] = first_child[ni];
+        first_child[ni] = ci;
+      }
+      ni = ci;
+    }
+    terminal[ni] = eqn_nr;
+    if (!(char) eqn_nr)
+      container.status(2,1,"Building trie (" FMT_ID " of " FMT_ID ")\n",
+                       eqn_nr,nr_equations-1);
+  }
+
+  /* Now place the nodes in the double array in breadth first order.
+     This means that when we come to place the children of a node, every
+     node nearer the root has already been placed, so we can compute the
+     failure links of the children using new_state() */
+  State_ID * position = new State_ID[nr_nodes];
+  State_ID * queue = new State_ID[nr_nodes];
+  State_Count head = 0;
+  State_Count tail = 0;
+  grow(State_ID(nr_nodes) + nr_symbols);
+  position[0] = 0;
+  check[0] = 0;
+  base[0] = 1;
+  queue[tail++] = 0;
+  State_ID first_free = 1;
+  while (head < tail)
+  {
+    State_ID ni = queue[head++];
+    State_ID si = position[ni];
+    if (!first_child[ni])
+      continue;
+    Ordinal low = nr_symbols;
+    State_ID ci;
+    for (ci = first_child[ni]; ci;ci = next_sibling[ci])
+      if (letter[ci] < low)
+        low = letter[ci];
+    while (first_free < array_size && check[first_free] != -1)
+      first_free++;
+    /* Look for a base at which all the children land on unused positions.
+       base[] must be at least 1, so that the root is never mistaken for
+       a child of itself */
+    State_ID b = 0;
+    for (State_ID p = first_free;;p++)
+    {
+      grow(p + nr_symbols);
+      if (check[p] != -1 || p - low < 1)
+        continue;
+      b = p - low;
+      for (ci = first_child[ni]; ci;ci = next_sibling[ci])
+        if (check[b+letter[ci]] != -1)
+          break;
+      if (!ci)
+        break;
+    }
+    base[si] = b;
+    for (ci = first_child[ni]; ci;ci = next_sibling[ci])
+    {
+      State_ID ti = position[ci] = b + letter[ci];
+      check[ti] = si;
+      queue[tail++] = ci;
+    }
+    for (ci = first_child[ni]; ci;ci = next_sibling[ci])
+    {
+      State_ID ti = position[ci];
+      fail[ti] = si ? new_state(fail[si],letter[ci]) : 0;
+      match[ti] = terminal[ci] ? terminal[ci] : match[fail[ti]];
+    }
+    if (!(char) head)
+      container.status(2,1,"Building failure links (" FMT_NC " of " FMT_NC
+                       ")\n",head,nr_nodes);
+  }
+  delete [] queue;
+  delete [] position;
+  delete [] terminal;
+  delete [] letter;
+  delete [] next_sibling;
+  delete [] first_child;
+}
+
+/**/
+
+Aho_Corasick_Reducer::~Aho_Corasick_Reducer()
+{
+  delete [] base;
+  delete [] check;
+  delete [] fail;
+  delete [] match;
+  if (state)
+    delete [] state;
+  if (input)
+    delete [] input;
+}
+
+/**/
+
+void Aho_Corasick_Reducer::grow(State_ID needed)
+{
+  /* Ensure that position needed exists in the double array */
+  if (needed < array_size)
+    return;
+  State_ID new_size = array_size ? array_size*2 : 256;
+  if (new_size <= needed)
+    new_size = needed+1;
+  State_ID * new_base = new State_ID[new_size];
+  State_ID * new_check = new State_ID[new_size];
+  State_ID * new_fail = new State_ID[new_size];
+  Element_ID * new_match = new Element_ID[new_size];
+  if (array_size)
+  {
+    memcpy(new_base,base,array_size*sizeof(State_ID));
+    memcpy(new_check,check,array_size*sizeof(State_ID));
+    memcpy(new_fail,fail,array_size*sizeof(State_ID));
+    memcpy(new_match,match,array_size*sizeof(Element_ID));
+    delete [] base;
+    delete [] check;
+    delete [] fail;
+    delete [] match;
+  }
+  for (State_ID i = array_size; i < new_size;i++)
+  {
+    new_base[i] = 0;
+    new_check[i] = -1;
+    new_fail[i] = 0;
+    new_match[i] = 0;
+  }
+  base = new_base;
+  check = new_check;
+  fail = new_fail;
+  match = new_match;
+  array_size = new_size;
+}
+
+/**/
+
+void Aho_Corasick_Reducer::reserve_input(Total_Length needed)
+{
+  if (needed <= max_input)
+    return;
+  if (needed > MAX_WORD)
+    MAF_INTERNAL_ERROR(rws.container,
+                       ("Maximum word length exceeded in"
+                        " Aho_Corasick_Reducer::reduce()\n"));
+  Total_Length new_size = max_input ? max_input*2 : 64;
+  if (new_size < needed)
+    new_size = needed;
+  if (new_size > MAX_WORD)
+    new_size = MAX_WORD;
+  Ordinal * new_input = new Ordinal[new_size];
+  if (input)
+  {
+    memcpy(new_input,input,max_input*sizeof(Ordinal));
+    delete [] input;
+  }
+  input = new_input;
+  max_input = Word_Length(new_size);
+}
+
+/**/
+
+unsigned Aho_Corasick_Reducer::reduce(Word * word,const Word & start_word,
+                                      unsigned flags,const FSA *)
+{
+  /* Letters are read from the input stack if it is not empty, and
+     otherwise from the unread part of the word. As long as the RHS of
+     the equations used are no longer than their LHS the output can never
+     catch up with the unread part of the word, so the word can be reduced
+     in place. When a longer RHS is pushed the unread part of the word is
+     moved onto the input stack beneath it first. */
+  unsigned retcode = 0;
+  Word_Length length = start_word.length();
+  if (!length)
+    return 0;
+  if (!state || max_state < length)
+  {
+    if (state)
+      delete [] state;
+    state = new State_ID[(max_state = length)+1];
+  }
+
+  if (word != &start_word)
+  {
+    word->set_length(length);
+    word_copy(*word,start_word,length);
+  }
+  Ordinal * values = word->buffer();
+  Ordinal rvalue = PADDING_SYMBOL; // Initialised to shut up the compiler
+  Word_Length max_length = MAX_WORD;
+  Word_Length allocated = length;
+  if (flags & WR_PREFIX_ONLY)
+  {
+    rvalue = values[--length];
+    max_length--;
+  }
+  Total_Length total_length = length;
+  Word_Length read_pos = 0;
+  Word_Length valid_length = 0;
+  Word_Length input_top = 0;
+  Ordinal_Word rhs_word(rws.base_alphabet);
+  Element_ID eqn_nr = 0;
+  bool reducing = true;
+  state[0] = 0;
+
+  for (;;)
+  {
+    Ordinal g;
+    if (input_top)
+      g = input[--input_top];
+    else if (read_pos < length)
+      g = values[read_pos++];
+    else
+      break;
+    if (valid_length >= allocated)
+    {
+      /* This can only happen once the unread part of the word is on the
+         input stack */
+      if (valid_length == max_length)
+        MAF_INTERNAL_ERROR(rws.container,
+                           ("Maximum word length exceeded in"
+                            " Aho_Corasick_Reducer::reduce()\n"));
+      word->allocate(allocated = total_length > MAX_WORD ? MAX_WORD :
+                                 Word_Length(total_length),true);
+      values = word->buffer();
+    }
+    if (valid_length == max_state)
+    {
+      Word_Length new_max = max_state < MAX_WORD/2 ? max_state*2 : MAX_WORD;
+      State_ID * new_stack = new State_ID[new_max+1];
+      memcpy(new_stack,state,(valid_length+1)*sizeof(State_ID));
+      delete [] state;
+      state = new_stack;
+      max_state = new_max;
+    }
+    values[valid_length] = g;
+    State_ID si = reducing ? new_state(state[valid_length],g) : 0;
+    state[++valid_length] = si;
+    Element_ID e = match[si];
+    if (e)
+    {
+      if (flags & WR_CHECK_ONLY)
+        return 1;
+      if (eqn_nr != e)
+      {
+        eqn_nr = e;
+        rws.read_rhs(&rhs_word,eqn_nr);
+      }
+      Word_Length lhs_length = rws.lhs_length(eqn_nr);
+      Word_Length rhs_length = rhs_word.length();
+      valid_length -= lhs_length;
+      total_length += rhs_length - lhs_length;
+      if (rhs_length > lhs_length && read_pos < length)
+      {
+        /* The unread part of the word follows anything still on the
+           input stack, so it has to go underneath it */
+        Word_Length tail = length - read_pos;
+        reserve_input(input_top + tail);
+        memmove(input+tail,input,input_top*sizeof(Ordinal));
+        for (Word_Length i = 0; i < tail;i++)
+          input[i] = values[length-1-i];
+        input_top += tail;
+        length = read_pos;
+      }
+      reserve_input(input_top + rhs_length);
+      const Ordinal * rvalues = rhs_word.buffer();
+      for (Word_Length i = rhs_length; i > 0;)
+        input[input_top++] = rvalues[--i];
+      retcode++;
+      if (flags & WR_ONCE)
+        reducing = false;
+    }
+  }
+
+  word->set_length(valid_length);
+  if (flags & WR_PREFIX_ONLY)
+    word->append(rvalue);
+  return retcode;
+}
@@ -0,0 +1,106 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: maf_acr.h $
+*/
+#pragma once
+#ifndef MAF_ACR_INCLUDED
+#define MAF_ACR_INCLUDED 1
+
+/* Aho_Corasick_Reducer is a Word_Reducer that works from the equations
+   of a Rewriting_System alone, and does not use the index automaton at all.
+   As the comment in maf_rws.h points out, the .reduce file is superfluous
+   since everything needed for reduction is present in the .kbprog file.
+
+   The LHS of the equations are compiled into a trie, which is stored as a
+   "double array": a node s has its child on letter g at position
+   base[s]+g, which belongs to s only if check[base[s]+g] == s. This
+   needs only two numbers per node however many generators there are,
+   whereas the index automaton needs a transition for every generator at
+   every state. Each node also has a failure link to the node for the
+   longest proper suffix of its word that is also in the trie, as in the
+   Aho-Corasick algorithm, and the number of the equation whose LHS is the
+   longest suffix of its word, if there is one.
+
+   Reduction is done in a single left to right pass. The trie node reached
+   after each letter of the output is kept on a stack, and when an LHS is
+   found the RHS is pushed back onto the input, so after a replacement we
+   resume from the node we were at before the LHS was read, and never
+   rescan the word. This is the same method RWS_Reducer uses, but here the
+   RHS is always put back onto the input, so reductions that increase the
+   length of the word need no special treatment.
+
+   If the rewriting system is confluent the results are identical to those
+   from RWS_Reducer, including the individual steps when WR_ONCE is used,
+   because the same equation is found at the same position. */
+
+#ifndef MAF_INCLUDED
+#include "maf.h"
+#endif
+
+// Classes referred to but defined elsewhere
+class Rewriting_System;
+
+class Aho_Corasick_Reducer : public Word_Reducer
+{
+  BLOCKED(Aho_Corasick_Reducer)
+  private:
+    const Rewriting_System & rws;
+    State_ID * base;
+    State_ID * check;    // parent of each node, or -1 if position is unused
+    State_ID * fail;
+    Element_ID * match;  // equation for longest LHS ending here, or 0
+    State_ID array_size;
+    State_Count nr_nodes;
+    // work areas for reduce()
+    State_ID * state;
+    Word_Length max_state;
+    Ordinal * input;
+    Word_Length max_input;
+  public:
+    Aho_Corasick_Reducer(const Rewriting_System & rws_);
+    ~Aho_Corasick_Reducer();
+    unsigned reduce(Word * word,const Word & start_word,
+                    unsigned flags = 0,const FSA * wa = 0);
+    State_Count node_count() const
+    {
+      return nr_nodes;
+    }
+    // size() returns the number of positions in the double array
+    State_ID size() const
+    {
+      return array_size;
+    }
+  private:
+    State_ID new_state(State_ID si,Ordinal g) const
+    {
+      for (;;)
+      {
+        State_ID ti = base[si] + g;
+        if (ti < array_size && check[ti] == si)
+          return ti;
+        if (!si)
+          return 0;
+        si = fail[si];
+      }
+    }
+    void grow(State_ID needed);
+    void reserve_input(Total_Length needed);
+};
+
+#endif
@@ -0,0 +1,414 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: maf_btree.h $
+*/
+#pragma once
+#ifndef MAF_BTREE_INCLUDED
+#define MAF_BTREE_INCLUDED 1
+#ifndef MAFBASE_INCLUDED
+#include "mafbase.h"
+#endif
+
+/**
+The B_Tree class implements an ordered collection of items of type T.
+To use it you derive a class from it that implements compare(), and then
+call insert(), remove() and pluck_first(). It is the caller's
+responsibility to ensure that data in the tree remains valid, and that its
+key does not change, for as long as it is in the tree, and that an item is
+not inserted if an equal item is already present.
+
+The items are kept in pages of up to MAX_ITEMS items, so that the space
+needed is 4-8 bytes for each item rather than the 24 or so needed for a
+node of a binary tree on a 64-bit machine, and an ordered walk through the
+tree touches far fewer cache lines.
+
+This is a classic B-tree, in which branch pages also hold items, rather
+than a B+-tree in which branch pages hold copies of keys. The reason is that
+compare() is normally implemented by looking at the object an item refers
+to. In a B+-tree the copy of a key in a branch page can outlive the item it
+was copied from, and then compare() would look at an object that might not
+exist any more.
+**/
+
+template<class T> class B_Tree
+{
+  private:
+    enum
+    {
+      MIN_ITEMS = 15,
+      MAX_ITEMS = MIN_ITEMS*2+1
+    };
+    struct Leaf
+    {
+      int count;
+      T item[MAX_ITEMS+1]; // The extra item is needed while a page is split
+    };
+    struct Branch : Leaf
+    {
+      Leaf * child[MAX_ITEMS+2];
+    };
+    Leaf * root;
+    int height;     // number of levels of branches above the leaves
+    State_Count nr_items;
+    T work;
+
+    /* compare must return 1,0,-1 according to whether
+       d1 > d2, d1 == d2, d1 < d2 */
+    virtual int compare(T d1, T d2) const = 0;
+
+  public:
+    B_Tree() :
+      root(0),
+      height(0),
+      nr_items(0)
+    {}
+    virtual ~B_Tree()
+    {
+      empty();
+    }
+    State_Count node_count() const
+    {
+      return nr_items;
+    }
+    State_Count depth() const
+    {
+      return root ? height+1 : 0;
+    }
+    void empty()
+    {
+      if (root)
+        free_page(root,height);
+      root = 0;
+      height = 0;
+      nr_items = 0;
+    }
+    bool insert(T t)
+    {
+      work = t;
+      return insert(false);
+    }
+    bool remove(T t)
+    {
+      work = t;
+      if (!root || !remove_from(root,height))
+        return false;
+      nr_items--;
+      shrink();
+      return true;
+    }
+    T pluck_first()
+    {
+      if (nr_items)
+      {
+        work = remove_first(root,height);
+        nr_items--;
+        shrink();
+      }
+      else
+        work = T(0);
+      return work;
+    }
+    /* copy_in_order() copies the data into buffer, which must have room
+       for node_count() items, in order.
+       load_in_order() fills an empty tree from data already in order,
+       without calling compare() */
+    void copy_in_order(T * buffer) const
+    {
+      if (root)
+        copy_page(root,height,buffer);
+    }
+    void load_in_order(const T * buffer,State_Count count)
+    {
+      empty();
+      for (State_Count i = 0; i < count;i++)
+      {
+        work = buffer[i];
+        insert(true);
+      }
+    }
+  private:
+    /* find() returns the position of work in page, or the position of
+       the child that would contain it */
+    int find(const Leaf * page,bool * found) const
+    {
+      int low = 0;
+      int high = page->count;
+      while (low < high)
+      {
+        int mid = (low+high)/2;
+        int c = compare(work,page->item[mid]);
+        if (c == 0)
+        {
+          *found = true;
+          return mid;
+        }
+        if (c < 0)
+          high = mid;
+        else
+          low = mid+1;
+      }
+      *found = false;
+      return low;
+    }
+
+    bool insert(bool append)
+    {
+      if (!root)
+      {
+        root = new Leaf;
+        root->count = 0;
+      }
+      bool inserted = false;
+      T median;
+      Leaf * right = insert_into(root,height,append,&inserted,&median);
+      if (right)
+      {
+        Branch * new_root = new Branch;
+        new_root->count = 1;
+        new_root->item[0] = median;
+        new_root->child[0] = root;
+        new_root->child[1] = right;
+        root = new_root;
+        height++;
+      }
+      if (inserted)
+        nr_items++;
+      return inserted;
+    }
+
+    /* insert_into() inserts work into the subtree at page. If page
+       overflows it is split, and the new page that should follow it is
+       returned with *median set to the item that separates the two */
+    Leaf * insert_into(Leaf * page,int level,bool append,bool * inserted,
+                       T * median)
+    {
+      bool found = false;
+      int i = append ? page->count : find(page,&found);
+      if (found)
+        return 0;
+      T new_item = work;
+      Leaf * new_child = 0;
+      if (level)
+      {
+        new_child = insert_into(((Branch *) page)->child[i],level-1,append,
+                                inserted,&new_item);
+        if (!new_child)
+          return 0;
+      }
+      else
+        *inserted = true;
+      for (int j = page->count; j > i;j--)
+        page->item[j] = page->item[j-1];
+      page->item[i] = new_item;
+      if (level)
+      {
+        Branch * branch = (Branch *) page;
+        for (int j = page->count+1; j > i+1;j--)
+          branch->child[j] = branch->child[j-1];
+        branch->child[i+1] = new_child;
+      }
+      if (++page->count <= MAX_ITEMS)
+        return 0;
+
+      /* The page has overflowed, so split it in two */
+      int keep = page->count/2;
+      int moved = page->count - keep - 1;
+      Leaf * right = level ? new Branch : new Leaf;
+      *median = page->item[keep];
+      for (int j = 0; j < moved;j++)
+        right->item[j] = page->item[keep+1+j];
+      if (level)
+        for (int j = 0; j <= moved;j++)
+          ((Branch *) right)->child[j] = ((Branch *) page)->child[keep+1+j];
+      right->count = moved;
+      page->count = keep;
+      return right;
+    }
+
+    /* remove_from() removes work from the subtree at page, and returns
+       true if it was there. The caller must repair page if it has
+       become too small */
+    bool remove_from(Leaf * page,int level)
+    {
+      bool found;
+      int i = find(page,&found);
+      if (!level)
+      {
+        if (!found)
+          return false;
+        remove_item(page,i);
+        return true;
+      }
+      Branch * branch = (Branch *) page;
+      if (found)
+        branch->item[i] = remove_last(branch->child[i],level-1);
+      else if (!remove_from(branch->child[i],level-1))
+        return false;
+      if (branch->child[i]->count < MIN_ITEMS)
+        fix_child(branch,i,level);
+      return true;
+    }
+
+    T remove_first(Leaf * page,int level)
+    {
+      if (!level)
+      {
+        T answer = page->item[0];
+        remove_item(page,0);
+        return answer;
+      }
+      Branch * branch = (Branch *) page;
+      T answer = remove_first(branch->child[0],level-1);
+      if (branch->child[0]->count < MIN_ITEMS)
+        fix_child(branch,0,level);
+      return answer;
+    }
+
+    T remove_last(Leaf * page,int level)
+    {
+      if (!level)
+        return page->item[--page->count];
+      Branch * branch = (Branch *) page;
+      int i = branch->count;
+      T answer = remove_last(branch->child[i],level-1);
+      if (branch->child[i]->count < MIN_ITEMS)
+        fix_child(branch,i,level);
+      return answer;
+    }
+
+    // remove_item() removes an item from a leaf
+    static void remove_item(Leaf * page,int i)
+    {
+      page->count--;
+      for (int j = i; j < page->count;j++)
+        page->item[j] = page->item[j+1];
+    }
+
+    /* fix_child() is called when child i of branch has too few items.
+       It either moves an item across from a neighbouring page, or merges
+       the child with one of its neighbours */
+    void fix_child(Branch * branch,int i,int level)
+    {
+      Leaf * child = branch->child[i];
+      bool child_is_branch = level > 1;
+      if (i > 0 && branch->child[i-1]->count > MIN_ITEMS)
+      {
+        Leaf * left = branch->child[i-1];
+        for (int j = child->count; j > 0;j--)
+          child->item[j] = child->item[j-1];
+        child->item[0] = branch->item[i-1];
+        if (child_is_branch)
+        {
+          Branch * c = (Branch *) child;
+          for (int j = child->count+1; j > 0;j--)
+            c->child[j] = c->child[j-1];
+          c->child[0] = ((Branch *) left)->child[left->count];
+        }
+        branch->item[i-1] = left->item[left->count-1];
+        left->count--;
+        child->count++;
+      }
+      else if (i < branch->count && branch->child[i+1]->count > MIN_ITEMS)
+      {
+        Leaf * right = branch->child[i+1];
+        child->item[child->count] = branch->item[i];
+        branch->item[i] = right->item[0];
+        for (int j = 0; j+1 < right->count;j++)
+          right->item[j] = right->item[j+1];
+        if (child_is_branch)
+        {
+          Branch * r = (Branch *) right;
+          ((Branch *) child)->child[child->count+1] = r->child[0];
+          for (int j = 0; j < right->count;j++)
+            r->child[j] = r->child[j+1];
+        }
+        right->count--;
+        child->count++;
+      }
+      else
+      {
+        /* Neither neighbour can spare an item, so the child and one of
+           them will fit in a single page */
+        if (i == branch->count)
+          i--;
+        Leaf * left = branch->child[i];
+        Leaf * right = branch->child[i+1];
+        left->item[left->count] = branch->item[i];
+        for (int j = 0; j < right->count;j++)
+          left->item[left->count+1+j] = right->item[j];
+        if (child_is_branch)
+        {
+          for (int j = 0; j <= right->count;j++)
+            ((Branch *) left)->child[left->count+1+j] = ((Branch *) right)->child[j];
+        }
+        left->count += right->count+1;
+        if (child_is_branch)
+          delete (Branch *) right;
+        else
+          delete right;
+        for (int j = i; j+1 < branch->count;j++)
+        {
+          branch->item[j] = branch->item[j+1];
+          branch->child[j+1] = branch->child[j+2];
+        }
+        branch->count--;
+      }
+    }
+
+    // shrink() removes the root page if it has become empty
+    void shrink()
+    {
+      if (!nr_items)
+        empty();
+      else if (height && !root->count)
+      {
+        Leaf * old_root = root;
+        root = ((Branch *) old_root)->child[0];
+        delete (Branch *) old_root;
+        height--;
+      }
+    }
+
+    T * copy_page(const Leaf * page,int level,T * buffer) const
+    {
+      for (int i = 0; i <= page->count;i++)
+      {
+        if (level)
+          buffer = copy_page(((const Branch *) page)->child[i],level-1,buffer);
+        if (i < page->count)
+          *buffer++ = page->item[i];
+      }
+      return buffer;
+    }
+
+    void free_page(Leaf * page,int level)
+    {
+      if (level)
+      {
+        Branch * branch = (Branch *) page;
+        for (int i = 0; i <= branch->count;i++)
+          free_page(branch->child[i],level-1);
+        delete branch;
+      }
+      else
+        delete page;
+    }
+};
+
+#endif
@@ -972,10 +972,10 @@ size_t Sparse_Function_Packer::pack(const State_ID * key)
       {
         bool complete = true;
         if (available >= bits_per_state)
-          current |= key[i] << (available -= bits_per_state);
+          current |= (unsigned long) key[i] << (available -= bits_per_state);
         else
         {
-          current |= key[i] >> (bits_per_state - available);
+          current |= (unsigned long) key[i] >> (bits_per_state - available);
           available -= bits_per_state;
           complete = false;
         }
@@ -986,7 +986,7 @@ size_t Sparse_Function_Packer::pack(const State_ID * key)
           available += CHAR_BIT;
         }
         if (!complete)
-          current |= key[i] << available;
+          current |= (unsigned long) key[i] << available;
         *start += 1;
         if (++i == nr_elements || *start == UCHAR_MAX)
           break;
@@ -161,6 +161,39 @@ struct Diff_Reduce::Node_List
   }
 };
 
+/* The prefix cache is a trie whose entries each hold a copy of one level
+   of the stack. Entry 1 is the root for ordinary words and entry 2 the root
+   for coset words, which start from all the initial states, and neither
+   root holds a level, since the first level of the stack is always set up
+   afresh. A level is only stored if it was completed, so a level that was
+   cut short by a reduction never gets into the cache. Since each level
+   depends only on the one before and the next letter of the word, a level
+   can be copied from the cache whenever the entry for its parent is known.
+
+   Entries other than the roots are kept on a list in order of use. Only
+   entries without children are discarded, so that the ancestors of every
+   entry are always present. */
+
+const Element_ID CACHE_GROUP_ROOT = 1;
+const Element_ID CACHE_COSET_ROOT = 2;
+
+struct Diff_Reduce::Cache_Entry
+{
+  Element_ID parent;
+  Element_ID first_child;
+  Element_ID next_sibling; /* also used to link unused entries */
+  Element_ID lru_prev;     /* towards the most recently used entry */
+  Element_ID lru_next;
+  Node * node;
+  State_Count nr_nodes;
+  Word_Length level;
+  Ordinal lvalue;
+  size_t size() const
+  {
+    return sizeof(Cache_Entry) + nr_nodes*sizeof(Node);
+  }
+};
+
 /**/
 
 Diff_Reduce::Diff_Reduce(const FSA * difference_machine) :
@@ -174,7 +207,17 @@ Diff_Reduce::Diff_Reduce(const FSA * difference_machine) :
   equality_si(difference_machine->accepting_state()),
   initial_si(difference_machine->initial_state()),
   is_right_shortlex(difference_machine->base_alphabet.order_type() == WO_Right_Shortlex),
-  is_shortlex(is_right_shortlex || difference_machine->base_alphabet.order_is_effectively_shortlex())
+  is_shortlex(is_right_shortlex || difference_machine->base_alphabet.order_is_effectively_shortlex()),
+  cache(0),
+  cache_path(0),
+  cache_allocated(0),
+  cache_free(0),
+  lru_head(0),
+  lru_tail(0),
+  cache_limit(0),
+  cache_used(0),
+  nr_cache_hits(0),
+  nr_cache_misses(0)
 {
   can_lengthen = !is_shortlex && !dm.base_alphabet.order_is_geodesic();
   if (dm.alphabet_size() != dm.base_alphabet.product_alphabet_size() ||
@@ -187,12 +230,17 @@ Diff_Reduce::Diff_Reduce(const FSA * difference_machine) :
 
 Diff_Reduce::~Diff_Reduce()
 {
+  if (nr_cache_hits || nr_cache_misses)
+    dm.container.progress(2,"Prefix cache: " FMT_NC " hits, " FMT_NC
+                          " misses\n",nr_cache_hits,nr_cache_misses);
+  set_prefix_cache(0);
   if (max_depth)
   {
     for (Word_Length i = 0; i < max_depth;i++)
       if (stack[i].node)
         delete [] stack[i].node;
     delete [] stack;
+    delete [] cache_path;
     if (seen)
       delete [] seen;
     if (seen_at)
@@ -210,6 +258,253 @@ void Diff_Reduce::invalidate()
      changes have occurred since the last call to reduce().
      This is mainly for use by Strong_Diff_Reduce() */
   valid_length = dm.has_multiple_initial_states() ? INVALID_LENGTH : 0;
+  clear_prefix_cache();
+}
+
+/**/
+
+void Diff_Reduce::invalidate(const unsigned * change_time,unsigned since)
+{
+  /* stack[i+1] is computed from the transitions of the states in
+     stack[i], and only stack[0] to stack[valid_length] are up to date. So if
+     stack[i] is the first level that contains a changed state we set
+     valid_length to i. That keeps stack[i] itself, which is still right,
+     because only the transitions out of its states have changed, and
+     discards the levels computed from them.
+     We don't try to be clever when there are several initial states,
+     since a change may affect which states are initial. Nor do we try
+     to be clever with the prefix cache, which is simply emptied. */
+  clear_prefix_cache();
+  if (valid_length == INVALID_LENGTH)
+    return;
+  if (dm.has_multiple_initial_states())
+  {
+    invalidate();
+    return;
+  }
+  for (Word_Length i = 0; i < valid_length;i++)
+  {
+    const Node_List & level = stack[i];
+    for (State_Count j = 0; j < level.nr_nodes;j++)
+      if (change_time[level.node[j].dm_si] > since)
+      {
+        valid_length = i;
+        return;
+      }
+  }
+}
+
+/**/
+
+void Diff_Reduce::set_prefix_cache(size_t max_bytes)
+{
+  clear_prefix_cache();
+  cache_limit = max_bytes;
+  if (!max_bytes)
+  {
+    if (cache)
+    {
+      delete [] cache;
+      cache = 0;
+      cache_allocated = 0;
+      cache_free = 0;
+    }
+    return;
+  }
+  if (!cache)
+  {
+    cache_allocated = 64;
+    cache = new Cache_Entry[cache_allocated];
+    for (Element_ID i = 0; i < Element_ID(cache_allocated);i++)
+      cache[i].node = 0;
+    clear_prefix_cache();
+  }
+}
+
+/**/
+
+void Diff_Reduce::clear_prefix_cache()
+{
+  if (!cache)
+    return;
+  cache_free = 0;
+  for (Element_ID i = Element_ID(cache_allocated); i-- > 0;)
+  {
+    Cache_Entry & entry = cache[i];
+    if (entry.node)
+    {
+      delete [] entry.node;
+      entry.node = 0;
+    }
+    entry.first_child = 0;
+    if (i > CACHE_COSET_ROOT)
+    {
+      entry.next_sibling = cache_free;
+      cache_free = i;
+    }
+  }
+  cache[CACHE_GROUP_ROOT].level = cache[CACHE_COSET_ROOT].level = 0;
+  lru_head = lru_tail = 0;
+  cache_used = 0;
+  for (Word_Length i = 0; i < max_depth;i++)
+    cache_path[i] = 0;
+}
+
+/**/
+
+Element_ID Diff_Reduce::new_cache_entry()
+{
+  if (!cache_free)
+  {
+    Element_Count new_allocated = cache_allocated*2;
+    Cache_Entry * new_cache = new Cache_Entry[new_allocated];
+    memcpy(new_cache,cache,cache_allocated*sizeof(Cache_Entry));
+    for (Element_ID i = Element_ID(new_allocated); i-- > Element_ID(cache_allocated);)
+    {
+      new_cache[i].node = 0;
+      new_cache[i].next_sibling = cache_free;
+      cache_free = i;
+    }
+    delete [] cache;
+    cache = new_cache;
+    cache_allocated = new_allocated;
+  }
+  Element_ID entry = cache_free;
+  cache_free = cache[entry].next_sibling;
+  cache[entry].first_child = 0;
+  cache[entry].lru_prev = cache[entry].lru_next = 0;
+  return entry;
+}
+
+/**/
+
+void Diff_Reduce::free_cache_entry(Element_ID entry)
+{
+  /* Discards an entry which has no children */
+  Cache_Entry & e = cache[entry];
+  Element_ID * link = &cache[e.parent].first_child;
+  while (*link != entry)
+    link = &cache[*link].next_sibling;
+  *link = e.next_sibling;
+  if (e.lru_prev)
+    cache[e.lru_prev].lru_next = e.lru_next;
+  else
+    lru_head = e.lru_next;
+  if (e.lru_next)
+    cache[e.lru_next].lru_prev = e.lru_prev;
+  else
+    lru_tail = e.lru_prev;
+  if (e.level < max_depth && cache_path[e.level] == entry)
+    cache_path[e.level] = 0;
+  cache_used -= e.size();
+  delete [] e.node;
+  e.node = 0;
+  e.next_sibling = cache_free;
+  cache_free = entry;
+}
+
+/**/
+
+void Diff_Reduce::use_cache_entry(Element_ID entry)
+{
+  /* Moves an entry to the front of the list of entries in order of use */
+  Cache_Entry & e = cache[entry];
+  if (lru_head == entry)
+    return;
+  if (e.lru_prev)
+  {
+    cache[e.lru_prev].lru_next = e.lru_next;
+    if (e.lru_next)
+      cache[e.lru_next].lru_prev = e.lru_prev;
+    else
+      lru_tail = e.lru_prev;
+  }
+  e.lru_prev = 0;
+  e.lru_next = lru_head;
+  if (lru_head)
+    cache[lru_head].lru_prev = entry;
+  else
+    lru_tail = entry;
+  lru_head = entry;
+}
+
+/**/
+
+bool Diff_Reduce::restore_level(Word_Length level,Ordinal lvalue)
+{
+  /* Sets stack[level+1] from the cache if the level for lvalue following
+     the prefix of stack[level] is present */
+  Element_ID entry = cache_path[level];
+  if (entry)
+    for (entry = cache[entry].first_child; entry;
+         entry = cache[entry].next_sibling)
+      if (cache[entry].lvalue == lvalue)
+        break;
+  if (!entry)
+  {
+    nr_cache_misses++;
+    return false;
+  }
+  const Cache_Entry & e = cache[entry];
+  Node_List & next = stack[level+1];
+  if (next.nr_allocated < e.nr_nodes)
+  {
+    if (next.node)
+      delete [] next.node;
+    next.node = new Node[next.nr_allocated = e.nr_nodes];
+  }
+  memcpy(next.node,e.node,e.nr_nodes*sizeof(Node));
+  next.nr_nodes = e.nr_nodes;
+  next.lvalue = lvalue;
+  cache_path[level+1] = entry;
+  use_cache_entry(entry);
+  nr_cache_hits++;
+  return true;
+}
+
+/**/
+
+void Diff_Reduce::save_level(Word_Length level)
+{
+  /* Copies the newly completed stack[level] into the cache, discarding
+     entries as needed to keep within the limit */
+  Element_ID parent = cache_path[level-1];
+  const Node_List & current = stack[level];
+  size_t size = sizeof(Cache_Entry) + current.nr_nodes*sizeof(Node);
+  cache_path[level] = 0;
+  if (!parent || size > cache_limit)
+    return;
+  if (parent > CACHE_COSET_ROOT)
+    use_cache_entry(parent);
+  while (cache_used + size > cache_limit)
+  {
+    /* The entries with children are moved to the front instead of being
+       discarded. There is always at least one entry without children,
+       and the parent is the most recently used entry, so it is the last
+       candidate */
+    Element_ID victim = lru_tail;
+    while (cache[victim].first_child)
+    {
+      use_cache_entry(victim);
+      victim = lru_tail;
+    }
+    if (victim == parent)
+      return;
+    free_cache_entry(victim);
+  }
+  Element_ID entry = new_cache_entry();
+  Cache_Entry & e = cache[entry];
+  e.parent = parent;
+  e.level = level;
+  e.lvalue = current.lvalue;
+  e.nr_nodes = current.nr_nodes;
+  e.node = new Node[current.nr_nodes];
+  memcpy(e.node,current.node,current.nr_nodes*sizeof(Node));
+  e.next_sibling = cache[parent].first_child;
+  cache[parent].first_child = entry;
+  cache_used += size;
+  use_cache_entry(entry);
+  cache_path[level] = entry;
 }
 
 /**/
@@ -356,6 +651,9 @@ unsigned Diff_Reduce::reduce(Word * answer,const Word & start_word,
     /* Create the stack if need be */
     max_depth = length+1;
     stack = new Node_List[max_depth];
+    cache_path = new Element_ID[max_depth];
+    for (Word_Length i = 0; i < max_depth;i++)
+      cache_path[i] = 0;
     valid_length = INVALID_LENGTH;
   }
 
@@ -398,6 +696,7 @@ unsigned Diff_Reduce::reduce(Word * answer,const Word & start_word,
       valid_length = 0;
     stack[0].nr_nodes = 1;
   }
+  cache_path[0] = subgroup_word ? CACHE_COSET_ROOT : CACHE_GROUP_ROOT;
 
   if (nr_seen != nr_differences)
   {
@@ -430,14 +729,28 @@ unsigned Diff_Reduce::reduce(Word * answer,const Word & start_word,
       {
         max_depth = length+1;
         Node_List * new_stack = new Node_List[max_depth];
+        Element_ID * new_cache_path = new Element_ID[max_depth];
         for (Word_Length j = 0; j <= i;j++)
+        {
           new_stack[j] = stack[j];
+          new_cache_path[j] = cache_path[j];
+        }
+        for (Word_Length j = i+1; j < max_depth;j++)
+          new_cache_path[j] = 0;
         delete [] stack;
+        delete [] cache_path;
         stack = new_stack;
+        cache_path = new_cache_path;
       }
       bool reduced = false;
       if (i >= valid_length || lvalue != stack[i+1].lvalue)
       {
+        if (cache_limit && lvalue < nr_generators &&
+            restore_level(i,lvalue))
+        {
+          valid_length = ++i;
+          continue;
+        }
         Node_List & current = stack[i];
         Node_List & next = stack[i+1];
         next.lvalue = lvalue;
@@ -600,7 +913,11 @@ unsigned Diff_Reduce::reduce(Word * answer,const Word & start_word,
           }
         }
         else
+        {
           valid_length = ++i;
+          if (cache_limit)
+            save_level(i);
+        }
       }
       else
         i++;
@@ -625,10 +942,15 @@ unsigned Diff_Reduce::reduce(Word * answer,const Word & start_word,
         {
           max_depth = max(Word_Length(i+1),length)+1;
           Node_List * new_stack = new Node_List[max_depth];
+          Element_ID * new_cache_path = new Element_ID[max_depth];
           for (Word_Length j = 0; j <= i;j++)
             new_stack[j] = stack[j];
+          for (Word_Length j = 0; j < max_depth;j++)
+            new_cache_path[j] = 0;
           delete [] stack;
+          delete [] cache_path;
           stack = new_stack;
+          cache_path = new_cache_path;
         }
         Word_Length used = i+1;
         if (used > limit)
@@ -70,6 +70,9 @@ using a word-difference machine. However, to improve performance, it
 remembers its state between calls, so that when it is called repeatedly
 for similar words that are either not reducible, or have a longish common
 prefix with their reduction there will be a considerable saving in time.
+Optionally it can also keep a bounded cache of the state sets for
+prefixes of earlier words (see set_prefix_cache()), which helps when many
+words that share prefixes are reduced in no particular order.
 
 Diff_Equate() is used to discover equations that are implied, but not
 recognised by the word-difference machine, i.e. triples of words u,v1,v2
@@ -91,6 +94,7 @@ class Diff_Reduce : public Word_Reducer
   private:
     struct Node;
     struct Node_List;
+    struct Cache_Entry;
   public:
     const FSA & dm;
   private:
@@ -111,6 +115,17 @@ class Diff_Reduce : public Word_Reducer
     bool can_lengthen;
     const bool is_right_shortlex;
     const bool is_shortlex;
+    // members for the prefix cache
+    Cache_Entry * cache;
+    Element_ID * cache_path; // cache entry for each valid level of stack
+    Element_Count cache_allocated;
+    Element_ID cache_free;   // head of list of unused entries
+    Element_ID lru_head;     // most recently used entry
+    Element_ID lru_tail;     // least recently used entry
+    size_t cache_limit;
+    size_t cache_used;
+    Element_Count nr_cache_hits;
+    Element_Count nr_cache_misses;
   public:
     Diff_Reduce(const FSA * difference_machine);
     ~Diff_Reduce();
@@ -120,9 +135,33 @@ class Diff_Reduce : public Word_Reducer
          it knows that changes have occurred since the last call to reduce().
          This is mainly for use by Strong_Diff_Reduce() */
     void invalidate();
+    /* This form of invalidate() can be used instead when the caller knows
+       which states have had their transitions changed, in which case
+       change_time[si] > since must be true for each such state.
+       The remembered state is then only discarded from the first point at
+       which it depended on a changed state. */
+    void invalidate(const unsigned * change_time,unsigned since);
 
     unsigned reduce(Word * answer,const Word & start_word,
                     unsigned flags = 0,const FSA * wa = 0);
+    /* set_prefix_cache() enables a cache of the levels of the stack that
+       allows up to max_bytes of memory to be used, or disables it if
+       max_bytes is 0. Each level is remembered in a trie keyed by the
+       prefix of the word it was computed for, and is taken from there
+       instead of being computed again when a later word has the same
+       prefix. The least recently used entries are discarded when the
+       limit is reached. The cache is only used for shortlex and right
+       shortlex orderings, and is emptied by invalidate() */
+    void set_prefix_cache(size_t max_bytes);
+    // The counts of levels found in, and missing from, the prefix cache
+    Element_Count prefix_cache_hits() const
+    {
+      return nr_cache_hits;
+    }
+    Element_Count prefix_cache_misses() const
+    {
+      return nr_cache_misses;
+    }
   private:
     void apply_reduction(Ordinal * values, Word_Length *length,
                          Ordinal_Word * subgroup_prefix,
@@ -130,7 +169,12 @@ class Diff_Reduce : public Word_Reducer
                          State_Count prefix,Ordinal rvalue);
     void extract_word(Ordinal_Word * word,Element_ID node_nr,
                       Word_Length full_length,State_ID * initial_state,bool cached);
-
+    void clear_prefix_cache();
+    bool restore_level(Word_Length level,Ordinal lvalue);
+    void save_level(Word_Length level);
+    Element_ID new_cache_entry();
+    void free_cache_entry(Element_ID entry);
+    void use_cache_entry(Element_ID entry);
 };
 
 /**/
@@ -95,10 +95,15 @@
   usually "left half differences". See prepare_differences() in maf_we.cpp for
   an explanation of what these are and why they are used.
 */
+#include <string.h>
 #include "container.h"
+#include "checkpoint.h"
 #include "maf_dt.h"
 #include "maf_nm.h"
 
+/* The largest number of transitions for which grow_wd() keeps a mirror */
+const size_t MAX_MIRROR_SIZE = 0x800000;
+
 Difference_Tracker::Difference_Tracker(Node_Manager &nm_,
                                        State_Count hash_size,
                                        bool cached) :
@@ -113,8 +118,14 @@ Difference_Tracker::Difference_Tracker(Node_Manager &nm_,
   interest_wrong(false),
   dt_stats(stats),
   pending_pair(0),
-  pending_tail(&pending_pair)
+  pending_tail(&pending_pair),
+  journal_clock(1),
+  mirror(0),
+  mirror_count(0),
+  mirror_allocated(0),
+  mirror_time(0)
 {
+  manage(row_time);
   manage(state_equations);
   manage(state_primaries);
   manage(merge_map);
@@ -169,6 +180,8 @@ Difference_Tracker::~Difference_Tracker()
 {
   detach_all();
   delete [] reverse_product;
+  if (mirror)
+    delete [] mirror;
 }
 
 /**/
@@ -1533,6 +1546,7 @@ State_ID Difference_Tracker::find_state(Node_Handle s,bool insert,bool mapped)
       {
         si = LTFSA::find_state(&nid,sizeof(Node_ID),true);
         count++;
+        journal(si);
       }
       else
         set_state_key(si,nid);
@@ -1591,6 +1605,175 @@ void Difference_Tracker::label_states(Difference_Tracker & other,State_ID si)
 
 /**/
 
+void Difference_Tracker::checkpoint(Checkpoint_Writer & cw) const
+{
+  /* The tracker is saved state by state. The state numbers matter, since
+     they are used in the transitions, in merge_map and so on, so the
+     holes left by removed states must be reproduced on restore() */
+  cw.put(count);
+  for (State_ID si = 2; si < count;si++)
+  {
+    Node_ID nid = 0;
+    bool present = LTFSA::get_state_key(&nid,si);
+    cw.put(present);
+    cw.put(nid);
+  }
+  cw.put(state_equations.buffer(),count*sizeof(Node_ID));
+  cw.put(state_primaries.buffer(),count*sizeof(Node_ID));
+  bool has_hwords = state_hwords.capacity() != 0;
+  cw.put(has_hwords);
+  if (has_hwords)
+    cw.put(state_hwords.buffer(),count*sizeof(Node_ID));
+  cw.put(merge_map.buffer(),count*sizeof(State_ID));
+  cw.put(merge_next.buffer(),count*sizeof(State_ID));
+  cw.put(merge_prev.buffer(),count*sizeof(State_ID));
+  cw.put(distance.buffer(),count*sizeof(Word_Length));
+
+  Transition_ID nr_symbols = alphabet_size();
+  State_ID * transitions = new State_ID[nr_symbols];
+  for (State_ID si = 1; si < count;si++)
+  {
+    Node_ID nid;
+    if (si != 1 && !LTFSA::get_state_key(&nid,si))
+      continue;
+    get_transitions(transitions,si);
+    cw.put(transitions,nr_symbols*sizeof(State_ID));
+    for (Transition_ID ti = 0; ti < nr_symbols;ti++)
+      cw.put(get_transition_label(si,ti));
+    cw.put(is_initial(si));
+  }
+  delete [] transitions;
+
+  cw.put(get_flags());
+  cw.put(stats);
+  cw.put(limit);
+  cw.put(changes);
+  cw.put(recent_changes);
+  bool bits[4] = {closed!=0,interest_wrong!=0,ok!=0,max_changed!=0};
+  cw.put(bits);
+  State_Count nr_pairs = 0;
+  const Pending_Pair * pair;
+  for (pair = pending_pair; pair;pair = pair->next)
+    nr_pairs++;
+  cw.put(nr_pairs);
+  for (pair = pending_pair; pair;pair = pair->next)
+  {
+    cw.put(pair->si1);
+    cw.put(pair->si2);
+  }
+  State_Count nr_holes = holes.count();
+  cw.put(nr_holes);
+  cw.put(holes.buffer(),nr_holes*sizeof(State_ID));
+  bool labelled = label_count() != 0;
+  cw.put(labelled);
+}
+
+/**/
+
+void Difference_Tracker::restore(Checkpoint_Reader & cr)
+{
+  /* The tracker was created before the Node_Manager was restored, so
+     states 0 and 1 are already present with the right keys. The remaining
+     states are inserted in order. Holes are given dummy keys which are
+     removed again once every state is present. An extra state is added
+     at the end for the same reason, because otherwise removing a hole at
+     the end of the table would reclaim its number. */
+  State_Count saved_count;
+  cr.get(&saved_count);
+  bool * is_hole = new bool[saved_count];
+  is_hole[0] = is_hole[1] = false;
+  for (State_ID si = 2; si < saved_count;si++)
+  {
+    bool present;
+    Node_ID nid;
+    cr.get(&present);
+    cr.get(&nid);
+    is_hole[si] = !present;
+    if (!present)
+      nid = Node_ID(~0) - si;
+    LTFSA::find_state(&nid,sizeof(Node_ID),true);
+  }
+  Node_ID sentinel = Node_ID(~0) - saved_count;
+  State_ID sentinel_si = LTFSA::find_state(&sentinel,sizeof(Node_ID),true);
+  for (State_ID si = 2; si < saved_count;si++)
+    if (is_hole[si])
+      remove_state(si);
+  remove_state(sentinel_si);
+  count = saved_count;
+
+  cr.get(state_equations.buffer(),count*sizeof(Node_ID));
+  cr.get(state_primaries.buffer(),count*sizeof(Node_ID));
+  bool has_hwords;
+  cr.get(&has_hwords);
+  if (has_hwords)
+    cr.get(state_hwords.buffer(),count*sizeof(Node_ID));
+  cr.get(merge_map.buffer(),count*sizeof(State_ID));
+  cr.get(merge_next.buffer(),count*sizeof(State_ID));
+  cr.get(merge_prev.buffer(),count*sizeof(State_ID));
+  cr.get(distance.buffer(),count*sizeof(Word_Length));
+
+  Transition_ID nr_symbols = alphabet_size();
+  State_ID * transitions = new State_ID[nr_symbols];
+  for (State_ID si = 1; si < count;si++)
+  {
+    if (is_hole[si])
+      continue;
+    cr.get(transitions,nr_symbols*sizeof(State_ID));
+    set_transitions(si,transitions);
+    for (Transition_ID ti = 0; ti < nr_symbols;ti++)
+    {
+      Node_ID label;
+      cr.get(&label);
+      if (label || get_transition_label(si,ti))
+        set_transition_label(si,ti,label);
+    }
+    bool initial;
+    cr.get(&initial);
+    set_is_initial(si,initial);
+  }
+  delete [] transitions;
+  delete [] is_hole;
+
+  unsigned flags;
+  cr.get(&flags);
+  change_flags(flags,~0u);
+  cr.get(&stats);
+  cr.get(&limit);
+  cr.get(&changes);
+  cr.get(&recent_changes);
+  bool bits[4];
+  cr.get(&bits);
+  closed = bits[0];
+  interest_wrong = bits[1];
+  ok = bits[2];
+  max_changed = bits[3];
+  State_Count nr_pairs;
+  cr.get(&nr_pairs);
+  for (State_Count i = 0; i < nr_pairs;i++)
+  {
+    State_ID si1,si2;
+    cr.get(&si1);
+    cr.get(&si2);
+    *pending_tail = new Pending_Pair(si1,si2);
+    pending_tail = &(*pending_tail)->next;
+  }
+  State_Count nr_holes;
+  cr.get(&nr_holes);
+  holes.empty();
+  for (State_Count i = 0; i < nr_holes;i++)
+  {
+    State_ID si;
+    cr.get(&si);
+    holes.append_one(si);
+  }
+  bool labelled;
+  cr.get(&labelled);
+  if (labelled)
+    label_states(*this,-1);
+}
+
+/**/
+
 bool Difference_Tracker::is_inverse_complete()
 {
   /* The difference machine should be closed under inversion since
@@ -1730,13 +1913,32 @@ class Filtered_Word_Difference_Machine : public Delegated_FSA
   private:
     Difference_Tracker & dt;
     unsigned gwd_flags;
+    /* When the tracker has an up to date mirror of its transitions we
+       work from that instead, and note here which states pass the filter,
+       so that we don't have to look at the node for every transition */
+    bool * passes;
   public:
     Filtered_Word_Difference_Machine(Difference_Tracker & dt_,
                                      unsigned gwd_flags_) :
       Delegated_FSA(&dt_,false),
       dt(dt_),
-      gwd_flags(gwd_flags_)
+      gwd_flags(gwd_flags_),
+      passes(0)
     {
+      if (dt.mirror && !(gwd_flags & GWD_PRIMARY_ONLY))
+      {
+        passes = new bool[dt.mirror_count];
+        for (State_ID si = 0; si < dt.mirror_count;si++)
+        {
+          Node_Reference s = dt.nm_state(si);
+          passes[si] = !s.is_null() && s->flagged(NF_IS_DIFFERENCE);
+        }
+      }
+    }
+    ~Filtered_Word_Difference_Machine()
+    {
+      if (passes)
+        delete [] passes;
     }
     virtual const State_ID * dense_transition_table() const
     {
@@ -1756,8 +1958,33 @@ class Filtered_Word_Difference_Machine : public Delegated_FSA
                                Transition_ID symbol_nr,
                                bool buffer = true) const
     {
+      if (passes)
+        return mirror_new_state(si,symbol_nr);
       return dt.filtered_new_state(si,symbol_nr,buffer,gwd_flags);
     }
+  private:
+    State_ID mirror_new_state(State_ID si,Transition_ID symbol_nr) const
+    {
+      /* This must give the same answer as filtered_new_state() */
+      if (si >= dt.mirror_count || !passes[si])
+        return 0;
+      State_ID nsi = dt.mirror[si*size_t(dt.alphabet_size())+symbol_nr];
+      bool labelled = nsi > 0;
+      if (!labelled)
+        nsi = -nsi;
+      if (!nsi)
+        return 0;
+      if (si == 1)
+      {
+        Ordinal g1,g2;
+        dt.base_alphabet.product_generators(&g1,&g2,symbol_nr);
+        if (g1 == PADDING_SYMBOL || g1 == g2)
+          return nsi;
+      }
+      if (!passes[nsi] || (gwd_flags & GWD_KNOWN_TRANSITIONS && !labelled))
+        return 0;
+      return nsi;
+    }
 };
 
 /**/
@@ -1834,6 +2061,8 @@ FSA_Simple * Difference_Tracker::grow_wd(unsigned gwd_flags)
   set_transitions(1,transition);
   delete [] transition;
   label_states(*this,-1);
+  if (!(gwd_flags & GWD_PRIMARY_ONLY))
+    refresh_mirror();
   Filtered_Word_Difference_Machine temp(*this,gwd_flags);
   if (!holes.count() && !(gwd_flags & GWD_PRIMARY_ONLY))
     return FSA_Factory::copy(temp);
@@ -1842,6 +2071,61 @@ FSA_Simple * Difference_Tracker::grow_wd(unsigned gwd_flags)
 
 /**/
 
+void Difference_Tracker::refresh_mirror()
+{
+  /* Brings the mirror of the transitions used by grow_wd() up to date.
+     Only the rows the journal says have changed since the last time are
+     read again. The mirror is given up if it would be very large, since
+     then it would use more memory than it is worth. */
+  const Transition_ID nr_symbols = alphabet_size();
+  const State_Count nr_states = state_count();
+  if (nr_states*size_t(nr_symbols) > MAX_MIRROR_SIZE)
+  {
+    if (mirror)
+    {
+      delete [] mirror;
+      mirror = 0;
+    }
+    mirror_count = mirror_allocated = 0;
+    return;
+  }
+
+  if (nr_states > mirror_allocated)
+  {
+    mirror_allocated = nr_states + nr_states/4;
+    State_ID * new_mirror = new State_ID[mirror_allocated*size_t(nr_symbols)];
+    if (mirror)
+    {
+      memcpy(new_mirror,mirror,mirror_count*size_t(nr_symbols)*sizeof(State_ID));
+      delete [] mirror;
+    }
+    mirror = new_mirror;
+  }
+  State_Count old_count = mirror_count;
+  mirror_count = nr_states;
+
+  const unsigned * times = row_time.buffer();
+  for (State_ID si = 0; si < nr_states;si++)
+  {
+    if (si < old_count && times[si] <= mirror_time)
+      continue;
+    State_ID * row = mirror + si*size_t(nr_symbols);
+    Node_ID nid = 0;
+    if (!LTFSA::get_state_key(&nid,si) || !nid)
+    {
+      memset(row,0,nr_symbols*sizeof(State_ID));
+      continue;
+    }
+    get_transitions(row,si);
+    for (Transition_ID ti = 0; ti < nr_symbols;ti++)
+      if (row[ti] && !get_transition_label(si,ti))
+        row[ti] = -row[ti];
+  }
+  mirror_time = take_journal_time();
+}
+
+/**/
+
 void Difference_Tracker::compute_transitions(unsigned gwd_flags)
 {
   /* Look for transitions between states that we did not spot before.
@@ -51,6 +51,10 @@ Ported to Darwin
 #include "maf_el.h"
 #endif
 
+// Classes referred to but defined elsewhere
+class Checkpoint_Writer;
+class Checkpoint_Reader;
+
 /* The Difference_Tracker class is used by Rewriter_Machine to keep track of
    the word-differences known so far and the shortest equations that give rise
    to them. It also does most of the work of building word-difference
@@ -139,6 +143,22 @@ class Difference_Tracker : public LTFSA
     unsigned char recent_changes;
     Pending_Pair * pending_pair;
     Pending_Pair ** pending_tail;
+    /* The change journal. row_time[si] is the value journal_clock had
+       when the transitions, transition labels or key of state si last
+       changed, which includes the state being added or removed. A user of
+       the tracker that wants to know what has changed since some point
+       calls take_journal_time() then, and later looks for states with a
+       time greater than the value it was given. */
+    Array_Of<unsigned> row_time;
+    unsigned journal_clock;
+    /* grow_wd() keeps a copy of the transitions of the tracker, which it
+       brings up to date using the journal, so that it does not have to
+       decompress every row each time it builds a difference machine.
+       Transitions that are not labelled with an equation are negated. */
+    State_ID * mirror;
+    State_Count mirror_count;
+    State_Count mirror_allocated;
+    unsigned mirror_time;
     short closed:1;
     short interest_wrong:1;
     short ok:1;
@@ -159,6 +179,12 @@ class Difference_Tracker : public LTFSA
        would be built using the specified flags has changed since the
        Difference_Tracker was closed() */
     bool dm_changed(unsigned gwd_flags,bool recent = false) const;
+    /* change_journal() returns the row_time[] array described above. It
+       has an entry for every state. */
+    const unsigned * change_journal() const
+    {
+      return row_time.buffer();
+    }
     Total_Length interest_limit() const
     {
       /* returns the size of the longest equation which shows that a possible
@@ -212,6 +238,19 @@ class Difference_Tracker : public LTFSA
     void compute_transitions(unsigned gwd_flags);
     FSA_Simple *grow_wd(unsigned gwd_flags);
     bool is_inverse_complete();
+    /* checkpoint() and restore() save and reload the tracker for a
+       Rewriter_Machine checkpoint. restore() must be called on a newly
+       created tracker after the Node_Manager itself has been restored.
+       It does not attach the nodes again, since the restored nodes
+       already have the correct reference counts */
+    void checkpoint(Checkpoint_Writer & cw) const;
+    void restore(Checkpoint_Reader & cr);
+    // set_transitions() is over-ridden so that every change is journalled
+    bool set_transitions(State_ID si,const State_ID * buffer)
+    {
+      journal(si);
+      return LTFSA::set_transitions(si,buffer);
+    }
     void set_limit(Total_Length limit_)
     {
       limit = limit_;
@@ -236,6 +275,10 @@ class Difference_Tracker : public LTFSA
       stats.nr_recent_changes = 0;
       return answer;
     }
+    unsigned take_journal_time()
+    {
+      return journal_clock++;
+    }
     bool take_max_changed()
     {
       bool retcode = max_changed!=0;
@@ -277,6 +320,10 @@ class Difference_Tracker : public LTFSA
       changes |= flags;
       recent_changes |= flags;
     }
+    void journal(State_ID si)
+    {
+      row_time[si] = journal_clock;
+    }
     void label_states(Difference_Tracker & other,State_ID si = -1);
     unsigned learn_transition(State_ID * si,int * distance,
                               Ordinal lvalue,Ordinal rvalue,
@@ -287,15 +334,23 @@ class Difference_Tracker : public LTFSA
     Node_Reference nm_difference(Equation_Word * ew1,const Equation_Word &ew0,Transition_ID ti) const;
     bool valid_transition(State_ID si,Transition_ID ti,State_ID nsi) const;
     void queue_pair(State_ID si1,State_ID si2);
+    void refresh_mirror();
+    void remove_state(State_ID si)
+    {
+      journal(si);
+      LTFSA::remove_state(si);
+    }
     void set_equation(State_ID si,Transition_ID ti,Node_Handle e)
     {
       Node_ID nid(e);
+      journal(si);
       set_transition_label(si,ti,nid);
       if (!e.is_null())
         e->attach(nm);
     }
     void set_state_key(State_ID si,Node_ID nid)
     {
+      journal(si);
       LTFSA::set_state_key(si,&nid,sizeof(Node_ID));
     }
 };
@@ -170,6 +170,16 @@ int Equation_Manager::learn(Working_Equation * we,unsigned flags,bool * discarde
 
 /**/
 
+bool Equation_Manager::is_trivial(Working_Equation * we,unsigned flags) const
+{
+  /* This must agree with the start of process() */
+  if (!(flags & AE_COPY_LHS) && !stats.want_secondaries && maf.options.secondary < 2)
+    flags &= ~AE_KEEP_LHS;
+  return !we->prepare_for_insert(flags);
+}
+
+/**/
+
 enum Accepted_Reason
 {
   AR_Rejected,
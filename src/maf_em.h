@@ -108,6 +108,15 @@ class Equation_Manager : private Managed_Equation
     Equation_Manager(Rewriter_Machine & rm_);
     ~Equation_Manager();
     int learn(Working_Equation * we,unsigned flags,bool * discarded);
+    /* is_trivial() returns true if learn() would certainly return 0 for
+       the equation without changing anything. It only reads the
+       Rewriter_Machine, but it does modify the equation. */
+    bool is_trivial(Working_Equation * we,unsigned flags) const;
+    // idle() returns true if there are no equations waiting to be learnt
+    bool idle() const
+    {
+      return head == 0;
+    }
     void queue(const Word & lhs,const Word & rhs,const Derivation &d,unsigned flags)
     {
       Managed_Equation * me = new Managed_Equation(nm,lhs,rhs,d,flags);
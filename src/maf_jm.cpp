@@ -119,8 +119,12 @@
 #include "maf_jm.h"
 #include "mafnode.h"
 #include "maf_wdb.h"
+#include "maf_spool.h"
 #include "container.h"
 #include "maf_we.h"
+#include "heap.h"
+#include "mafthread.h"
+#include "checkpoint.h"
 
 const int Priority_Optimise = -1;
 const int Priority_Urgent_Deduce = -2;
@@ -161,6 +165,17 @@ class Node_Equation
       first_->attach(nm);
       second_->attach(nm);
     }
+    /* This constructor is used when restoring a checkpoint. The nodes
+       are not attached because the reference counts were saved with them */
+    Node_Equation(Node_ID first_,Node_ID second_,
+                  const Derivation & derivation_,
+                  Ordinal transition_) :
+      first(first_),
+      second(second_),
+      derivation(derivation_),
+      transition(transition_),
+      next(0)
+    {}
 
     void release(Node_Manager &nm)
     {
@@ -190,6 +205,13 @@ class Node_Overlap
       first_->attach(nm);
       second_->attach(nm);
     }
+    // As for Node_Equation, this constructor is used to restore a checkpoint
+    Node_Overlap(Node_ID first_,Node_ID second_,Word_Length offset_) :
+      first(first_),
+      second(second_),
+      offset(offset_),
+      next(0)
+    {}
 
     void release(Node_Manager &nm)
     {
@@ -285,6 +307,143 @@ Rewriter_Machine::Job_Manager::~Job_Manager()
 
 /**/
 
+void Rewriter_Machine::Job_Manager::checkpoint(Checkpoint_Writer & cw) const
+{
+  /* Save all the outstanding work. This is only called from
+     Rewriter_Machine::checkpoint() */
+  cw.put(new_priority);
+  cw.put(overloaded);
+  cw.put(pruning);
+  cw.put(optimising);
+  cw.put(dm_broken);
+  cw.put(weed);
+  bad_inverse.checkpoint(cw);
+  bad_difference.checkpoint(cw);
+  partial_reductions.checkpoint(cw);
+  Node_Equation * const heads[2] = {pending_head,urgent_pending_head};
+  const Node_Count counts[2] = {pending_count,urgent_pending_count};
+  for (int i = 0; i < 2;i++)
+  {
+    cw.put(counts[i]);
+    for (const Node_Equation * ne = heads[i];ne;ne = ne->next)
+    {
+      cw.put(ne->first);
+      cw.put(ne->second);
+      cw.put(ne->transition);
+      cw.put(ne->derivation);
+    }
+  }
+  cw.put(optimisation_count);
+  for (const Optimisation_Request * request = optimisation_head;request;
+       request = request->next)
+    cw.put_word(request->word);
+  total_overlaps.checkpoint(cw);
+  pending_overlaps.checkpoint(cw);
+  unconjugated.checkpoint(cw);
+  undifferenced.checkpoint(cw);
+  uncorrected.checkpoint(cw);
+  rhs_pending.checkpoint(cw);
+  oversized.checkpoint(cw);
+  dubious.checkpoint(cw);
+  removed.checkpoint(cw);
+  cw.put(stats);
+}
+
+/**/
+
+void Rewriter_Machine::Job_Manager::restore(Checkpoint_Reader & cr)
+{
+  Node_Manager & nm = rm.nm;
+  cr.get(&new_priority);
+  cr.get(&overloaded);
+  cr.get(&pruning);
+  cr.get(&optimising);
+  cr.get(&dm_broken);
+  cr.get(&weed);
+  bad_inverse.restore(cr,nm);
+  bad_difference.restore(cr,nm);
+  partial_reductions.restore(cr);
+  for (int i = 0; i < 2;i++)
+  {
+    Node_Equation ** head = i ? &urgent_pending_head : &pending_head;
+    Node_Equation ** tail = i ? &urgent_pending_tail : &pending_tail;
+    Node_Count & count = i ? urgent_pending_count : pending_count;
+    cr.get(&count);
+    for (Node_Count done = 0; done < count && cr.is_ok();done++)
+    {
+      Node_ID first,second;
+      Ordinal transition;
+      Derivation derivation(BDT_Unspecified);
+      cr.get(&first);
+      cr.get(&second);
+      cr.get(&transition);
+      cr.get(&derivation);
+      Node_Equation * ne = new Node_Equation(first,second,derivation,transition);
+      if (*head)
+        (*tail)->next = ne;
+      else
+        *head = ne;
+      *tail = ne;
+    }
+  }
+  Element_Count count = 0;
+  cr.get(&count);
+  Ordinal_Word word(rm.alphabet());
+  while (count-- && cr.is_ok())
+  {
+    cr.get_word(&word);
+    Optimisation_Request * request = new Optimisation_Request(word);
+    if (optimisation_head)
+      optimisation_tail->next = request;
+    else
+      optimisation_head = request;
+    optimisation_tail = request;
+    optimisation_count++;
+  }
+  total_overlaps.restore(cr);
+  pending_overlaps.restore(cr);
+  unconjugated.restore(cr);
+  undifferenced.restore(cr);
+  uncorrected.restore(cr);
+  rhs_pending.restore(cr);
+  oversized.restore(cr);
+  dubious.restore(cr);
+  removed.restore(cr);
+  cr.get(&stats);
+}
+
+/**/
+
+void Rewriter_Machine::Job_Manager::Overlap_Queue::checkpoint(Checkpoint_Writer & cw) const
+{
+  cw.put(count);
+  for (const Node_Overlap * nov = head;nov;nov = nov->next)
+  {
+    cw.put(nov->first);
+    cw.put(nov->second);
+    cw.put(nov->offset);
+  }
+}
+
+/**/
+
+void Rewriter_Machine::Job_Manager::Overlap_Queue::restore(Checkpoint_Reader & cr)
+{
+  Node_Count to_do = 0;
+  cr.get(&to_do);
+  while (to_do-- && cr.is_ok())
+  {
+    Node_ID first,second;
+    Word_Length offset;
+    cr.get(&first);
+    cr.get(&second);
+    cr.get(&offset);
+    add(new Node_Overlap(first,second,offset));
+  }
+}
+
+/**/
+
 void Rewriter_Machine::Job_Manager::equate_nodes(Node_Handle first,Node_Handle second,
                                                  const Derivation &d,
                                                  Ordinal difference,bool urgent)
@@ -1111,6 +1270,138 @@ void Rewriter_Machine::Job_Manager::check_dubious_reductions(unsigned flags,int
 
 /**/
 
+/* Parallel processing of overlaps.
+
+   When maf.options.threads is more than 1 overlaps() processes its queue in
+   rounds. At the start of each round a "window" of overlaps is taken from
+   the head of the queue, and several threads use Rewriter_Machine::
+   speculate() to work out which of them give rise to trivial equations,
+   while the tree is left alone. Most overlaps turn out to be trivial, and
+   working this out is where most of the time goes, because both sides of
+   the equation have to be reduced.
+
+   The overlaps are then processed one at a time in their original order by
+   this thread, exactly as they would be otherwise, except that consider()
+   does not need to reduce an equation again if it was found to be trivial
+   and the Certificate taken when the round started shows that the tree
+   has not changed since. As soon as the tree does change, the rest of the
+   window is speculated about again in a new round. So the results are the
+   same as in single threaded operation whatever the number of threads, and
+   the size of the window only depends on what has been learnt so far.
+*/
+
+class Rewriter_Machine::Job_Manager::Overlap_Speculator : public Thread
+{
+  private:
+    Job_Manager & jm;
+    Node_Overlap ** window;
+    Overlap_Speculation * speculation;
+    Node_Count count;
+    unsigned ae_flags;
+    bool is_total;
+  public:
+    Overlap_Speculator(Job_Manager & jm_,Node_Overlap ** window_,
+                       Overlap_Speculation * speculation_,Node_Count count_,
+                       bool is_total_,unsigned ae_flags_) :
+      jm(jm_),
+      window(window_),
+      speculation(speculation_),
+      count(count_),
+      ae_flags(ae_flags_),
+      is_total(is_total_)
+    {}
+  protected:
+    void run()
+    {
+      jm.speculate(window,speculation,count,is_total,ae_flags);
+      Node_List::purge();
+    }
+};
+
+unsigned Rewriter_Machine::Job_Manager::speculation_threads() const
+{
+  /* Speculation is only safe if reduction cannot have any side effects.
+     With orderings that are not length based, reduction can be difficult
+     enough for Equation_Word::hard_reduce() to output status messages
+     and schedule optimisations, and when MAF has another reduction method
+     available Equation_Word::reduce() uses that, and it might not be thread
+     safe. Derivation logging also uses Node_List, which we prefer not to
+     have happening in other threads. */
+  if (maf.options.threads <= 1 || !rm.pd.is_short ||
+      maf.reduction_available() ||
+      maf.options.log_flags & LOG_DERIVATIONS)
+    return 1;
+  return maf.options.threads;
+}
+
+void Rewriter_Machine::Job_Manager::speculate(Node_Overlap ** window,
+                                              Overlap_Speculation * speculation,
+                                              Node_Count count,bool is_total,
+                                              unsigned ae_flags)
+{
+  /* Work out which overlaps in the window give rise to trivial equations.
+     This is called in several threads at once, so must not change
+     anything apart from its own speculation entries. The checks on the
+     overlap are the same as in overlaps(), which repeats them anyway. */
+  Simple_Equation se1(rm.alphabet());
+  Simple_Equation se2(rm.alphabet());
+  for (Node_Count i = 0; i < count;i++)
+  {
+    Node_Overlap * current = window[i];
+    speculation[i].trivial = false;
+    Node_Reference e1(rm.nm,current->first);
+    if (e1->is_valid())
+    {
+      Node_Reference e2(rm.nm,current->second);
+      if (e2->is_valid() &&
+          (is_total || rm.overlap_interesting(e1,e2,current->offset)))
+      {
+        se1.read_equation(rm.nm,e1);
+        se2.read_equation(rm.nm,e2);
+        rm.speculate(&speculation[i],e1,e2,current->offset,se1,se2,ae_flags);
+      }
+    }
+  }
+}
+
+void Rewriter_Machine::Job_Manager::speculate_in_parallel(Node_Overlap ** window,
+                                                          Overlap_Speculation * speculation,
+                                                          Node_Count count,
+                                                          bool is_total,
+                                                          unsigned ae_flags,
+                                                          unsigned nr_threads)
+{
+  /* Divide the window into nr_threads slices, and do the first slice
+     in this thread */
+  Overlap_Speculator ** speculators = new Overlap_Speculator *[nr_threads];
+  Node_Count slice = (count + nr_threads - 1)/nr_threads;
+  Node_Count start = slice;
+  unsigned i;
+  for (i = 1; i < nr_threads;i++)
+  {
+    Node_Count end = start + slice < count ? start + slice : count;
+    speculators[i] = 0;
+    if (start < end)
+    {
+      speculators[i] = new Overlap_Speculator(*this,window+start,speculation+start,
+                                              end-start,is_total,ae_flags);
+      if (!speculators[i]->start())
+        speculate(window+start,speculation+start,end-start,is_total,ae_flags);
+    }
+    start = end;
+  }
+  speculate(window,speculation,slice < count ? slice : count,is_total,ae_flags);
+  for (i = 1; i < nr_threads;i++)
+    if (speculators[i])
+    {
+      speculators[i]->join();
+      delete speculators[i];
+    }
+  delete [] speculators;
+}
+
+/**/
+
 void Rewriter_Machine::Job_Manager::overlaps(Overlap_Queue * queue,unsigned flags,int priority)
 {
   Node_Count done = 0;
@@ -1126,9 +1417,71 @@ void Rewriter_Machine::Job_Manager::overlaps(Overlap_Queue * queue,unsigned flag
   unsigned ae_flags = AE_INSERT_DESIRABLE;
   int going = 0;
   unsigned was_to_do = 0;
+  Node_Count nr_threads = Node_Count(speculation_threads());
+  /* The window holds overlaps that have been taken from the queue for
+     speculation. window[next] to window[next+pending-1] are still to be
+     processed */
+  Node_Count max_window = nr_threads*256;
+  Node_Count window_limit = nr_threads*16;
+  Node_Overlap ** window = 0;
+  Overlap_Speculation * speculation = 0;
+  Node_Count next = 0;
+  Node_Count pending = 0;
+  Certificate round;
+  if (nr_threads > 1)
+  {
+    window = new Node_Overlap *[max_window];
+    speculation = new Overlap_Speculation[max_window];
+  }
 
-  while ((current = queue->use())!=0)
+  for (;;)
   {
+    const Overlap_Speculation * guess = 0;
+    if (window && pending && !rm.nm.tree_unchanged(round))
+    {
+      /* The tree has changed, so the remaining speculation is stale.
+         Use a smaller window next time if this round ended early */
+      if (next < window_limit/2)
+        window_limit = next*2 > nr_threads ? next*2 : nr_threads;
+      for (Node_Count i = 0; i < pending;i++)
+        window[i] = window[next+i];
+      next = 0;
+      if (!maf.aborting && pending + queue->length() >= nr_threads*4)
+      {
+        while (pending < window_limit && (current = queue->use())!=0)
+          window[pending++] = current;
+        speculate_in_parallel(window,speculation,pending,is_total,ae_flags,
+                              nr_threads);
+      }
+      else
+        for (Node_Count i = 0; i < pending;i++)
+          speculation[i].trivial = false;
+      round = rm.nm.current_certificate();
+    }
+    else if (window && !pending && !maf.aborting &&
+             queue->length() >= nr_threads*4)
+    {
+      /* Start a new round. The last one went well, so try a bigger window */
+      if (done)
+        window_limit = window_limit*2 < max_window ? window_limit*2 : max_window;
+      next = 0;
+      while (pending < window_limit && (current = queue->use())!=0)
+        window[pending++] = current;
+      speculate_in_parallel(window,speculation,pending,is_total,ae_flags,
+                            nr_threads);
+      round = rm.nm.current_certificate();
+    }
+
+    if (pending)
+    {
+      current = window[next];
+      guess = &speculation[next];
+      next++;
+      pending--;
+    }
+    else if ((current = queue->use())==0)
+      break;
+
     ++done;
     if (!maf.aborting)
     {
@@ -1141,14 +1494,14 @@ void Rewriter_Machine::Job_Manager::overlaps(Overlap_Queue * queue,unsigned flag
         {
           se1.read_equation(rm.nm,e1);
           se2.read_equation(rm.nm,e2);
-          if (rm.consider(e1,e2,current->offset,se1,se2,ae_flags) > 0)
+          if (rm.consider(e1,e2,current->offset,se1,se2,ae_flags,guess) > 0)
             added++;
         }
       }
     }
     current->release(rm.nm);
     update_inner(flags,priority);
-    unsigned to_do = queue->length();
+    unsigned to_do = queue->length() + pending;
     if (to_do && rm.status(priority,2,gap,message,to_do,done+to_do,added))
     {
       gap = 1;
@@ -1157,6 +1510,11 @@ void Rewriter_Machine::Job_Manager::overlaps(Overlap_Queue * queue,unsigned flag
       was_to_do = to_do;
     }
   }
+  if (window)
+  {
+    delete [] window;
+    delete [] speculation;
+  }
 }
 
 /**/
@@ -1312,27 +1670,9 @@ void Rewriter_Machine::Job_Manager::check_pool(unsigned flags,int priority)
            reduced */
         old_pool->remove_entry(id);
         stats.nr_equations--;
-        for (;;)
-        {
-          Working_Equation we(rm.nm,lhs_word,rhs_word,Derivation(id));
-          int i = rm.add_equation(&we,inner_flags);
-          if (i == 1)
-          {
-            nr_adopted++;
-            seen_useful = true;
-          }
-          else if (i == 2)
-          {
-            if (!we.failed && we.total_length() < rm.height()*2 &&
-                we.lhs_word().length() >= we.rhs_word().length())
-              seen_useful = true;
-            if (we.changed)
-              nr_improved++;
-          }
-          update_inner(flags,priority);
-          if (i != 1 || we.balanced != 1)
-            break;
-        }
+        if (reconsider_pooled(lhs_word,rhs_word,Derivation(id),inner_flags,
+                              flags,priority,&nr_adopted,&nr_improved))
+          seen_useful = true;
         Node_Count to_do = nr_entries - id -1;
         if (rm.status(priority,2,gap,
                       "Examining pool (" FMT_ID " of " FMT_ID ") ("
@@ -1348,6 +1688,8 @@ void Rewriter_Machine::Job_Manager::check_pool(unsigned flags,int priority)
             id = nr_entries - 1;
             if (rm.pool)
               stats.nr_equations -= rm.pool->count();
+            if (rm.spool)
+              stats.nr_equations -= rm.spool->count();
             rm.restart();
           }
           seen_useful = false;
@@ -1356,7 +1698,29 @@ void Rewriter_Machine::Job_Manager::check_pool(unsigned flags,int priority)
       }
     }
     if (old_pool)
+    {
       delete old_pool;
+      Heap::trim();
+    }
+    if (rm.spool && !rm.spool->is_reading())
+    {
+      /* Bring back the equations that were spilled to disk and are now
+         short enough to be worth looking at again */
+      Element_Count done = 0;
+      rm.spool->start_read(rm.stats.visible_limit);
+      while (rm.spool->read(&lhs_word,&rhs_word))
+      {
+        stats.nr_equations--;
+        if (reconsider_pooled(lhs_word,rhs_word,Derivation(BDT_Pool),
+                              inner_flags,flags,priority,&nr_adopted,
+                              &nr_improved))
+          seen_useful = true;
+        rm.status(priority,2,gap,"Reading pool back from disk (" FMT_ID
+                  " read) (" FMT_ID " adopted)\n",++done,nr_adopted);
+      }
+      rm.spool->end_read(true);
+      rm.update_spool_limits();
+    }
     Element_Count new_entries = rm.pool ? rm.pool->count() : 0;
     if (nr_adopted+nr_improved || new_entries != nr_entries)
     {
@@ -1381,12 +1745,54 @@ void Rewriter_Machine::Job_Manager::check_pool(unsigned flags,int priority)
     /* In this case the pool only contains equations that we can't deal with
        Let's throw it away and start KB again */
     stats.nr_equations -= rm.pool->count();
+    if (rm.spool)
+      stats.nr_equations -= rm.spool->count();
     rm.restart();
   }
 }
 
 /**/
 
+bool Rewriter_Machine::Job_Manager::reconsider_pooled(Ordinal_Word & lhs_word,
+                                                      Ordinal_Word & rhs_word,
+                                                      const Derivation & derivation,
+                                                      unsigned inner_flags,
+                                                      unsigned flags,
+                                                      int priority,
+                                                      Element_Count * nr_adopted,
+                                                      Element_Count * nr_improved)
+{
+  /* An equation taken out of the pool will either turn into an ordinary
+     equation or go back into the pool, possibly after being further
+     reduced. The return value is true if it looks as though it was
+     worth doing */
+  bool useful = false;
+  for (;;)
+  {
+    Working_Equation we(rm.nm,lhs_word,rhs_word,derivation);
+    int i = rm.add_equation(&we,inner_flags);
+    if (i == 1)
+    {
+      ++*nr_adopted;
+      useful = true;
+    }
+    else if (i == 2)
+    {
+      if (!we.failed && we.total_length() < rm.height()*2 &&
+          we.lhs_word().length() >= we.rhs_word().length())
+        useful = true;
+      if (we.changed)
+        ++*nr_improved;
+    }
+    update_inner(flags,priority);
+    if (i != 1 || we.balanced != 1)
+      break;
+  }
+  return useful;
+}
+
+/**/
+
 void Rewriter_Machine::Job_Manager::check_partial_reductions(unsigned flags,int priority)
 {
   /* This method checks whether a node w which has a reduction at wg is itself
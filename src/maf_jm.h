@@ -67,6 +67,8 @@ class Equation_Queue;
 class Node_Equation;
 class Node_Overlap;
 class Optimisation_Request;
+class Checkpoint_Writer;
+class Checkpoint_Reader;
 
 struct Equation_Stats
 {
@@ -109,8 +111,12 @@ class Rewriter_Machine::Job_Manager
         {
           return count;
         }
+        void checkpoint(Checkpoint_Writer & cw) const;
+        void restore(Checkpoint_Reader & cr);
     };
   private:
+    class Overlap_Speculator;
+    friend class Overlap_Speculator;
     /* priority is a negative number, with -1 for the most urgent tasks,
         -2, for the next most urgent and so on */
     MAF &maf;
@@ -143,7 +149,7 @@ class Rewriter_Machine::Job_Manager
     Equation_Queue oversized;
 //    Equation_Queue removed;
     By_Left_Size_Node_Tree_Queued dubious;
-    By_Size_Node_Tree_Queued removed;
+    Removed_Equation_Queue removed;
     Equation_Stats stats;
   public:
     Rewriter_Machine & rm;
@@ -156,6 +162,7 @@ class Rewriter_Machine::Job_Manager
     }
 
     bool work_pending() const;
+    void checkpoint(Checkpoint_Writer & cw) const;
     // commands
     void cancel_jobs(Equation_Handle e);
     void change_pool_count(int delta)
@@ -173,6 +180,7 @@ class Rewriter_Machine::Job_Manager
     void schedule_partial_reduction_check(Node_Handle node,Ordinal g);
     void update_machine(unsigned flags);
     void divert_differences();
+    void restore(Checkpoint_Reader & cr);
     void urgent_deductions();
   private:
     void check_differences(Equation_Queue & queue,unsigned flags,int priority);
@@ -182,6 +190,11 @@ class Rewriter_Machine::Job_Manager
     void check_partial_reductions(unsigned flags,int priority);
     void recheck_partial_reductions(unsigned flags,int priority);
     void check_pool(unsigned flags,int priority);
+    bool reconsider_pooled(Ordinal_Word & lhs_word,Ordinal_Word & rhs_word,
+                           const Derivation & derivation,unsigned inner_flags,
+                           unsigned flags,int priority,
+                           Element_Count * nr_adopted,
+                           Element_Count * nr_improved);
     void conjugate(unsigned flags,int priority);
     void deduce(unsigned flags,int priority);
     void make_room_for_more_jobs();
@@ -191,6 +204,13 @@ class Rewriter_Machine::Job_Manager
     void pre_correct(unsigned flags,int priority);
     void remove(unsigned flags,int priority);
     void rhs_corrections(unsigned flags,int priority);
+    void speculate(Node_Overlap ** window,Overlap_Speculation * speculation,
+                   Node_Count count,bool is_total,unsigned ae_flags);
+    void speculate_in_parallel(Node_Overlap ** window,
+                               Overlap_Speculation * speculation,
+                               Node_Count count,bool is_total,
+                               unsigned ae_flags,unsigned nr_threads);
+    unsigned speculation_threads() const;
     void set_priority(int priority)
     {
       if (priority > new_priority)
@@ -0,0 +1,507 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: maf_mcache.cpp $
+//
+
+/* Implementation of the class declared in maf_mcache.h */
+
+#include "awcc.h"
+#include "fsa.h"
+#include "maf.h"
+#include "maf_mcache.h"
+#include "checkpoint.h"
+#include "container.h"
+#include "mafword.h"
+
+/* The version is stored in each file, so that if the format changes old
+   entries are simply treated as misses */
+const unsigned MCACHE_MAGIC = 0x4d43464du;
+const unsigned MCACHE_VERSION = 1;
+const unsigned MCACHE_INDEX_MAGIC = 0x4d434649u;
+
+/* Flags stored for each state */
+const Byte MCS_INITIAL = 1;
+const Byte MCS_ACCEPTING = 2;
+
+/* The keys are 64-bit FNV-1a. They only need to make collisions unlikely,
+   since the file contains everything that went into the key and this is
+   checked before the entry is used */
+const Unsigned_Long_Long FNV64_OFFSET_BASIS = 14695981039346656037ull;
+const Unsigned_Long_Long FNV64_PRIME = 1099511628211ull;
+
+inline Unsigned_Long_Long fnv64_update(Unsigned_Long_Long hash,
+                                       const void * data,size_t size)
+{
+  const Byte * bytes = (const Byte *) data;
+  for (size_t i = 0; i < size;i++)
+    hash = (hash ^ bytes[i]) * FNV64_PRIME;
+  return hash;
+}
+
+inline Unsigned_Long_Long fnv64_word(Unsigned_Long_Long hash,const Word & word)
+{
+  Word_Length length = word.length();
+  hash = fnv64_update(hash,&length,sizeof(length));
+  return fnv64_update(hash,word.buffer(),length*sizeof(Ordinal));
+}
+
+/**/
+
+Multiplier_Cache::Multiplier_Cache(Container & container_,String directory_,
+                                   Unsigned_Long_Long max_size_) :
+  container(container_),
+  max_size(max_size_),
+  total_size(0),
+  clock(0),
+  entries(0),
+  nr_entries(0),
+  allocated_entries(0),
+  nr_hits(0),
+  nr_misses(0),
+  index_changed(false),
+  usable(false)
+{
+  String_Buffer sb;
+  directory = directory_;
+  index_filename = sb.format("%s/multipliers.idx",directory_.string());
+  read_index();
+  evict();
+  usable = write_index();
+}
+
+/**/
+
+Multiplier_Cache::~Multiplier_Cache()
+{
+  if (index_changed)
+    write_index();
+  if (nr_hits || nr_misses)
+    container.progress(1,"Multiplier cache: " FMT_NC " hits " FMT_NC
+                       " misses\n",nr_hits,nr_misses);
+  if (entries)
+    delete [] entries;
+}
+
+/**/
+
+Unsigned_Long_Long Multiplier_Cache::fingerprint(const FSA & fsa)
+{
+  /* The flags are deliberately left out, since they record how the FSA
+     was built and checked rather than what it is */
+  const State_Count nr_states = fsa.state_count();
+  const Transition_ID nr_symbols = fsa.alphabet_size();
+  const Label_Count nr_labels = fsa.label_count();
+  Unsigned_Long_Long hash = FNV64_OFFSET_BASIS;
+  hash = fnv64_update(hash,&nr_states,sizeof(nr_states));
+  hash = fnv64_update(hash,&nr_symbols,sizeof(nr_symbols));
+  hash = fnv64_update(hash,&nr_labels,sizeof(nr_labels));
+  State_ID * transition = new State_ID[nr_symbols];
+  for (State_ID si = 1; si < nr_states;si++)
+  {
+    Byte state_flags = (fsa.is_initial(si) ? MCS_INITIAL : 0) |
+                       (fsa.is_accepting(si) ? MCS_ACCEPTING : 0);
+    Label_ID label_nr = fsa.get_label_nr(si);
+    fsa.get_transitions(transition,si);
+    hash = fnv64_update(hash,&state_flags,sizeof(state_flags));
+    hash = fnv64_update(hash,&label_nr,sizeof(label_nr));
+    hash = fnv64_update(hash,transition,nr_symbols*sizeof(State_ID));
+  }
+  delete [] transition;
+  if (fsa.labels_are_words())
+  {
+    Word_List wl(fsa.label_alphabet());
+    Ordinal_Word word(fsa.label_alphabet());
+    for (Label_ID label = 1; label < nr_labels;label++)
+    {
+      fsa.label_word_list(&wl,label);
+      Element_Count count = wl.count();
+      hash = fnv64_update(hash,&count,sizeof(count));
+      for (Element_ID word_nr = 0; word_nr < count;word_nr++)
+      {
+        wl.get(&word,word_nr);
+        hash = fnv64_word(hash,word);
+      }
+    }
+  }
+  return hash;
+}
+
+/**/
+
+bool Multiplier_Cache::worth_caching(const Multiplier & basis,
+                                     const Word_Collection & words)
+{
+  Ordinal_Word word(words.alphabet);
+  Element_Count count = words.count();
+  for (Element_ID word_nr = 0; word_nr < count;word_nr++)
+    if (words.get(&word,word_nr) && !basis.is_multiplier(word))
+      return true;
+  return false;
+}
+
+/**/
+
+Unsigned_Long_Long Multiplier_Cache::key(Unsigned_Long_Long basis_fingerprint,
+                                         const Word_Collection & words,
+                                         bool labelled) const
+{
+  Unsigned_Long_Long hash = FNV64_OFFSET_BASIS;
+  Byte flag = labelled;
+  hash = fnv64_update(hash,&basis_fingerprint,sizeof(basis_fingerprint));
+  hash = fnv64_update(hash,&flag,sizeof(flag));
+  Ordinal_Word word(words.alphabet);
+  Element_Count count = words.count();
+  for (Element_ID word_nr = 0; word_nr < count;word_nr++)
+    if (words.get(&word,word_nr))
+      hash = fnv64_word(hash,word);
+  return hash;
+}
+
+/**/
+
+String Multiplier_Cache::filename(String_Buffer * sb,Unsigned_Long_Long key) const
+{
+  return sb->format("%s/%08x%08x.mcm",directory.string().string(),
+                    unsigned(key >> 32),unsigned(key & 0xffffffffu));
+}
+
+/**/
+
+Multiplier_Cache::Entry * Multiplier_Cache::find_entry(Unsigned_Long_Long key) const
+{
+  /* The index is small, since each entry stands for a composite that
+     took a noticeable amount of time to build, so a linear search is
+     good enough */
+  for (Element_ID i = 0; i < nr_entries;i++)
+    if (entries[i].key == key)
+      return entries+i;
+  return 0;
+}
+
+/**/
+
+void Multiplier_Cache::add_entry(Unsigned_Long_Long key,Unsigned_Long_Long size)
+{
+  Entry * entry = find_entry(key);
+  if (entry)
+    total_size -= entry->size;
+  else
+  {
+    if (nr_entries == allocated_entries)
+    {
+      allocated_entries = allocated_entries ? allocated_entries*2 : 64;
+      Entry * new_entries = new Entry[allocated_entries];
+      for (Element_ID i = 0; i < nr_entries;i++)
+        new_entries[i] = entries[i];
+      if (entries)
+        delete [] entries;
+      entries = new_entries;
+    }
+    entry = entries + nr_entries++;
+    entry->key = key;
+  }
+  entry->size = size;
+  entry->last_used = ++clock;
+  total_size += size;
+  index_changed = true;
+}
+
+/**/
+
+void Multiplier_Cache::evict()
+{
+  if (!max_size)
+    return;
+  String_Buffer sb;
+  while (total_size > max_size && nr_entries)
+  {
+    Element_ID oldest = 0;
+    for (Element_ID i = 1; i < nr_entries;i++)
+      if (entries[i].last_used < entries[oldest].last_used)
+        oldest = i;
+    container.delete_file(filename(&sb,entries[oldest].key));
+    total_size -= entries[oldest].size;
+    entries[oldest] = entries[--nr_entries];
+    index_changed = true;
+  }
+}
+
+/**/
+
+void Multiplier_Cache::read_index()
+{
+  Checkpoint_Reader cr(container,index_filename);
+  unsigned magic = 0;
+  unsigned version = 0;
+  Element_Count count = 0;
+  if (!cr.is_ok() || !cr.get(&magic) || magic != MCACHE_INDEX_MAGIC ||
+      !cr.get(&version) || version != MCACHE_VERSION ||
+      !cr.get(&clock) || !cr.get(&count))
+  {
+    clock = 0;
+    return;
+  }
+  for (Element_ID i = 0; i < count;i++)
+  {
+    Entry entry;
+    if (!cr.get(&entry))
+      break;
+    add_entry(entry.key,entry.size);
+    entries[nr_entries-1].last_used = entry.last_used;
+  }
+  index_changed = false;
+}
+
+/**/
+
+bool Multiplier_Cache::write_index()
+{
+  Checkpoint_Writer cw(container,index_filename);
+  cw.put(MCACHE_INDEX_MAGIC);
+  cw.put(MCACHE_VERSION);
+  cw.put(clock);
+  cw.put(nr_entries);
+  for (Element_ID i = 0; i < nr_entries;i++)
+    cw.put(entries[i]);
+  if (!cw.is_ok() || !cw.commit())
+    return false;
+  index_changed = false;
+  return true;
+}
+
+/**/
+
+FSA_Simple * Multiplier_Cache::find(const Multiplier & basis,
+                                    const Word & word,bool labelled)
+{
+  Word_List wl(word.alphabet(),1);
+  wl.add(word);
+  return find(basis,wl,labelled);
+}
+
+/**/
+
+FSA_Simple * Multiplier_Cache::find(const Multiplier & basis,
+                                    const Word_Collection & words,
+                                    bool labelled)
+{
+  Unsigned_Long_Long basis_fingerprint = basis.fingerprint();
+  Unsigned_Long_Long k = key(basis_fingerprint,words,labelled);
+  String_Buffer sb;
+  Mutex_Lock lock(mutex);
+  Checkpoint_Reader cr(container,filename(&sb,k));
+  if (!cr.is_ok())
+  {
+    nr_misses++;
+    return 0;
+  }
+
+  /* Check the header matches what we are looking for */
+  unsigned magic = 0;
+  unsigned version = 0;
+  Unsigned_Long_Long fp = 0;
+  Byte flag = 0;
+  bool ok = cr.get(&magic) && magic == MCACHE_MAGIC &&
+            cr.get(&version) && version == MCACHE_VERSION &&
+            cr.get(&fp) && fp == basis_fingerprint &&
+            cr.get(&flag) && flag == Byte(labelled);
+  Ordinal_Word word(words.alphabet);
+  Ordinal_Word stored_word(words.alphabet);
+  Element_Count count = words.count();
+  for (Element_ID word_nr = 0; ok && word_nr < count;word_nr++)
+    if (words.get(&word,word_nr))
+      ok = cr.get_word(&stored_word) && stored_word == word;
+
+  /* Now read the FSA itself */
+  State_Count nr_states = 0;
+  Transition_ID nr_symbols = 0;
+  unsigned flags = 0;
+  unsigned label_type = 0;
+  Byte own_labels = 0;
+  Label_Count nr_labels = 0;
+  ok = ok && cr.get(&nr_states) && cr.get(&nr_symbols) && cr.get(&flags) &&
+       cr.get(&label_type) && cr.get(&own_labels) && cr.get(&nr_labels) &&
+       nr_symbols == basis.alphabet_size();
+  FSA_Simple * fsa = 0;
+  if (ok)
+  {
+    const Alphabet & label_alphabet = own_labels ? basis.label_alphabet() :
+                                                   basis.base_alphabet;
+    fsa = new FSA_Simple(container,basis.base_alphabet,nr_states,nr_symbols,
+                         TSF_Default);
+    fsa->change_flags(flags,0);
+    if (nr_labels > 1)
+    {
+      fsa->set_label_type(Label_Type(label_type));
+      fsa->set_label_alphabet(label_alphabet);
+      fsa->set_nr_labels(nr_labels);
+      Word_List wl(label_alphabet);
+      Ordinal_Word label_word(label_alphabet);
+      for (Label_ID label = 1; ok && label < nr_labels;label++)
+      {
+        Element_Count nr_words = 0;
+        ok = cr.get(&nr_words);
+        wl.empty();
+        for (Element_ID word_nr = 0; ok && word_nr < nr_words;word_nr++)
+          if ((ok = cr.get_word(&label_word))!=false)
+            wl.add(label_word);
+        ok = ok && fsa->set_label_word_list(label,wl);
+      }
+    }
+    fsa->clear_accepting(true);
+    fsa->clear_initial();
+    Transition_Compressor compressor(nr_symbols);
+    State_ID * transition = new State_ID[nr_symbols];
+    Byte * cdata = new Byte[nr_symbols*sizeof(State_ID)*2+16];
+    for (State_ID si = 1; ok && si < nr_states;si++)
+    {
+      Byte state_flags = 0;
+      Label_ID label_nr = 0;
+      size_t size = 0;
+      ok = cr.get(&state_flags) && cr.get(&label_nr) && cr.get(&size) &&
+           size <= nr_symbols*sizeof(State_ID)*2+16 && cr.get(cdata,size);
+      if (ok)
+      {
+        compressor.decompress(transition,size ? cdata : 0);
+        fsa->set_transitions(si,transition);
+        if (nr_labels > 1)
+          fsa->set_label_nr(si,label_nr);
+        if (state_flags & MCS_INITIAL)
+          fsa->set_is_initial(si,true);
+        if (state_flags & MCS_ACCEPTING)
+          fsa->set_is_accepting(si,true);
+      }
+    }
+    delete [] cdata;
+    delete [] transition;
+    if (ok)
+      fsa->tidy();
+    else
+    {
+      delete fsa;
+      fsa = 0;
+    }
+  }
+  if (!fsa)
+  {
+    /* Either the key collided, or the entry was written by a different
+       version of MAF. Either way it is no use to anybody */
+    container.delete_file(filename(&sb,k));
+    nr_misses++;
+    return 0;
+  }
+  Entry * entry = find_entry(k);
+  if (entry)
+  {
+    entry->last_used = ++clock;
+    index_changed = true;
+  }
+  nr_hits++;
+  return fsa;
+}
+
+/**/
+
+void Multiplier_Cache::store(const Multiplier & basis,const Word & word,
+                             bool labelled,const FSA_Simple & fsa)
+{
+  Word_List wl(word.alphabet(),1);
+  wl.add(word);
+  store(basis,wl,labelled,fsa);
+}
+
+/**/
+
+void Multiplier_Cache::store(const Multiplier & basis,
+                             const Word_Collection & words,bool labelled,
+                             const FSA_Simple & fsa)
+{
+  /* Only FSAs whose labels can be rebuilt from the file are kept */
+  const Label_Count nr_labels = fsa.label_count();
+  Byte own_labels = &fsa.label_alphabet() != &basis.base_alphabet;
+  if (&fsa.base_alphabet != &basis.base_alphabet)
+    return;
+  if (nr_labels > 1 && !fsa.labels_are_words())
+    return;
+  if (nr_labels > 1 && own_labels &&
+      &fsa.label_alphabet() != &basis.label_alphabet())
+    return;
+
+  Unsigned_Long_Long basis_fingerprint = basis.fingerprint();
+  Unsigned_Long_Long k = key(basis_fingerprint,words,labelled);
+  String_Buffer sb;
+  Mutex_Lock lock(mutex);
+  Checkpoint_Writer cw(container,filename(&sb,k));
+  if (!cw.is_ok())
+    return;
+  cw.put(MCACHE_MAGIC);
+  cw.put(MCACHE_VERSION);
+  cw.put(basis_fingerprint);
+  cw.put(Byte(labelled));
+  Ordinal_Word word(words.alphabet);
+  Element_Count count = words.count();
+  for (Element_ID word_nr = 0; word_nr < count;word_nr++)
+    if (words.get(&word,word_nr))
+      cw.put_word(word);
+
+  const State_Count nr_states = fsa.state_count();
+  const Transition_ID nr_symbols = fsa.alphabet_size();
+  cw.put(nr_states);
+  cw.put(nr_symbols);
+  cw.put(fsa.get_flags());
+  cw.put(unsigned(fsa.label_type()));
+  cw.put(own_labels);
+  cw.put(nr_labels);
+  if (nr_labels > 1)
+  {
+    Word_List wl(fsa.label_alphabet());
+    Ordinal_Word label_word(fsa.label_alphabet());
+    for (Label_ID label = 1; label < nr_labels;label++)
+    {
+      fsa.label_word_list(&wl,label);
+      Element_Count nr_words = wl.count();
+      cw.put(nr_words);
+      for (Element_ID word_nr = 0; word_nr < nr_words;word_nr++)
+      {
+        wl.get(&label_word,word_nr);
+        cw.put_word(label_word);
+      }
+    }
+  }
+  Transition_Compressor compressor(nr_symbols);
+  State_ID * transition = new State_ID[nr_symbols];
+  for (State_ID si = 1; si < nr_states;si++)
+  {
+    Byte state_flags = (fsa.is_initial(si) ? MCS_INITIAL : 0) |
+                       (fsa.is_accepting(si) ? MCS_ACCEPTING : 0);
+    fsa.get_transitions(transition,si);
+    size_t size = compressor.compress(transition);
+    cw.put(state_flags);
+    cw.put(fsa.get_label_nr(si));
+    cw.put(size);
+    cw.put(compressor.cdata,size);
+  }
+  delete [] transition;
+  Unsigned_Long_Long size = cw.size();
+  if (cw.commit())
+  {
+    add_entry(k,size);
+    evict();
+    write_index();
+  }
+}
@@ -0,0 +1,134 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: maf_mcache.h $
+*/
+#pragma once
+#ifndef MAF_MCACHE_INCLUDED
+#define MAF_MCACHE_INCLUDED 1
+
+/* A Multiplier_Cache keeps composite multipliers on disk, so that
+   gpaxioms, gpsubpres, gpmult2 and the like do not have to build the same
+   composites again each time they are run against the same automatic
+   structure. It is created by MAF::start_multiplier_cache() when the
+   -multiplier_cache option is used, and Multiplier::composite() and
+   Serial_Compositor look in it before doing any work.
+
+   The cache is content addressed. Each entry is identified by a
+   fingerprint of the multiplier it was built from, which is computed from
+   the FSA itself rather than from the name of the file it was read from,
+   by whether the composite has proper labels, and by the list of words
+   requested. The file name is a hash of all of these, and the file also
+   contains them in full, so a hash collision only causes a miss.
+
+   Each file is written with Checkpoint_Writer, so it is protected by a
+   checksum and is never left half written. The transitions are stored in
+   the same compressed form that FSA_Simple uses for sparse FSAs.
+
+   An index file in the cache directory records the size of each entry and
+   when it was last used. When the total size exceeds the limit the least
+   recently used entries are deleted. If two programs use the same cache
+   directory at once entries written by one of them may be left out of the
+   index, in which case they are still found but are never evicted.
+
+   All the methods are thread safe. */
+
+#ifndef AWDEFS_INCLUDED
+#include "awdefs.h"
+#endif
+#ifndef MAFBASE_INCLUDED
+#include "mafbase.h"
+#endif
+#ifndef MAFTHREAD_INCLUDED
+#include "mafthread.h"
+#endif
+
+// Classes referred to but defined elsewhere
+class Container;
+class FSA;
+class FSA_Simple;
+class Multiplier;
+class Word;
+class Word_Collection;
+
+class Multiplier_Cache
+{
+  BLOCKED(Multiplier_Cache)
+  private:
+    struct Entry
+    {
+      Unsigned_Long_Long key;
+      Unsigned_Long_Long size;
+      Unsigned_Long_Long last_used;
+    };
+    Container & container;
+    Owned_String directory;
+    Owned_String index_filename;
+    Unsigned_Long_Long max_size;
+    Unsigned_Long_Long total_size;
+    Unsigned_Long_Long clock;
+    Entry * entries;
+    Element_Count nr_entries;
+    Element_Count allocated_entries;
+    Element_Count nr_hits;
+    Element_Count nr_misses;
+    Mutex mutex;
+    bool index_changed;
+    bool usable;
+  public:
+    /* max_size is the total size in bytes the files in the cache may
+       occupy. 0 means there is no limit */
+    Multiplier_Cache(Container & container_,String directory_,
+                     Unsigned_Long_Long max_size_);
+    ~Multiplier_Cache();
+    /* is_ok() returns false if the index could not be written, which
+       usually means the directory does not exist */
+    bool is_ok() const
+    {
+      return usable;
+    }
+    /* find() returns a new copy of the composite of basis for words if it
+       is in the cache, and 0 otherwise. labelled should be true if the
+       composite should have labelled accept states */
+    FSA_Simple * find(const Multiplier & basis,const Word_Collection & words,
+                      bool labelled);
+    FSA_Simple * find(const Multiplier & basis,const Word & word,bool labelled);
+    void store(const Multiplier & basis,const Word_Collection & words,
+               bool labelled,const FSA_Simple & fsa);
+    void store(const Multiplier & basis,const Word & word,bool labelled,
+               const FSA_Simple & fsa);
+    /* worth_caching() returns false if all the words are already
+       multipliers of basis, in which case the composite is only an
+       extraction which costs less than reading it back */
+    static bool worth_caching(const Multiplier & basis,
+                              const Word_Collection & words);
+    // fingerprint() returns a 64-bit hash of the contents of an FSA
+    static Unsigned_Long_Long fingerprint(const FSA & fsa);
+  private:
+    Unsigned_Long_Long key(Unsigned_Long_Long basis_fingerprint,
+                           const Word_Collection & words,
+                           bool labelled) const;
+    String filename(String_Buffer * sb,Unsigned_Long_Long key) const;
+    Entry * find_entry(Unsigned_Long_Long key) const;
+    void add_entry(Unsigned_Long_Long key,Unsigned_Long_Long size);
+    void evict();
+    void read_index();
+    bool write_index();
+};
+
+#endif
@@ -116,6 +116,8 @@
 #include "maf_el.h"
 #include "maf_ss.h"
 #include "equation.h"
+#include "mafthread.h"
+#include "maf_mcache.h"
 
 /* Multiplier::Node and Multiplier::Node_List are used in performing
    multiplication*/
@@ -167,7 +169,8 @@ Multiplier::Multiplier(const Multiplier &other) :
   multipliers(*new Sorted_Word_List(other.base_alphabet)),
   max_depth(0),
   stack(0),
-  valid_length(0)
+  valid_length(0),
+  content_fingerprint(other.content_fingerprint)
 {
   fsa__ = FSA_Factory::copy(*other.fsa());
   set_multipliers();
@@ -181,7 +184,8 @@ Multiplier::Multiplier(FSA &other,bool owner_) :
   containing_label(0),
   max_depth(0),
   stack(0),
-  valid_length(0)
+  valid_length(0),
+  content_fingerprint(0)
 {
   owner = owner_;
 
@@ -209,6 +213,15 @@ bool Multiplier::is_multiplier(const Word & word,Element_ID * multiplier_nr) con
   return multipliers.find(word,multiplier_nr);
 }
 
+Unsigned_Long_Long Multiplier::fingerprint() const
+{
+  if (!content_fingerprint)
+    content_fingerprint = Multiplier_Cache::fingerprint(*this);
+  return content_fingerprint;
+}
+
+/**/
+
 const Word * Multiplier::multiplier(Element_ID word_nr) const
 {
   return multipliers.word(word_nr);
@@ -912,6 +925,10 @@ class Multiplier_DB : public Word_DB
     {
       counts[multiplier_nr] += delta;
     }
+    unsigned reference_count(Element_ID multiplier_nr) const
+    {
+      return counts[multiplier_nr];
+    }
     FSA_Simple * multiplier(Element_ID multiplier_nr)
     {
       return fsas[multiplier_nr];
@@ -991,6 +1008,108 @@ class Multiplier_DB : public Word_DB
     }
 };
 
+/* Shared_Multiplier_DB is used when the axioms are checked in more than
+   one thread. Each thread builds the multipliers for one relation at a time
+   with its own Serial_Compositor, so without some help a composite needed
+   for several relations would be built once for each of them.
+
+   Before the threads start every subword of length 3 or more of each side
+   of the relations is counted, and those that occur more than once are
+   entered into the database with their count. When a thread builds one of
+   these multipliers it publishes a copy, and any other thread that needs
+   it later takes a copy of that instead of building it again. Each time a
+   relation has been checked its subwords are released, so that each
+   multiplier is freed once nothing else can need it.
+
+   Two threads may still build the same multiplier if both start on it
+   before either has finished it. All the methods are thread safe. */
+
+class Shared_Multiplier_DB
+{
+  private:
+    Multiplier_DB multiplier_db;
+    Mutex mutex;
+    bool failed;
+  public:
+    Shared_Multiplier_DB(const Word_List & axiom_words) :
+      multiplier_db(axiom_words.alphabet,1024),
+      failed(false)
+    {
+      Multiplier_DB census(axiom_words.alphabet,1024);
+      Ordinal_Word word(axiom_words.alphabet);
+      Element_Count nr_words = axiom_words.count();
+      Element_ID word_nr;
+      for (word_nr = 0; word_nr < nr_words;word_nr++)
+      {
+        axiom_words.get(&word,word_nr);
+        Word_Length l = word.length();
+        for (Word_Length i = 0; i + 3 <= l;i++)
+          for (Word_Length j = i + 3; j <= l;j++)
+            census.up_count(census.enter(Subword(word,i,j)),1);
+      }
+      Element_Count nr_subwords = census.count();
+      for (word_nr = 0; word_nr < nr_subwords;word_nr++)
+      {
+        unsigned count = census.reference_count(word_nr);
+        if (count > 1)
+        {
+          census.get(&word,word_nr);
+          multiplier_db.up_count(multiplier_db.enter(word),count);
+        }
+      }
+    }
+    /* copy() returns a copy of the multiplier for word if another thread
+       has published it, and 0 otherwise */
+    FSA_Simple * copy(const Word & word)
+    {
+      Mutex_Lock lock(mutex);
+      Element_ID multiplier_nr;
+      if (multiplier_db.find(word,&multiplier_nr))
+      {
+        const FSA_Simple * fsa = multiplier_db.multiplier(multiplier_nr);
+        if (fsa)
+          return FSA_Factory::copy(*fsa);
+      }
+      return 0;
+    }
+    void publish(const Word & word,const FSA_Simple & fsa)
+    {
+      Mutex_Lock lock(mutex);
+      Element_ID multiplier_nr;
+      if (multiplier_db.find(word,&multiplier_nr) &&
+          multiplier_db.reference_count(multiplier_nr) &&
+          !multiplier_db.multiplier(multiplier_nr))
+        multiplier_db.set_multiplier(multiplier_nr,FSA_Factory::copy(fsa));
+    }
+    // release() is called for each side of a relation once it is checked
+    void release(const Word & side)
+    {
+      Mutex_Lock lock(mutex);
+      Word_Length l = side.length();
+      for (Word_Length i = 0; i + 3 <= l;i++)
+        for (Word_Length j = i + 3; j <= l;j++)
+        {
+          Element_ID multiplier_nr;
+          if (multiplier_db.find(Subword((Word &) side,i,j),&multiplier_nr))
+            multiplier_db.down_count(multiplier_nr,1);
+        }
+    }
+    /* Once one relation has failed there is no point in checking any others,
+       so abandon() tells every thread to stop as soon as it can */
+    void abandon()
+    {
+      Mutex_Lock lock(mutex);
+      failed = true;
+    }
+    bool abandoned()
+    {
+      Mutex_Lock lock(mutex);
+      return failed;
+    }
+};
+
+/**/
+
 class Parallel_Compositor : public Compositor
 {
   private:
@@ -1782,6 +1901,7 @@ class Serial_Compositor : public Compositor
     Operator_Word ** words;
     Element_Count nr_words;
     Element_Count work_count;
+    Shared_Multiplier_DB * shared_db; // only used by parallel axiom checks
     bool require_labels;
     bool can_invert;
   public:
@@ -1789,12 +1909,14 @@ class Serial_Compositor : public Compositor
                       const Word_List &desired_multipliers,
                       const Word_List &short_multipliers,
                       bool require_labels_,
-                      Compositor_Algorithm algorithm = CA_Hybrid) :
+                      Compositor_Algorithm algorithm = CA_Hybrid,
+                      Shared_Multiplier_DB * shared_db_ = 0) :
       maf(maf_),
       gm(gm_),
       multiplier_db(gm_.base_alphabet,1024),
       work_db(1024,0),
       gm2(0),
+      shared_db(shared_db_),
       require_labels(require_labels_),
       can_invert(maf.alphabet == gm.label_alphabet())
     {
@@ -1825,11 +1947,32 @@ class Serial_Compositor : public Compositor
           }
         }
 
+        /* Any multipliers that an earlier run has left in the cache need
+           no further work */
+        Multiplier_Cache * cache = maf.multiplier_cache;
+        Sorted_Word_List uncached_multipliers(desired_multipliers.alphabet,
+                                              new_multipliers.count());
+        for (word_nr = 0;word_nr < new_multipliers.count();word_nr++)
+        {
+          const Ordinal_Word & word = *new_multipliers.word(word_nr);
+          FSA_Simple * fsa = 0;
+          if (cache && word.length() > 1)
+            fsa = cache->find(gm,word,require_labels);
+          if (fsa)
+          {
+            Element_ID multiplier_nr = multiplier_db.enter(word);
+            multiplier_db.set_multiplier(multiplier_nr,fsa);
+            multiplier_db.up_count(multiplier_nr,1);
+          }
+          else
+            uncached_multipliers.insert(word);
+        }
+
         /* Construct the list of Operator_Words for the multipliers we need
            to create */
-        words = new Operator_Word *[nr_words = new_multipliers.count()];
+        words = new Operator_Word *[nr_words = uncached_multipliers.count()];
         for (word_nr = 0;word_nr < nr_words;word_nr++)
-          if (set_work(word_nr,*new_multipliers.word(word_nr)))
+          if (set_work(word_nr,*uncached_multipliers.word(word_nr)))
             pending++;
       }
 
@@ -1865,6 +2008,10 @@ class Serial_Compositor : public Compositor
 
         while (pending)
         {
+          /* If another thread has found a relation that fails the
+             multipliers are not needed any more */
+          if (shared_db && shared_db->abandoned())
+            return;
           bool found = false;
           for (word_nr = 0; word_nr < nr_words;word_nr++)
           {
@@ -1891,7 +2038,7 @@ class Serial_Compositor : public Compositor
         }
       }
       // make sure any words of length 0 or 1 are dealt with
-      for (word_nr = 0; word_nr < nr_words;word_nr++)
+      for (word_nr = 0; word_nr < new_multipliers.count();word_nr++)
         make_multiplier(*new_multipliers.word(word_nr));
       // make sure any inverse words are dealt with
       multiplier_db.extract_inverse_multipliers(maf,inverse_multipliers,!require_labels);
@@ -2000,14 +2147,26 @@ class Serial_Compositor : public Compositor
         else if (new_word.length() != 2 || !gm2)
         {
           /* hard case */
-          new_word.format(&sb1);
-          left.format(&sb2);
-          right.format(&sb3);
-          FSA_Simple * fsa1 = make_multiplier(left);
-          FSA_Simple * fsa2 = make_multiplier(right);
-          maf.container.progress(1,"Building multiplier %s from %s and %s\n",
-                                 sb1.get().string(),sb2.get().string(),sb3.get().string());
-          fsa = FSA_Factory::composite(*fsa1,*fsa2,require_labels);
+          Multiplier_Cache * cache = maf.multiplier_cache;
+          if (shared_db)
+            fsa = shared_db->copy(new_word);
+          if (!fsa && cache)
+            fsa = cache->find(gm,new_word,require_labels);
+          if (!fsa)
+          {
+            new_word.format(&sb1);
+            left.format(&sb2);
+            right.format(&sb3);
+            FSA_Simple * fsa1 = make_multiplier(left);
+            FSA_Simple * fsa2 = make_multiplier(right);
+            maf.container.progress(1,"Building multiplier %s from %s and %s\n",
+                                   sb1.get().string(),sb2.get().string(),sb3.get().string());
+            fsa = FSA_Factory::composite(*fsa1,*fsa2,require_labels);
+            if (cache)
+              cache->store(gm,new_word,require_labels,*fsa);
+            if (shared_db)
+              shared_db->publish(new_word,*fsa);
+          }
         }
         else
         {
@@ -2108,23 +2267,81 @@ Axiom_Checker checks that a multiplier that has passed the consistency
 check is really associative.
 
 All the work is done in the constructor!
+
+If the -threads option allows more than one thread, and the algorithm is
+not CA_Parallel, the relations in which one side is longer than 2 are
+shared out between several threads. Each thread builds the multipliers for
+one relation at a time using its own copy of the general multiplier and
+its own Serial_Compositor, and a Shared_Multiplier_DB lets the threads
+reuse composites built by each other. The first relation that fails stops
+all the threads. As elsewhere this is limited to geodesic orderings,
+because comparing words uses work areas in the Alphabet otherwise.
 */
 
 class Axiom_Checker
 {
   private:
+    class Worker;
     bool ok;
+    // state shared by the threads in check_in_parallel()
+    Mutex mutex;
+    const Word_List * long_relations;
+    Element_ID next_word;
+    Shared_Multiplier_DB * shared_db;
   public:
-    void check_relations(Word_List & axiom_words,Compositor &c)
+    bool check_relation(const Word & lhs_word,const Word & rhs_word,
+                        Compositor &c)
+    {
+      /* Check one relation using the multipliers contained in a compositor
+         on which fix_multipliers() has been called */
+      String_Buffer sb1,sb2;
+      Container & container = lhs_word.alphabet().container;
+      const Multiplier *gm2 = c.short_multiplier();
+      lhs_word.format(&sb1);
+      rhs_word.format(&sb2);
+      container.progress(1,"Checking relation %s=%s\n",sb1.get().string(),sb2.get().string());
+      if (lhs_word.length() <= 2 && rhs_word.length() <= 2 && gm2)
+      {
+        /* Check the multipliers always occur together */
+        Label_Count nr_labels = gm2->label_count();
+        Word_List label_wl(gm2->label_alphabet());
+
+        for (Label_ID label = 1;label < nr_labels;label++)
+        {
+          gm2->label_word_list(&label_wl,label);
+          int found = 0;
+          if (label_wl.contains(lhs_word))
+            found++;
+          if (label_wl.contains(rhs_word))
+            found++;
+          if (found == 1)
+          {
+            container.progress(1,"Check fails!\n");
+            return false;
+          }
+        }
+      }
+      else
+      {
+        const FSA_Simple * fsa1 = c.multiplier(lhs_word);
+        const FSA_Simple * fsa2 = c.multiplier(rhs_word);
+        if (!fsa1 || !fsa2)
+          MAF_INTERNAL_ERROR(container,("An FSA is unexpectedly missing!\n"));
+        if (fsa1->compare(*fsa2)!=0)
+        {
+          container.progress(1,"Check fails!\n");
+          return false;
+        }
+      }
+      return true;
+    }
+    void check_relations(const Word_List & axiom_words,Compositor &c)
     {
       /* Check the group relations using the multipliers contained
          in a compositor */
       ok = true;
       Ordinal_Word lhs_word(axiom_words.alphabet);
       Ordinal_Word rhs_word(axiom_words.alphabet);
-      String_Buffer sb1,sb2;
-      Container & container = axiom_words.alphabet.container;
-      const Multiplier *gm2 = c.short_multiplier();
       c.fix_multipliers();
 
       Element_Count nr_words = axiom_words.count();
@@ -2132,46 +2349,14 @@ class Axiom_Checker
       {
         axiom_words.get(&lhs_word,word_nr);
         axiom_words.get(&rhs_word,word_nr+1);
-        lhs_word.format(&sb1);
-        rhs_word.format(&sb2);
-        container.progress(1,"Checking relation %s=%s\n",sb1.get().string(),sb2.get().string());
-        if (lhs_word.length() <= 2 && rhs_word.length() <= 2 && gm2)
-        {
-          /* Check the multipliers always occur together */
-          Label_Count nr_labels = gm2->label_count();
-          Word_List label_wl(gm2->label_alphabet());
-
-          for (Label_ID label = 1;label < nr_labels;label++)
-          {
-            gm2->label_word_list(&label_wl,label);
-            int found = 0;
-            if (label_wl.contains(lhs_word))
-              found++;
-            if (label_wl.contains(rhs_word))
-              found++;
-            if (found == 1)
-            {
-              container.progress(1,"Check fails!\n");
-              ok = false;
-            }
-          }
-        }
-        else
-        {
-          const FSA_Simple * fsa1 = c.multiplier(lhs_word);
-          const FSA_Simple * fsa2 = c.multiplier(rhs_word);
-          if (!fsa1 || !fsa2)
-            MAF_INTERNAL_ERROR(container,("An FSA is unexpectedly missing!\n"));
-          if (fsa1->compare(*fsa2)!=0)
-          {
-            container.progress(1,"Check fails!\n");
-            ok = false;
-          }
-        }
+        ok = check_relation(lhs_word,rhs_word,c);
       }
     }
     Axiom_Checker(const MAF & maf,const General_Multiplier & gm,Compositor_Algorithm algorithm,
-                  bool check_inverses)
+                  bool check_inverses) :
+      long_relations(0),
+      next_word(0),
+      shared_db(0)
     {
       /* On entry gm_ is a general multiplier that is presumed to have
          passed the General_Multiplier::valid(). This means it defines
@@ -2243,6 +2428,8 @@ class Axiom_Checker
         Parallel_Compositor pc(maf,gm,axiom_words,short_words,false);
         check_relations(axiom_words,pc);
       }
+      else if (maf.options.threads > 1 && pd.is_short)
+        check_in_parallel(maf,gm,axiom_words,algorithm,maf.options.threads);
       else
       {
         Serial_Compositor sc(maf,gm,axiom_words,short_words,false,algorithm);
@@ -2254,10 +2441,151 @@ class Axiom_Checker
     {
       return ok;
     }
+  private:
+    void check_in_parallel(const MAF & maf,const General_Multiplier & gm,
+                           const Word_List & axiom_words,
+                           Compositor_Algorithm algorithm,unsigned nr_threads);
+    void work(const MAF & maf,const General_Multiplier & gm,
+              Compositor_Algorithm algorithm);
+};
+
+/**/
+
+class Axiom_Checker::Worker : public Thread
+{
+  private:
+    Axiom_Checker & checker;
+    const MAF & maf;
+    General_Multiplier gm; // FSA_Simple cannot be read by two threads at once
+    Compositor_Algorithm algorithm;
+  public:
+    Worker(Axiom_Checker & checker_,const MAF & maf_,
+           const General_Multiplier & gm_,Compositor_Algorithm algorithm_) :
+      checker(checker_),
+      maf(maf_),
+      gm(gm_),
+      algorithm(algorithm_)
+    {}
+  protected:
+    void run()
+    {
+      checker.work(maf,gm,algorithm);
+    }
 };
 
 /**/
 
+void Axiom_Checker::check_in_parallel(const MAF & maf,
+                                      const General_Multiplier & gm,
+                                      const Word_List & axiom_words,
+                                      Compositor_Algorithm algorithm,
+                                      unsigned nr_threads)
+{
+  /* The relations in which neither side is longer than 2 are checked
+     together in this thread first, since a single short multiplier deals
+     with all of them at once. */
+  Word_List short_relations(axiom_words.alphabet);
+  Word_List long_words(axiom_words.alphabet);
+  Ordinal_Word lhs_word(axiom_words.alphabet);
+  Ordinal_Word rhs_word(axiom_words.alphabet);
+  Element_Count nr_words = axiom_words.count();
+  for (Element_ID word_nr = 0; word_nr < nr_words; word_nr += 2)
+  {
+    axiom_words.get(&lhs_word,word_nr);
+    axiom_words.get(&rhs_word,word_nr+1);
+    Word_List & wl = lhs_word.length() <= 2 && rhs_word.length() <= 2 ?
+                     short_relations : long_words;
+    wl.add(lhs_word);
+    wl.add(rhs_word);
+  }
+  ok = true;
+  if (short_relations.count())
+  {
+    Serial_Compositor sc(maf,gm,short_relations,short_relations,false,
+                         algorithm);
+    check_relations(short_relations,sc);
+  }
+  if (!ok || !long_words.count())
+    return;
+
+  Element_Count nr_relations = long_words.count()/2;
+  if (Element_Count(nr_threads) > nr_relations)
+    nr_threads = unsigned(nr_relations);
+  Shared_Multiplier_DB sdb(long_words);
+  long_relations = &long_words;
+  next_word = 0;
+  shared_db = &sdb;
+  /* The copies of the general multiplier are made here, because gm may
+     not be read while another thread is reading it */
+  Worker ** workers = new Worker *[nr_threads];
+  unsigned i;
+  for (i = 1; i < nr_threads;i++)
+    workers[i] = new Worker(*this,maf,gm,algorithm);
+  for (i = 1; i < nr_threads;i++)
+    if (!workers[i]->start())
+    {
+      delete workers[i];
+      workers[i] = 0;
+    }
+  work(maf,gm,algorithm);
+  for (i = 1; i < nr_threads;i++)
+    if (workers[i])
+    {
+      workers[i]->join();
+      delete workers[i];
+    }
+  delete [] workers;
+  ok = !sdb.abandoned();
+  shared_db = 0;
+  long_relations = 0;
+}
+
+/**/
+
+void Axiom_Checker::work(const MAF & maf,const General_Multiplier & gm,
+                         Compositor_Algorithm algorithm)
+{
+  /* Check relations from long_relations until there are none left, or
+     one of the threads has found a relation that fails */
+  const Alphabet & alphabet = long_relations->alphabet;
+  Ordinal_Word lhs_word(alphabet);
+  Ordinal_Word rhs_word(alphabet);
+  Element_Count nr_words = long_relations->count();
+  for (;;)
+  {
+    {
+      Mutex_Lock lock(mutex);
+      if (next_word >= nr_words || shared_db->abandoned())
+        break;
+      long_relations->get(&lhs_word,next_word);
+      long_relations->get(&rhs_word,next_word+1);
+      next_word += 2;
+    }
+    Word_List relation(alphabet);
+    Word_List short_words(alphabet);
+    relation.add(lhs_word);
+    relation.add(rhs_word);
+    if (lhs_word.length() <= 2)
+      short_words.add(lhs_word);
+    if (rhs_word.length() <= 2)
+      short_words.add(rhs_word);
+    {
+      Serial_Compositor sc(maf,gm,relation,short_words,false,algorithm,
+                           shared_db);
+      if (!shared_db->abandoned())
+      {
+        sc.fix_multipliers();
+        if (!check_relation(lhs_word,rhs_word,sc))
+          shared_db->abandon();
+      }
+    }
+    shared_db->release(lhs_word);
+    shared_db->release(rhs_word);
+  }
+}
+
+/**/
+
 bool MAF::check_axioms(const General_Multiplier &gm,
                        Compositor_Algorithm algorithm,
                        bool check_inverses) const
@@ -2498,9 +2826,21 @@ void MAF::subgroup_relators(const General_Multiplier &gm,
 FSA_Simple * Multiplier::composite(const MAF & maf,
                                    const Word_Collection & new_multipliers) const
 {
-  Word_List short_wl(new_multipliers.alphabet);
-  Parallel_Compositor pc(maf,*this,new_multipliers,short_wl,true);
-  return pc.take();
+  /* Extracting multipliers we already have is cheaper than reading them
+     back, so the cache is only used for genuine composites */
+  Multiplier_Cache * cache = maf.multiplier_cache;
+  if (cache && !Multiplier_Cache::worth_caching(*this,new_multipliers))
+    cache = 0;
+  FSA_Simple * answer = cache ? cache->find(*this,new_multipliers,true) : 0;
+  if (!answer)
+  {
+    Word_List short_wl(new_multipliers.alphabet);
+    Parallel_Compositor pc(maf,*this,new_multipliers,short_wl,true);
+    answer = pc.take();
+    if (cache && answer)
+      cache->store(*this,new_multipliers,true,*answer);
+  }
+  return answer;
 }
 
 /**/
@@ -2509,10 +2849,8 @@ FSA_Simple * Multiplier::composite(const MAF & maf,
                                    const Word & new_multiplier) const
 {
   Word_List wl(new_multiplier.alphabet(),1);
-  Word_List short_wl(new_multiplier.alphabet());
   wl.add(new_multiplier);
-  Parallel_Compositor pc(maf,*this,wl,short_wl,true);
-  return pc.take();
+  return composite(maf,wl);
 }
 
 /**/
@@ -57,6 +57,8 @@
 #include "maf_we.h"
 #include "arraybox.h"
 #include "maf_el.h"
+#include "heap.h"
+#include "checkpoint.h"
 
 /*
    Node_Manager maintains the data describing the equations in a rewriting
@@ -294,6 +296,123 @@ class Block_Manager
         blocks[block_nr] = 0;
       }
     }
+
+    /* A checkpoint contains an image of each block of nodes. Since
+       Node_IDs are just block and slot numbers the images remain valid
+       when they are loaded into new blocks. The only things we have to
+       save separately are the transition tables of reduced nodes, which
+       are the only part of a Node not held inside the block. */
+    void checkpoint(Checkpoint_Writer & cw,const Node_Manager & nm) const
+    {
+      cw.put(nr_blocks);
+      cw.put(free_node);
+      for (Element_ID block_nr = 0; block_nr < nr_blocks;block_nr++)
+      {
+        const Node * node = blocks[block_nr];
+        bool present = node != 0;
+        cw.put(present);
+        if (!present)
+          continue;
+        cw.put(nodes_used[block_nr]);
+        cw.put(node,sizeof(Node)*BLOCK_SIZE);
+        for (int i = 0; i < BLOCK_SIZE;i++,node++)
+          if (!node->is_final())
+          {
+            if (node->flagged(NF_SPARSE))
+            {
+              const Node::Sparse_Node & sn = *node->reduced.child.sparse;
+              cw.put(sn.nr_children);
+              cw.put(sn.suffix);
+              cw.put(sn.children,sn.nr_children*sizeof(Node_ID));
+              /* The hash table is saved as it is, since rebuilding it
+                 would need the children, which may be in later blocks */
+              unsigned hash_size = sn.hash ? sn.hash_mask+1 : 0;
+              cw.put(hash_size);
+              cw.put(sn.hash,hash_size*sizeof(Node::Sparse_Node::Hash_Slot));
+            }
+            else
+            {
+              Ordinal child_start,child_end;
+              nm.valid_children(&child_start,&child_end,node->rvalue);
+              cw.put(node->reduced.child.dense+child_start,
+                     (child_end-child_start)*sizeof(Node_ID));
+            }
+          }
+      }
+      Element_Count count = block_holes.count();
+      cw.put(count);
+      cw.put(block_holes.buffer(),count*sizeof(Element_ID));
+    }
+
+    void restore(Checkpoint_Reader & cr,Nodes & nodes,const Node_Manager & nm)
+    {
+      /* The caller must already have freed the transition tables of
+         any nodes we have now */
+      for (Element_ID block_nr = 0; block_nr < nr_blocks;block_nr++)
+        if (blocks[block_nr])
+          delete [] blocks[block_nr];
+      cr.get(&nr_blocks);
+      cr.get(&free_node);
+      blocks.set_capacity((nr_blocks/64+1)*64,false);
+      nodes_used.set_capacity(blocks.capacity(),false);
+      nodes.block_table = blocks.buffer();
+      Heap_Tag tag(HC_Nodes);
+      for (Element_ID block_nr = 0; block_nr < nr_blocks;block_nr++)
+      {
+        bool present = false;
+        cr.get(&present);
+        if (!present || !cr.is_ok())
+        {
+          blocks[block_nr] = 0;
+          nodes_used[block_nr] = 0;
+          continue;
+        }
+        Node * node = blocks[block_nr] = new Node[BLOCK_SIZE];
+        cr.get(&nodes_used[block_nr]);
+        cr.get(node,sizeof(Node)*BLOCK_SIZE);
+        for (int i = 0; i < BLOCK_SIZE;i++,node++)
+          if (!node->is_final())
+          {
+            if (node->flagged(NF_SPARSE))
+            {
+              Node::Sparse_Node & sn = *(node->reduced.child.sparse = new Node::Sparse_Node);
+              cr.get(&sn.nr_children);
+              cr.get(&sn.suffix);
+              sn.nr_children_allocated = sn.nr_children;
+              if (sn.nr_children)
+              {
+                sn.children = new Node_ID[sn.nr_children];
+                cr.get(sn.children,sn.nr_children*sizeof(Node_ID));
+              }
+              unsigned hash_size = 0;
+              cr.get(&hash_size);
+              if (hash_size)
+              {
+                sn.hash = new Node::Sparse_Node::Hash_Slot[hash_size];
+                sn.hash_mask = hash_size-1;
+                cr.get(sn.hash,hash_size*sizeof(Node::Sparse_Node::Hash_Slot));
+              }
+            }
+            else
+            {
+              Ordinal child_start,child_end;
+              nm.valid_children(&child_start,&child_end,node->rvalue);
+              node->reduced.child.dense = new Node_ID[child_end-child_start] - child_start;
+              cr.get(node->reduced.child.dense+child_start,
+                     (child_end-child_start)*sizeof(Node_ID));
+            }
+          }
+      }
+      Element_Count count = 0;
+      cr.get(&count);
+      block_holes.empty();
+      while (count-- > 0 && cr.is_ok())
+      {
+        Element_ID block_nr;
+        cr.get(&block_nr);
+        block_holes.append_one(block_nr);
+      }
+    }
 };
 #else
 
@@ -372,6 +491,52 @@ Node_Manager::Node_Manager(Rewriter_Machine & rm_) :
 
 /**/
 
+void Node_Manager::checkpoint(Checkpoint_Writer & cw) const
+{
+#if MAF_USE_LOOKUP
+  bm.checkpoint(cw,*this);
+  cw.put(last_id);
+  cw.put(last_removed_id);
+  cw.put(current);
+  cw.put(stats);
+  cw.put(confluent);
+  cw.put(old_overlap_filter);
+  cw.put(overlap_filter);
+#endif
+}
+
+/**/
+
+void Node_Manager::restore(Checkpoint_Reader & cr)
+{
+#if MAF_USE_LOOKUP
+  /* Throw away the transition table of the root we made in the
+     constructor. Nothing else can own any memory yet. The root is always
+     the first node allocated, so it will be node 1 in the restored tree as
+     well. */
+  Node & old_root = root->node(*this);
+  if (old_root.flagged(NF_SPARSE))
+    delete old_root.reduced.child.sparse;
+  else
+  {
+    Ordinal child_start,child_end;
+    valid_children(&child_start,&child_end,old_root.rvalue);
+    delete [] (old_root.reduced.child.dense + child_start);
+  }
+  bm.restore(cr,*this,*this);
+  root = Node_Reference(*this,(Node_ID) 1);
+  cr.get(&last_id);
+  cr.get(&last_removed_id);
+  cr.get(&current);
+  cr.get(&stats);
+  cr.get(&confluent);
+  cr.get(&old_overlap_filter);
+  cr.get(&overlap_filter);
+#endif
+}
+
+/**/
+
 void Node_Manager::destroy_tree()
 {
   /* This needs to be called before the destructor, to allow Job_Manager
@@ -598,6 +763,7 @@ void Node_Manager::check_transitions(const Equation_Word & lhs,
      This part of the code can come to totally dominate performance if
      page faulting becomes significant, or if there are very many generators
   */
+  tree_modified();
   if (maf.aborting || maf.options.no_equations)
     publish_overlaps = false;
   Transition_Check tc(lhs,new_prefix_length,rhs_changed,
@@ -1073,6 +1239,7 @@ void Node_Manager::node_free(Node * node)
   node->rvalue = INVALID_SYMBOL;
   bm.node_free(node);
   current.node_freed++; // increment the timestamp for freed nodes in Certificate
+  current.tree_changed++;
   stats.nc[language_A]--;
 }
 
@@ -1080,6 +1247,7 @@ void Node_Manager::node_free(Node * node)
 
 Node_Reference Node_Manager::node_get()
 {
+  Heap_Tag tag(HC_Nodes);
   return bm.node_get(*this);
 }
 
@@ -1088,6 +1256,7 @@ void Node_Manager::purge()
 #ifndef MAF_USE_LOOKUP
   bm.purge();
 #endif
+  Heap::trim();
 }
 
 /**/
@@ -1177,6 +1346,7 @@ void Node_Manager::publish_partial_reduction(Node_Handle node,Ordinal g)
 
 void Node_Manager::remove_node(Node_Handle nh)
 {
+  tree_modified();
   Node & node = nh->node(*this);
   if (node.flagged(NF_REDUCIBLE))
   {
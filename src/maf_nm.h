@@ -69,6 +69,8 @@ class Equation_Word;
 class Node_List;
 class Block_Manager;
 class Transition_Check;
+class Checkpoint_Writer;
+class Checkpoint_Reader;
 
 /* During KB completion we may have equations of very different sizes and
    ages, and want to consider overlaps between them in a way that we hope
@@ -202,6 +204,7 @@ class Node_Manager : private Nodes
     {
       Node_Count ntc[2];
       Node_Count nc[5];
+      Node_Count nrc[NR_Count]; // irreducible nodes in each representation
     };
   private:
     Node_Reference root;
@@ -238,6 +241,12 @@ class Node_Manager : private Nodes
     {
       return current;
     }
+    // tree_unchanged() returns true if nothing in the tree has been altered
+    // since the certificate was taken
+    bool tree_unchanged(const Certificate & other) const
+    {
+      return current.same_tree(other);
+    }
     Node_Reference get_state(const Ordinal *values,Word_Length end,
                              Word_Length start = 0) const;
 #ifdef MAFNODE_INCLUDED
@@ -305,9 +314,13 @@ class Node_Manager : private Nodes
                                       unsigned short eq_flags,
                                       Node_Handle rhs_node,
                                       Node_Handle primary);
+    void checkpoint(Checkpoint_Writer & cw) const;
     void inspect(Node_Reference node,bool check_height);
     Node_Reference node_get();
     void purge();
+    // restore() replaces the tree with the one saved by checkpoint().
+    // It must be called before anything else has been added to the tree
+    void restore(Checkpoint_Reader & cr);
     void set_overlap_limits(Total_Length overlap_limit,
                             Total_Length attempt_limit,
                             Total_Length keep_limit,
@@ -336,6 +349,10 @@ class Node_Manager : private Nodes
     bool in_tree_as_subword_inner(const Equation_Word & word,Node_Reference nr) const;
     void node_free(Node * node);
     void remove_node(Node_Handle nh);
+    void tree_modified()
+    {
+      current.tree_changed++;
+    }
     /* statistics */
     void count_in(Language language)
     {
@@ -345,6 +362,14 @@ class Node_Manager : private Nodes
     {
       stats.nc[language]--;
     }
+    void count_in(Node_Representation representation)
+    {
+      stats.nrc[representation]++;
+    }
+    void count_out(Node_Representation representation)
+    {
+      stats.nrc[representation]--;
+    }
     /* publish/revoke methods are called internally to announce various types
        of change to the tree */
     void publish_partial_reduction(Node_Handle node,Ordinal g);
@@ -36,8 +36,8 @@ Revision 1.4  2007/10/24 21:15:36Z  Alun
 #pragma once
 #ifndef MAF_ONT_INCLUDED
 #define MAF_ONT_INCLUDED 1
-#ifndef MAF_AVL_INCLUDED
-#include "maf_avl.h"
+#ifndef MAF_BTREE_INCLUDED
+#include "maf_btree.h"
 #endif
 
 class Alphabet;
@@ -48,11 +48,12 @@ class Alphabet;
 
 #include "maf_nm.h"
 #include "container.h"
+#include "checkpoint.h"
 
 /* NB. When using these classes one must be certain that the key of the
 equation does not change */
 
-class Ordered_Node_Tree : public AVL_Tree<Node_ID>
+class Ordered_Node_Tree : public B_Tree<Node_ID>
 {
   public:
     Node_Manager & nm;
@@ -65,7 +66,7 @@ class Ordered_Node_Tree : public AVL_Tree<Node_ID>
     {
       Node_ID nid(data);
       extract_key(data);
-      AVL_Tree<Node_ID>::remove(nid);
+      B_Tree<Node_ID>::remove(nid);
     }
     void remove(Node_Handle e)
     {
@@ -99,6 +100,27 @@ class Ordered_Node_Tree : public AVL_Tree<Node_ID>
     {
       return node_count();
     }
+    /* The tree is saved in order and rebuilt without comparing keys, so
+       that the order of a restored tree is exactly the same as it was
+       even if some of the keys have changed since the nodes were added */
+    void checkpoint(Checkpoint_Writer & cw) const
+    {
+      State_Count count = node_count();
+      Node_ID * buffer = new Node_ID[count];
+      copy_in_order(buffer);
+      cw.put(count);
+      cw.put(buffer,count*sizeof(Node_ID));
+      delete [] buffer;
+    }
+    void restore(Checkpoint_Reader & cr)
+    {
+      State_Count count = 0;
+      cr.get(&count);
+      Node_ID * buffer = new Node_ID[count];
+      cr.get(buffer,count*sizeof(Node_ID));
+      load_in_order(buffer,count);
+      delete [] buffer;
+    }
 };
 
 class By_Left_Size_Node_Tree : public Ordered_Node_Tree
@@ -121,7 +143,7 @@ class By_Left_Size_Node_Tree : public Ordered_Node_Tree
     // virtual method we have to implement
     int compare(Node_ID,Node_ID d2) const
     {
-      /* AVL_Tree guarantees first parameter is pointer to data being inserted
+      /* B_Tree guarantees first parameter is pointer to data being inserted
          or removed. So we can compare the other word against the current
          test_word.
          We rank equations as follows:
@@ -178,7 +200,7 @@ class By_Size_Node_Tree : public Ordered_Node_Tree
     // virtual method we have to implement
     int compare(Node_ID,Node_ID d2) const
     {
-      /* AVL_Tree guarantees first parameter is pointer to data being inserted
+      /* B_Tree guarantees first parameter is pointer to data being inserted
          or removed. So we can compare the other word against the current
          test_word.
          We rank equations as follows:
@@ -202,92 +224,6 @@ class By_Size_Node_Tree : public Ordered_Node_Tree
     }
 };
 
-
-class By_Size_Removed_Time_Node_Tree : public Ordered_Node_Tree
-{
-  private:
-    Word_Length test_length;
-    Word_Length test_rlength;
-    Total_Length test_tl;
-    int equation_type;
-    ID timestamp;
-  public:
-    By_Size_Removed_Time_Node_Tree(Node_Manager  &nm_) :
-      Ordered_Node_Tree(nm_)
-    {}
-    void extract_key(State data)
-    {
-      test_rlength = data->raw_reduced_length(nm);
-      test_length = data->length(nm);
-      test_tl = test_rlength + test_length;
-      if (nm.pd.is_coset_system && data->first_letter(nm) >= nm.pd.coset_symbol)
-        equation_type = data->last_letter() > nm.pd.coset_symbol ? 1 : 2;
-      else
-        equation_type = 0;
-      timestamp = data->removed_id();
-    }
-    // virtual method we have to implement
-    int compare(Node_ID,Node_ID d2) const
-    {
-      /* AVL_Tree guarantees first parameter is pointer to data being inserted
-         or removed. So we can compare the other word against the current
-         test_word.
-         We rank equations as follows:
-         1) Shorter LHS length is better
-         2) Amongst equations of equal LHS length shorter RHS is better
-         (The opposite rule seems just as sensible and is what I used to
-          do. But there seems to be a slight amount of evidence that
-          this way round works a bit better on average, though it is
-          frequently worse. This should be controlled by an option)
-         3) If equations are still equal equation removed first is better
-      */
-      State e2 = Node::fast_find_node(nm,(Node_ID) d2);
-
-      int e2_type = 0;
-
-      if (nm.pd.is_coset_system)
-      {
-        if (e2->last_letter() > nm.pd.coset_symbol)
-          e2_type = 1;
-        else if (e2->first_letter(nm) >= nm.pd.coset_symbol)
-          e2_type = 2;
-      }
-
-      if (e2_type != equation_type)
-        return equation_type > e2_type ? 1 : -1;
-
-      Word_Length l2 = e2->length(nm);
-      if (l2 != test_length)
-        return test_length > l2 ? 1 : -1;
-
-      if (equation_type != 2)
-      {
-        l2 = e2->raw_reduced_length(nm);
-        if (l2 != test_rlength)
-          return test_rlength > l2  ? 1 : -1;
-      }
-
-      return timestamp < e2->removed_id() ? 1 : -1;
-    }
-};
-
-class By_Size_Node_Tree_Queued : public By_Size_Removed_Time_Node_Tree
-{
-  public:
-    By_Size_Node_Tree_Queued(Node_Manager  &nm_) :
-      By_Size_Removed_Time_Node_Tree(nm_)
-      {}
-    bool use(Node_Reference *e)
-    {
-      if (By_Size_Removed_Time_Node_Tree::use(e))
-      {
-        (*e)->node(nm).clear_flags(EQ_QUEUED);
-        return true;
-      }
-      return false;
-    }
-};
-
 class By_SizeTime_Node_Tree : public Ordered_Node_Tree
 {
   private:
@@ -312,7 +248,7 @@ class By_SizeTime_Node_Tree : public Ordered_Node_Tree
     // virtual method we have to implement
     int compare(Node_ID ,Node_ID d2) const
     {
-      /* AVL_Tree guarantees first parameter is pointer to data being inserted
+      /* B_Tree guarantees first parameter is pointer to data being inserted
          or removed. So we can compare the other word against the current
          test_word.
          We rank equations as follows:
@@ -365,7 +301,7 @@ class By_Time_Node_Tree : public Ordered_Node_Tree
     // virtual method we have to implement
     int compare(Node_ID ,Node_ID d2) const
     {
-      /* AVL_Tree guarantees first parameter is pointer to data being inserted
+      /* B_Tree guarantees first parameter is pointer to data being inserted
          or removed. So we can compare the other node against the extracted key.
          We rank equations as follows:
          1) Equations that have not yet been expanded are better than
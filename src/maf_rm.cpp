@@ -145,8 +145,13 @@
 #include "maf_dr.h"
 #include "maf_ont.h"
 #include "maf_wdb.h"
+#include "maf_spool.h"
 #include "maf_rws.h"
 #include "maf_em.h"
+#include "heap.h"
+#include "mafthread.h"
+#include "checkpoint.h"
+#include "telemetry.h"
 
 const int Priority_Extended = -100;
 const int Priority_Consider = -101;
@@ -229,11 +234,13 @@ Rewriter_Machine::Rewriter_Machine(MAF & maf_) :
   nr_trivial_generators(0),
   nr_coset_reducible_generators(0),
   pool(0),
+  spool(0),
   derivation_db(0),
   dt(0),
   expand_ont(0),
   word_reducer(*new Equation_Word_Reducer(nm)),
-  rm_state(RMS_Starting)
+  rm_state(RMS_Starting),
+  restored(false)
 {
   memset(&stats,0,sizeof(stats));
   reset_pool();
@@ -297,6 +304,8 @@ Rewriter_Machine::~Rewriter_Machine()
   delete &nm;
   if (pool)
     delete pool;
+  if (spool)
+    delete spool;
   if (derivation_db)
     delete derivation_db;
   delete [] generator_properties;
@@ -307,6 +316,13 @@ Rewriter_Machine::~Rewriter_Machine()
 
 void Rewriter_Machine::start()
 {
+  if (restored)
+  {
+    /* Everything start() would do was done before the checkpoint was
+       taken, and has been restored with it */
+    restored = false;
+    return;
+  }
   stats.started = stats.starting = true;
   if (pd.is_group)
   {
@@ -459,6 +475,14 @@ void Rewriter_Machine::start()
     else
       maf.options.expansion_order = 2;
 
+  create_expand_ont();
+  rm_state = RMS_Starting;
+}
+
+/**/
+
+void Rewriter_Machine::create_expand_ont()
+{
   switch (maf.options.expansion_order)
   {
     case 1:
@@ -477,7 +501,6 @@ void Rewriter_Machine::start()
       expand_ont = new By_Left_Size_Node_Tree(nm,maf.options.expansion_order==6);
       break;
   }
-  rm_state = RMS_Starting;
 }
 
 void Rewriter_Machine::reset_pool()
@@ -501,10 +524,13 @@ void Rewriter_Machine::restart()
      have thrown away something necessary.
      This method can save a lot of time in the confluent case, especially
      if a recursive ordering is used. */
+  if (spool)
+    spool->empty();
   if (pool)
   {
     delete pool;
     reset_pool();
+    Heap::trim();
   }
   Node_Reference e;
   stats.visible_limit = 0;
@@ -542,8 +568,57 @@ void Rewriter_Machine::restart()
 
 /**/
 
+void Rewriter_Machine::telemetry_sample(Telemetry_Sample * sample) const
+{
+  const Equation_Stats & estats = jm.status();
+  Telemetry_Value * value = sample->value;
+  value[TF_Status_Count] = stats.status_count;
+  value[TF_Nodes_L0] = nm.stats.nc[language_L0];
+  value[TF_Nodes_L1] = nm.stats.nc[language_L1];
+  value[TF_Nodes_L2] = nm.stats.nc[language_L2]+nm.stats.nc[language_L3];
+  value[TF_Nodes_Bad] = nm.stats.nc[language_A];
+  value[TF_Depth] = height();
+  value[TF_Nodes_Dense] = nm.stats.nrc[NR_Dense];
+  value[TF_Nodes_Sorted] = nm.stats.nrc[NR_Sorted];
+  value[TF_Nodes_Hashed] = nm.stats.nrc[NR_Hashed];
+  value[TF_Equations] = estats.nr_equations;
+  value[TF_Adopted] = estats.nr_adopted;
+  value[TF_Visible] = estats.nr_visible;
+  value[TF_Pool] = pool ? pool->count() : 0;
+  if (spool)
+    value[TF_Pool] += spool->count();
+  if (dt)
+  {
+    const Difference_Tracker::Status & dstats = dt->status();
+    value[TF_Differences] = dstats.nr_differences;
+    value[TF_Primary_Differences] = dstats.nr_primary_differences;
+  }
+  value[TF_Pool_Limit] = stats.pool_limit;
+  value[TF_Max_Expanded] = stats.max_expanded;
+  value[TF_Visible_Limit] = stats.visible_limit;
+  value[TF_Auto_Expand_Limit] = stats.auto_expand_limit;
+  value[TF_Complete] = stats.complete;
+  value[TF_Primary_Complete] = stats.primary_complete;
+  value[TF_G_Complete] = stats.g_complete;
+  value[TF_H_Complete] = stats.h_complete;
+  value[TF_Coset_Complete] = stats.coset_complete;
+}
+
+/**/
+
+void Rewriter_Machine::record_telemetry()
+{
+  Telemetry_Sample sample;
+  telemetry_sample(&sample);
+  maf.telemetry->record("sample",sample);
+}
+
+/**/
+
 bool Rewriter_Machine::short_status(int priority,unsigned level,int gap,const char * control,Variadic_Arguments & va)
 {
+  if (maf.telemetry && maf.telemetry->sample_due())
+    record_telemetry();
   if (stats.priority_status > priority)
     gap = 0;
 
@@ -582,6 +657,8 @@ bool Rewriter_Machine::critical_status(unsigned level,int gap,const char * contr
 bool Rewriter_Machine::status(int priority,unsigned level,int gap,const char * control,...)
 {
   DECLARE_VA(va,control);
+  if (maf.telemetry && maf.telemetry->sample_due())
+    record_telemetry();
   if (stats.priority_status > priority/* && stats.priority_status != 0*/)
     gap = 0;
 
@@ -589,11 +666,14 @@ bool Rewriter_Machine::status(int priority,unsigned level,int gap,const char * c
   {
     const Equation_Stats & estats = jm.status();
     stats.priority_status = priority;
-    container.progress(2,"Nodes:L0=" FMT_NC ",L1=" FMT_NC ",L2/3=" FMT_NC ",Bad=" FMT_NC ",Depth=%d,Acc=%d\n",
+    container.progress(2,"Nodes:L0=" FMT_NC ",L1=" FMT_NC ",L2/3=" FMT_NC ",Bad=" FMT_NC ",Depth=%d,Acc=%d"
+                         " Links:Dense=" FMT_NC ",Sorted=" FMT_NC ",Hashed=" FMT_NC "\n",
                        nm.stats.nc[language_L0],nm.stats.nc[language_L1],
                        nm.stats.nc[language_L2]+nm.stats.nc[language_L3],
                        nm.stats.nc[language_A],height(),
-                       nm.start()->reduced.max_accepted);
+                       nm.start()->reduced.max_accepted,
+                       nm.stats.nrc[NR_Dense],nm.stats.nrc[NR_Sorted],
+                       nm.stats.nrc[NR_Hashed]);
     if (stats.want_differences && dt)
     {
       const Difference_Tracker::Status & dstats = dt->status();
@@ -640,6 +720,9 @@ bool Rewriter_Machine::status(int priority,unsigned level,int gap,const char * c
                          ", Visible=" FMT_NC ", Pool=" FMT_ID ".\n",
                        estats.nr_equations,estats.nr_adopted,estats.nr_visible,
                        pool ? pool->count() : 0);
+    if (spool && spool->count())
+      container.progress(2,"Pool on disk=" FMT_ID " in %u runs\n",
+                         spool->count(),spool->run_count());
 
     stats.status_count += gap;
     return true;
@@ -924,6 +1007,9 @@ int Rewriter_Machine::expand_machine(bool limit)
     }
     if (nm.has_filtered())
       stats.complete = false;
+    /* The end of a pass is a good moment to give memory back to the OS,
+       since the equations that were removed during the pass have gone */
+    Heap::trim();
     bool should_build = examine(rm_state);
     bool coset_complete_flag = should_build && stats.no_coset_pool;
 
@@ -1806,89 +1892,152 @@ void Rewriter_Machine::expand(Node_Handle e1,Node_Count done,unsigned ost)
 
 /**/
 
-int Rewriter_Machine::consider(Equation_Handle e1,Equation_Handle e2,
-                               Word_Length offset,
-                               const Simple_Equation & eq1,
-                               const Simple_Equation & eq2,
-                               unsigned flags)
+Overlap_Equation_Result Rewriter_Machine::overlap_equation(Ordinal_Word * lhs_word,
+                                                           Ordinal_Word * rhs_word,
+                                                           unsigned * flags,
+                                                           Equation_Handle e1,
+                                                           Equation_Handle e2,
+                                                           Word_Length offset,
+                                                           const Simple_Equation & eq1,
+                                                           const Simple_Equation & eq2) const
 {
   /* Called when expand() has identified that a suffix of e1 and
      a prefix of e2 are the same. This means we can perform two different
      reductions on aXb where aX is the lhs of e1, and Xb is the lhs of e2.
      We form the equation with the "left reduction" cb as the LHS and
-     "right reduction" ad as the RHS.
+     "right reduction" ad as the RHS, and work out the flags to learn it
+     with.
+     This method does not change anything. consider() does whatever is
+     required by the return value.
   */
-  int retcode = 0;
 
   if (maf.options.no_h && e1->last_letter() > pd.coset_symbol)
-    return 0;
+    return OER_Skip;
 
   if (maf.options.max_overlap_length &&
       offset + eq2.lhs_length > maf.options.max_overlap_length)
+    return OER_Ignored;
+
+  if (!e2->is_valid())
+    return OER_Invalid;
+
+  Word_Length common_length = eq1.lhs_length - offset;
+  Total_Length l = eq1.rhs_length+eq2.lhs_length-common_length;
+  Total_Length r = offset+eq2.rhs_length;
+
+  /* Test equation is not too big to form. We probably must do this now
+     even though filtering would probably usually dispose of long equations
+     since the RHSes might have changed since the overlap was put on the
+     list of overlaps to be considered */
+  if (l > MAX_WORD || r > MAX_WORD)
+    return OER_Too_Long;
+
+  bool extended_consider = maf.options.extended_consider && *flags == 0;
+  if (!*flags)
   {
-    stats.some_ignored = true;
-    return 0;
+    *flags = AE_KEEP_FAILED|AE_UPDATE;
+    if (!e2->is_adopted() ||
+        maf.options.strategy & MSF_SELECTIVE_PROBE &&
+        e2->status() != NS_Expanded_Equation ||
+        l+r > stats.visible_limit)
+    {
+      *flags |= AE_DISCARDABLE;
+      *flags &= ~AE_KEEP_FAILED;
+    }
   }
 
-  if (e2->is_valid())
+  lhs_word->allocate(Word_Length(l));
+  rhs_word->allocate(Word_Length(r));
+  if (!eq1.rhs_length || !eq2.rhs_length ||
+      offset+eq2.lhs_length==eq1.lhs_length)
+    *flags |= AE_PRE_CANCEL;
+  word_copy(*lhs_word,eq1.rhs_word,eq1.rhs_length);
+  word_copy(lhs_word->data(eq1.rhs_length),
+            eq2.lhs_word.data(common_length),
+            (eq2.lhs_length-common_length));
+  word_copy(*rhs_word,eq1.lhs_word,offset);
+  word_copy(rhs_word->data(offset),eq2.rhs_word,eq2.rhs_length);
+  return extended_consider ? OER_Extended : OER_Formed;
+}
+
+/**/
+
+int Rewriter_Machine::consider(Equation_Handle e1,Equation_Handle e2,
+                               Word_Length offset,
+                               const Simple_Equation & eq1,
+                               const Simple_Equation & eq2,
+                               unsigned flags,
+                               const Overlap_Speculation * speculation)
+{
+  /* Learn the equation arising from an overlap, as formed by
+     overlap_equation().
+     If speculation is not 0 it is the result of an earlier call to
+     speculate() for the same overlap. If it says the equation was trivial
+     and the tree has not changed since then we need not reduce the equation
+     again, since we know learn() would just return 0.
+  */
+  Ordinal_Word lhs_word(alphabet());
+  Ordinal_Word rhs_word(alphabet());
+
+  switch (overlap_equation(&lhs_word,&rhs_word,&flags,e1,e2,offset,eq1,eq2))
   {
-    Word_Length common_length = eq1.lhs_length - offset;
-    Total_Length l = eq1.rhs_length+eq2.lhs_length-common_length;
-    Total_Length r = offset+eq2.rhs_length;
-
-    /* Test equation is not too big to form. We probably must do this now
-       even though filtering would probably usually dispose of long equations
-       since the RHSes might have changed since the overlap was put on the
-       list of overlaps to be considered */
-    if (l > MAX_WORD || r > MAX_WORD)
-    {
+    case OER_Skip:
+      return 0;
+    case OER_Ignored:
+      stats.some_ignored = true;
+      return 0;
+    case OER_Invalid:
+      return -1;
+    case OER_Too_Long:
       stats.some_discarded = true;
       return -1;
-    }
-
-    bool extended_consider = maf.options.extended_consider && flags == 0;
-    if (!flags)
-    {
-      flags = AE_KEEP_FAILED|AE_UPDATE;
-      if (!e2->is_adopted() ||
-          maf.options.strategy & MSF_SELECTIVE_PROBE &&
-          e2->status() != NS_Expanded_Equation ||
-          l+r > stats.visible_limit)
+    case OER_Extended:
       {
-        flags |= AE_DISCARDABLE;
-        flags &= ~AE_KEEP_FAILED;
+        Word_DB wdb(alphabet(),1024);
+        wdb.insert(lhs_word);
+        wdb.insert(rhs_word);
+        consider(wdb);
       }
-    }
+      return 0;
+    case OER_Formed:
+      break;
+  }
 
-    Ordinal_Word lhs_word(alphabet(),Word_Length(l));
-    Ordinal_Word rhs_word(alphabet(),Word_Length(r));
-    if (!eq1.rhs_length || !eq2.rhs_length ||
-        offset+eq2.lhs_length==eq1.lhs_length)
-      flags |= AE_PRE_CANCEL;
-    word_copy(lhs_word,eq1.rhs_word,eq1.rhs_length);
-    word_copy(lhs_word.data(eq1.rhs_length),
-              eq2.lhs_word.data(common_length),
-              (eq2.lhs_length-common_length));
-    word_copy(rhs_word,eq1.lhs_word,offset);
-    word_copy(rhs_word.data(offset),eq2.rhs_word,eq2.rhs_length);
-
-    if (extended_consider)
-    {
-      Word_DB wdb(alphabet(),1024);
-      wdb.insert(lhs_word);
-      wdb.insert(rhs_word);
-      consider(wdb);
-    }
-    else
-    {
-      Working_Equation we(nm,lhs_word,rhs_word,
-                          Derivation(BDT_Conjunction,e1,e2,offset));
-      retcode = add_equation(&we,flags|AE_NO_REPEAT);
-    }
+  if (speculation && speculation->trivial &&
+      speculation->flags == flags &&
+      nm.tree_unchanged(speculation->certificate))
+    return 0;
+
+  Working_Equation we(nm,lhs_word,rhs_word,
+                      Derivation(BDT_Conjunction,e1,e2,offset));
+  return add_equation(&we,flags|AE_NO_REPEAT);
+}
+
+/**/
+
+void Rewriter_Machine::speculate(Overlap_Speculation * speculation,
+                                 Equation_Handle e1,Equation_Handle e2,
+                                 Word_Length offset,
+                                 const Simple_Equation & eq1,
+                                 const Simple_Equation & eq2,
+                                 unsigned flags) const
+{
+  /* Works out whether consider() would find the equation for this overlap
+     to be trivial, but without changing anything. Since this only reads
+     the tree it can be called by several threads at once provided no other
+     thread is changing the Rewriter_Machine in the meantime. */
+  Ordinal_Word lhs_word(alphabet());
+  Ordinal_Word rhs_word(alphabet());
+
+  speculation->certificate = nm.current_certificate();
+  speculation->trivial = false;
+  if (overlap_equation(&lhs_word,&rhs_word,&flags,e1,e2,offset,eq1,eq2) == OER_Formed)
+  {
+    Working_Equation we(nm,lhs_word,rhs_word,
+                        Derivation(BDT_Conjunction,e1,e2,offset));
+    speculation->flags = flags;
+    speculation->trivial = em.is_trivial(&we,flags|AE_NO_REPEAT);
   }
-  else
-    retcode = -1;
-  return retcode;
 }
 
 /**/
@@ -2145,6 +2294,10 @@ int Rewriter_Machine::add_equation(Working_Equation * we,unsigned flags)
     }
   }
 
+  if (pool && maf.options.pool_memory &&
+      pool->count() > maf.options.pool_memory)
+    spill_pool();
+
   if (retcode==1 && flags & AE_UPDATE)
   {
     // now optionally find its "obvious" consequences
@@ -2464,6 +2617,7 @@ void Rewriter_Machine::add_to_tree(Working_Equation * we,unsigned flags,
 
 bool Rewriter_Machine::add_to_pool(Element_ID * id,Working_Equation *we,unsigned flags)
 {
+  Heap_Tag tag(HC_Equations);
   bool good = false;
   Equation_Word & lhs = we->lhs_word();
   Equation_Word & rhs = we->rhs_word();
@@ -2561,6 +2715,132 @@ bool Rewriter_Machine::add_to_pool(Element_ID * id,Working_Equation *we,unsigned
 
 /**/
 
+void Rewriter_Machine::spill_pool()
+{
+  /* The pool has grown past the size specified by -pool_memory, so we
+     keep the shorter half of it in memory and write the rest to the spool
+     in order of total length. The equations are sorted with a counting
+     sort, which is stable, so that equations of the same length keep the
+     order they had in the pool.
+     The equations that stay in memory are renumbered. A pool ID is only
+     referred to by the Derivation of an equation the Equation_Manager has
+     queued, and by the derivation log. So we wait until the
+     Equation_Manager is idle, and log the new numbers in the same way as
+     check_pool() does when it puts equations back in the pool. */
+  if ((spool && spool->is_reading()) || !em.idle())
+    return;
+  Heap_Tag tag(HC_Equations);
+  if (!spool)
+    spool = new Equation_Spool(container,alphabet(),pd.filename.length() ?
+                               String(pd.filename) : String("maf"));
+  Element_Count count = pool->count();
+  Total_Length * length = new Total_Length[count];
+  Total_Length max_length = 0;
+  Ordinal_Word lhs(alphabet());
+  Ordinal_Word rhs(alphabet());
+  for (Element_ID id = 0; id < count;id++)
+  {
+    pool->get_lhs(&lhs,id);
+    pool->get_rhs(&rhs,id);
+    length[id] = lhs.length() + rhs.length();
+    if (length[id] > max_length)
+      max_length = length[id];
+  }
+  Element_Count * start = new Element_Count[max_length+2];
+  for (Total_Length tl = 0; tl <= max_length+1;tl++)
+    start[tl] = 0;
+  for (Element_ID id = 0; id < count;id++)
+    start[length[id]+1]++;
+  for (Total_Length tl = 1; tl <= max_length+1;tl++)
+    start[tl] += start[tl-1];
+  Element_ID * order = new Element_ID[count];
+  for (Element_ID id = 0; id < count;id++)
+    order[start[length[id]]++] = id;
+  delete [] start;
+
+  Element_Count keep = count/2;
+  bool ok = spool->begin_run();
+  if (ok)
+  {
+    for (Element_Count i = keep; i < count;i++)
+    {
+      pool->get_lhs(&lhs,order[i]);
+      pool->get_rhs(&rhs,order[i]);
+      spool->add(lhs,rhs);
+    }
+    ok = spool->end_run();
+  }
+  update_spool_limits();
+  if (ok)
+  {
+    /* Rebuild the pool from the equations we are keeping, in their
+       original order, so that it has no holes in it */
+    bool * spilt = new bool[count];
+    for (Element_Count i = 0; i < count;i++)
+      spilt[order[i]] = i >= keep;
+    Equation_DB * new_pool = new Equation_DB(alphabet(),keep < 1024 ? 1024 : keep);
+    for (Element_ID id = 0; id < count;id++)
+      if (!spilt[id])
+      {
+        Element_ID key;
+        pool->get_lhs(&lhs,id);
+        pool->get_rhs(&rhs,id);
+        new_pool->insert(lhs,&key);
+        new_pool->update_rhs(key,rhs);
+        if (maf.options.log_flags & LOG_EQUATIONS)
+        {
+          Working_Equation we(nm,lhs,rhs,Derivation(id));
+          we.print_derivation(container.get_log_stream(),key);
+        }
+      }
+    delete [] spilt;
+    delete pool;
+    pool = new_pool;
+    Heap::trim();
+    container.progress(2,"Pool: " FMT_ID " equations written to disk. "
+                         FMT_ID " remain in memory\n",count-keep,keep);
+  }
+  else
+  {
+    container.error_output("Unable to write pool to disk. -pool_memory has"
+                           " been ignored\n");
+    maf.options.pool_memory = 0;
+  }
+  delete [] order;
+  delete [] length;
+}
+
+/**/
+
+void Rewriter_Machine::update_spool_limits()
+{
+  /* Called after anything that changes the contents of the spool. The
+     spilled equations still count as pooled, so the pool limit has to
+     take them into account, and the pool must not appear to be empty
+     while the spool is not */
+  if (!spool)
+    return;
+  Element_Count lost = spool->lost_equations();
+  if (lost)
+  {
+    jm.change_pool_count(-(int) lost);
+    stats.some_discarded = true;
+  }
+  if (spool->count())
+  {
+    if (!pool)
+      pool = new Equation_DB(alphabet(),1024);
+    Total_Length tl = spool->shortest();
+    if (tl < stats.pool_limit)
+    {
+      stats.pool_limit = tl;
+      stats.discard_limit = stats.pool_limit + POOL_DEPTH;
+    }
+  }
+}
+
+/**/
+
 void Rewriter_Machine::schedule_optimise(const Word &word)
 {
   jm.schedule_optimise(word);
@@ -2753,8 +3033,10 @@ bool Rewriter_Machine::examine(unsigned rm_state)
 void Rewriter_Machine::purge()
 {
   /* Get rid of any spare nodes and node list entries. There may be a lot
-     of these and this may free up a substantial amount of memory */
+     of these and this may free up a substantial amount of memory, which
+     we let the OS have back */
   Node_List::purge();
+  Heap::trim();
 }
 
 /**/
@@ -2957,6 +3239,274 @@ FSA_Simple * Rewriter_Machine::grow_wd(unsigned cd_flags,unsigned gwd_flags)
 
 /**/
 
+/* Parallel exploration.
+
+   Nearly all the time taken by explore_acceptor() and explore_dm() goes in
+   reducing the words at the nodes of the tree with a Diff_Reduce. When
+   maf.options.threads is more than 1 this is done in several threads, in
+   much the same way as Job_Manager::overlaps() speculates about overlaps.
+   This thread walks the tree as usual, but instead of reducing the words
+   straight away it collects them in an Explore_Window. When the window is
+   full the words in it are reduced by several threads, each with its own
+   Diff_Reduce. The threads only read a dense copy of the word-difference
+   machine (and word-acceptor), because the other kinds of FSA, in
+   particular the Difference_Tracker, use work areas to look up transitions.
+
+   This thread then goes through the window in order, and adds the new
+   equations just as it would have done otherwise. As soon as the tree or
+   the word-difference machine has changed the rest of the window is stale,
+   so the walk is moved back to the node concerned and continues from there.
+   So the equations found do not depend on the number of threads.
+*/
+
+class Rewriter_Machine::Explore_Window
+{
+  BLOCKED(Explore_Window)
+  public:
+    struct Item
+    {
+      Ordinal_Word * lhs;   // word at the node
+      Ordinal_Word * word;  // word to reduce, replaced by its reduction
+      unsigned retcode;     // value returned by Diff_Reduce::reduce()
+      Word_Length depth;    // depth of the walk at the node
+      int info;             // for use by the caller
+    };
+    Certificate round;      // state of the tree when the window was started
+  private:
+    class Reducer;
+    friend class Reducer;
+    const Alphabet & alphabet;
+    const unsigned nr_threads;
+    const Element_Count max_count;
+    Element_Count limit;
+    Element_Count count;
+    Item * items;
+    const FSA * dm;
+    const FSA * wa;
+    FSA_Simple * dm_copy;
+    FSA_Simple * wa_copy;
+    Diff_Reduce ** dr;   // one for each slice of the window
+    unsigned dr_flags;
+    Difference_Tracker * tracker; // set by use_tracker()
+    unsigned copy_time;           // journal time of tracker when copied
+  public:
+    Explore_Window(const Alphabet & alphabet_,unsigned nr_threads_) :
+      alphabet(alphabet_),
+      nr_threads(nr_threads_),
+      max_count(nr_threads_*256),
+      limit(nr_threads_*16),
+      count(0),
+      dm(0),
+      wa(0),
+      dm_copy(0),
+      wa_copy(0),
+      dr_flags(0),
+      tracker(0),
+      copy_time(0)
+    {
+      dr = new Diff_Reduce *[nr_threads];
+      for (unsigned i = 0; i < nr_threads;i++)
+        dr[i] = 0;
+      items = new Item[max_count];
+      for (Element_Count i = 0; i < max_count;i++)
+        items[i].lhs = items[i].word = 0;
+    }
+    ~Explore_Window()
+    {
+      for (Element_Count i = 0; i < max_count;i++)
+        if (items[i].lhs)
+        {
+          delete items[i].lhs;
+          delete items[i].word;
+        }
+      delete [] items;
+      set_machines(0,0,0);
+      delete [] dr;
+    }
+    /* set_machines() specifies the FSAs to reduce with. A dense copy is
+       taken of each FSA that does not have dense transitions already, so
+       if the original FSA changes set_machines() must be called again.
+       Each slice of the window always uses the same Diff_Reduce, so that
+       it can take advantage of the similarity of successive words. */
+    void set_machines(const FSA * dm_,const FSA * wa_,unsigned dr_flags_)
+    {
+      for (unsigned i = 0; i < nr_threads;i++)
+        if (dr[i])
+        {
+          delete dr[i];
+          dr[i] = 0;
+        }
+      if (dm_copy)
+        delete dm_copy;
+      if (wa_copy)
+        delete wa_copy;
+      dm_copy = wa_copy = 0;
+      dm = dm_;
+      wa = wa_;
+      dr_flags = dr_flags_;
+      tracker = 0;
+      if (dm && !dm->dense_transition_table())
+        dm = dm_copy = FSA_Factory::copy(*dm,TSF_Dense);
+      if (wa && !wa->dense_transition_table())
+        wa = wa_copy = FSA_Factory::copy(*wa,TSF_Dense);
+      if (dm)
+        for (unsigned i = 0; i < nr_threads;i++)
+          dr[i] = new Diff_Reduce(dm);
+    }
+    /* use_tracker() is used instead of set_machines() when the
+       word-difference machine is a Difference_Tracker that may change
+       between one window and the next. It should be called before each
+       call to reduce(). Only the rows of the states that the tracker's
+       change journal shows have changed since the last call are copied
+       again, and each Diff_Reduce only forgets the part of its stack that
+       depends on them. A complete new copy is made if the tracker has
+       gained states, or has several initial states, since then the
+       initial states or the labels used by Diff_Reduce might have changed */
+    void use_tracker(Difference_Tracker * dt,unsigned dr_flags_)
+    {
+      if (dt != tracker || dr_flags_ != dr_flags ||
+          dt->has_multiple_initial_states() ||
+          (dm_copy && dm_copy->state_count() != dt->state_count()))
+      {
+        unsigned time = dt->take_journal_time();
+        set_machines(dt,0,dr_flags_);
+        tracker = dt;
+        copy_time = time;
+        return;
+      }
+      const unsigned * change_time = dt->change_journal();
+      if (dm_copy)
+      {
+        const State_Count nr_states = dt->state_count();
+        const Transition_ID nr_symbols = dt->alphabet_size();
+        State_ID * transition = new State_ID[nr_symbols];
+        for (State_ID si = 1; si < nr_states;si++)
+          if (change_time[si] > copy_time)
+          {
+            for (Transition_ID ti = 0; ti < nr_symbols;ti++)
+              transition[ti] = dt->new_state(si,ti);
+            dm_copy->set_transitions(si,transition);
+          }
+        delete [] transition;
+      }
+      for (unsigned i = 0; i < nr_threads;i++)
+        dr[i]->invalidate(change_time,copy_time);
+      copy_time = dt->take_journal_time();
+    }
+    void add(const Word & lhs,const Word & word,Word_Length depth,int info)
+    {
+      Item & item = items[count++];
+      if (!item.lhs)
+      {
+        item.lhs = new Ordinal_Word(alphabet);
+        item.word = new Ordinal_Word(alphabet);
+      }
+      *item.lhs = lhs;
+      *item.word = word;
+      item.depth = depth;
+      item.info = info;
+    }
+    Element_Count length() const
+    {
+      return count;
+    }
+    bool is_full() const
+    {
+      return count >= limit;
+    }
+    const Item & item(Element_Count i) const
+    {
+      return items[i];
+    }
+    void reduce();
+    /* finish() empties the window after the first used items have been
+       processed. The window is made smaller if it was not all used, and
+       larger if it was */
+    void finish(Element_Count used)
+    {
+      if (used < count)
+      {
+        Element_Count minimum = Element_Count(nr_threads);
+        limit = used*2 > minimum ? used*2 : minimum;
+      }
+      else
+        limit = limit*2 < max_count ? limit*2 : max_count;
+      count = 0;
+    }
+  private:
+    void reduce(unsigned slice_nr,Element_Count start,Element_Count end) const
+    {
+      for (Element_Count i = start; i < end;i++)
+        items[i].retcode = dr[slice_nr]->reduce(items[i].word,*items[i].word,
+                                                dr_flags,wa);
+    }
+};
+
+class Rewriter_Machine::Explore_Window::Reducer : public Thread
+{
+  private:
+    const Explore_Window & window;
+    unsigned slice_nr;
+    Element_Count first;
+    Element_Count end;
+  public:
+    Reducer(const Explore_Window & window_,unsigned slice_nr_,
+            Element_Count first_,Element_Count end_) :
+      window(window_),
+      slice_nr(slice_nr_),
+      first(first_),
+      end(end_)
+    {}
+  protected:
+    void run()
+    {
+      window.reduce(slice_nr,first,end);
+    }
+};
+
+void Rewriter_Machine::Explore_Window::reduce()
+{
+  /* Divide the window into nr_threads slices, and do the first slice
+     in this thread */
+  Reducer ** reducers = new Reducer *[nr_threads];
+  Element_Count slice = (count + nr_threads - 1)/nr_threads;
+  Element_Count start = slice;
+  unsigned i;
+  for (i = 1; i < nr_threads;i++)
+  {
+    Element_Count end = start + slice < count ? start + slice : count;
+    reducers[i] = 0;
+    if (start < end)
+    {
+      reducers[i] = new Reducer(*this,i,start,end);
+      if (!reducers[i]->start())
+        reduce(i,start,end);
+    }
+    start = end;
+  }
+  reduce(0,0,slice < count ? slice : count);
+  for (i = 1; i < nr_threads;i++)
+    if (reducers[i])
+    {
+      reducers[i]->join();
+      delete reducers[i];
+    }
+  delete [] reducers;
+}
+
+unsigned Rewriter_Machine::explore_threads() const
+{
+  /* The threads only use Diff_Reduce, which compares words, and
+     comparing words uses work areas in the Alphabet for orderings that are
+     not geodesic. Once the tree is confluent Strong_Diff_Reduce uses the
+     tree instead, so there is nothing for the threads to do */
+  if (maf.options.threads <= 1 || !pd.is_short || stats.complete)
+    return 1;
+  return maf.options.threads;
+}
+
+/**/
+
 bool Rewriter_Machine::explore_acceptor(const FSA *wa,
                                          const FSA * dm2,
                                          bool finite,
@@ -2980,6 +3530,12 @@ bool Rewriter_Machine::explore_acceptor(const FSA *wa,
   Equation_Word ew(nm);
   Diff_Reduce dr(dm2);
   Working_Equation we(nm,Derivation(BDT_Diff_Reduction));
+  Explore_Window * window = 0;
+  if (explore_threads() > 1)
+  {
+    window = new Explore_Window(alphabet(),explore_threads());
+    window->set_machines(dm2,wa,0);
+  }
 
   state[0] = wa->initial_state();
   if (!allow)
@@ -3008,6 +3564,8 @@ bool Rewriter_Machine::explore_acceptor(const FSA *wa,
         if (ew.reduce(AE_KEEP_LHS))
         {
           /* give up - our acceptor has accepted a now reducible word */
+          if (window)
+            delete window;
           delete [] state;
           return true;
         }
@@ -3023,7 +3581,16 @@ bool Rewriter_Machine::explore_acceptor(const FSA *wa,
           {
             rhs = lhs = ew;
             bool wrong = !rhs.reduce();
-            if (!stats.complete)
+            if (window)
+            {
+              /* The reduction is left to the threads */
+              if (!window->length())
+                window->round = nm.current_certificate();
+              window->add(lhs,rhs,depth,0);
+              if (window->is_full())
+                process_acceptor_window(*window,ew,&depth,state,wa,we,&done);
+            }
+            else if (!stats.complete)
             {
               Ordinal_Word rhs_word(rhs);
               wrong = dr.reduce(&rhs_word,rhs_word,0,wa) != 0;
@@ -3033,11 +3600,14 @@ bool Rewriter_Machine::explore_acceptor(const FSA *wa,
                 rhs.invalidate();
               }
             }
-            if (add_equation(&we,AE_KEEP_LHS|AE_DISCARDABLE|AE_IGNORE_PRIMARY|AE_NO_REPEAT)==1)
+            if (!window &&
+                add_equation(&we,AE_KEEP_LHS|AE_DISCARDABLE|AE_IGNORE_PRIMARY|AE_NO_REPEAT)==1)
               done = true;
           }
           if (status(Priority_General,2,1,"Examining word-acceptor at depth %d pass %d\n",depth,limit))
           {
+            if (window && window->length())
+              process_acceptor_window(*window,ew,&depth,state,wa,we,&done);
             if (done)
             {
               update_machine();
@@ -3058,6 +3628,9 @@ bool Rewriter_Machine::explore_acceptor(const FSA *wa,
     {
       if (!depth)
       {
+        if (window && window->length() &&
+            process_acceptor_window(*window,ew,&depth,state,wa,we,&done))
+          continue;
         if (finished)
           break;
         status(Priority_General,2,1,"Examining word-acceptor to depth %d\n",++limit);
@@ -3068,6 +3641,8 @@ bool Rewriter_Machine::explore_acceptor(const FSA *wa,
         depth--;
     }
   }
+  if (window)
+    delete window;
   delete [] state;
   if (finished)
     container.progress(1,"Exploration of word-acceptor completed\n");
@@ -3085,6 +3660,58 @@ bool Rewriter_Machine::explore_acceptor(const FSA *wa,
   return retcode;
 }
 
+bool Rewriter_Machine::process_acceptor_window(Explore_Window & window,
+                                               Equation_Word & ew,
+                                               Word_Length * depth,
+                                               State_ID * state,
+                                               const FSA * wa,
+                                               Working_Equation & we,
+                                               bool * done)
+{
+  /* Reduce the words in the window and add the equations for them in
+     order. If the tree changes the walk in explore_acceptor() is moved back
+     to just after the node of the last word that has been dealt with, or
+     to the node of the first word in the window if there is none, since
+     the nodes the walk passed after that were looked at using a tree that
+     is now out of date, and the return value is true */
+  Element_Count count = window.length();
+  Element_Count i;
+  bool rewound = false;
+  window.reduce();
+  for (i = 0; i < count;i++)
+  {
+    const Explore_Window::Item & item = window.item(i);
+    if (!nm.tree_unchanged(window.round))
+    {
+      /* Arrange for the next step of the walk to visit the node after the
+         previous item, or this node again if it is the first */
+      const Explore_Window::Item & last = i ? window.item(i-1) : item;
+      Word_Length d = *depth = last.depth;
+      ew = *last.lhs;
+      if (!i)
+        ew.values[d]--;
+      for (Word_Length j = 0; j < d;j++)
+        state[j+1] = wa->new_state(state[j],ew.values[j]);
+      rewound = true;
+      break;
+    }
+    we.lhs_word() = *item.lhs;
+    if (stats.complete)
+    {
+      /* As in explore_acceptor(), once the tree is confluent the
+         word-difference machine is not used */
+      we.rhs_word() = *item.lhs;
+      we.rhs_word().reduce();
+    }
+    else
+      we.rhs_word() = *item.word;
+    if (add_equation(&we,AE_KEEP_LHS|AE_DISCARDABLE|AE_IGNORE_PRIMARY|AE_NO_REPEAT)==1)
+      *done = true;
+  }
+  window.finish(i);
+  return rewound;
+}
+
 /**/
 
 void Rewriter_Machine::explore_dm(bool repeat)
@@ -3211,6 +3838,9 @@ void Rewriter_Machine::explore_dm(bool repeat)
     bool do_all = !repeat;
     bool restart = true;
     Ordinal child_start,child_end;
+    Explore_Window * window = 0;
+    if (explore_threads() > 1)
+      window = new Explore_Window(alphabet(),explore_threads());
     while (!maf.aborting)
     {
       /* In this block we look for nodes that can be reduced using the
@@ -3253,6 +3883,10 @@ void Rewriter_Machine::explore_dm(bool repeat)
             /* In this case we have managed to delete the part of
                the tree we were working on, so we must have created an
                equation and need to start again */
+            if (window && window->length() &&
+                process_dm_window(*window,sdr,ew,&depth,we,&added,&restart,
+                                  &do_all))
+              continue;
             restart = true;
             continue;
           }
@@ -3285,6 +3919,12 @@ void Rewriter_Machine::explore_dm(bool repeat)
             do_it = ns->flagged(EQ_HAS_DIFFERENCES) ? 2 : 0;
             if (ns->fast_is_primary() && (do_it || !repeat))
             {
+              /* This may add equations, so the window must be dealt with
+                 first */
+              if (window && window->length() &&
+                  process_dm_window(*window,sdr,ew,&depth,we,&added,&restart,
+                                    &do_all))
+                continue;
               ns->attach(nm);
               for (Word_Length i = 1; i < depth;i++)
               {
@@ -3315,7 +3955,19 @@ void Rewriter_Machine::explore_dm(bool repeat)
             Ordinal_Word rhs_word(ew);
             if (ns->is_final())
               rhs_word.set_length(depth);
-            if (sdr.reduce(&rhs_word,rhs_word))
+            if (window)
+            {
+              /* The depth recorded is the depth of the node, and the
+                 info records whether it is final, and the value of do_it */
+              if (ns->is_final())
+                window->add(ew,rhs_word,depth,do_it+4);
+              else
+                window->add(ew,rhs_word,depth-1,do_it);
+              if (window->is_full())
+                process_dm_window(*window,sdr,ew,&depth,we,&added,&restart,
+                                  &do_all);
+            }
+            else if (sdr.reduce(&rhs_word,rhs_word))
             {
               we.lhs_word() = ew;
               if (ns->is_final())
@@ -3340,11 +3992,19 @@ void Rewriter_Machine::explore_dm(bool repeat)
       else
       {
         if (!depth)
+        {
+          if (window && window->length() &&
+              process_dm_window(*window,sdr,ew,&depth,we,&added,&restart,
+                                &do_all))
+            continue;
           break;
+        }
         else
           depth--;
       }
     }
+    if (window)
+      delete window;
     if (!repeat || maf.aborting || !do_all && dt->state_count()==nr_states)
       break;
   }
@@ -3352,6 +4012,59 @@ void Rewriter_Machine::explore_dm(bool repeat)
   stats.last_explore = stats.status_count;
 }
 
+bool Rewriter_Machine::process_dm_window(Explore_Window & window,
+                                         Strong_Diff_Reduce & sdr,
+                                         Equation_Word & ew,
+                                         Word_Length * depth,
+                                         Working_Equation & we,
+                                         Node_Count * added,
+                                         bool * restart,bool * do_all)
+{
+  /* Reduce the words in the window using the same flags as the first step
+     of Strong_Diff_Reduce. Words which are not reducible need nothing
+     doing, so only the first reducible word has to be dealt with, which is
+     done exactly as in explore_dm(). Then the walk is moved back to the
+     node of that word, and the return value is true.
+     The copy of the Difference_Tracker used by the window is brought up
+     to date first, since the previous window may have changed it */
+  Element_Count count = window.length();
+  Element_Count i;
+  bool rewound = false;
+  window.use_tracker(dt,DR_ONCE|DR_NO_G_PREFIX);
+  window.reduce();
+  for (i = 0; i < count && !rewound;i++)
+  {
+    const Explore_Window::Item & item = window.item(i);
+    /* Once the tree is confluent Strong_Diff_Reduce uses the tree, which
+       may reduce words that the word-difference machine did not */
+    if (!item.retcode && !stats.complete)
+      continue;
+    bool is_final = (item.info & 4) != 0;
+    Ordinal_Word rhs_word(*item.lhs);
+    if (is_final)
+      rhs_word.set_length(item.depth);
+    if (sdr.reduce(&rhs_word,rhs_word))
+    {
+      we.lhs_word() = *item.lhs;
+      if (is_final)
+        we.lhs_word().set_length(item.depth);
+      we.rhs_word() = rhs_word;
+      ew = *item.lhs;
+      *depth = item.depth;
+      rewound = true;
+      if (add_equation(&we,AE_KEEP_LHS|AE_INSERT|AE_NO_REPEAT)==1)
+      {
+        update_machine();
+        (*added)++;
+        if ((item.info & 3) == 2)
+          *restart = *do_all = true;
+      }
+    }
+  }
+  window.finish(i);
+  return rewound;
+}
+
 /**/
 
 void Rewriter_Machine::schedule_right_conjugation(Equation_Handle e)
@@ -4007,6 +4720,187 @@ State_ID Rewriter_Machine::get_derivation_id(Node_ID eid, bool insert)
 
 /**/
 
+bool Rewriter_Machine::checkpoint(Checkpoint_Writer & cw)
+{
+  /* Equations the Equation_Manager has yet to learn are not in the tree,
+     and would be lost. Nor can we save the spool while it is being read,
+     since some of the equations read so far may not be anywhere else */
+  if (!em.idle() || (spool && spool->is_reading()))
+    return false;
+
+  /* The tracker has to be created before the tree is restored, so we
+     have to say whether there is one first */
+  bool present = dt != 0;
+  cw.put(present);
+  nm.checkpoint(cw);
+  if (dt)
+    dt->checkpoint(cw);
+  jm.checkpoint(cw);
+  cw.put(stats);
+  expand_list.checkpoint(cw);
+  re_expand_list.checkpoint(cw);
+  present = expand_ont != 0;
+  cw.put(present);
+  if (expand_ont)
+    expand_ont->checkpoint(cw);
+
+  /* The pool never has any holes in it, so we only need to save the
+     equations in order. Any equations that have been spilled to disk
+     follow, so that the checkpoint does not depend on the spool files */
+  present = pool != 0;
+  cw.put(present);
+  if (pool)
+  {
+    Element_Count count = pool->count();
+    cw.put(count);
+    Ordinal_Word word(alphabet());
+    for (Element_ID id = 0; id < count;id++)
+    {
+      pool->get_lhs(&word,id);
+      cw.put_word(word);
+      pool->get_rhs(&word,id);
+      cw.put_word(word);
+    }
+    if (spool)
+    {
+      Ordinal_Word rhs(alphabet());
+      spool->start_read(UNLIMITED);
+      while (spool->read(&word,&rhs))
+      {
+        present = true;
+        cw.put(present);
+        cw.put_word(word);
+        cw.put_word(rhs);
+      }
+      spool->end_read(false);
+    }
+    present = false;
+    cw.put(present);
+  }
+
+  present = derivation_db != 0;
+  cw.put(present);
+  if (derivation_db)
+  {
+    Element_Count count = derivation_db->count();
+    cw.put(count);
+    for (Element_ID id = 0; id < count;id++)
+    {
+      Node_ID eid = 0;
+      present = derivation_db->get_key(&eid,id);
+      cw.put(present);
+      cw.put(eid);
+    }
+  }
+
+  cw.put(generator_properties,nr_generators);
+  cw.put(nr_good_generators);
+  cw.put(nr_trivial_generators);
+  cw.put(nr_coset_reducible_generators);
+  cw.put(rm_state);
+  return cw.is_ok();
+}
+
+/**/
+
+bool Rewriter_Machine::restore(Checkpoint_Reader & cr)
+{
+  bool present;
+  cr.get(&present);
+  if (present)
+    dt = Difference_Tracker::create(nm,1024);
+  nm.restore(cr);
+  if (dt)
+    dt->restore(cr);
+  jm.restore(cr);
+  cr.get(&stats);
+  expand_list.restore(cr,nm);
+  re_expand_list.restore(cr,nm);
+  cr.get(&present);
+  if (present)
+  {
+    create_expand_ont();
+    if (!expand_ont)
+      return false;
+    expand_ont->restore(cr);
+  }
+
+  cr.get(&present);
+  if (present)
+  {
+    Element_Count count = 0;
+    cr.get(&count);
+    pool = new Equation_DB(alphabet(),count < 1024 ? 1024 : count);
+    Ordinal_Word lhs(alphabet());
+    Ordinal_Word rhs(alphabet());
+    for (Element_ID id = 0; id < count && cr.is_ok();id++)
+    {
+      cr.get_word(&lhs);
+      cr.get_word(&rhs);
+      pool->insert(lhs);
+      pool->update_rhs(id,rhs);
+    }
+    /* The equations that were on disk are all put in memory. They may
+       include equations with the same LHS as one already in the pool, in
+       which case we keep the better one, as add_to_pool() would have */
+    Ordinal_Word old_rhs(alphabet());
+    cr.get(&present);
+    while (present && cr.is_ok())
+    {
+      Element_ID key;
+      cr.get_word(&lhs);
+      cr.get_word(&rhs);
+      if (pool->insert(lhs,&key))
+        pool->update_rhs(key,rhs);
+      else
+      {
+        pool->get_rhs(&old_rhs,key);
+        if (old_rhs.compare(rhs) > 0)
+          pool->update_rhs(key,rhs);
+        jm.change_pool_count(-1);
+        stats.some_discarded = true;
+      }
+      cr.get(&present);
+    }
+  }
+
+  cr.get(&present);
+  if (present)
+  {
+    /* Removed entries are given dummy keys at first, and then removed
+       once every entry is present, so that the remaining entries keep
+       their numbers */
+    Element_Count count = 0;
+    cr.get(&count);
+    derivation_db = new Hash(1024*1024,sizeof(Node_ID));
+    bool * is_hole = new bool[count];
+    for (Element_ID id = 0; id < count;id++)
+    {
+      Node_ID eid;
+      cr.get(&present);
+      cr.get(&eid);
+      is_hole[id] = !present;
+      if (!present)
+        eid = Node_ID(~0) - id;
+      derivation_db->find_entry(&eid,sizeof(Node_ID));
+    }
+    for (Element_ID id = 0; id < count;id++)
+      if (is_hole[id])
+        derivation_db->remove_entry(id,false);
+    delete [] is_hole;
+  }
+
+  cr.get(generator_properties,nr_generators);
+  cr.get(&nr_good_generators);
+  cr.get(&nr_trivial_generators);
+  cr.get(&nr_coset_reducible_generators);
+  cr.get(&rm_state);
+  restored = true;
+  return cr.is_ok();
+}
+
+/**/
+
 Strong_Diff_Reduce::Strong_Diff_Reduce(Rewriter_Machine * rm_) :
   rm(rm_),
   dt(rm_ ? rm_->dt : 0)
@@ -4014,6 +4908,7 @@ Strong_Diff_Reduce::Strong_Diff_Reduce(Rewriter_Machine * rm_) :
   dr0 = dt ? new Diff_Reduce(dt) : 0;
   dr1 = dt ? new Diff_Reduce(dt) : 0;
   dr2 = 0;
+  journal_time = dt ? dt->take_journal_time() : 0;
 }
 
 Strong_Diff_Reduce::~Strong_Diff_Reduce()
@@ -4035,10 +4930,14 @@ unsigned Strong_Diff_Reduce::reduce(Word * rword,const Word & word,
     return rm->reduce(rword,word,flags);
   if (dt->dm_changed(0,true))
   {
-    dr0->invalidate();
-    dr1->invalidate();
+    /* The journal tells us which states have changed, so the Diff_Reduce
+       objects can keep the part of their state that is still good */
+    const unsigned * change_time = dt->change_journal();
+    dr0->invalidate(change_time,journal_time);
+    dr1->invalidate(change_time,journal_time);
     if (dr2)
-      dr2->invalidate();
+      dr2->invalidate(change_time,journal_time);
+    journal_time = dt->take_journal_time();
     dt->clear_changes();
   }
   int retcode = 0;
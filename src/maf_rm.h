@@ -86,11 +86,35 @@ class Diff_Reduce;
 class Word_DB;
 class Equation_Manager;
 class Equation_DB;
+class Equation_Spool;
+class Checkpoint_Writer;
+class Checkpoint_Reader;
+struct Telemetry_Sample;
 
 //Classes defined in this header
 class Rewriter_Machine;
 class Equation_Word_Reducer;
 
+/* Return values for Rewriter_Machine::overlap_equation() */
+enum Overlap_Equation_Result
+{
+  OER_Formed,    // equation formed normally
+  OER_Extended,  // equation formed, but it should be given to consider(Word_DB &)
+  OER_Skip,      // overlap is not to be considered
+  OER_Ignored,   // overlap is too long to consider (some_ignored should be set)
+  OER_Too_Long,  // equation is too long to form (some_discarded should be set)
+  OER_Invalid    // the second equation has been removed
+};
+
+/* Overlap_Speculation records the result of Rewriter_Machine::speculate(),
+   which is used by the parallel overlap code in maf_jm.cpp */
+struct Overlap_Speculation
+{
+  Certificate certificate; // state of the tree when the speculation was made
+  unsigned flags;          // flags the equation would have been learnt with
+  bool trivial;            // true if learn() would have returned 0
+};
+
 /* Values for generator_properties.
    Left cancellation means from xa=xb we are allowed to deduce a=b
    Right cancellation means from ax=bx we are allowed to deduce a=b
@@ -133,6 +157,7 @@ class Strong_Diff_Reduce : public Word_Reducer
     Diff_Reduce * dr0;
     Diff_Reduce * dr1;
     Diff_Reduce * dr2;
+    unsigned journal_time;
   public:
     Strong_Diff_Reduce(Rewriter_Machine *rm_);
     ~Strong_Diff_Reduce();
@@ -247,6 +272,7 @@ class Rewriter_Machine
     Node_List re_expand_list;
     Ordered_Node_Tree *expand_ont;
     Equation_DB * pool;
+    Equation_Spool * spool; // overflow of pool to disk, if -pool_memory used
     Hash * derivation_db;
     const Ordinal nr_generators;
     Ordinal nr_good_generators;
@@ -254,6 +280,7 @@ class Rewriter_Machine
     Ordinal nr_coset_reducible_generators;
     unsigned rm_state;
     unsigned char * generator_properties;
+    bool restored;
   public:
     /* Constructors /Destructors */
     Rewriter_Machine(MAF & maf_);
@@ -330,9 +357,21 @@ class Rewriter_Machine
     bool add_axiom(const Word & lhs,const Word & rhs,unsigned flags);
     bool add_correction(const Ordinal_Word & lhs,const Ordinal_Word & rhs,bool is_primary = false);
     bool check_differences(unsigned ae_flags);
+    /* checkpoint() saves the complete state of the Rewriter_Machine so that
+       restore() can put it back in a new instance. It returns false, and
+       saves nothing useful, unless it is called between passes of
+       expand_machine(), since otherwise there may be work in progress
+       which is not saved. restore() must be called on a newly constructed
+       Rewriter_Machine to which no axioms have been added.
+       checkpoint() is not const because it reads back the equations that
+       have been spilled to disk, though it leaves the spool as it was. */
+    bool checkpoint(Checkpoint_Writer & cw);
     bool container_status(unsigned level,int gap,const char * control,...) __attribute__((format(printf,4,5)));
     bool critical_status(unsigned level,int gap,const char * control,...) __attribute__((format(printf,4,5)));
     bool short_status(int priority,unsigned level,int gap,const char * control,Variadic_Arguments & va);
+    /* telemetry_sample() fills in the fields of a Telemetry_Sample that
+       describe the Rewriter_Machine */
+    void telemetry_sample(Telemetry_Sample * sample) const;
     // dm_valid() returns true if changes to the difference tracker
     // since the last call to grow_wd() would cause the specified difference
     // machine to be different.
@@ -379,6 +418,7 @@ class Rewriter_Machine
         stats.first_timeout = 60;
     }
     void restart();
+    bool restore(Checkpoint_Reader & cr);
     void schedule_optimise(const Word & word);
     void start(); // to be called once before beginning KB expansion
                   // allows for one type initialisations that cannot be
@@ -394,6 +434,7 @@ class Rewriter_Machine
                          Equation_Handle e,bool force);
     bool check_interest(Equation_Handle e,State initial_state,Ordinal lvalue,Ordinal rvalue);
     void clear_differences(Node_List * equation_list);
+    void create_expand_ont();
     bool conjugate(Equation_Handle e);
     void schedule_right_conjugation(Equation_Handle e);
     void coset_extras(Equation_Handle e);
@@ -401,7 +442,21 @@ class Rewriter_Machine
     int consider(Equation_Handle e1,Equation_Handle e2,Word_Length offset,
                  const Simple_Equation & eq1,
                  const Simple_Equation & eq2,
-                 unsigned flags = 0);
+                 unsigned flags = 0,
+                 const Overlap_Speculation * speculation = 0);
+    Overlap_Equation_Result overlap_equation(Ordinal_Word * lhs_word,
+                                             Ordinal_Word * rhs_word,
+                                             unsigned * flags,
+                                             Equation_Handle e1,
+                                             Equation_Handle e2,
+                                             Word_Length offset,
+                                             const Simple_Equation & eq1,
+                                             const Simple_Equation & eq2) const;
+    void speculate(Overlap_Speculation * speculation,
+                   Equation_Handle e1,Equation_Handle e2,Word_Length offset,
+                   const Simple_Equation & eq1,
+                   const Simple_Equation & eq2,
+                   unsigned flags) const;
     bool add_to_reduced_words(Sorted_Word_List &reduced_swl,
                               Word_DB &next_wdb,
                               Ordinal_Word * rword);
@@ -417,15 +472,29 @@ class Rewriter_Machine
     void late_differences();
     bool prepare_differences(Equation_Handle e);
     void purge();
+    void record_telemetry();
     bool relabel_difference(Node_Handle nh,Node_Flags flags,Node_Count to_do);
     void kill_node(Node * node);
     void reset_pool();
+    void spill_pool();
+    void update_spool_limits();
     void schedule(unsigned rm_state);
     void set_initial_special_limit();
     bool status(int priority,unsigned level,int gap,const char * control,...) __attribute__((format(printf,5,6)));
     bool add_to_pool(Element_ID *id,Working_Equation *we,unsigned flags);
     void optimise(const Word & word);
     void add_to_tree(Working_Equation * we,unsigned flags,Total_Length was_length);
+    /* Methods used for exploring the tree in several threads */
+    class Explore_Window;
+    unsigned explore_threads() const;
+    bool process_acceptor_window(Explore_Window & window,Equation_Word & ew,
+                                 Word_Length * depth,State_ID * state,
+                                 const FSA * wa,Working_Equation & we,
+                                 bool * done);
+    bool process_dm_window(Explore_Window & window,Strong_Diff_Reduce & sdr,
+                           Equation_Word & ew,Word_Length * depth,
+                           Working_Equation & we,Node_Count * added,
+                           bool * restart,bool * do_all);
 };
 
 #endif
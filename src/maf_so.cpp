@@ -50,6 +50,8 @@
 #include "maf_so.h"
 #include "fsa.h"
 #include "mafctype.h"
+#include "heap.h"
+#include "maf.h"
 
 Standard_Options::Standard_Options(Container & container_,unsigned relevant_) :
   container(container_),
@@ -59,7 +61,11 @@ Standard_Options::Standard_Options(Container & container_,unsigned relevant_) :
   verbose(false),
   use_stdin(false),
   use_stdout(false),
-  reduction_method(GAT_Auto_Select)
+  multiplier_cache(0),
+  multiplier_cache_size(256),
+  reduction_method(GAT_Auto_Select),
+  use_trie(false),
+  prefix_cache(0)
 {
 }
 
@@ -301,6 +307,54 @@ bool Standard_Options::recognised(char ** argv,int &i)
     return true;
   }
 
+  if (present(arg,"-heap_profile"))
+  {
+    Heap::start_profiling();
+    i++;
+    return true;
+  }
+
+  if (present(arg,"-heap_trim"))
+  {
+    Unsigned_Long_Long keep;
+    if (parse_natural(&keep,argv[i+1],0,arg))
+    {
+      Heap_Trim_Policy policy = Heap::trim_policy();
+      policy.keep = size_t(keep) << 20;
+      Heap::set_trim_policy(policy);
+    }
+    i += 2;
+    return true;
+  }
+
+  if (present(arg,"-no_heap_trim"))
+  {
+    Heap_Trim_Policy policy = Heap::trim_policy();
+    policy.keep = ~size_t(0);
+    Heap::set_trim_policy(policy);
+    i++;
+    return true;
+  }
+
+  if (relevant & SO_MULTIPLIER_CACHE)
+  {
+    if (present(arg,"-multiplier_cache"))
+    {
+      multiplier_cache = argv[i+1];
+      if (!multiplier_cache)
+        container.usage_error("Expected directory name for option %s\n",
+                              arg.string());
+      i += 2;
+      return true;
+    }
+    if (present(arg,"-multiplier_cache_size"))
+    {
+      parse_natural(&multiplier_cache_size,argv[i+1],0,arg);
+      i += 2;
+      return true;
+    }
+  }
+
   if (relevant & SO_REDUCTION_METHOD)
   {
     if (arg.is_equal("-cosets"))
@@ -359,6 +413,20 @@ bool Standard_Options::recognised(char ** argv,int &i)
       return true;
     }
 
+    if (arg.is_equal("-trie"))
+    {
+      use_trie = true;
+      i++;
+      return true;
+    }
+
+    if (present(arg,"-prefix_cache"))
+    {
+      parse_natural(&prefix_cache,argv[i+1],0,arg);
+      i += 2;
+      return true;
+    }
+
     if (relevant & SO_PROVISIONAL)
     {
       if (arg.is_equal("-pkbprog"))
@@ -419,7 +487,13 @@ void Standard_Options::usage(String suffix) const
   cprintf("[loglevel] can be one of the following:\n"
           "  -verbose or -v : regular progress reports are made\n"
           "  -quiet         : progress reports are made at significant points\n"
-          "  -silent        : there are no progress reports at all\n");
+          "  -silent        : there are no progress reports at all\n"
+          "-heap_profile can also be specified to have memory usage analysed"
+          " by size\nand subsystem. The analysis is output to stderr at exit,"
+          " and with -verbose\nalso in regular progress reports.\n"
+          "-heap_trim n allows up to n MB of unused memory (default 64) to be"
+          " kept rather\nthan returned to the OS. -no_heap_trim keeps all"
+          " memory until the program ends.\n");
 
   if (relevant & SO_FSA_FORMAT)
     cprintf("[format] options:\n"
@@ -443,6 +517,33 @@ void Standard_Options::usage(String suffix) const
     else
       cprintf("\n");
     cprintf("If unspecified (recommended) MAF will use the best available"
-            " method.\n");
+            " method.\n"
+            "-trie causes reduction using a rewriting system to be performed"
+            " by an\nAho-Corasick automaton built from the equations, rather"
+            " than by the index\nautomaton.\n"
+            "-prefix_cache n allows up to n MB to be used to remember the"
+            " states reached by\nthe prefixes of earlier words when"
+            " reducing with a word-difference machine.\n");
   }
+
+  if (relevant & SO_MULTIPLIER_CACHE)
+    cprintf("-multiplier_cache dir keeps the composite multipliers that are"
+            " built in the\nexisting directory dir, and uses them again when"
+            " the same multiplier is needed\nfrom the same automatic structure"
+            " later. -multiplier_cache_size n limits the\ncache to n MB"
+            " (default 256), deleting the least recently used entries first."
+            "\n0 means there is no limit.\n");
+}
+
+/**/
+
+bool Standard_Options::start_multiplier_cache(MAF & maf) const
+{
+  if (!multiplier_cache)
+    return true;
+  if (maf.start_multiplier_cache(multiplier_cache,multiplier_cache_size))
+    return true;
+  container.error_output("Unable to use %s as a multiplier cache. Check the"
+                         " directory exists\n",multiplier_cache.string());
+  return false;
 }
@@ -54,24 +54,34 @@ const unsigned SO_FSA_KBMAG_COMPATIBILITY = 16;
 const unsigned SO_STDOUT = 32;
 const unsigned SO_GPUTIL = 64;   // Flag to change the name used in the
 const unsigned SO_WORDUTIL = 128; // "output is to" message
+const unsigned SO_MULTIPLIER_CACHE = 256;
 
 // clases referred to and defined elsewhere
 class Container;
+class MAF;
 
 class Standard_Options
 {
   public:
     unsigned fsa_format_flags;
     Group_Automaton_Type reduction_method;
+    bool use_trie;
+    unsigned prefix_cache;            // in megabytes, 0 if there is no cache
     const unsigned relevant;
     unsigned log_level;
     bool verbose;
     bool use_stdin;
     bool use_stdout;
+    String multiplier_cache;          // directory, or 0 if there is no cache
+    unsigned multiplier_cache_size;   // in megabytes
     Container & container;
     Standard_Options(Container & container_,unsigned relevant_);
     bool recognised(char ** argv,int & i);
     void usage(String default_suffix = 0) const;
+    /* start_multiplier_cache() starts the cache requested with
+       -multiplier_cache, if there was one, and returns false if it could not
+       be started */
+    bool start_multiplier_cache(MAF & maf) const;
     /* present() can be used to check for options whose names consist of
        several parts.
        present("-option_name",option) will return true if the option is any of
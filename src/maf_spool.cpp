@@ -0,0 +1,317 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: maf_spool.cpp $
+//
+
+/* Implementation of the class declared in maf_spool.h */
+
+#include "awcc.h"
+#include "maf_spool.h"
+#include "checkpoint.h"
+#include "container.h"
+#include "mafword.h"
+
+/* Every read has to merge all the runs, and has to skip over the part of
+   each run that has already been read back, so once there are this many
+   runs they are merged into one before another is written */
+const unsigned MAX_RUNS = 16;
+
+/**/
+
+Equation_Spool::Equation_Spool(Container & container_,
+                               const Alphabet & alphabet_,
+                               String base_filename_) :
+  container(container_),
+  alphabet(alphabet_),
+  runs(0),
+  nr_runs(0),
+  allocated_runs(0),
+  next_run_nr(0),
+  nr_equations(0),
+  writer(0),
+  new_run(0),
+  readers(0),
+  nr_readers(0),
+  read_limit(0),
+  nr_lost(0)
+{
+  base_filename = base_filename_;
+}
+
+/**/
+
+Equation_Spool::~Equation_Spool()
+{
+  empty();
+  if (runs)
+    delete [] runs;
+}
+
+/**/
+
+Total_Length Equation_Spool::shortest() const
+{
+  Total_Length answer = UNLIMITED;
+  for (unsigned i = 0; i < nr_runs;i++)
+    if (runs[i]->shortest < answer)
+      answer = runs[i]->shortest;
+  return answer;
+}
+
+/**/
+
+void Equation_Spool::empty()
+{
+  if (readers)
+    end_read(false);
+  if (writer)
+  {
+    /* Deleting the writer without calling commit() removes the partly
+       written file */
+    delete writer;
+    writer = 0;
+    delete new_run;
+    new_run = 0;
+  }
+  while (nr_runs)
+    delete_run(nr_runs-1);
+  nr_equations = 0;
+}
+
+/**/
+
+void Equation_Spool::delete_run(unsigned i)
+{
+  Run * run = runs[i];
+  nr_equations -= run->count - run->consumed;
+  container.delete_file(run->filename);
+  delete run;
+  for (unsigned j = i+1; j < nr_runs;j++)
+    runs[j-1] = runs[j];
+  nr_runs--;
+}
+
+/**/
+
+bool Equation_Spool::begin_run()
+{
+  if (nr_runs >= MAX_RUNS)
+    merge_runs();
+  return open_run();
+}
+
+/**/
+
+bool Equation_Spool::open_run()
+{
+  String_Buffer sb1;
+  String_Buffer sb2;
+  String suffix = sb1.format(".pool%u",next_run_nr++);
+  new_run = new Run;
+  new_run->filename = sb2.make_filename("",base_filename,suffix);
+  new_run->count = 0;
+  new_run->consumed = 0;
+  new_run->shortest = UNLIMITED;
+  writer = new Checkpoint_Writer(container,new_run->filename);
+  if (writer->is_ok())
+    return true;
+  delete writer;
+  writer = 0;
+  delete new_run;
+  new_run = 0;
+  return false;
+}
+
+/**/
+
+void Equation_Spool::add(const Word & lhs,const Word & rhs)
+{
+  if (writer)
+  {
+    Total_Length tl = lhs.length() + rhs.length();
+    if (!new_run->count)
+      new_run->shortest = tl;
+    writer->put(tl);
+    writer->put_word(lhs);
+    writer->put_word(rhs);
+    new_run->count++;
+  }
+}
+
+/**/
+
+bool Equation_Spool::end_run()
+{
+  if (!writer)
+    return false;
+  bool ok = writer->commit();
+  delete writer;
+  writer = 0;
+  if (ok && new_run->count)
+  {
+    if (nr_runs == allocated_runs)
+    {
+      allocated_runs = allocated_runs ? allocated_runs*2 : MAX_RUNS+1;
+      Run ** new_runs = new Run *[allocated_runs];
+      for (unsigned i = 0; i < nr_runs;i++)
+        new_runs[i] = runs[i];
+      if (runs)
+        delete [] runs;
+      runs = new_runs;
+    }
+    runs[nr_runs++] = new_run;
+    nr_equations += new_run->count;
+  }
+  else
+  {
+    if (ok)
+      container.delete_file(new_run->filename);
+    delete new_run;
+  }
+  new_run = 0;
+  return ok;
+}
+
+/**/
+
+void Equation_Spool::start_read(Total_Length limit)
+{
+  MAF_ASSERT(!readers,container,("Equation_Spool::start_read() called while"
+                                 " a read is in progress\n"));
+  read_limit = limit;
+  nr_readers = 0;
+  readers = new Reader[nr_runs ? nr_runs : 1];
+  for (unsigned i = 0; i < nr_runs;i++)
+  {
+    Run * run = runs[i];
+    if (run->shortest > limit)
+      continue;
+    Reader & reader = readers[nr_readers++];
+    reader.run = run;
+    reader.cr = new Checkpoint_Reader(container,run->filename);
+    reader.lhs = new Ordinal_Word(alphabet);
+    reader.rhs = new Ordinal_Word(alphabet);
+    reader.next = 0;
+    reader.taken = 0;
+    reader.held = false;
+    reader.lost = !reader.cr->is_ok();
+    /* Runs are never rewritten, so the equations that have already been
+       read back are still at the start of the file, and we have to skip
+       them */
+    while (!reader.lost && reader.next <= run->consumed &&
+           reader.next < run->count)
+      advance(reader);
+  }
+}
+
+/**/
+
+void Equation_Spool::advance(Reader & reader)
+{
+  reader.held = false;
+  if (reader.lost || reader.next == reader.run->count)
+    return;
+  reader.cr->get(&reader.tl);
+  reader.cr->get_word(reader.lhs);
+  if (!reader.cr->get_word(reader.rhs))
+    reader.lost = true;
+  else
+  {
+    reader.next++;
+    reader.held = true;
+  }
+}
+
+/**/
+
+bool Equation_Spool::read(Word * lhs,Word * rhs)
+{
+  /* There are never more than MAX_RUNS runs, so a linear search for the
+     shortest equation is good enough */
+  Reader * best = 0;
+  for (unsigned i = 0; i < nr_readers;i++)
+  {
+    Reader & reader = readers[i];
+    if (reader.held && reader.tl <= read_limit &&
+        (!best || reader.tl < best->tl))
+      best = &reader;
+  }
+  if (!best)
+    return false;
+  *lhs = *best->lhs;
+  *rhs = *best->rhs;
+  best->taken++;
+  advance(*best);
+  return true;
+}
+
+/**/
+
+void Equation_Spool::end_read(bool consume)
+{
+  for (unsigned i = 0; i < nr_readers;i++)
+  {
+    Reader & reader = readers[i];
+    Run * run = reader.run;
+    if (reader.lost)
+    {
+      /* The rest of a damaged run is thrown away. If we are consuming
+         the equations already read from it have been dealt with. */
+      Element_Count gone = run->count - run->consumed;
+      if (consume)
+        gone -= reader.taken;
+      nr_lost += gone;
+      nr_equations -= run->count - run->consumed;
+      run->consumed = run->count;
+    }
+    else if (consume)
+    {
+      run->consumed += reader.taken;
+      nr_equations -= reader.taken;
+      run->shortest = reader.held ? reader.tl : UNLIMITED;
+    }
+    delete reader.cr;
+    delete reader.lhs;
+    delete reader.rhs;
+  }
+  delete [] readers;
+  readers = 0;
+  nr_readers = 0;
+  for (unsigned i = nr_runs; i-- > 0;)
+    if (runs[i]->consumed == runs[i]->count)
+      delete_run(i);
+}
+
+/**/
+
+void Equation_Spool::merge_runs()
+{
+  /* The merged run goes at the end of runs[], so it is not one of the runs
+     being read */
+  start_read(UNLIMITED);
+  if (!open_run())
+  {
+    end_read(false);
+    return;
+  }
+  Ordinal_Word lhs(alphabet);
+  Ordinal_Word rhs(alphabet);
+  while (read(&lhs,&rhs))
+    add(lhs,rhs);
+  end_read(end_run());
+}
@@ -0,0 +1,155 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: maf_spool.h $
+*/
+#pragma once
+#ifndef MAF_SPOOL_INCLUDED
+#define MAF_SPOOL_INCLUDED 1
+
+/* An Equation_Spool is the second, disk based, tier of the pool. When the
+   -pool_memory option is used and the pool grows past the specified size,
+   Rewriter_Machine::spill_pool() keeps the shortest equations in memory
+   and writes the rest to a "run": a file in which the equations are
+   sorted by total length. Each run is written once and never modified.
+
+   The pool is only ever examined from the shortest equations upwards, so
+   check_pool() reads the runs back with a merge, asking only for the
+   equations no longer than the visible limit. A run remembers how many
+   of its equations have been read back, and is deleted once all of them
+   have been. Since the spilled equations were the longest in the pool
+   when they were spilled, most of them stay on disk until the visible
+   limit has grown to meet them, or are thrown away unread if MAF
+   restarts.
+
+   The runs are written with Checkpoint_Writer, so that a damaged run is
+   detected rather than read back as nonsense. */
+
+#ifndef AWDEFS_INCLUDED
+#include "awdefs.h"
+#endif
+#ifndef MAFBASE_INCLUDED
+#include "mafbase.h"
+#endif
+
+// Classes referred to but defined elsewhere
+class Alphabet;
+class Checkpoint_Reader;
+class Checkpoint_Writer;
+class Container;
+class Ordinal_Word;
+class Word;
+
+class Equation_Spool
+{
+  BLOCKED(Equation_Spool)
+  private:
+    struct Run
+    {
+      Owned_String filename;
+      Element_Count count;     // number of equations in the file
+      Element_Count consumed;  // number that have been read back
+      Total_Length shortest;   // total length of the first unread equation
+    };
+    struct Reader
+    {
+      Run * run;
+      Checkpoint_Reader * cr;
+      Ordinal_Word * lhs;
+      Ordinal_Word * rhs;
+      Element_Count next;     // index in run of the next equation in the file
+      Element_Count taken;    // number of equations returned by read()
+      Total_Length tl;        // total length of the equation in lhs,rhs
+      bool held;              // true if lhs,rhs hold an unread equation
+      bool lost;              // true if the run could not be read
+    };
+    Container & container;
+    const Alphabet & alphabet;
+    Owned_String base_filename;
+    Run ** runs;
+    unsigned nr_runs;
+    unsigned allocated_runs;
+    unsigned next_run_nr;
+    Element_Count nr_equations;  // unread equations in all the runs
+    // state of the run being written
+    Checkpoint_Writer * writer;
+    Run * new_run;
+    // state of a read
+    Reader * readers;
+    unsigned nr_readers;
+    Total_Length read_limit;
+    Element_Count nr_lost;
+  public:
+    /* base_filename is the name of the input file. The runs are written
+       next to it, with suffixes ".pool0", ".pool1", and so on */
+    Equation_Spool(Container & container_,const Alphabet & alphabet_,
+                   String base_filename_);
+    ~Equation_Spool();
+    Element_Count count() const
+    {
+      return nr_equations;
+    }
+    unsigned run_count() const
+    {
+      return nr_runs;
+    }
+    // shortest() returns UNLIMITED if the spool is empty
+    Total_Length shortest() const;
+    // empty() deletes all the runs
+    void empty();
+
+    /* To write a run call begin_run(), then add() for each equation in
+       order of total length, then end_run(). end_run() returns false if
+       the run could not be written, in which case the caller still owns
+       the equations */
+    bool begin_run();
+    void add(const Word & lhs,const Word & rhs);
+    bool end_run();
+
+    /* To read equations back call start_read(), then call read() until
+       it returns false, then call end_read(). Only the equations with
+       total length no more than limit are returned. If consume is false
+       in the call to end_read() the equations that were read remain in
+       the spool; this is used when a checkpoint is written. Only one read
+       can be in progress at a time, so callers that might interrupt a
+       read must check is_reading() first */
+    void start_read(Total_Length limit);
+    bool read(Word * lhs,Word * rhs);
+    void end_read(bool consume);
+    bool is_reading() const
+    {
+      return readers != 0;
+    }
+    /* A run that cannot be read back is discarded. lost_equations()
+       returns the number of equations that have been lost in this way
+       since it was last called, so that the caller can adjust its counts
+       and remember that the equations are not all present any more */
+    Element_Count lost_equations()
+    {
+      Element_Count answer = nr_lost;
+      nr_lost = 0;
+      return answer;
+    }
+  private:
+    bool open_run();
+    void advance(Reader & reader);
+    void merge_runs();
+    void delete_run(unsigned i);
+};
+
+#endif
@@ -132,6 +132,7 @@ Low_Index_Subgroup_Finder.
 #include "container.h"
 #include "maf_tc.h"
 #include "relators.h"
+#include "heap.h"
 
 class Coset_Enumerator : public FSA_Common
 {
@@ -3287,6 +3288,7 @@ Language_Size MAF::enumerate_cosets(FSA **coset_table,
   /* Enumerate the cosets of the specified, possibly trivial subgroup, of the
      underlying group of the current MAF object */
 
+  Heap_Tag tag(HC_Cosets);
   Coset_Enumerator * ce = new Coset_Enumerator(*this);
   Language_Size retcode = ce->enumerate(normal_closure_generators,
                                         subgroup_generators,options,
@@ -89,6 +89,7 @@
 #include "maf_we.h"
 #include "maf_wdb.h"
 #include "maf_ss.h"
+#include "mafthread.h"
 
 /* This module contains code for building and checking word_acceptor and
 multiplier FSAs for automatic groups and coset systems. The algorithms used are
@@ -263,13 +264,58 @@ static inline bool better_compare_state(char new_shortlex_state,
 
 /**/
 
+/* WA_Growth_Monitor is used by the methods that build a word-acceptor from
+   a difference machine to notice when the construction is diverging. When
+   the difference machine is still missing word-differences the number of
+   states of each length often keeps increasing rather than levelling off,
+   and the construction continues until memory is exhausted. Once the
+   acceptor has at least floor states it is deemed to be diverging if
+   each of the last DIVERGENT_LENGTHS lengths has had more states than the
+   one before. The caller then stops creating new states and completes a
+   partial acceptor, in the same way as when max_states is reached.
+   A floor of 0 means that the construction is never cut short.
+*/
+
+class WA_Growth_Monitor
+{
+  private:
+    enum { DIVERGENT_LENGTHS = 4 };
+    const State_Count floor;
+    State_Count last_layer;
+    unsigned nr_growing;
+  public:
+    WA_Growth_Monitor(State_Count floor_) :
+      floor(floor_),
+      last_layer(0),
+      nr_growing(0)
+    {}
+    bool active() const
+    {
+      return floor != 0;
+    }
+    /* layer_complete() is called when the first state of a new length has
+       been created, with the number of states of the previous length and
+       the number of states so far, and returns true if the construction
+       should be cut short */
+    bool layer_complete(State_Count layer_size,State_Count count)
+    {
+      nr_growing = layer_size > last_layer ? nr_growing+1 : 0;
+      last_layer = layer_size;
+      return floor && count >= floor && nr_growing >= DIVERGENT_LENGTHS;
+    }
+};
+
+/**/
+
 static FSA_Simple * build_shortlex_wa_from_dm(MAF & maf,
                                               const FSA *fsa_wd,
                                               bool create_equations,
                                               bool geodesic,
                                               bool force_group_acceptor,
                                               Word_Length max_context,
-                                              State_Count max_states)
+                                              State_Count max_states,
+                                              State_Count divergence_floor,
+                                              bool * truncated)
 {
   /* This method is called to implement the construction of the word-acceptor
      of a shortlex automatic group, or the coset word-acceptor for a shortlex
@@ -360,9 +406,13 @@ static FSA_Simple * build_shortlex_wa_from_dm(MAF & maf,
     /* We can't limit the state set for coset acceptors yet */
     max_context = 0;
     max_states = 0;
+    divergence_floor = 0;
   }
+  WA_Growth_Monitor monitor(truncated ? divergence_floor : 0);
+  if (truncated)
+    *truncated = false;
   bool unlimited = max_states == 0 && max_context == 0;
-  bool need_definitions = create_equations || !unlimited;
+  bool need_definitions = create_equations || !unlimited || monitor.active();
 
   /* Insert and skip failure state */
   factory.find_state(packed_key,0);
@@ -532,6 +582,20 @@ static FSA_Simple * build_shortlex_wa_from_dm(MAF & maf,
           if (wa_state >= ceiling)
           {
             state_length++;
+            if (monitor.layer_complete(transition[g1] - ceiling,count+1))
+            {
+              container.progress(1,"Word-acceptor construction is diverging."
+                                 " " FMT_ID " states of length %u, " FMT_ID
+                                 " states in all\nCompleting partial"
+                                 " word-acceptor\n",transition[g1] - ceiling,
+                                 state_length-1,count+1);
+              /* From now on no new states are created, so the transitions
+                 that would have needed them go to the state for the
+                 suffix instead */
+              unlimited = false;
+              max_states = count+1;
+              *truncated = true;
+            }
             ceiling = transition[g1];
           }
           if (need_definitions)
@@ -563,7 +627,9 @@ FSA_Simple * MAF::build_acceptor_from_dm(const FSA *fsa_wd,
                                          bool geodesic,
                                          bool force_group_acceptor,
                                          Word_Length max_context,
-                                         State_Count max_states)
+                                         State_Count max_states,
+                                         State_Count divergence_floor,
+                                         bool * truncated)
 {
   /* This method is intended to be called only in the construction of the
      word-acceptor of an automatic group, or the coset word-acceptor
@@ -619,6 +685,14 @@ FSA_Simple * MAF::build_acceptor_from_dm(const FSA *fsa_wd,
      for all words x,y, x is shorter than y => x < y and x is longer than y
      => x > y. We may as well use the shortlex code in this case, and
      simply start the greater than automaton in its x > y state.
+
+     If truncated is not 0 and divergence_floor is non-zero the construction
+     is cut short if a WA_Growth_Monitor decides it is diverging, and
+     *truncated is set to true. The FSA returned is then only a partial
+     word-acceptor, in which the transitions from the states that were
+     still to be created lead to the state for the suffix of the word
+     instead. It accepts some reducible words, but every word it rejects
+     is reducible, so it is still useful to explore_acceptor().
   */
   const Alphabet & alphabet = fsa_wd->base_alphabet;
   if (alphabet.order_is_effectively_shortlex() ||
@@ -626,7 +700,7 @@ FSA_Simple * MAF::build_acceptor_from_dm(const FSA *fsa_wd,
       geodesic && alphabet.order_is_geodesic())
     return build_shortlex_wa_from_dm(*this,fsa_wd,create_equations,geodesic,
                                      force_group_acceptor,max_context,
-                                     max_states);
+                                     max_states,divergence_floor,truncated);
 
   if (!alphabet.order_supports_automation())
     return 0;
@@ -866,9 +940,14 @@ FSA_Simple * MAF::build_acceptor_from_dm(const FSA *fsa_wd,
     /* We can't limit the state set for coset acceptors yet */
     max_context = 0;
     max_states = 0;
+    divergence_floor = 0;
   }
+  WA_Growth_Monitor monitor(truncated ? divergence_floor : 0);
+  if (truncated)
+    *truncated = false;
   bool unlimited = max_context == 0 && max_states == 0;
-  bool need_definitions = create_equations || can_lengthen || !unlimited;
+  bool need_definitions = create_equations || can_lengthen || !unlimited ||
+                          monitor.active();
   const char * status_message =  create_equations ?
     "Building word-acceptor & equations " FMT_ID " (" FMT_ID " of " FMT_ID " to do). Length %u\n":
     "Building word-acceptor state " FMT_ID " (" FMT_ID " of " FMT_ID " to do). Length %u\n";
@@ -1017,6 +1096,20 @@ FSA_Simple * MAF::build_acceptor_from_dm(const FSA *fsa_wd,
           if (wa_state >= ceiling)
           {
             state_length++;
+            if (monitor.layer_complete(transition[g1] - ceiling,count+1))
+            {
+              container.progress(1,"Word-acceptor construction is diverging."
+                                 " " FMT_ID " states of length %u, " FMT_ID
+                                 " states in all\nCompleting partial"
+                                 " word-acceptor\n",transition[g1] - ceiling,
+                                 state_length-1,count+1);
+              /* From now on no new states are created, so the transitions
+                 that would have needed them go to the state for the
+                 suffix instead */
+              unlimited = false;
+              max_states = count+1;
+              *truncated = true;
+            }
             ceiling = transition[g1];
           }
           if (need_definitions)
@@ -1146,6 +1239,346 @@ bool Difference_Machine_Index::find(const Word & word,State_ID * si) const
 
 /**/
 
+/* State_Lookahead is the base class for the classes that let several
+   threads help with one of the breadth first explorations below. Those all
+   spend most of their time computing the successors of each state and
+   looking them up in a Keyed_FSA, and the successors of states that were
+   already present can be computed in any order. So when there are enough
+   states waiting to be processed prepare() divides a block of them among
+   the threads, and the derived class's look_up() method records what it
+   finds for each one. The main thread then processes the states in order
+   exactly as it would have done otherwise, but uses the answers instead of
+   searching the index again. look_up() must only read the Keyed_FSA and
+   any tables it uses, since the main thread waits for the threads to
+   finish before it does anything else.
+*/
+
+class State_Lookahead
+{
+  private:
+    class Worker : public Thread
+    {
+      private:
+        State_Lookahead & lookahead;
+        State_ID from;
+        State_ID to;
+      public:
+        Worker(State_Lookahead & lookahead_,State_ID from_,State_ID to_) :
+          lookahead(lookahead_),
+          from(from_),
+          to(to_)
+        {}
+      protected:
+        void run()
+        {
+          lookahead.look_up(from,to);
+        }
+    };
+    unsigned nr_threads;
+  protected:
+    State_ID first;
+    State_ID end;
+    State_ID block_size;
+    /* entries_per_state is the number of answers look_up() records for each
+       state */
+    State_Lookahead(unsigned nr_threads_,Transition_ID entries_per_state) :
+      nr_threads(nr_threads_ ? nr_threads_ : 1),
+      first(0),
+      end(0)
+    {
+      /* Blocks are made big enough for starting the threads to be
+         worthwhile, but not so big that the answers take much memory */
+      if (!entries_per_state)
+        entries_per_state = 1;
+      block_size = 0x40000/entries_per_state;
+      if (block_size < State_ID(nr_threads*64))
+        block_size = nr_threads*64;
+    }
+  public:
+    virtual ~State_Lookahead() {}
+    bool is_enabled() const
+    {
+      return nr_threads > 1;
+    }
+    bool covers(State_ID state) const
+    {
+      return state >= first && state < end;
+    }
+    /* prepare() is called before state is processed. If state is past
+       the current block, and there are enough states waiting to be
+       processed, the next block is looked up. */
+    void prepare(State_ID state,State_ID nr_states)
+    {
+      if (nr_threads <= 1 || state < end)
+        return;
+      State_ID available = nr_states - state;
+      if (available > block_size)
+        available = block_size;
+      if (available < State_ID(nr_threads*16))
+        return;
+      first = state;
+      end = state + available;
+      State_ID slice = (available + nr_threads - 1)/nr_threads;
+      Worker ** workers = new Worker *[nr_threads];
+      State_ID from = first + slice;
+      unsigned i;
+      for (i = 1; i < nr_threads;i++)
+      {
+        State_ID to = from + slice < end ? from + slice : end;
+        workers[i] = 0;
+        if (from < to)
+        {
+          workers[i] = new Worker(*this,from,to);
+          if (!workers[i]->start())
+            look_up(from,to);
+        }
+        from = to;
+      }
+      look_up(first,first + slice < end ? first + slice : end);
+      for (i = 1; i < nr_threads;i++)
+        if (workers[i])
+        {
+          workers[i]->join();
+          delete workers[i];
+        }
+      delete [] workers;
+    }
+  protected:
+    virtual void look_up(State_ID from,State_ID to) = 0;
+};
+
+/**/
+
+/* DM_Validation_Step computes the successors of the states constructed by
+   validate_difference_machine() and decides whether there are errors. It
+   is used both by the main loop of that method and, when there are
+   several threads, by DM_Validation_Lookahead, so that both are certain to
+   compute the same thing. If dense transition tables are available it
+   uses them, so that it can be called from several threads at once.
+*/
+
+enum DM_Validation_Flags
+{
+  DVF_SHOULD_REJECT = 1,
+  DVF_NO_TRANSITION = 2,
+  DVF_BAD_STATE = 4
+};
+
+class DM_Validation_Step
+{
+  private:
+    const FSA & difference_machine;
+    const FSA & word_acceptor;
+    const Alphabet & alphabet;
+    const State_ID * dm_table;
+    const State_ID * wa_table;
+    const State_Count nr_differences;
+    const State_Count nr_wa_states;
+    const Ordinal nr_generators;
+    const Transition_ID nr_dm_transitions;
+  public:
+    DM_Validation_Step(const FSA & difference_machine_,
+                       const FSA & word_acceptor_,
+                       const State_ID * dm_table_,const State_ID * wa_table_) :
+      difference_machine(difference_machine_),
+      word_acceptor(word_acceptor_),
+      alphabet(difference_machine_.base_alphabet),
+      dm_table(dm_table_),
+      wa_table(wa_table_),
+      nr_differences(difference_machine_.state_count()),
+      nr_wa_states(word_acceptor_.state_count()),
+      nr_generators(difference_machine_.base_alphabet.letter_count()),
+      nr_dm_transitions(difference_machine_.alphabet_size())
+    {}
+    bool is_thread_safe() const
+    {
+      return dm_table && wa_table;
+    }
+    /* successor() computes the key of the state reached from the state
+       with key old_key by g1, and returns a combination of the
+       DM_Validation_Flags. The key is only complete if DVF_NO_TRANSITION
+       is not set */
+    unsigned successor(State_ID * key,const State_ID * old_key,Ordinal g1) const
+    {
+      bool should_reject = wa_new_state(old_key[1],g1)==0;
+      memset(key,0,nr_differences*sizeof(State_ID));
+      bool no_transition = false;
+      bool bad_state = false;
+      State_ID dsi,ndsi,nwsi;
+      Ordinal g2;
+      Transition_ID product_id;
+
+      for (dsi = 1; dsi < nr_differences;dsi++)
+      {
+        if (old_key[dsi])
+        {
+          ndsi = dm_new_state(dsi,alphabet.product_id(g1,PADDING_SYMBOL));
+          if (ndsi)
+          {
+            nwsi = nr_wa_states;
+            if (!key[ndsi])
+              key[ndsi] = nwsi;
+            else
+              bad_state = true;
+
+            if (ndsi == 1)
+            {
+              no_transition = true;
+              if (should_reject)
+                break;
+              bad_state = true;
+            }
+          }
+          if (old_key[dsi] < nr_wa_states)
+          {
+            for (product_id = alphabet.product_base(g1),g2 = 0;
+                 g2 < nr_generators;g2++,product_id++)
+            {
+              nwsi = wa_new_state(old_key[dsi],g2);
+              if (nwsi)
+              {
+                ndsi = dm_new_state(dsi,product_id);
+                if (ndsi)
+                {
+                  if (ndsi == 1 && (dsi != 1 || g1 != g2))
+                  {
+                    if (should_reject)
+                    {
+                      no_transition = true;
+                      break;
+                    }
+                    bad_state = true;
+                  }
+                  if (key[ndsi])
+                    bad_state = true; /* Here we have already accepted two
+                                         equal words that are close to the u
+                                         word. We should be able to find
+                                         an equation to reject one of the
+                                         v words */
+                  else
+                    key[ndsi] = nwsi;
+                }
+              }
+            }
+            if (no_transition)
+              break;
+          }
+        }
+      }
+      return (should_reject ? DVF_SHOULD_REJECT : 0) |
+             (no_transition ? DVF_NO_TRANSITION : 0) |
+             (bad_state ? DVF_BAD_STATE : 0);
+    }
+  private:
+    State_ID dm_new_state(State_ID si,Transition_ID product_id) const
+    {
+      if (dm_table)
+        return dm_table[si*size_t(nr_dm_transitions)+product_id];
+      return difference_machine.new_state(si,product_id);
+    }
+    State_ID wa_new_state(State_ID si,Ordinal g) const
+    {
+      if (wa_table)
+        return wa_table[si*size_t(nr_generators)+g];
+      return word_acceptor.new_state(si,g);
+    }
+};
+
+/* DM_Validation_Lookahead is the State_Lookahead for
+   validate_difference_machine(). For each state in the block and each
+   generator it records the flags returned by DM_Validation_Step and the
+   existing state the successor is, if there is one. The corrections are
+   still made by the main loop, in the same order as before, so the
+   equations found do not depend on the number of threads. */
+
+class DM_Validation_Lookahead : public State_Lookahead
+{
+  private:
+    const Keyed_FSA & factory;
+    const DM_Validation_Step & step;
+    const State_Count nr_differences;
+    const State_Count nr_wa_states;
+    const Ordinal nr_generators;
+    State_ID * found;
+    unsigned char * flags;
+  public:
+    DM_Validation_Lookahead(const Keyed_FSA & factory_,
+                            const DM_Validation_Step & step_,
+                            State_Count nr_differences_,
+                            State_Count nr_wa_states_,
+                            Ordinal nr_generators_,unsigned nr_threads_) :
+      State_Lookahead(step_.is_thread_safe() ? nr_threads_ : 1,nr_generators_),
+      factory(factory_),
+      step(step_),
+      nr_differences(nr_differences_),
+      nr_wa_states(nr_wa_states_),
+      nr_generators(nr_generators_),
+      found(0),
+      flags(0)
+    {
+      if (is_enabled())
+      {
+        found = new State_ID[block_size*size_t(nr_generators)];
+        flags = new unsigned char[block_size*size_t(nr_generators)];
+      }
+    }
+    ~DM_Validation_Lookahead()
+    {
+      if (found)
+      {
+        delete [] found;
+        delete [] flags;
+      }
+    }
+    /* successor() returns true if state has been looked up, in which case
+       *step_flags is set to the value DM_Validation_Step::successor()
+       returns, and *nstate to the state reached by g1, or 0 if the
+       successor was not present */
+    bool successor(unsigned * step_flags,State_ID * nstate,State_ID state,
+                   Ordinal g1) const
+    {
+      if (!covers(state))
+        return false;
+      size_t i = (state-first)*size_t(nr_generators)+g1;
+      *step_flags = flags[i];
+      *nstate = found[i];
+      return true;
+    }
+  protected:
+    void look_up(State_ID from,State_ID to)
+    {
+      /* This must compute the same keys as the main loop of
+         validate_difference_machine() */
+      Sparse_Function_Packer key_packer(nr_differences,nr_wa_states+1,1);
+      void * packed_key = (char *) key_packer.get_buffer()+1;
+      State_ID *key = new State_ID[nr_differences];
+      State_ID *old_key = new State_ID[nr_differences];
+      /* Packing the initial key puts the zero gap indicator at the start
+         of the buffer */
+      memset(key,0,nr_differences*sizeof(State_ID));
+      key[1] = 1;
+      key_packer.pack(key);
+      for (State_ID state = from; state < to;state++)
+      {
+        size_t i = (state-first)*size_t(nr_generators);
+        factory.get_state_key(packed_key,state);
+        key_packer.unpack(old_key);
+        for (Ordinal g1 = 0; g1 < nr_generators;g1++,i++)
+        {
+          unsigned step_flags = step.successor(key,old_key,g1);
+          flags[i] = (unsigned char) step_flags;
+          found[i] = 0;
+          if (!(step_flags & DVF_SHOULD_REJECT))
+            found[i] = factory.look_up_state(packed_key,key_packer.pack(key)-1);
+        }
+      }
+      delete [] key;
+      delete [] old_key;
+    }
+};
+
+/**/
+
 int Group_Automata::validate_difference_machine(const FSA *dm,
                                                 const FSA *wa,
                                                 Rewriter_Machine *rm)
@@ -1227,14 +1660,12 @@ int Group_Automata::validate_difference_machine(const FSA *dm,
   void * packed_key = (char *) key_packer.get_buffer()+1;
   const Alphabet & alphabet = rm->alphabet();
   const Ordinal nr_generators = difference_machine.base_alphabet.letter_count();
-  Ordinal g1,g2;
-  Transition_ID product_id;
+  Ordinal g1;
   Container & container = rm->container;
   Keyed_FSA factory(container,difference_machine.base_alphabet,nr_generators,nr_wa_states,0);
   State_ID state = 0;
   State_ID *key = new State_ID[nr_differences];
   State_ID *old_key = new State_ID[nr_differences];
-  State_ID dsi,ndsi,nwsi;
   State_ID ceiling = 1;
   Word_Length state_length = 0;
   Ordinal_Word lhs_word(alphabet,1);
@@ -1258,9 +1689,20 @@ int Group_Automata::validate_difference_machine(const FSA *dm,
   State_Count count = 2;
   int count_down = 60;
   Diff_Equate de(dm,&word_acceptor);
+  /* Dense transition tables may need a lot of memory, so they are only
+     built if there are threads to share the work */
+  const unsigned nr_threads = rm->maf.options.threads;
+  size_t ceiling_size = nr_threads > 1 ? 0x2000000 : 0;
+  Transition_Realiser tr_dm(difference_machine,ceiling_size);
+  Transition_Realiser tr_wa(word_acceptor,ceiling_size);
+  DM_Validation_Step step(difference_machine,word_acceptor,
+                          tr_dm.transition_table(),tr_wa.transition_table());
+  DM_Validation_Lookahead lookahead(factory,step,nr_differences,nr_wa_states,
+                                    nr_generators,nr_threads);
 
   while (factory.get_state_key(packed_key,++state))
   {
+    lookahead.prepare(state,count);
     Word_Length length = state >= ceiling ? state_length : state_length - 1;
     if (container.status(2,1,"Checking reductions state " FMT_ID " ("
                              FMT_ID " of " FMT_ID " to do). Word Length %u.\n"
@@ -1288,68 +1730,17 @@ int Group_Automata::validate_difference_machine(const FSA *dm,
 
     for (g1 = 0; g1 < nr_generators;g1++)
     {
-      bool should_reject = word_acceptor.new_state(old_key[1],g1)==0;
-      memset(key,0,nr_differences*sizeof(State_ID));
-      bool no_transition = false;
-      bool bad_state = false;
-
-      for (dsi = 1; dsi < nr_differences;dsi++)
+      unsigned step_flags;
+      State_ID nstate = 0;
+      bool have_key = false;
+      if (!lookahead.successor(&step_flags,&nstate,state,g1))
       {
-        if (old_key[dsi])
-        {
-          ndsi = difference_machine.new_state(dsi,alphabet.product_id(g1,PADDING_SYMBOL));
-          if (ndsi)
-          {
-            nwsi = nr_wa_states;
-            if (!key[ndsi])
-              key[ndsi] = nwsi;
-            else
-              bad_state = true;
-
-            if (ndsi == 1)
-            {
-              no_transition = true;
-              if (should_reject)
-                break;
-              bad_state = true;
-            }
-          }
-          if (old_key[dsi] < nr_wa_states)
-          {
-            for (product_id = alphabet.product_base(g1),g2 = 0;
-                 g2 < nr_generators;g2++,product_id++)
-            {
-              nwsi = word_acceptor.new_state(old_key[dsi],g2);
-              if (nwsi)
-              {
-                ndsi = difference_machine.new_state(dsi,product_id);
-                if (ndsi)
-                {
-                  if (ndsi == 1 && (dsi != 1 || g1 != g2))
-                  {
-                    if (should_reject)
-                    {
-                      no_transition = true;
-                      break;
-                    }
-                    bad_state = true;
-                  }
-                  if (key[ndsi])
-                    bad_state = true; /* Here we have already accepted two
-                                         equal words that are close to the u
-                                         word. We should be able to find
-                                         an equation to reject one of the
-                                         v words */
-                  else
-                    key[ndsi] = nwsi;
-                }
-              }
-            }
-            if (no_transition)
-              break;
-          }
-        }
+        step_flags = step.successor(key,old_key,g1);
+        have_key = true;
       }
+      bool should_reject = (step_flags & DVF_SHOULD_REJECT) != 0;
+      bool no_transition = (step_flags & DVF_NO_TRANSITION) != 0;
+      bool bad_state = (step_flags & DVF_BAD_STATE) != 0;
 
       if (should_reject && !no_transition)
       {
@@ -1385,10 +1776,14 @@ int Group_Automata::validate_difference_machine(const FSA *dm,
         lhs_word.set_length(length);
       }
 
-      if (!should_reject && !aborted)
+      if (!should_reject && !aborted && !nstate)
       {
+        /* The lookahead did not find the state, so it is probably new.
+           key_packer has to be used for it anyway. */
+        if (!have_key)
+          step.successor(key,old_key,g1);
         size = key_packer.pack(key)-1;
-        State_ID nstate = factory.find_state(packed_key,size);
+        nstate = factory.find_state(packed_key,size);
         if (nstate >= count)
         {
           tot_size += size;
@@ -1629,6 +2024,127 @@ static void initialise_gm(Keyed_FSA & factory,
 
 /**/
 
+/* When several threads are available build_gm() uses a GM_Lookahead to
+   look up the successors of a block of states it has not expanded yet.
+   Nearly every transition of a multiplier leads to a state that already
+   exists, and finding that state in the index is most of the work of
+   building it, so the lookups are divided among the threads. The threads
+   only read the index and the dense transition tables of the word-acceptor
+   and difference machine. build_gm() then expands the states one at a time
+   exactly as before, using the states that were found, and only searches
+   the index itself for triples that were not present yet. So the multiplier,
+   its state numbering and any correcting equations found are the same
+   whatever the number of threads.
+*/
+
+class GM_Lookahead : public State_Lookahead
+{
+  private:
+    const Keyed_FSA & factory;
+    const Special_Subset & paddable_dm_states;
+    const State_ID * wa_table;
+    const State_ID * dm_table;
+    const State_ID end_of_string;
+    const Ordinal nr_generators;
+    const Transition_ID nr_transitions;
+    const bool geodesic;
+    State_ID key_limit[3];
+    State_ID * found;
+  public:
+    GM_Lookahead(const Keyed_FSA & factory_,const State_ID * key_limit_,
+                 const State_ID * wa_table_,const State_ID * dm_table_,
+                 const Special_Subset & paddable_dm_states_,
+                 State_ID end_of_string_,Ordinal nr_generators_,
+                 bool geodesic_,unsigned nr_threads_) :
+      State_Lookahead(wa_table_ && dm_table_ ? nr_threads_ : 1,
+                      factory_.alphabet_size()),
+      factory(factory_),
+      paddable_dm_states(paddable_dm_states_),
+      wa_table(wa_table_),
+      dm_table(dm_table_),
+      end_of_string(end_of_string_),
+      nr_generators(nr_generators_),
+      nr_transitions(factory_.alphabet_size()),
+      geodesic(geodesic_),
+      found(0)
+    {
+      for (int i = 0; i < 3;i++)
+        key_limit[i] = key_limit_[i];
+      if (is_enabled())
+        found = new State_ID[block_size*size_t(nr_transitions)];
+    }
+    ~GM_Lookahead()
+    {
+      if (found)
+        delete [] found;
+    }
+    /* successor() returns the state reached from gm_state by product_id,
+       if it was found, and otherwise 0 */
+    State_ID successor(State_ID gm_state,Transition_ID product_id) const
+    {
+      if (!covers(gm_state))
+        return 0;
+      return found[(gm_state-first)*size_t(nr_transitions)+product_id];
+    }
+  protected:
+    void look_up(State_ID from,State_ID to)
+    {
+      /* This must compute the same keys as the main loop of build_gm() */
+      Triple_Packer key_packer(key_limit);
+      State_ID key[3],old_key[3];
+      /* get_state_key() only fills in key_size() bytes of the buffer, but
+         unpack_key() reads whole words, so the rest must be cleared first */
+      key[0] = key[1] = key[2] = 0;
+      key_packer.pack_key(key);
+      for (State_ID gm_state = from; gm_state < to;gm_state++)
+      {
+        State_ID * answer = found + (gm_state-first)*size_t(nr_transitions);
+        memset(answer,0,nr_transitions*sizeof(State_ID));
+        factory.get_state_key(key_packer.get_buffer(),gm_state);
+        key_packer.unpack_key(old_key);
+        State_ID wa_lhs_state = old_key[GMK_WA_LHS];
+        State_ID wa_rhs_state = old_key[GMK_WA_RHS];
+        const State_ID * dm_row = dm_table + old_key[GMK_DIFF]*size_t(nr_transitions);
+        Transition_ID product_id = 0;
+        for (Ordinal g1 = 0; g1 <= nr_generators;g1++)
+        {
+          State_ID lhs_state = 0;
+          if (g1 == nr_generators)
+            lhs_state = end_of_string;
+          else if (wa_lhs_state != end_of_string)
+            lhs_state = wa_table[wa_lhs_state*size_t(nr_generators)+g1];
+          for (Ordinal g2 = 0; g2 <= nr_generators;g2++,product_id++)
+          {
+            if (product_id == nr_transitions || !lhs_state)
+              continue;
+            key[GMK_WA_LHS] = lhs_state;
+            key[GMK_DIFF] = dm_row[product_id];
+            if (g2 == nr_generators)
+              key[GMK_WA_RHS] = end_of_string;
+            else if (wa_rhs_state != end_of_string)
+              key[GMK_WA_RHS] = wa_table[wa_rhs_state*size_t(nr_generators)+g2];
+            else
+              key[GMK_WA_RHS] = 0;
+            if (!key[GMK_DIFF] || !key[GMK_WA_RHS])
+              continue;
+            if (geodesic && (key[GMK_WA_LHS] == end_of_string ||
+                             key[GMK_WA_RHS] == end_of_string))
+            {
+              key[GMK_WA_LHS] = key[GMK_WA_RHS] = end_of_string;
+              if (!paddable_dm_states.contains(key[GMK_DIFF]))
+                continue;
+            }
+            if (key[GMK_DIFF] == 1 && g1 != g2)
+              continue;
+            answer[product_id] = factory.look_up_state(key_packer.pack_key(key));
+          }
+        }
+      }
+    }
+};
+
+/**/
+
 int Group_Automata::build_gm(FSA_Simple **answer,
                              Rewriter_Machine * rm,
                              const FSA * word_acceptor,
@@ -1767,9 +2283,15 @@ int Group_Automata::build_gm(FSA_Simple **answer,
   State_ID ceiling = 1;
   Transition_Realiser tr_wa(wa);
   Transition_Realiser tr_dm(dm);
+  /* key still contains the limits key_packer was created with */
+  GM_Lookahead lookahead(factory,key,tr_wa.transition_table(),
+                         tr_dm.transition_table(),paddable_dm_states,
+                         end_of_string,nr_generators,geodesic,
+                         rm ? rm->maf.options.threads : 1);
 
   while (factory.get_state_key(packed_key,++gm_state))
   {
+    lookahead.prepare(gm_state,nr_states);
     Word_Length length = gm_state >= ceiling ? state_length : state_length-1;
     key_packer.unpack_key(old_key);
     if (!(char) gm_state)
@@ -1897,7 +2419,9 @@ int Group_Automata::build_gm(FSA_Simple **answer,
           }
           else
           {
-            State_ID new_gm_state = factory.find_state(key_packer.pack_key(key));
+            State_ID new_gm_state = lookahead.successor(gm_state,product_id);
+            if (!new_gm_state)
+              new_gm_state = factory.find_state(key_packer.pack_key(key));
             if (correct_only)
             {
               /* If the number of states in the multiplier is getting too big
@@ -2137,6 +2661,80 @@ FSA_Simple * Group_Automata::build_finite_gm(Rewriter_Machine * rm,
 
 /**/
 
+/* GM_Valid_Lookahead is the State_Lookahead for gm_valid(). For each state
+   in the block and each generator it records the existing state that is the
+   successor, or 0 if there is none. gm_valid() only has to check states
+   that are new, so it can skip most transitions without building the key
+   itself. It is only enabled if the multiplier has a dense transition
+   table. */
+
+class GM_Valid_Lookahead : public State_Lookahead
+{
+  private:
+    const Keyed_FSA & factory;
+    const Alphabet & base_alphabet;
+    const State_ID * table;
+    const Ordinal nr_generators;
+    const Transition_ID nr_transitions;
+    State_ID * found;
+  public:
+    GM_Valid_Lookahead(const Keyed_FSA & factory_,const FSA & multiplier,
+                       const State_ID * table_,unsigned nr_threads_) :
+      State_Lookahead(table_ ? nr_threads_ : 1,
+                      multiplier.base_alphabet.letter_count()),
+      factory(factory_),
+      base_alphabet(multiplier.base_alphabet),
+      table(table_),
+      nr_generators(multiplier.base_alphabet.letter_count()),
+      nr_transitions(multiplier.alphabet_size()),
+      found(0)
+    {
+      if (is_enabled())
+        found = new State_ID[block_size*size_t(nr_generators)];
+    }
+    ~GM_Valid_Lookahead()
+    {
+      if (found)
+        delete [] found;
+    }
+    /* successor() returns the state reached from state by g1, if it was
+       found, and otherwise 0 */
+    State_ID successor(State_ID state,Ordinal g1) const
+    {
+      if (!covers(state))
+        return 0;
+      return found[(state-first)*size_t(nr_generators)+g1];
+    }
+  protected:
+    void look_up(State_ID from,State_ID to)
+    {
+      /* This must compute the same keys as the main loop of gm_valid() */
+      State_List key;
+      for (State_ID state = from; state < to;state++)
+      {
+        State_ID * answer = found + (state-first)*size_t(nr_generators);
+        const State_ID * old_key = (const State_ID *) factory.get_state_key(state);
+        for (Ordinal g1 = 0; g1 < nr_generators;g1++)
+        {
+          key.empty();
+          for (const State_ID * s = old_key;*s;s++)
+          {
+            const State_ID * trow = table + *s*size_t(nr_transitions) +
+                                    base_alphabet.product_base(g1);
+            for (Ordinal g2 = 0;g2 <= nr_generators;g2++)
+              if (trow[g2])
+                key.insert(trow[g2]);
+          }
+          key.append_one(0);
+          answer[g1] = factory.look_up_state(key.buffer(),
+                                             key.count()*sizeof(State_ID));
+        }
+      }
+    }
+};
+
+/**/
+
 int Group_Automata::gm_valid(const General_Multiplier & gm,
                              Rewriter_Machine * rm,unsigned gwd_flags)
 {
@@ -2236,10 +2834,13 @@ int Group_Automata::gm_valid(const General_Multiplier & gm,
         factory.find_state(key.buffer(),sizeof(State_ID)*key.count());
         old_key.reserve(key.count(),false);
         check_state(1,0,IdWord); // we need to check the initial state!
+        GM_Valid_Lookahead lookahead(factory,multiplier,tr.transition_table(),
+                                     rm->maf.options.threads);
 
         state = 0;
         while (factory.get_state_key(old_key.buffer(),++state))
         {
+          lookahead.prepare(state,count);
           Word_Length length = state >= ceiling ? state_length : state_length-1;
           if (rm->container_status(2,1,"Multiplier checks ("
                                        FMT_ID " of " FMT_ID " to do)."
@@ -2267,6 +2868,10 @@ int Group_Automata::gm_valid(const General_Multiplier & gm,
              the padding symbol). */
           for (g1 = 0; g1 < nr_generators;g1++)
           {
+            /* If the successor was already present it has been checked */
+            State_ID nstate = lookahead.successor(state,g1);
+            if (nstate && !(bad_state && nstate >= bad_state))
+              continue;
             key.empty();
             for (State_ID * s = old_key.buffer();*s;s++)
             {
@@ -2282,7 +2887,7 @@ int Group_Automata::gm_valid(const General_Multiplier & gm,
             }
             key.append_one(0);
             Element_Count key_count = key.count();
-            State_ID nstate = factory.find_state(key.buffer(),key_count*sizeof(State_ID),!aborted);
+            nstate = factory.find_state(key.buffer(),key_count*sizeof(State_ID),!aborted);
             if (nstate == -1 || nstate >= count || bad_state && nstate >= bad_state)
             {
               check_state(nstate,length,g1);
@@ -2461,6 +3066,16 @@ int Group_Automata::gm_valid(const General_Multiplier & gm,
 unsigned General_Multiplier::reduce(Word * answer,
                                     const Word & start_word,
                                     unsigned flags) const
+{
+  return prefix_reduce(answer,start_word,flags,0,0);
+}
+
+/**/
+
+unsigned General_Multiplier::prefix_reduce(Word * answer,
+                                           const Word & start_word,
+                                           unsigned flags,State_ID * path,
+                                           Word_Length * known) const
 {
   /* This function uses a multiplier to reduce a word.
      It should always be able to reduce a word at least as well as
@@ -2516,12 +3131,27 @@ unsigned General_Multiplier::reduce(Word * answer,
       length -= i;
       *answer = Subword(*answer,i);
       want_prefix = true;
+      /* path does not allow for the h word */
+      if (path)
+        *known = 0;
+      path = 0;
     }
   }
   for (;;)
   {
     State_ID state = idword_state;
-    for (valid_length = 0;valid_length < length;valid_length++)
+    valid_length = 0;
+    if (path)
+    {
+      /* On the first pass the word is still start_word, so we can start
+         from the last state in path that is still valid */
+      path[0] = idword_state;
+      if (*known > length)
+        *known = length;
+      valid_length = *known;
+      state = path[valid_length];
+    }
+    for (;valid_length < length;valid_length++)
     {
       if ((unsigned) values[valid_length] >= (unsigned) base_alphabet.letter_count())
         MAF_INTERNAL_ERROR(container,("Bad word passed to General_Multiplier::reduce()\n"));
@@ -2529,12 +3159,17 @@ unsigned General_Multiplier::reduce(Word * answer,
                                                  values[valid_length]);
       state = fsa__->new_state(state,t);
       if (!state)
-      {
-        if (flags & WR_CHECK_ONLY)
-          return 1;
         break;
-      }
+      if (path)
+        path[valid_length+1] = state;
+    }
+    if (path)
+    {
+      *known = valid_length;
+      path = 0;
     }
+    if (valid_length < length && (flags & WR_CHECK_ONLY))
+      return 1;
 
     if (valid_length == length)
       break;
@@ -2592,6 +3227,213 @@ unsigned General_Multiplier::reduce(Word * answer,
 
 /**/
 
+/* GM_Batch_Reducer implements General_Multiplier::reduce_batch(). The
+   words are sorted into lexicographic order of their letters, so that words
+   with a long common prefix are next to each other, and each word is
+   reduced with prefix_reduce(), starting from the state the previous word
+   reached at the end of the common prefix. Sorting the words does not
+   change any of the answers, only the order in which they are computed.
+
+   When several threads are used the sorted list is divided into one
+   range per thread. Each thread puts its answers into its own Word_List,
+   and these are then copied to the caller's list in the original order.
+   The threads other than the main one use a copy of the multiplier,
+   because Multiplier::multiply() keeps its work area in the Multiplier.
+*/
+
+class GM_Batch_Reducer
+{
+  private:
+    class Worker : public Thread
+    {
+      private:
+        GM_Batch_Reducer & reducer;
+        General_Multiplier gm;
+        Element_ID from;
+        Element_ID to;
+      public:
+        Word_List answers;
+        Worker(GM_Batch_Reducer & reducer_,const General_Multiplier & gm_,
+               Element_ID from_,Element_ID to_) :
+          reducer(reducer_),
+          gm(gm_),
+          from(from_),
+          to(to_),
+          answers(reducer_.words.alphabet,to_-from_)
+        {}
+        void work()
+        {
+          reducer.reduce_range(&answers,gm,from,to);
+        }
+      protected:
+        void run()
+        {
+          work();
+        }
+    };
+    const Word_List & words;
+    const unsigned flags;
+    Element_ID * order;
+    Element_Count nr_words;
+  public:
+    GM_Batch_Reducer(const Word_List & words_,unsigned flags_) :
+      words(words_),
+      flags(flags_),
+      nr_words(words_.count())
+    {
+      order = new Element_ID[nr_words ? nr_words : 1];
+      for (Element_ID i = 0; i < nr_words;i++)
+        order[i] = i;
+      sort();
+    }
+    ~GM_Batch_Reducer()
+    {
+      delete [] order;
+    }
+    void reduce(Word_List * answers,const General_Multiplier & gm,
+                unsigned nr_threads)
+    {
+      if (!nr_words)
+        return;
+      /* It is not worth starting a thread for only a few words */
+      if (Element_Count(nr_threads) > nr_words/256)
+        nr_threads = unsigned(nr_words/256);
+      if (!nr_threads)
+        nr_threads = 1;
+      Element_Count slice = (nr_words + nr_threads - 1)/nr_threads;
+      Word_List main_answers(words.alphabet,slice);
+      Word_List ** sorted_answers = new Word_List *[nr_threads];
+      Worker ** workers = new Worker *[nr_threads];
+      bool * started = new bool[nr_threads];
+      unsigned i;
+      /* The copies of the multiplier are made here, because gm may not be
+         read while another thread is reading it */
+      sorted_answers[0] = &main_answers;
+      for (i = 1; i < nr_threads;i++)
+      {
+        Element_ID from = Element_ID(i*slice) < nr_words ? i*slice : nr_words;
+        Element_ID to = from + slice < nr_words ? from + slice : nr_words;
+        workers[i] = new Worker(*this,gm,from,to);
+        sorted_answers[i] = &workers[i]->answers;
+      }
+      for (i = 1; i < nr_threads;i++)
+        started[i] = workers[i]->start();
+      reduce_range(&main_answers,gm,0,slice < nr_words ? slice : nr_words);
+      for (i = 1; i < nr_threads;i++)
+        if (started[i])
+          workers[i]->join();
+        else
+          workers[i]->work();
+
+      Element_ID * position = new Element_ID[nr_words];
+      for (Element_ID j = 0; j < nr_words;j++)
+        position[order[j]] = j;
+      for (Element_ID j = 0; j < nr_words;j++)
+      {
+        i = unsigned(position[j]/slice);
+        answers->add(Entry_Word(*sorted_answers[i],position[j] - i*slice));
+      }
+      delete [] position;
+      for (i = 1; i < nr_threads;i++)
+        delete workers[i];
+      delete [] workers;
+      delete [] started;
+      delete [] sorted_answers;
+    }
+  private:
+    void reduce_range(Word_List * answers,const General_Multiplier & gm,
+                      Element_ID from,Element_ID to)
+    {
+      Ordinal_Word test(words.alphabet);
+      State_ID * path = 0;
+      Word_Length path_size = 0;
+      Word_Length known = 0;
+      Fast_Word previous;
+      previous.buffer = 0;
+      previous.length = 0;
+      for (Element_ID i = from; i < to;i++)
+      {
+        Fast_Word fw;
+        words.get_fast_word(&fw,order[i]);
+        Word_Length common = 0;
+        while (common < known && common < fw.length &&
+               fw.buffer[common] == previous.buffer[common])
+          common++;
+        if (fw.length >= path_size)
+        {
+          if (path)
+            delete [] path;
+          path_size = fw.length + 1;
+          path = new State_ID[path_size];
+          common = 0;
+        }
+        known = common;
+        words.get(&test,order[i]);
+        gm.prefix_reduce(&test,test,flags,path,&known);
+        answers->add(test);
+        previous = fw;
+      }
+      if (path)
+        delete [] path;
+    }
+    int compare(Element_ID a,Element_ID b) const
+    {
+      Fast_Word fa,fb;
+      words.get_fast_word(&fa,a);
+      words.get_fast_word(&fb,b);
+      Word_Length l = fa.length < fb.length ? fa.length : fb.length;
+      for (Word_Length i = 0; i < l;i++)
+        if (fa.buffer[i] != fb.buffer[i])
+          return fa.buffer[i] < fb.buffer[i] ? -1 : 1;
+      if (fa.length != fb.length)
+        return fa.length < fb.length ? -1 : 1;
+      /* Equal words are kept in their original order */
+      return a < b ? -1 : a > b;
+    }
+    void sort()
+    {
+      /* A merge sort of order[], since the word lists may be long */
+      if (nr_words < 2)
+        return;
+      Element_ID * work = new Element_ID[nr_words];
+      Element_ID * from = order;
+      Element_ID * to = work;
+      for (Element_Count width = 1; width < nr_words;width *= 2)
+      {
+        for (Element_ID start = 0; start < nr_words;start += 2*width)
+        {
+          Element_ID middle = start + width < nr_words ? start + width : nr_words;
+          Element_ID end = middle + width < nr_words ? middle + width : nr_words;
+          Element_ID i = start,j = middle,k = start;
+          while (i < middle && j < end)
+            to[k++] = compare(from[i],from[j]) <= 0 ? from[i++] : from[j++];
+          while (i < middle)
+            to[k++] = from[i++];
+          while (j < end)
+            to[k++] = from[j++];
+        }
+        Element_ID * temp = from;
+        from = to;
+        to = temp;
+      }
+      if (from != order)
+        memcpy(order,from,nr_words*sizeof(Element_ID));
+      delete [] work;
+    }
+};
+
+/**/
+
+void General_Multiplier::reduce_batch(Word_List * answers,
+                                      const Word_List & words,unsigned flags,
+                                      unsigned nr_threads) const
+{
+  GM_Batch_Reducer reducer(words,flags);
+  reducer.reduce(answers,*this,nr_threads);
+}
+
+/**/
+
 /* class Vital_Builder is used to implement the functionality of
    Group_Automata::build_vital(), which was originally one very
    large function. In order to make the code more manageable it
@@ -2615,6 +3457,7 @@ class Vital_Builder
     bool defining_equations_done;
     bool impossible;
     bool is_weak_acceptor;
+    bool wa_truncated;
     bool primary_mistakes_tried;
     bool is_confluent;
     bool resume_kb;
@@ -2669,6 +3512,7 @@ class Vital_Builder
       last_weak_word_acceptor(0)
     {
       is_weak_acceptor = try_multiplier = is_finite = force_finite = false;
+      wa_truncated = false;
       primary_mistakes_tried = wa_stable = wa_correct = false;
       use_dm1 = dm1_tried = create_all_equations = false;
       huge_L1 = defining_equations_done = all_equations_tried = false;
@@ -2738,6 +3582,11 @@ class Vital_Builder
             build_word_acceptor();
             if (!word_acceptor)
               return false;
+            if (wa_truncated)
+            {
+              explore_partial_acceptor();
+              return false;
+            }
           }
 
           deal_with_acceptor();
@@ -2986,7 +3835,11 @@ class Vital_Builder
               last_word_acceptor = 0;
             }
             time_t now = time(0);
-            word_acceptor = maf.build_acceptor_from_dm(dm2,create_all_equations);
+            word_acceptor = maf.build_acceptor_from_dm(dm2,create_all_equations,
+                                                       false,false,0,0,
+                                                       is_confluent ? 0 :
+                                                       ga.wa_divergence_floor,
+                                                       &wa_truncated);
             rm->set_timeout(wa_build_time = time(0) - now);
             if (!create_all_equations)
               strong_wa_build_time = wa_build_time;
@@ -2998,6 +3851,23 @@ class Vital_Builder
       }
     }
 
+    void explore_partial_acceptor()
+    {
+      /* The construction of the word-acceptor was cut short because it
+         was diverging, which means that dm2 is still missing a lot of
+         word-differences. The partial acceptor accepts some words it
+         should not, but every word it rejects is reducible, so we look
+         for the missing equations with it, and then go back to
+         Knuth-Bendix. The next acceptor may grow twice as large before it
+         is cut short, so that we cannot keep giving up on an acceptor that
+         is just big */
+      rm->explore_acceptor(word_acceptor,dm2,false,explore_time);
+      delete word_acceptor;
+      word_acceptor = 0;
+      wa_truncated = false;
+      ga.wa_divergence_floor *= 2;
+    }
+
     void deal_with_acceptor()
     {
       if (last_word_acceptor)
@@ -86,6 +86,9 @@ class Group_Automata
     FSA_Simple *word_acceptor;
     General_Multiplier *multiplier;
     Rewriting_System * rws;
+    /* size at which build_vital() cuts short the construction of a
+       diverging word-acceptor. It is doubled each time this happens */
+    State_Count wa_divergence_floor;
     bool owner;
   public:
     Group_Automata() :
@@ -94,6 +97,7 @@ class Group_Automata
       word_acceptor(0),
       multiplier(0),
       rws(0),
+      wa_divergence_floor(0x100000),
       owner(true)
     {}
     ~Group_Automata()
@@ -92,6 +92,19 @@
    is a link and if not look for the transition inside the suffix node, which
    may in turn need to look inside another suffix, and so on...
 
+   The links of a sparse node are kept in order of their last letter. While
+   there are only a few of them we simply look at each in turn (NR_Sorted),
+   but once there are more than SPARSE_HASH_PROMOTE we also keep a small
+   hash table keyed on the letter (NR_Hashed), so that finding a child
+   does not involve looking at every other child first. The hash table is
+   discarded again if the number of children falls to SPARSE_HASH_DEMOTE
+   or below; the gap between the two limits stops a node with a borderline
+   number of children from rebuilding its table over and over again.
+   A dense node is never turned back into a sparse one, as that would
+   involve finding all the nodes its prefix change links point to again,
+   and nodes mostly lose children when a collapse is taking place. The
+   Node_Manager keeps a count of the nodes in each representation.
+
    Dense format is preferable because it makes the determination of
    transitions so much simpler. Since each node always has a pointer
    back to its prefix, it is easy to distinguish between a link to a
@@ -102,6 +115,10 @@
 #include "equation.h"
 #include "maf_nm.h"
 #include "container.h"
+#include "heap.h"
+
+const Ordinal SPARSE_HASH_PROMOTE = 12;
+const Ordinal SPARSE_HASH_DEMOTE = 8;
 
 /**/
 
@@ -117,6 +134,7 @@ Node_Reference Node::construct(Node_Manager & nm,
   Node_ID id = this;
 #endif
   Node_Reference answer(this,id);
+  nm.tree_modified();
   rvalue = rvalue_;
   reduced.word_length = word_length_;
   flags = NF_NEW;
@@ -125,14 +143,18 @@ Node_Reference Node::construct(Node_Manager & nm,
   Ordinal child_end;
   Ordinal child_start;
   nm.valid_children(&child_start,&child_end,rvalue);
-  if (nm.maf.options.dense_rm || child_end - child_start <= 8 ||
-      word_length_ <= 1)
-    reduced.child.dense = new Node_ID[child_end-child_start] - child_start;
-  else
   {
-    reduced.child.sparse = new Sparse_Node;
-    flags |= NF_SPARSE;
+    Heap_Tag tag(HC_Nodes);
+    if (nm.maf.options.dense_rm || child_end - child_start <= 8 ||
+        word_length_ <= 1)
+      reduced.child.dense = new Node_ID[child_end-child_start] - child_start;
+    else
+    {
+      reduced.child.sparse = new Sparse_Node;
+      flags |= NF_SPARSE;
+    }
   }
+  nm.count_in(representation());
 
   reduced.inverse = 0;
   reduced.max_accepted = 0;
@@ -206,6 +228,7 @@ void Node::construct_equation(Node_Manager & nm,Node_ID nid,
 {
   /* This method is only called from Node_Manager::construct_equation()
      which already asserted that the prefix and rhs are not reducible */
+  nm.tree_modified();
   rhs->attach(nm);
 
   if (new_node)
@@ -249,6 +272,7 @@ void Node::link_replace(Node_Manager & nm,Node_ID this_id,
     MAF_INTERNAL_ERROR(nm.maf.container,("Attempt to insert invalid transition!\n"));
   if (new_child->length(nm) > reduced.word_length+1)
     MAF_INTERNAL_ERROR(nm.maf.container,("Attempt to insert state in wrong node!\n"));
+  nm.tree_modified();
 
   if (new_child != old_child)
   {
@@ -284,6 +308,17 @@ void Node::link_replace(Node_Manager & nm,Node_ID this_id,
     else
     {
       Sparse_Node & sn = *reduced.child.sparse;
+      /* If the children are about to change any hash table will be wrong,
+         so discard it now. sparse_reindex() decides whether we want a new
+         one once we know how many children there will be. */
+      bool was_hashed = sn.hash != 0;
+      bool reindex = new_child->prefix == this_id || old_child->prefix == this_id;
+      if (reindex && was_hashed)
+      {
+        delete [] sn.hash;
+        sn.hash = 0;
+        sn.hash_mask = 0;
+      }
       if (new_child->prefix != this_id)
       {
         /* In this case we don't create a link, but we need to make sure
@@ -297,7 +332,10 @@ void Node::link_replace(Node_Manager & nm,Node_ID this_id,
 
         Node_ID * new_children = sn.children;
         if (sn.nr_children == sn.nr_children_allocated)
+        {
+          Heap_Tag tag(HC_Nodes);
           new_children = new Node_ID[++sn.nr_children_allocated];
+        }
         int i;
         for (i = sn.nr_children; i > 0;i--)
         {
@@ -339,6 +377,9 @@ void Node::link_replace(Node_Manager & nm,Node_ID this_id,
            We shall not bother with switching to sparse if children disappear
            later, as this is only likely to happen when a collapse is
            taking place */
+        Heap_Tag tag(HC_Nodes);
+        nm.count_out(was_hashed ? NR_Hashed : NR_Sorted);
+        nm.count_in(NR_Dense);
         Node_ID * dense_child = new Node_ID[child_end-child_start] - child_start;
         for (Ordinal g = child_start;g < child_end;g++)
         {
@@ -351,6 +392,8 @@ void Node::link_replace(Node_Manager & nm,Node_ID this_id,
         reduced.child.dense = dense_child;
         clear_flags(NF_SPARSE);
       }
+      else if (reindex)
+        sparse_reindex(nm,was_hashed);
     }
 
     if (new_child->prefix == this_id)
@@ -411,6 +454,17 @@ Node_Reference Node::fast_child(const Node_Manager &nm,Node_ID nid,Ordinal value
 Node_Reference Node::sparse_child(const Node_Manager &nm,Ordinal value) const
 {
   Sparse_Node & sn = *reduced.child.sparse;
+  if (sn.hash)
+  {
+    for (unsigned i = value & sn.hash_mask;sn.hash[i].position >= 0;
+         i = (i+1) & sn.hash_mask)
+      if (sn.hash[i].value == value)
+      {
+        Node_ID child = sn.children[sn.hash[i].position];
+        return Node_Reference(fast_find_node(nm,child),child);
+      }
+    return Node_Reference(0,0);
+  }
   for (Ordinal i = 0; i < sn.nr_children;i++)
   {
     State child = fast_find_node(nm,sn.children[i]);
@@ -426,6 +480,41 @@ Node_Reference Node::sparse_child(const Node_Manager &nm,Ordinal value) const
 
 /**/
 
+void Node::sparse_reindex(Node_Manager &nm,bool was_hashed)
+{
+  Sparse_Node & sn = *reduced.child.sparse;
+  bool want_hash = sn.nr_children > (was_hashed ? SPARSE_HASH_DEMOTE :
+                                                  SPARSE_HASH_PROMOTE);
+  if (want_hash)
+  {
+    /* Keep the table no more than half full, so that chains are short */
+    unsigned size = 32;
+    while (size < unsigned(sn.nr_children)*2)
+      size *= 2;
+    Heap_Tag tag(HC_Nodes);
+    sn.hash = new Sparse_Node::Hash_Slot[size];
+    sn.hash_mask = size-1;
+    for (unsigned i = 0; i < size;i++)
+      sn.hash[i].position = -1;
+    for (Ordinal i = 0; i < sn.nr_children;i++)
+    {
+      Ordinal value = fast_find_node(nm,sn.children[i])->rvalue;
+      unsigned j = value & sn.hash_mask;
+      while (sn.hash[j].position >= 0)
+        j = (j+1) & sn.hash_mask;
+      sn.hash[j].value = value;
+      sn.hash[j].position = i;
+    }
+  }
+  if (want_hash != was_hashed)
+  {
+    nm.count_out(was_hashed ? NR_Hashed : NR_Sorted);
+    nm.count_in(want_hash ? NR_Hashed : NR_Sorted);
+  }
+}
+
+/**/
+
 Node_Reference Node::sparse_transition(const Node_Manager &nm,Ordinal value) const
 {
   Node_Reference answer = sparse_child(nm,value);
@@ -452,6 +541,7 @@ Node_Reference Node::sparse_transition(const Node_Manager &nm,Ordinal value) con
 
 void Node::make_reducible(Node_Manager & nm,Node_ID nid,unsigned short new_language)
 {
+  nm.tree_modified();
   if (!flagged(NF_REDUCIBLE))
   {
     /* put all the equations that had this as the RHS into the list
@@ -465,6 +555,7 @@ void Node::make_reducible(Node_Manager & nm,Node_ID nid,unsigned short new_langu
 
     /* We remove all our forward links. We have to be careful to do this
        otherwise inaccessible nodes would hang around in limbo for ever */
+    nm.count_out(representation());
     if (!flagged(NF_SPARSE))
     {
       Ordinal child_start;
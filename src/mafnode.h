@@ -199,6 +199,7 @@ class Node
   friend class Node_Manager;
   friend class Equation_Word;
   friend class Equation_Queue;
+  friend class Equation_Bucket_Queue;
   friend class Rewriter_Machine;
   friend class Block_Manager;
   friend class Node_Iterator;
@@ -206,20 +207,36 @@ class Node
 
     struct Sparse_Node
     {
+      /* Once a sparse node has more than a few children it is quicker to
+         find them using a small hash table, keyed on the last letter of
+         the child, than to look at each child in turn. Each slot holds the
+         letter and the position of the child in children, or -1 if the
+         slot is empty. */
+      struct Hash_Slot
+      {
+        Ordinal value;
+        Ordinal position;
+      };
       Ordinal nr_children_allocated;
       Ordinal nr_children;
+      unsigned hash_mask; // hash table has hash_mask+1 slots
       Node_ID suffix; /* We don't attach this - if a suffix becomes reducible
                         anything it is a suffix of also becomes reducible */
       Node_ID * children;
+      Hash_Slot * hash;  // 0 unless the node is NR_Hashed
       Sparse_Node() :
         nr_children_allocated(0),
         nr_children(0),
-        children(0)
+        hash_mask(0),
+        children(0),
+        hash(0)
       {}
       ~Sparse_Node()
       {
         if (children)
           delete [] children;
+        if (hash)
+          delete [] hash;
       }
     };
 
@@ -596,6 +613,13 @@ class Node
       return length(nm) + reduced_length(nm);
     }
 
+    Node_Representation representation() const
+    {
+      if (!flagged(NF_SPARSE))
+        return NR_Dense;
+      return reduced.child.sparse->hash ? NR_Hashed : NR_Sorted;
+    }
+
     Node_Reference transition(const Node_Manager & nm,Ordinal value) const
     {
       if (!flagged(NF_SPARSE))
@@ -672,6 +696,11 @@ class Node
     void rebind(Node * prefix,Node_Manager &nm,bool check_height) const;
     Node_Reference sparse_child(const Node_Manager & nm,Ordinal value) const;
     Node_Reference sparse_transition(const Node_Manager & nm,Ordinal value) const;
+    /* sparse_reindex() chooses between NR_Sorted and NR_Hashed after the
+       number of children of a sparse node has changed, and builds a new
+       hash table if necessary. Any old table must already have been
+       discarded. was_hashed says whether the node was NR_Hashed before. */
+    void sparse_reindex(Node_Manager &nm,bool was_hashed);
 
 
     Node_Reference construct(Node_Manager &nm,Node_Reference prefix_,
@@ -49,6 +49,7 @@ this may improve performance quite a lot.
 #include "mafnode.h"
 #include "maf_nm.h"
 #include "container.h"
+#include "checkpoint.h"
 
 /**/
 
@@ -143,3 +144,237 @@ bool Equation_Queue::use(Node_Reference * nr)
   return true;
 }
 
+/**/
+
+void Equation_Queue::checkpoint(Checkpoint_Writer & cw) const
+{
+  Node_ID nid = head;
+  cw.put(nid);
+  nid = tail;
+  cw.put(nid);
+  cw.put(count);
+}
+
+/**/
+
+void Equation_Queue::restore(Checkpoint_Reader & cr)
+{
+  Node_ID nid = 0;
+  cr.get(&nid);
+  head = Node_Reference(nm,nid);
+  cr.get(&nid);
+  tail = Node_Reference(nm,nid);
+  cr.get(&count);
+}
+
+/**/
+
+Equation_Bucket_Queue::Equation_Bucket_Queue(Node_Manager &nm_,
+                                             unsigned nr_bands_,
+                                             bool newest_first_) :
+  nm(nm_),
+  rows(0),
+  nr_rows(0),
+  first_row(0),
+  row_stride(0),
+  nr_bands(nr_bands_),
+  count(0),
+  newest_first(newest_first_)
+{
+  set_row_stride(32);
+}
+
+/**/
+
+Equation_Bucket_Queue::~Equation_Bucket_Queue()
+{
+  Node_Reference e;
+  while (use(&e))
+    e->detach(nm,e);
+  free_rows();
+}
+
+/**/
+
+void Equation_Bucket_Queue::free_rows()
+{
+  for (Element_ID i = 0; i < nr_rows;i++)
+    if (rows[i].bucket)
+      delete [] rows[i].bucket;
+  if (rows)
+    delete [] rows;
+  rows = 0;
+  nr_rows = 0;
+}
+
+/**/
+
+void Equation_Bucket_Queue::set_row_stride(Word_Length new_row_stride)
+{
+  /* There is a row for every possible band and major key. When a major
+     key that is too big for the current layout turns up the rows are
+     moved to their new positions. This happens very rarely, since the
+     stride is doubled each time. */
+  Element_Count new_nr_rows = Element_Count(nr_bands) * new_row_stride;
+  Row * new_rows = new Row[new_nr_rows];
+  for (Element_ID i = 0; i < new_nr_rows;i++)
+  {
+    new_rows[i].bucket = 0;
+    new_rows[i].nr_buckets = 0;
+    new_rows[i].first = 0;
+  }
+  for (Element_ID i = 0; i < nr_rows;i++)
+  {
+    Element_ID band = i / row_stride;
+    new_rows[band*new_row_stride + i % row_stride] = rows[i];
+  }
+  if (rows)
+    delete [] rows;
+  if (row_stride)
+    first_row = first_row / row_stride * new_row_stride + first_row % row_stride;
+  rows = new_rows;
+  nr_rows = new_nr_rows;
+  row_stride = new_row_stride;
+}
+
+/**/
+
+void Equation_Bucket_Queue::add(Node_Handle nh)
+{
+  MAF_ASSERT(!nh.is_null() && !nh->flagged(EQ_QUEUED),
+             nm.maf.container,("Bad attempt to queue equation\n"));
+  unsigned band;
+  Word_Length major,minor;
+  extract_key(nh,&band,&major,&minor);
+  if (major >= row_stride)
+  {
+    Word_Length new_row_stride = row_stride;
+    while (major >= new_row_stride)
+      new_row_stride *= 2;
+    set_row_stride(new_row_stride);
+  }
+  Element_ID row_nr = band*row_stride + major;
+  Row & row = rows[row_nr];
+  if (minor >= row.nr_buckets)
+  {
+    Word_Length new_nr_buckets = row.nr_buckets ? row.nr_buckets : 8;
+    while (minor >= new_nr_buckets)
+      new_nr_buckets *= 2;
+    Bucket * new_bucket = new Bucket[new_nr_buckets];
+    Word_Length i;
+    for (i = 0; i < row.nr_buckets;i++)
+      new_bucket[i] = row.bucket[i];
+    for (; i < new_nr_buckets;i++)
+      new_bucket[i].head = new_bucket[i].tail = 0;
+    if (row.bucket)
+      delete [] row.bucket;
+    row.bucket = new_bucket;
+    row.nr_buckets = new_nr_buckets;
+  }
+
+  Equation_Node & e = *nh->attach(nm);
+  Bucket & bucket = row.bucket[minor];
+  if (newest_first || !bucket.head)
+  {
+    e.reduction.queue_next = bucket.head;
+    if (!bucket.head)
+      bucket.tail = nh;
+    bucket.head = nh;
+  }
+  else
+  {
+    e.reduction.queue_next = 0;
+    Node::fast_find_node(nm,bucket.tail)->node(nm).reduction.queue_next = nh;
+    bucket.tail = nh;
+  }
+  e.set_flags(EQ_QUEUED);
+  if (row_nr < first_row)
+    first_row = row_nr;
+  if (minor < row.first)
+    row.first = minor;
+  count++;
+}
+
+/**/
+
+bool Equation_Bucket_Queue::use(Node_Reference * nr)
+{
+  if (!count)
+  {
+    *nr = Node_Reference(0,0);
+    return false;
+  }
+  for (;;first_row++)
+  {
+    Row & row = rows[first_row];
+    for (;row.first < row.nr_buckets;row.first++)
+    {
+      Bucket & bucket = row.bucket[row.first];
+      if (bucket.head)
+      {
+        *nr = Node_Reference(nm,bucket.head);
+        Equation_Node & e = (*nr)->node(nm);
+        bucket.head = e.reduction.queue_next;
+        if (!bucket.head)
+          bucket.tail = 0;
+        e.reduction.queue_next = 0;
+        e.clear_flags(EQ_QUEUED);
+        count--;
+        return true;
+      }
+    }
+  }
+}
+
+/**/
+
+void Equation_Bucket_Queue::checkpoint(Checkpoint_Writer & cw) const
+{
+  cw.put(row_stride);
+  cw.put(first_row);
+  cw.put(count);
+  for (Element_ID i = 0; i < nr_rows;i++)
+  {
+    cw.put(rows[i].nr_buckets);
+    cw.put(rows[i].first);
+    cw.put(rows[i].bucket,rows[i].nr_buckets*sizeof(Bucket));
+  }
+}
+
+/**/
+
+void Equation_Bucket_Queue::restore(Checkpoint_Reader & cr)
+{
+  free_rows();
+  row_stride = 0;
+  Word_Length new_row_stride = 32;
+  cr.get(&new_row_stride);
+  set_row_stride(new_row_stride);
+  cr.get(&first_row);
+  cr.get(&count);
+  for (Element_ID i = 0; i < nr_rows && cr.is_ok();i++)
+  {
+    Row & row = rows[i];
+    cr.get(&row.nr_buckets);
+    cr.get(&row.first);
+    if (row.nr_buckets)
+    {
+      row.bucket = new Bucket[row.nr_buckets];
+      cr.get(row.bucket,row.nr_buckets*sizeof(Bucket));
+    }
+  }
+}
+
+/**/
+
+void Removed_Equation_Queue::extract_key(State e,unsigned * band,
+                                         Word_Length * major,
+                                         Word_Length * minor) const
+{
+  if (nm.pd.is_coset_system && e->first_letter(nm) >= nm.pd.coset_symbol)
+    *band = e->last_letter() > nm.pd.coset_symbol ? 1 : 2;
+  else
+    *band = 0;
+  *major = e->length(nm);
+  *minor = *band != 2 ? e->raw_reduced_length(nm) : 0;
+}
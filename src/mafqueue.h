@@ -35,6 +35,9 @@ Revision 1.2  2008/09/30 08:00:16Z  Alun
 #include "nodebase.h"
 #endif
 
+class Checkpoint_Writer;
+class Checkpoint_Reader;
+
 
 class Equation_Queue
 {
@@ -50,6 +53,86 @@ class Equation_Queue
     void add(Node_Handle e);
     void remove(Node_Handle e);
     Node_Count length() const { return count;};
+    /* The links are held in the nodes, so only the ends of the queue
+       need to be saved in a checkpoint */
+    void checkpoint(Checkpoint_Writer & cw) const;
+    void restore(Checkpoint_Reader & cr);
+};
+
+/* An Equation_Bucket_Queue is a priority queue of equations. The priority
+   of an equation is given by three small numbers, a "band", a "major" key
+   and a "minor" key, which are compared in that order. Equations with
+   the same priority come out either in the order they went in, or, if
+   newest_first is set, in the reverse order. Each combination of keys
+   has its own list, so adding and using an equation takes constant time,
+   apart from skipping over empty lists, whereas a tree would need
+   O(log n) comparisons each involving a node lookup.
+   The keys are read once when an equation is added, so it does not matter
+   if they change later on.
+
+   Equations are linked using only the queue_next field of the node, since
+   queue_prev shares its storage with removed_id. So equations can't be
+   removed from the middle of an Equation_Bucket_Queue.
+*/
+
+class Equation_Bucket_Queue
+{
+  private:
+    struct Bucket
+    {
+      Node_ID head;
+      Node_ID tail;
+    };
+    struct Row
+    {
+      Bucket * bucket;
+      Word_Length nr_buckets;
+      Word_Length first; // no bucket before this one is occupied
+    };
+    Row * rows;
+    Element_Count nr_rows;
+    Element_ID first_row; // no row before this one is occupied
+    Word_Length row_stride; // all major keys are less than this
+    unsigned nr_bands;
+    Node_Count count;
+    bool newest_first;
+  protected:
+    Node_Manager &nm;
+  public:
+    Equation_Bucket_Queue(Node_Manager &nm_,unsigned nr_bands_,
+                          bool newest_first_);
+    virtual ~Equation_Bucket_Queue();
+    bool use(Node_Reference *e);
+    void add(Node_Handle e);
+    Node_Count length() const { return count;};
+    /* Only the bucket tables are saved in a checkpoint. As for
+       Equation_Queue the links are held in the nodes */
+    void checkpoint(Checkpoint_Writer & cw) const;
+    void restore(Checkpoint_Reader & cr);
+  protected:
+    virtual void extract_key(State e,unsigned * band,Word_Length * major,
+                             Word_Length * minor) const = 0;
+  private:
+    void free_rows();
+    void set_row_stride(Word_Length new_row_stride);
+};
+
+/* Removed_Equation_Queue holds the equations waiting to be removed in the
+   following order:
+   1) G equations before H equations before coset equations
+   2) Shorter LHS first
+   3) Shorter RHS first, except for coset equations
+   4) Most recent removal first. */
+
+class Removed_Equation_Queue : public Equation_Bucket_Queue
+{
+  public:
+    Removed_Equation_Queue(Node_Manager &nm_) :
+      Equation_Bucket_Queue(nm_,3,true)
+    {}
+  protected:
+    void extract_key(State e,unsigned * band,Word_Length * major,
+                     Word_Length * minor) const;
 };
 
 #endif
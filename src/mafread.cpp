@@ -1874,6 +1874,20 @@ MAF * MAF::create_from_rws(String filename,Container * container,unsigned flags,
       flags |= CFI_RESUME;
     }
 
+  /* If we are resuming and there is a checkpoint we read the axioms into
+     the presentation first rather than into a new Rewriter_Machine, so that
+     restore_checkpoint() gets a fresh one. */
+  bool try_checkpoint = false;
+  if (flags & CFI_RESUME && flags & CFI_CREATE_RM && maf.options.checkpoint)
+  {
+    Input_Stream * stream = container->open_input_file(sb.make_filename("",maf.filename,".kbckpt"),0);
+    if (stream)
+    {
+      container->close_input_file(stream);
+      try_checkpoint = true;
+    }
+  }
+
   String open_filename = maf.filename;
   int pass = 0;
   for (;;)
@@ -1884,12 +1898,20 @@ MAF * MAF::create_from_rws(String filename,Container * container,unsigned flags,
     if (stream)
     {
       RWS_Reader reader(stream,maf);
-      reader.parse_rws(pass == 0 ? flags & CFI_CREATE_RM : flags);
+      reader.parse_rws(pass == 0 ? try_checkpoint ? 0 : flags & CFI_CREATE_RM : flags);
       container->close_input_file(stream);
       ok = true;
     }
     if (!(flags & CFI_RESUME))
       break;
+    if (pass == 0 && try_checkpoint)
+    {
+      if (ok && maf.restore_checkpoint())
+        break;
+      /* The checkpoint could not be used, so carry on as though it
+         were not there */
+      maf.realise_rm();
+    }
     if (pass == 0)
     {
       open_filename = sb.make_filename("",maf.filename,".pkbprog");
@@ -0,0 +1,426 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: mafstat.cpp $
+//
+
+/* mafstat summarises a file written by the -telemetry option of automata.
+   It prints how long each phase took, the final values of the most
+   important counters, and plots of the number of equations and of
+   word-differences against time, which are usually the best guide as
+   to whether a run is converging. */
+
+#include <string.h>
+#include <stdlib.h>
+#include "awcc.h"
+#include "container.h"
+#include "maf_so.h"
+#include "mafctype.h"
+#include "telemetry.h"
+
+struct Telemetry_Record
+{
+  char kind;     // 's'ample, 'p'hase or 'e'nd
+  char phase[16];
+  Telemetry_Value value[TF_Count];
+};
+
+class Telemetry_Summary
+{
+  private:
+    Container & container;
+    Output_Stream * os;
+    Telemetry_Record * records;
+    size_t nr_records;
+    unsigned width;
+    unsigned height;
+  public:
+    Telemetry_Summary(Container & container_,unsigned width_,unsigned height_) :
+      container(container_),
+      os(container_.get_stdout_stream()),
+      records(0),
+      nr_records(0),
+      width(width_),
+      height(height_)
+    {}
+    ~Telemetry_Summary()
+    {
+      if (records)
+        delete [] records;
+    }
+    bool load(String filename);
+    void print();
+  private:
+    void parse_csv(char * text,size_t nr_lines);
+    void parse_json(char * text,size_t nr_lines);
+    void plot(const char * title,Telemetry_Field field);
+    size_t last_change(Telemetry_Field field) const;
+};
+
+int main(int argc,char ** argv);
+  static int inner(Container & container,String filename,unsigned width,
+                   unsigned height);
+
+int main(int argc,char ** argv)
+{
+  int i = 1;
+  bool bad_usage = false;
+  char * filename = 0;
+  unsigned width = 64;
+  unsigned height = 12;
+  Container & container = *Container::create();
+  Standard_Options so(container,0);
+#define cprintf container.error_output
+
+  while (i < argc && !bad_usage)
+  {
+    if (argv[i][0] == '-')
+    {
+      String arg = argv[i];
+      if (arg.is_equal("-height"))
+      {
+        so.parse_natural(&height,argv[i+1],100,arg);
+        i += 2;
+      }
+      else if (arg.is_equal("-width"))
+      {
+        so.parse_natural(&width,argv[i+1],1000,arg);
+        i += 2;
+      }
+      else if (!so.recognised(argv,i))
+        bad_usage = true;
+    }
+    else if (filename == 0)
+      filename = argv[i++];
+    else
+      bad_usage = true;
+  }
+  int exit_code = 1;
+  if (!bad_usage && filename && width >= 8 && height >= 2)
+    exit_code = inner(container,filename,width,height);
+  else
+  {
+    cprintf("Usage: mafstat [loglevel] [-width n] [-height n] telemetry_file\n"
+            "where telemetry_file was written by the -telemetry option of"
+            " automata.\nmafstat prints a summary of the run, and plots"
+            " the number of equations\nand word-differences against time."
+            " -width and -height change the size of\nthe plots.\n");
+    so.usage();
+  }
+  delete &container;
+  return exit_code;
+}
+
+/**/
+
+static int inner(Container & container,String filename,unsigned width,
+                 unsigned height)
+{
+  Telemetry_Summary summary(container,width,height);
+  if (!summary.load(filename))
+    return 1;
+  summary.print();
+  return 0;
+}
+
+/**/
+
+bool Telemetry_Summary::load(String filename)
+{
+  Input_Stream * stream = container.open_input_file(filename);
+  if (!stream)
+    return false;
+
+  /* Read the whole file, and count the lines as we go */
+  size_t allocated = 0x10000;
+  size_t length = 0;
+  size_t nr_lines = 0;
+  char * text = new char[allocated+1];
+  size_t got;
+  while ((got = container.read(stream,(Byte *) text+length,allocated-length))!=0)
+  {
+    for (size_t i = length;i < length + got;i++)
+      if (text[i] == '\n')
+        nr_lines++;
+    length += got;
+    if (length == allocated)
+    {
+      char * new_text = new char[allocated*2+1];
+      memcpy(new_text,text,length);
+      delete [] text;
+      text = new_text;
+      allocated *= 2;
+    }
+  }
+  container.close_input_file(stream);
+  text[length] = 0;
+  if (length && text[length-1] != '\n')
+    nr_lines++;
+
+  records = new Telemetry_Record[nr_lines];
+  if (strncmp(text,"kind,",5)==0)
+    parse_csv(text,nr_lines);
+  else
+    parse_json(text,nr_lines);
+  delete [] text;
+  if (!nr_records)
+  {
+    container.error_output("%s does not contain any telemetry records\n",
+                           filename.string());
+    return false;
+  }
+  return true;
+}
+
+/**/
+
+static void set_kind_and_phase(Telemetry_Record * record,const char * kind,
+                               const char * phase,size_t phase_length)
+{
+  record->kind = *kind;
+  if (phase_length >= sizeof(record->phase))
+    phase_length = sizeof(record->phase)-1;
+  memcpy(record->phase,phase,phase_length);
+  record->phase[phase_length] = 0;
+}
+
+/**/
+
+void Telemetry_Summary::parse_csv(char * text,size_t nr_lines)
+{
+  /* The header line says which column each field is in. Fields mafstat does
+     not know about are ignored, so that older versions of mafstat can read
+     files from newer versions of MAF */
+  int column_field[TF_Count+2];
+  int nr_columns = 0;
+  char * line = text;
+  char * end = strchr(line,'\n');
+  if (!end)
+    return;
+  *end = 0;
+  for (char * s = line;s && nr_columns < TF_Count+2;nr_columns++)
+  {
+    char * comma = strchr(s,',');
+    if (comma)
+      *comma = 0;
+    column_field[nr_columns] = -1;
+    for (int i = 0; i < TF_Count;i++)
+      if (Telemetry::field_name(Telemetry_Field(i)).is_equal(s))
+        column_field[nr_columns] = i;
+    s = comma ? comma+1 : 0;
+  }
+
+  for (line = end+1;*line && nr_records < nr_lines;line = end+1)
+  {
+    end = strchr(line,'\n');
+    if (end)
+      *end = 0;
+    Telemetry_Record & record = records[nr_records];
+    memset(&record,0,sizeof(record));
+    char * s = line;
+    int column = 0;
+    for (;s && column < nr_columns;column++)
+    {
+      char * comma = strchr(s,',');
+      if (comma)
+        *comma = 0;
+      if (column == 1)
+        set_kind_and_phase(&record,line,s,strlen(s));
+      else if (column_field[column] >= 0)
+        record.value[column_field[column]] = atoll(s);
+      s = comma ? comma+1 : 0;
+    }
+    if (column == nr_columns)
+      nr_records++;
+    if (!end)
+      break;
+  }
+}
+
+/**/
+
+void Telemetry_Summary::parse_json(char * text,size_t nr_lines)
+{
+  /* We only have to understand the JSON that Telemetry writes, which is
+     a flat object of strings and integers on each line */
+  char * end;
+  for (char * line = text;*line && nr_records < nr_lines;line = end+1)
+  {
+    end = strchr(line,'\n');
+    if (end)
+      *end = 0;
+    char * kind = strstr(line,"\"kind\":\"");
+    char * phase = strstr(line,"\"phase\":\"");
+    if (kind && phase)
+    {
+      Telemetry_Record & record = records[nr_records++];
+      memset(&record,0,sizeof(record));
+      phase += 9;
+      char * phase_end = strchr(phase,'"');
+      set_kind_and_phase(&record,kind+8,phase,
+                         phase_end ? phase_end-phase : strlen(phase));
+      for (char * s = strchr(line,'{');s;s = strchr(s,','))
+      {
+        s++;
+        while (is_white(*s))
+          s++;
+        if (*s++ != '"')
+          continue;
+        char * name_end = strchr(s,'"');
+        if (!name_end || name_end[1] != ':')
+          continue;
+        *name_end = 0;
+        char * value = name_end+2;
+        for (int i = 0; i < TF_Count;i++)
+          if (Telemetry::field_name(Telemetry_Field(i)).is_equal(s))
+            record.value[i] = atoll(value);
+        s = value;
+      }
+    }
+    if (!end)
+      break;
+  }
+}
+
+/**/
+
+size_t Telemetry_Summary::last_change(Telemetry_Field field) const
+{
+  /* Returns the index of the first record with the final value of the
+     specified field */
+  size_t i = nr_records-1;
+  while (i > 0 && records[i-1].value[field] == records[i].value[field])
+    i--;
+  return i;
+}
+
+/**/
+
+/* Times in the telemetry file are in milliseconds. We print them in
+   seconds to one decimal place. */
+#define FMT_SECONDS "%lld.%lld"
+#define SECONDS(t) (t)/1000,((t)%1000)/100
+
+void Telemetry_Summary::print()
+{
+  const Telemetry_Record & last = records[nr_records-1];
+  Telemetry_Value total_time = last.value[TF_Time];
+
+  container.output(os,"%lu records covering " FMT_SECONDS " seconds.%s\n",
+                   (unsigned long) nr_records,SECONDS(total_time),
+                   last.kind == 'e' ? "" : " The run is incomplete.");
+
+  container.output(os,"\nPhase        Seconds\n");
+  for (size_t i = 0; i < nr_records;i++)
+    if (records[i].kind != 's')
+      container.output(os,"%-12s " FMT_SECONDS "\n",records[i].phase,
+                       SECONDS(records[i].value[TF_Phase_Time]));
+
+  container.output(os,"\nFinal state:\n"
+                   "  Equations %lld (%lld in use, %lld visible, %lld pooled)\n"
+                   "  Nodes L0=%lld L1=%lld L2/3=%lld Bad=%lld Depth=%lld\n",
+                   last.value[TF_Equations],last.value[TF_Adopted],
+                   last.value[TF_Visible],last.value[TF_Pool],
+                   last.value[TF_Nodes_L0],last.value[TF_Nodes_L1],
+                   last.value[TF_Nodes_L2],last.value[TF_Nodes_Bad],
+                   last.value[TF_Depth]);
+  container.output(os,"  Transitions Dense=%lld Sorted=%lld Hashed=%lld\n",
+                   last.value[TF_Nodes_Dense],last.value[TF_Nodes_Sorted],
+                   last.value[TF_Nodes_Hashed]);
+  container.output(os,"  Word-differences %lld (%lld primary)\n"
+                   "  Heap in use %lld, peak %lld, reserved %lld\n",
+                   last.value[TF_Differences],
+                   last.value[TF_Primary_Differences],
+                   last.value[TF_Heap_In_Use],last.value[TF_Heap_Peak],
+                   last.value[TF_Heap_Reserved]);
+  if (last.value[TF_Complete])
+    container.output(os,"  The rewriting system was confluent.\n");
+  else if (last.value[TF_Primary_Complete])
+    container.output(os,"  All primary equations had been found.\n");
+
+  plot("Equations",TF_Equations);
+  plot("Word-differences",TF_Differences);
+
+  /* The number of word-differences usually stops changing well before
+     the automatic structure can be built, while the number of equations
+     keeps growing at a steady rate for runs that are not going to finish */
+  if (total_time > 0 && last.kind != 'e')
+  {
+    Telemetry_Value stable_since = records[last_change(TF_Differences)].value[TF_Time];
+    container.output(os,"\nThe number of word-differences has not changed"
+                     " for " FMT_SECONDS " seconds (%lld%% of the run).\n",
+                     SECONDS(total_time - stable_since),
+                     (total_time - stable_since)*100/total_time);
+    size_t half = nr_records/2;
+    Telemetry_Value early = records[half].value[TF_Equations] -
+                            records[0].value[TF_Equations];
+    Telemetry_Value late = last.value[TF_Equations] -
+                           records[half].value[TF_Equations];
+    if (late > early)
+      container.output(os,"The rate at which equations are found is"
+                       " increasing.\n");
+    else if (late*2 < early)
+      container.output(os,"The rate at which equations are found is"
+                       " falling.\n");
+  }
+}
+
+/**/
+
+void Telemetry_Summary::plot(const char * title,Telemetry_Field field)
+{
+  Telemetry_Value total_time = records[nr_records-1].value[TF_Time];
+  Telemetry_Value max_value = 0;
+  for (size_t i = 0; i < nr_records;i++)
+    if (records[i].value[field] > max_value)
+      max_value = records[i].value[field];
+  if (!max_value)
+    return;
+
+  /* Each column of the plot shows the value from the last record at or
+     before the time at the start of the column */
+  unsigned * row = new unsigned[width];
+  size_t r = 0;
+  for (unsigned column = 0; column < width;column++)
+  {
+    Telemetry_Value t = total_time * column / (width-1);
+    while (r+1 < nr_records && records[r+1].value[TF_Time] <= t)
+      r++;
+    row[column] = unsigned(records[r].value[field] * (height-1) / max_value);
+  }
+
+  container.output(os,"\n%s\n",title);
+  for (unsigned y = height; y-- > 0;)
+  {
+    if (y == height-1)
+      container.output(os,"%10lld |",max_value);
+    else if (y == 0)
+      container.output(os,"%10d |",0);
+    else
+      container.output(os,"%10s |","");
+    for (unsigned column = 0; column < width;column++)
+      container.output(os,"%c",row[column] == y ? '*' :
+                               row[column] > y ? '.' : ' ');
+    container.output(os,"\n");
+  }
+  container.output(os,"%10s +","");
+  for (unsigned column = 0; column < width;column++)
+    container.output(os,"-");
+  container.output(os,"\n%10s  0%*s" FMT_SECONDS "s\n","",int(width-4),"",
+                   SECONDS(total_time));
+  delete [] row;
+}
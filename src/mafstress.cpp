@@ -0,0 +1,236 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: mafstress.cpp $
+//
+
+/* mafstress checks that several MAF objects can be used at once in
+   different threads of the same process, as described in platform.h.
+   Each input file is first processed once on its own, and the word-acceptor
+   that is computed is remembered. Then several threads are started, each of
+   which processes all the input files in turn with a new Container and MAF
+   object each time, starting at a different file, so that different
+   groups are being processed at the same time and the same group is
+   processed in several threads at once. Each word-acceptor must be the same
+   as the one computed at the start. No files are written. */
+
+#include "awcc.h"
+#include "maf.h"
+#include "container.h"
+#include "fsa.h"
+#include "maf_mcache.h"
+#include "maf_so.h"
+#include "mafthread.h"
+#include "nodelist.h"
+
+class Stress_Test
+{
+  BLOCKED(Stress_Test)
+  public:
+    char ** inputs;
+    unsigned nr_inputs;
+    unsigned repeats;
+    Unsigned_Long_Long * expected;
+    Stress_Test(char ** inputs_,unsigned nr_inputs_,unsigned repeats_) :
+      inputs(inputs_),
+      nr_inputs(nr_inputs_),
+      repeats(repeats_),
+      expected(new Unsigned_Long_Long[nr_inputs_])
+    {}
+    ~Stress_Test()
+    {
+      delete [] expected;
+    }
+    /* run() computes the word-acceptor for filename, using a new Container
+       and MAF object. The return value is the fingerprint of the
+       word-acceptor, or 0 if none was computed. If states is not 0 the
+       number of states is returned in it */
+    static Unsigned_Long_Long run(String filename,State_Count * states = 0);
+};
+
+class Stress_Worker : public Thread
+{
+  BLOCKED(Stress_Worker)
+  public:
+    const Stress_Test & test;
+    unsigned worker_nr;
+    unsigned nr_runs;
+    unsigned nr_failures;
+    unsigned first_failure;
+    Stress_Worker(const Stress_Test & test_,unsigned worker_nr_) :
+      test(test_),
+      worker_nr(worker_nr_),
+      nr_runs(0),
+      nr_failures(0),
+      first_failure(0)
+    {}
+  protected:
+    void run()
+    {
+      for (unsigned r = 0; r < test.repeats;r++)
+        for (unsigned j = 0; j < test.nr_inputs;j++)
+        {
+          unsigned i = (j + worker_nr) % test.nr_inputs;
+          if (Stress_Test::run(test.inputs[i]) != test.expected[i])
+          {
+            if (!nr_failures++)
+              first_failure = i;
+          }
+          nr_runs++;
+        }
+      Node_List::purge();
+    }
+};
+
+int main(int argc,char ** argv);
+  static int inner(Container & container,Stress_Test & test,
+                   unsigned nr_threads);
+
+int main(int argc,char ** argv)
+{
+  int i = 1;
+  bool bad_usage = false;
+  unsigned nr_threads = 4;
+  unsigned repeats = 1;
+  char ** inputs = new char *[argc];
+  unsigned nr_inputs = 0;
+  Container & container = *Container::create();
+  Standard_Options so(container,0);
+#define cprintf container.error_output
+
+  while (i < argc && !bad_usage)
+  {
+    if (argv[i][0] == '-')
+    {
+      String arg = argv[i];
+      if (arg.is_equal("-threads"))
+      {
+        if (!so.parse_natural(&nr_threads,argv[i+1],256,arg))
+          bad_usage = true;
+        i += 2;
+      }
+      else if (arg.is_equal("-repeat"))
+      {
+        if (!so.parse_natural(&repeats,argv[i+1],0,arg))
+          bad_usage = true;
+        i += 2;
+      }
+      else if (!so.recognised(argv,i))
+        bad_usage = true;
+    }
+    else
+      inputs[nr_inputs++] = argv[i++];
+  }
+  int exit_code = 1;
+  if (!bad_usage && nr_inputs && nr_threads && repeats)
+  {
+    Stress_Test test(inputs,nr_inputs,repeats);
+    exit_code = inner(container,test,nr_threads);
+  }
+  else
+  {
+    cprintf("Usage: mafstress [loglevel] [-threads n] [-repeat n] rwsname"
+            " [rwsname ...]\nwhere each rwsname is a GASP rewriting system"
+            " for a group or monoid that MAF\ncan compute a word-acceptor"
+            " for.\nmafstress computes the word-acceptor for each rwsname"
+            " once, and then again\nin n threads at once (4 by default),"
+            " each of which processes every rwsname\nrepeat times using"
+            " separate MAF objects. It reports any run that gives a\n"
+            "different answer. No files are written.\n");
+    so.usage();
+  }
+  delete [] inputs;
+  delete &container;
+  return exit_code;
+}
+
+/**/
+
+static int inner(Container & container,Stress_Test & test,unsigned nr_threads)
+{
+  unsigned i;
+  for (i = 0; i < test.nr_inputs;i++)
+  {
+    State_Count states = 0;
+    test.expected[i] = Stress_Test::run(test.inputs[i],&states);
+    if (!test.expected[i])
+    {
+      container.error_output("No word-acceptor was computed for %s\n",
+                             test.inputs[i]);
+      return 1;
+    }
+    container.progress(1,"%s: word-acceptor has " FMT_ID " states\n",
+                       test.inputs[i],states);
+  }
+
+  unsigned long long start = container.elapsed_time();
+  Stress_Worker ** workers = new Stress_Worker *[nr_threads];
+  for (i = 0; i < nr_threads;i++)
+  {
+    workers[i] = new Stress_Worker(test,i);
+    if (!workers[i]->start())
+    {
+      container.error_output("Unable to start thread %u\n",i+1);
+      delete workers[i];
+      nr_threads = i;
+      break;
+    }
+  }
+  unsigned nr_runs = 0;
+  unsigned nr_failures = 0;
+  for (i = 0; i < nr_threads;i++)
+  {
+    workers[i]->join();
+    nr_runs += workers[i]->nr_runs;
+    nr_failures += workers[i]->nr_failures;
+    if (workers[i]->nr_failures)
+      container.error_output("Thread %u computed a different word-acceptor"
+                             " in %u of %u runs, the first time for %s\n",
+                             i+1,workers[i]->nr_failures,workers[i]->nr_runs,
+                             test.inputs[workers[i]->first_failure]);
+    delete workers[i];
+  }
+  delete [] workers;
+  container.progress(1,"%u runs in %u threads took %llu ms."
+                       " %u runs gave a different answer\n",
+                     nr_runs,nr_threads,container.elapsed_time() - start,
+                     nr_failures);
+  return nr_failures || !nr_threads ? 1 : 0;
+}
+
+/**/
+
+Unsigned_Long_Long Stress_Test::run(String filename,State_Count * states)
+{
+  Container * container = MAF::create_container();
+  container->set_log_level(0);
+  MAF * maf = MAF::create_from_rws(filename,container);
+  Unsigned_Long_Long answer = 0;
+  {
+    FSA_Buffer buffer;
+    maf->grow_automata(&buffer,0,GA_WA);
+    if (buffer.wa)
+    {
+      answer = Multiplier_Cache::fingerprint(*buffer.wa);
+      if (states)
+        *states = buffer.wa->state_count();
+    }
+  }
+  delete maf;
+  delete container;
+  return answer;
+}
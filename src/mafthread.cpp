@@ -0,0 +1,234 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: mafthread.cpp $
+//
+
+/* Implementation of the classes declared in mafthread.h */
+
+#ifdef WIN32
+#include "awwin.h"
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "awcc.h"
+#include "mafthread.h"
+#include "heap.h"
+
+#ifdef WIN32
+typedef CRITICAL_SECTION Native_Mutex;
+#else
+typedef pthread_mutex_t Native_Mutex;
+#endif
+
+Mutex::Mutex()
+{
+  Native_Mutex * m = new Native_Mutex;
+#ifdef WIN32
+  InitializeCriticalSection(m);
+#else
+  pthread_mutex_init(m,0);
+#endif
+  handle = m;
+}
+
+Mutex::~Mutex()
+{
+  Native_Mutex * m = (Native_Mutex *) handle;
+#ifdef WIN32
+  DeleteCriticalSection(m);
+#else
+  pthread_mutex_destroy(m);
+#endif
+  delete m;
+}
+
+void Mutex::lock()
+{
+#ifdef WIN32
+  EnterCriticalSection((Native_Mutex *) handle);
+#else
+  pthread_mutex_lock((Native_Mutex *) handle);
+#endif
+}
+
+void Mutex::unlock()
+{
+#ifdef WIN32
+  LeaveCriticalSection((Native_Mutex *) handle);
+#else
+  pthread_mutex_unlock((Native_Mutex *) handle);
+#endif
+}
+
+/**/
+
+#ifndef WIN32
+struct Native_Event
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+  bool signalled;
+};
+#endif
+
+Event::Event()
+{
+#ifdef WIN32
+  handle = CreateEvent(0,FALSE,FALSE,0);
+#else
+  Native_Event * e = new Native_Event;
+  pthread_mutex_init(&e->mutex,0);
+  pthread_cond_init(&e->condition,0);
+  e->signalled = false;
+  handle = e;
+#endif
+}
+
+Event::~Event()
+{
+#ifdef WIN32
+  CloseHandle((HANDLE) handle);
+#else
+  Native_Event * e = (Native_Event *) handle;
+  pthread_cond_destroy(&e->condition);
+  pthread_mutex_destroy(&e->mutex);
+  delete e;
+#endif
+}
+
+void Event::signal()
+{
+#ifdef WIN32
+  SetEvent((HANDLE) handle);
+#else
+  Native_Event * e = (Native_Event *) handle;
+  pthread_mutex_lock(&e->mutex);
+  e->signalled = true;
+  pthread_cond_signal(&e->condition);
+  pthread_mutex_unlock(&e->mutex);
+#endif
+}
+
+void Event::wait()
+{
+#ifdef WIN32
+  WaitForSingleObject((HANDLE) handle,INFINITE);
+#else
+  Native_Event * e = (Native_Event *) handle;
+  pthread_mutex_lock(&e->mutex);
+  while (!e->signalled)
+    pthread_cond_wait(&e->condition,&e->mutex);
+  e->signalled = false;
+  pthread_mutex_unlock(&e->mutex);
+#endif
+}
+
+/**/
+
+long Atomic_Counter::increment()
+{
+#ifdef WIN32
+  return InterlockedIncrement(&value);
+#else
+  return __sync_add_and_fetch(&value,1);
+#endif
+}
+
+long Atomic_Counter::decrement()
+{
+#ifdef WIN32
+  return InterlockedDecrement(&value);
+#else
+  return __sync_sub_and_fetch(&value,1);
+#endif
+}
+
+/**/
+
+struct Thread_Entry
+{
+  static void execute(Thread * thread)
+  {
+    thread->run();
+    Heap::end_thread();
+  }
+#ifdef WIN32
+  static DWORD WINAPI entry(LPVOID thread)
+  {
+    execute((Thread *) thread);
+    return 0;
+  }
+#else
+  static void * entry(void * thread)
+  {
+    execute((Thread *) thread);
+    return 0;
+  }
+#endif
+};
+
+Thread::~Thread()
+{
+  join();
+}
+
+bool Thread::start()
+{
+  if (handle)
+    return false;
+  Heap::begin_threading();
+#ifdef WIN32
+  handle = CreateThread(0,0,Thread_Entry::entry,this,0,0);
+#else
+  pthread_t * t = new pthread_t;
+  if (pthread_create(t,0,Thread_Entry::entry,this) == 0)
+    handle = t;
+  else
+    delete t;
+#endif
+  return handle != 0;
+}
+
+void Thread::join()
+{
+  if (handle)
+  {
+#ifdef WIN32
+    WaitForSingleObject((HANDLE) handle,INFINITE);
+    CloseHandle((HANDLE) handle);
+#else
+    pthread_t * t = (pthread_t *) handle;
+    pthread_join(*t,0);
+    delete t;
+#endif
+    handle = 0;
+  }
+}
+
+unsigned Thread::processor_count()
+{
+#ifdef WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? unsigned(n) : 1;
+#endif
+}
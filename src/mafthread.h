@@ -0,0 +1,138 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: mafthread.h $
+*/
+#pragma once
+#ifndef MAFTHREAD_INCLUDED
+#define MAFTHREAD_INCLUDED 1
+
+/* This header file declares the very small set of classes MAF uses when it
+   wants to do some work in more than one thread. As with Platform, the idea
+   is that nothing else in MAF needs to know anything about how threads are
+   implemented on the underlying OS. mafthread.cpp implements them with
+   Win32 APIs on Windows and with POSIX threads everywhere else.
+
+   Nothing in MAF is thread safe unless it says it is. Code that uses
+   threads is responsible for making sure that the objects each thread
+   uses are either private to it, or are only read while other threads
+   are running. The global heap is an exception: it becomes safe for use
+   by any number of threads as soon as the first Thread is started.
+*/
+
+#ifndef AWDEFS_INCLUDED
+#include "awdefs.h"
+#endif
+
+class Mutex
+{
+  BLOCKED(Mutex)
+  private:
+    void * handle;
+  public:
+    Mutex();
+    ~Mutex();
+    void lock();
+    void unlock();
+};
+
+/* Mutex_Lock holds a lock on a Mutex for the lifetime of the Mutex_Lock */
+class Mutex_Lock
+{
+  BLOCKED(Mutex_Lock)
+  private:
+    Mutex & mutex;
+  public:
+    Mutex_Lock(Mutex & mutex_) :
+      mutex(mutex_)
+    {
+      mutex.lock();
+    }
+    ~Mutex_Lock()
+    {
+      mutex.unlock();
+    }
+};
+
+/* Atomic_Counter is a counter that any number of threads may change at
+   once. It is used for the reference counts of objects, such as Alphabet,
+   that are shared by objects which may be created and destroyed in worker
+   threads. */
+class Atomic_Counter
+{
+  BLOCKED(Atomic_Counter)
+  private:
+    volatile long value;
+  public:
+    Atomic_Counter(long value_ = 0) :
+      value(value_)
+    {}
+    // increment() and decrement() return the new value
+    long increment();
+    long decrement();
+    long get() const
+    {
+      return value;
+    }
+};
+
+/* An Event lets a thread wait until another thread tells it to continue.
+   Each call to signal() releases one call to wait(), which may already be
+   waiting or may come later. If signal() is called several times before
+   anybody waits only one wait() is released. */
+class Event
+{
+  BLOCKED(Event)
+  private:
+    void * handle;
+  public:
+    Event();
+    ~Event();
+    void signal();
+    void wait();
+};
+
+/* To do something in another thread derive a class from Thread and implement
+   its run() method, then call start(). The object must not be destroyed
+   until after join() has returned. The destructor calls join() in case you
+   forget. */
+class Thread
+{
+  BLOCKED(Thread)
+  friend struct Thread_Entry;
+  private:
+    void * handle;
+  public:
+    Thread() :
+      handle(0)
+    {}
+    virtual ~Thread();
+    bool start();
+    void join();
+    bool running() const
+    {
+      return handle != 0;
+    }
+    // processor_count() returns the number of processors the OS thinks are
+    // available to the process, or 1 if that cannot be discovered.
+    static unsigned processor_count();
+  protected:
+    virtual void run() = 0;
+};
+
+#endif
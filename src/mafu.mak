@@ -21,8 +21,8 @@
 #If any of the compilation flags cause trouble, then you can probably remove them
 #If you are not using GCC compilers then make sure you enable whatever flag
 #ensures char is unsigned by default.
-CPPFLAGS = -m32 -Os -Wall -Wextra -Wno-switch -Wno-reorder -Wno-char-subscripts  -funsigned-char -fno-default-inline -fpermissive -fno-rtti -fno-threadsafe-statics -fvisibility-inlines-hidden -fno-exceptions 
-LINKER = g++ -m32 
+CPPFLAGS = -m32 -Os -Wall -Wextra -Wno-switch -Wno-reorder -Wno-char-subscripts  -funsigned-char -fno-default-inline -fpermissive -fno-rtti -fno-threadsafe-statics -fvisibility-inlines-hidden -fno-exceptions -pthread 
+LINKER = g++ -m32 -pthread
 BIN = ./../bin
 O=o
 LINK_EXTRA =
@@ -39,6 +39,7 @@ all: \
   $(BIN)/fsaandnot \
   $(BIN)/fsabfs \
   $(BIN)/fsacartesian \
+  $(BIN)/fsacompile \
   $(BIN)/fsacompose \
   $(BIN)/fsaconcat \
   $(BIN)/fsacount \
@@ -97,6 +98,8 @@ all: \
   $(BIN)/makecosfile  \
   $(BIN)/isconjugate \
   $(BIN)/isnormal \
+  $(BIN)/mafstat \
+  $(BIN)/mafstress \
   $(BIN)/simplify
 
 MAFLIB = \
@@ -110,7 +113,7 @@ MAFLIB = \
   mafload.$O \
   mafread.$O \
   alphabet.$O \
-  maf_avl.$O \
+  maf_acr.$O \
   maf_cfp.$O \
   maf_dr.$O \
   maf_dt.$O \
@@ -118,12 +121,14 @@ MAFLIB = \
   maf_em.$O \
   maf_ew.$O \
   maf_jm.$O \
+  maf_mcache.$O \
   maf_mult.$O \
   maf_nm.$O \
   maf_rm.$O \
   maf_rws.$O \
   maf_spl.$O \
   maf_so.$O \
+  maf_spool.$O \
   maf_ss.$O \
   maf_sub.$O \
   maf_subwa.$O \
@@ -135,6 +140,10 @@ MAFLIB = \
   keyedfsa.$O \
   bitarray.$O \
   heap.$O \
+  mafthread.$O \
+  arena.$O \
+  checkpoint.$O \
+  telemetry.$O \
   rubik.$O \
   fsa.$O \
   mafauto.$O  \
@@ -163,7 +172,7 @@ maf.a : $(MAFLIB)
 
 $(BIN)/libmaf.dylib : $(MAFLIB)
 	-mkdir $(BIN)
-	g++ -m32 -dynamiclib $(MAFLIB) -o $@
+	g++ -m32 -pthread -dynamiclib $(MAFLIB) -o $@
 
 EXAMPLE = \
   example.$O \
@@ -235,6 +244,13 @@ FSAPRODUCT = \
 $(BIN)/fsaproduct: $(FSAPRODUCT) 
 	$(LINKER) -o $@ $(FSAPRODUCT) $(LINK_EXTRA)   
 
+FSACOMPILE = \
+  fsacompile.$O \
+  $(LIBS)
+
+$(BIN)/fsacompile: $(FSACOMPILE) 
+	$(LINKER) -o $@ $(FSACOMPILE) $(LINK_EXTRA)   
+
 FSACOUNT = \
   fsacount.$O \
   $(LIBS)
@@ -651,4 +667,18 @@ SIMPLIFY = \
 $(BIN)/simplify: $(SIMPLIFY) 
 	$(LINKER) -o $@ $(SIMPLIFY) $(LINK_EXTRA)   
 
+MAFSTAT = \
+  mafstat.$O \
+  $(LIBS)
+
+$(BIN)/mafstat: $(MAFSTAT) 
+	$(LINKER) -o $@ $(MAFSTAT) $(LINK_EXTRA)   
+
+MAFSTRESS = \
+  mafstress.$O \
+  $(LIBS)
+
+$(BIN)/mafstress: $(MAFSTRESS) 
+	$(LINKER) -o $@ $(MAFSTRESS) $(LINK_EXTRA)   
+
 include mafu.dep
@@ -343,14 +343,16 @@ void Word_List::reserve(Word_Length length)
      direct access to the word list, creating an Entry_Word at the end
      of the list of the specified length.
      Now it is just used to internally, to make room for a new word */
+  /* Once the list is more than tiny it grows by a quarter at a time,
+     since otherwise building a long list takes quadratic time */
   if (nr_words >= max_words)
-    grow(nr_words < 2 ? nr_words+1 : nr_words+4);
+    grow(nr_words < 2 ? nr_words+1 : nr_words+nr_words/4+4);
   words[nr_words] = buffer + used;
   if (used+length+1 > buffer_length)
   {
     buffer_length = used+length+1;
     if (max_words > 2)
-      buffer_length = (buffer_length+1023) & ~1023;
+      buffer_length = (buffer_length+used/4+1023) & ~1023;
     Ordinal * new_buffer = new Ordinal[buffer_length];
     word_copy(new_buffer,buffer,used);
     /* <= intentional below */
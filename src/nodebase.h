@@ -42,6 +42,16 @@ class Nodes
 typedef const Node *State;
 typedef Node Equation_Node;
 
+/* The ways in which the transitions of an irreducible Node can be stored.
+   See mafnode.cpp */
+enum Node_Representation
+{
+  NR_Dense,  // an array with an entry for every possible transition
+  NR_Sorted, // a sorted array of the real children only
+  NR_Hashed, // the same, with a hash table for finding children quickly
+  NR_Count
+};
+
 #ifndef MAF_USE_LOOKUP
 #ifdef _WIN64
 #define MAF_USE_LOOKUP 1
@@ -29,6 +29,7 @@
 
 #include "nodelist.h"
 #include "mafnode.h"
+#include "checkpoint.h"
 
 /**/
 
@@ -82,15 +83,11 @@ bool Node_List::use(Node_Reference *nr,const Node_Manager &nm,int * parameter)
       *parameter = head->parameter;
     head = head->next;
 #if 1
-    if (free_list.node_count < 128)
+    if (free_count < 128)
     {
-      if (free_list.head)
-        free_list.tail->next = save;
-      else
-        free_list.head = save;
-      free_list.tail = save;
-      free_list.tail->next = 0;
-      free_list.node_count++;
+      save->next = free_head;
+      free_head = save;
+      free_count++;
     }
     else
 #endif
@@ -105,27 +102,27 @@ bool Node_List::use(Node_Reference *nr,const Node_Manager &nm,int * parameter)
   }
 }
 
-Node_List Node_List::free_list;
+THREAD_LOCAL Node_List::Node_Item * Node_List::free_head;
+THREAD_LOCAL Node_Count Node_List::free_count;
 
 /**/
 
 void Node_List::add_state(Node_Handle nh,int parameter)
 {
 #if 1
-  if (!free_list.head)
+  if (!free_head)
   {
-    free_list.head = free_list.tail = new Node_Item;
-    for (int i = 0;i < 128;i++)
+    for (int i = 0;i <= 128;i++)
     {
-      free_list.tail->next = new Node_Item;
-      free_list.tail = free_list.tail->next;
+      Node_Item * item = new Node_Item;
+      item->next = free_head;
+      free_head = item;
     }
-    free_list.tail->next = 0;
-    free_list.node_count = 128;
+    free_count = 129;
   }
-  Node_Item * list = free_list.head;
-  free_list.head = list->next;
-  free_list.node_count--;
+  Node_Item * list = free_head;
+  free_head = list->next;
+  free_count--;
 #else
   Node_Item * list = new Node_Item;
 #endif
@@ -142,17 +139,72 @@ void Node_List::add_state(Node_Handle nh,int parameter)
 
 void Node_List::empty()
 {
-  if (this != &free_list)
-    free_list.merge(this);
-  else
+  /* Give our items to this thread's free list */
+  if (head)
   {
-    while (head)
-    {
-      Node_Item *save = head;
-      head = head->next;
-      delete save;
-      node_count--;
-    }
+    tail->next = free_head;
+    free_head = head;
+    free_count += node_count;
+    node_count = 0;
+    head = tail = 0;
+  }
+}
+
+/**/
+
+void Node_List::purge()
+{
+  while (free_head)
+  {
+    Node_Item *save = free_head;
+    free_head = free_head->next;
+    delete save;
+  }
+  free_count = 0;
+}
+
+/**/
+
+void Node_List::checkpoint(Checkpoint_Writer & cw) const
+{
+  cw.put(node_count);
+  for (const Node_Item * item = head; item;item = item->next)
+  {
+    cw.put(item->nid);
+    cw.put(item->parameter);
+  }
+}
+
+/**/
+
+void Node_List::restore(Checkpoint_Reader & cr,const Node_Manager &nm)
+{
+  Node_Count count = 0;
+  cr.get(&count);
+  while (count-- && cr.is_ok())
+  {
+    Node_ID nid;
+    int parameter;
+    cr.get(&nid);
+    cr.get(&parameter);
+    add_state(Node_Reference(nm,nid),parameter);
+  }
+}
+
+/**/
+
+void Sortable_Node_List::restore(Checkpoint_Reader & cr)
+{
+  /* We use our own add_state() so that height is recalculated */
+  Node_Count count = 0;
+  cr.get(&count);
+  while (count-- && cr.is_ok())
+  {
+    Node_ID nid;
+    int parameter;
+    cr.get(&nid);
+    cr.get(&parameter);
+    add_state(Node_Reference(nm,nid),parameter);
   }
 }
 
@@ -42,13 +42,22 @@ Revision 1.4  2007/09/07 20:20:18Z  Alun_Williams
 #include "nodebase.h"
 #endif
 
+// Classes referred to but defined elsewhere
+class Checkpoint_Writer;
+class Checkpoint_Reader;
+
 class Node_List
 {
   /* Class Node_List is used for building lists of nodes that
-     we want to do something with */
+     we want to do something with.
+     Spare Node_Item structures are kept on a free list which is private
+     to each thread, so Node_List objects in different threads do not
+     interfere with each other. A thread other than the main thread that
+     uses Node_List should call purge() before it exits. */
   struct Node_Item;
   private:
-    static Node_List free_list;
+    static THREAD_LOCAL Node_Item * free_head;
+    static THREAD_LOCAL Node_Count free_count;
     Node_Item * head;
     Node_Item * tail;
     Node_Count node_count;
@@ -70,10 +79,12 @@ class Node_List
     void merge(Node_List *other);
     void empty();
     bool use(Node_Reference *e,const Node_Manager &nm,int * parameter = 0);
-    static void purge()
-    {
-      free_list.empty();
-    }
+    static void purge();
+    /* checkpoint() saves the list. restore() adds the saved items back.
+       Neither of these touch the reference counts, since these are
+       saved with the nodes themselves. */
+    void checkpoint(Checkpoint_Writer & cw) const;
+    void restore(Checkpoint_Reader & cr,const Node_Manager &nm);
 };
 
 class Multi_Node_List
@@ -123,6 +134,7 @@ class Sortable_Node_List : public Node_List
       height(0)
     {}
     void add_state(Node_Handle node,int parameter = 0);
+    void restore(Checkpoint_Reader & cr);
     void sort();
     bool use(Node_Reference *e,int * parameter = 0)
     {
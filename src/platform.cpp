@@ -53,6 +53,22 @@
 #include "platform.h"
 #include "variadic.h"
 
+/* status_clock() returns a monotonic elapsed time in milliseconds. It is
+   used to decide when to output status messages. clock() used to be used
+   for this, but that measures CPU time for the whole process, so when
+   several MAF objects were busy in different threads each of them would
+   output status messages far more often than intended. */
+static unsigned long long status_clock()
+{
+#ifdef WIN32
+  return GetTickCount64();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (unsigned long long) now.tv_sec*1000 + now.tv_nsec/1000000;
+#endif
+}
+
 class Platform_Implementation : public Platform
 {
     Input_Stream * stdin_stream;
@@ -60,7 +76,7 @@ class Platform_Implementation : public Platform
     Output_Stream * stderr_stream;
     Stream_Mangler log_stream; // don't move this above stdout_stream!
     Stream_Mangler error_stream;  // or this above stderr_stream
-    clock_t status_time;
+    unsigned long long status_time;
     unsigned long reference_count;
   public:
     Platform_Implementation() :
@@ -77,7 +93,7 @@ class Platform_Implementation : public Platform
       error_stream(*stderr_stream),
       reference_count(0)
     {
-      status_time = clock();
+      status_time = status_clock();
     }
     Platform &attach()
     {
@@ -103,7 +119,7 @@ class Platform_Implementation : public Platform
     size_t log_output(const char * control,Variadic_Arguments &args)
     {
       size_t retcode = log_stream.formatv(control,args);
-      status_time = clock();
+      status_time = status_clock();
       return retcode;
     }
     Output_Stream * get_stdout_stream()
@@ -170,6 +186,14 @@ class Platform_Implementation : public Platform
       return DeleteFile(filename)!=0;
 #else
       return remove(filename)==0;
+#endif
+    }
+    bool rename_file(String from,String to)
+    {
+#ifdef WIN32
+      return MoveFileEx(from,to,MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH)!=0;
+#else
+      return rename(from,to)==0;
 #endif
     }
     Input_Stream * open_input_file(String filename,bool null_is_stdin)
@@ -211,7 +235,7 @@ class Platform_Implementation : public Platform
     }
     bool status_needed(int gap)
     {
-      return clock() >= status_time+gap*CLOCKS_PER_SEC;
+      return status_clock() >= status_time+(unsigned long long) gap*1000;
     }
     String last_error_message(String_Buffer * buffer)
     {
@@ -241,3 +265,24 @@ Platform * Platform::create_platform()
 {
   return new Platform_Implementation();
 }
+
+/**/
+
+size_t Platform::write(Output_Stream * stream,const Byte * buffer,size_t nr_bytes)
+{
+  return stream->write(buffer,nr_bytes);
+}
+
+/**/
+
+unsigned long long Platform::elapsed_time()
+{
+  return status_clock();
+}
+
+/**/
+
+bool Platform::flush(Output_Stream * stream)
+{
+  return stream->flush();
+}
@@ -56,6 +56,29 @@ time libary of your choice. You can create a container object by
 calling MAF::create_container(), or Container::create()).
 If you don't pass specify a platform object for it to use it will create one
 using its default implementation.
+
+Thread safety:
+Separate MAF objects, each created with its own Container, may be used
+concurrently in different threads of the same process. Each Container made
+by Container::create() without a Platform argument gets its own Platform,
+so nothing in either is shared. The rules are:
+1) A MAF object, the Container it uses, and any FSA, Rewriter_Machine or
+   other object created from it, must only be used by one thread at a time.
+   MAF itself may use helper threads internally, but it waits for them
+   before returning to the caller.
+2) A Platform object is not thread safe. If several containers share one
+   Platform they must all be used from the same thread.
+3) The heap is shared by the whole process and becomes thread safe as soon
+   as the first Thread is started. A program that creates its own threads
+   rather than using the Thread class must call Heap::begin_threading()
+   before they start, and Heap::end_thread() in each one before it exits.
+4) Threads that run MAF code should also call Node_List::purge() before they
+   exit, or the spare list entries they have cached will be leaked.
+5) Container::input_error(), usage_error() and die() terminate the whole
+   process, not just the calling thread, so an embedding program should
+   check its input before handing it to MAF if that matters.
+The mafstress utility runs several MAF objects at once in different threads
+and checks that each gives the same answer as a run on its own.
 */
 
 class Platform
@@ -121,6 +144,14 @@ class Platform
     /* MAF will always attempt to read files in 4K chunks.
        MAF is not interactive, so doesn't usually read from stdin */
     virtual size_t read(Input_Stream *,Byte * buffer,size_t buf_size) = 0;
+    /* write() is used for files opened with open_binary_output_file().
+       It should return the number of bytes actually written */
+    virtual size_t write(Output_Stream * stream,const Byte * buffer,size_t nr_bytes);
+    /* rename_file() should replace any existing file called to, and should
+       return false if that cannot be done atomically. MAF only uses it to
+       make sure that checkpoint files are never left half written, so
+       a Platform that cannot do this need not implement it. */
+    virtual bool rename_file(String /*from*/,String /*to*/) { return false;};
     /* set_gap_stdout() instructs the platform interface to ensure that
        any output sent to the "log stream" has a # at the beginning of
        each line, because stdout is going to be used as the destination
@@ -133,6 +164,14 @@ class Platform
        progress, so do not return false to suppress status output.
        Instead make log_output() do nothing */
     virtual bool status_needed(int /*gap*/) { return true;};
+    /* elapsed_time() should return the time in milliseconds from some
+       arbitrary fixed point, and should not go backwards if the system
+       clock is changed. It is used to time the records written by the
+       -telemetry option. */
+    virtual unsigned long long elapsed_time();
+    /* flush() is used for files that another program might be reading
+       while MAF is still writing them. */
+    virtual bool flush(Output_Stream * stream);
 };
 
 #endif
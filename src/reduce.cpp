@@ -41,14 +41,497 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 #include "maf.h"
 #include "mafctype.h"
 #include "container.h"
 #include "alphabet.h"
 #include "mafword.h"
+#include "hash.h"
 #include "maf_dr.h"
 #include "maf_so.h"
+#include "maf_wdb.h"
+#include "mafthread.h"
 
+/* With -read -threads n each thread reduces up to this many words before
+   the answers are output */
+const Element_Count READ_PIECE_SIZE = 65536;
+
+static void benchmark(MAF * maf,const Word_List & wl,
+                      Group_Automaton_Type method,unsigned repeats)
+{
+  /* Reduce the list of words repeatedly, first using the index automaton
+     and then using the Aho-Corasick trie, and report how long each took
+     and how many of the answers differed (which should be none) */
+  Container & container = maf->container;
+  Word_Reducer * reducer[2];
+  unsigned long long elapsed[2];
+  int j;
+  if (method == GAT_Auto_Select)
+    method = GAT_Minimal_RWS;
+  for (j = 0; j < 2;j++)
+  {
+    if (!maf->load_reduction_method(method,j==1))
+    {
+      container.error_output("-benchmark needs a rewriting system\n");
+      if (j)
+        delete reducer[0];
+      return;
+    }
+    reducer[j] = maf->take_word_reducer();
+  }
+  Element_Count count = wl.count();
+  Ordinal_Word test(maf->alphabet);
+  Ordinal_Word other(maf->alphabet);
+  for (j = 0; j < 2;j++)
+  {
+    unsigned long long start = container.elapsed_time();
+    for (unsigned r = 0; r < repeats;r++)
+      for (Element_ID i = 0; i < count;i++)
+      {
+        wl.get(&test,i);
+        reducer[j]->reduce(&test,test);
+      }
+    elapsed[j] = container.elapsed_time() - start;
+  }
+  Element_Count differences = 0;
+  for (Element_ID i = 0; i < count;i++)
+  {
+    wl.get(&test,i);
+    reducer[0]->reduce(&test,test);
+    wl.get(&other,i);
+    reducer[1]->reduce(&other,other);
+    if (!(test == other))
+      differences++;
+  }
+  container.error_output("Reduced " FMT_ID " words %u times\n"
+                         "Index automaton: %llu ms\n"
+                         "Aho-Corasick trie: %llu ms\n"
+                         FMT_ID " words reduced differently\n",
+                         count,repeats,elapsed[0],elapsed[1],differences);
+  delete reducer[0];
+  delete reducer[1];
+}
+
+/**/
+
+/* A Reduction_Pool reduces lists of words in several threads. The threads
+   are started when the pool is created and then wait for work, so that
+   reduce -server does not start new threads for each request, and reduce
+   -read does not start new threads for each piece of its input. The word
+   reducers, and the work areas they keep between calls, are not thread
+   safe, so each worker has a MAF object of its own, loaded from the same
+   files as the main one, and the calling thread reduces its own share of
+   each list with the main MAF object. */
+
+class Reduction_Pool
+{
+  BLOCKED(Reduction_Pool)
+  private:
+    class Worker : public Thread
+    {
+      BLOCKED(Worker)
+      public:
+        Reduction_Pool & pool;
+        MAF * maf;
+        Event go;
+        Word_List answers;
+        Element_ID from;
+        Element_ID to;
+        Worker(Reduction_Pool & pool_,MAF * maf_) :
+          pool(pool_),
+          maf(maf_),
+          answers(maf_->alphabet),
+          from(0),
+          to(0)
+        {}
+        ~Worker()
+        {
+          join();
+          delete maf;
+        }
+      protected:
+        void run()
+        {
+          for (;;)
+          {
+            go.wait();
+            if (pool.quit)
+              return;
+            answers.empty();
+            pool.reduce_range(&answers,*maf,from,to);
+            if (!pool.busy.decrement())
+              pool.done.signal();
+          }
+        }
+    };
+    MAF & maf;
+    Worker ** workers;
+    unsigned nr_workers;
+    const Word_List * words;
+    unsigned flags;
+    Atomic_Counter busy;
+    Event done;
+    bool quit;
+  public:
+    Reduction_Pool(MAF & maf_,unsigned nr_threads,bool cosets,
+                   String group_filename,String subgroup_suffix,
+                   const Standard_Options & so) :
+      maf(maf_),
+      workers(new Worker *[nr_threads ? nr_threads : 1]),
+      nr_workers(0),
+      words(0),
+      flags(0),
+      quit(false)
+    {
+      maf.options.threads = 1;
+      for (unsigned i = 1; i < nr_threads;i++)
+      {
+        MAF * worker_maf = MAF::create_from_input(cosets,group_filename,
+                                                  subgroup_suffix,
+                                                  &maf.container);
+        if (!worker_maf)
+          break;
+        if (!worker_maf->load_reduction_method(so.reduction_method,
+                                               so.use_trie,so.prefix_cache))
+        {
+          delete worker_maf;
+          break;
+        }
+        Worker * worker = new Worker(*this,worker_maf);
+        if (!worker->start())
+        {
+          delete worker;
+          break;
+        }
+        workers[nr_workers++] = worker;
+      }
+    }
+    ~Reduction_Pool()
+    {
+      quit = true;
+      for (unsigned i = 0; i < nr_workers;i++)
+        workers[i]->go.signal();
+      for (unsigned i = 0; i < nr_workers;i++)
+        delete workers[i];
+      delete [] workers;
+    }
+    unsigned thread_count() const
+    {
+      return nr_workers + 1;
+    }
+    /* reduce() reduces words and adds the answers to answers in the same
+       order */
+    void reduce(Word_List * answers,const Word_List & words_,
+                unsigned flags_ = 0)
+    {
+      reduce(answers,words_,0,words_.count(),flags_);
+    }
+    /* This version of reduce() only reduces the words from from up to but
+       not including to, so that a long list can be reduced and output a
+       piece at a time */
+    void reduce(Word_List * answers,const Word_List & words_,
+                Element_ID from,Element_ID to,unsigned flags_ = 0)
+    {
+      Element_Count count = to - from;
+      unsigned nr_used = nr_workers;
+      /* It is not worth waking a thread for only a few words */
+      if (Element_Count(nr_used) > count/64)
+        nr_used = unsigned(count/64);
+      if (!nr_used && count == words_.count())
+      {
+        maf.reduce_batch(answers,words_,flags_);
+        return;
+      }
+      words = &words_;
+      flags = flags_;
+      Element_Count slice = count/(nr_used+1);
+      unsigned i;
+      for (i = 0; i < nr_used;i++)
+      {
+        workers[i]->from = from + (i+1)*slice;
+        workers[i]->to = i+1 < nr_used ? from + (i+2)*slice : to;
+        busy.increment();
+      }
+      for (i = 0; i < nr_used;i++)
+        workers[i]->go.signal();
+      reduce_range(answers,maf,from,from + slice);
+      if (!nr_used)
+        return;
+      done.wait();
+      for (i = 0; i < nr_used;i++)
+      {
+        const Word_List & worker_answers = workers[i]->answers;
+        Element_Count nr_answers = worker_answers.count();
+        for (Element_ID j = 0; j < nr_answers;j++)
+          answers->add(Entry_Word(worker_answers,j));
+      }
+    }
+  private:
+    void reduce_range(Word_List * answers,MAF & reducer,Element_ID from,
+                      Element_ID to)
+    {
+      Word_List range(reducer.alphabet,to-from);
+      Ordinal_Word word(reducer.alphabet);
+      for (Element_ID i = from; i < to;i++)
+      {
+        words->get(&word,i);
+        range.add(word);
+      }
+      reducer.reduce_batch(answers,range,flags);
+    }
+};
+
+/**/
+
+/* Reduction_Server implements reduce -server. Requests are read from one
+   file, normally a FIFO, and the responses are written to another, so that
+   a program which needs to reduce many lists of words can keep one reduce
+   process running, rather than start a new one that loads the automata
+   again for each list.
+
+   All numbers are sent as 4 bytes, most significant byte first. A request
+   consists of the number of words n, followed by n words, each of which is
+   sent as the length of its text in bytes followed by the text, such as
+   "a*b^2". The response has the same form and contains the reduced words
+   in the same order. If a word cannot be parsed its length is sent as
+   0xFFFFFFFF and no text follows. A request with n equal to 0xFFFFFFFF
+   stops the server.
+
+   A client opens the request file and sends any number of requests,
+   reading the response to each from the response file. When it closes the
+   request file the server closes the response file and waits for the next
+   client, so only one client can be served at a time.
+
+   If a response cache is used the answers for up to the specified number
+   of different words are remembered, and are used again if a word is sent
+   again. When the cache is full it is emptied. */
+
+class Reduction_Server
+{
+  BLOCKED(Reduction_Server)
+  private:
+    class Quiet_Parse : public Parse_Error_Handler
+    {
+      public:
+        void input_error(const char *,...) {}
+    };
+    static const unsigned long NO_WORD = 0xffffffffUL;
+    static const unsigned long MAX_TEXT = 0x1000000UL;
+    Container & container;
+    MAF & maf;
+    Reduction_Pool & pool;
+    Equation_DB * cache;
+    Element_Count cache_size;
+    unsigned long nr_requests;
+    unsigned long nr_words;
+    unsigned long nr_cache_hits;
+    bool output_failed;
+  public:
+    Reduction_Server(MAF & maf_,Reduction_Pool & pool_,
+                     Element_Count cache_size_) :
+      container(maf_.container),
+      maf(maf_),
+      pool(pool_),
+      cache(0),
+      cache_size(cache_size_),
+      nr_requests(0),
+      nr_words(0),
+      nr_cache_hits(0),
+      output_failed(false)
+    {
+      if (cache_size)
+        cache = new Equation_DB(maf.alphabet,1024);
+    }
+    ~Reduction_Server()
+    {
+      if (cache)
+        delete cache;
+    }
+    /* serve() returns when a client asks the server to stop, or if either
+       file cannot be opened */
+    bool serve(String request_name,String response_name)
+    {
+      container.progress(1,"Serving reduction requests from %s using %u"
+                           " thread%s\n",request_name.string(),
+                         pool.thread_count(),
+                         pool.thread_count() == 1 ? "" : "s");
+      bool stop = false;
+      output_failed = false;
+      while (!stop && !output_failed)
+      {
+        /* Opening a FIFO waits until a client opens the other end */
+        Input_Stream * in = container.open_input_file(request_name,
+                                                      OIF_REPORT_ERROR);
+        if (!in)
+          return false;
+        Output_Stream * out = 0;
+        for (;;)
+        {
+          unsigned long count;
+          if (!read_number(in,&count))
+            break;
+          if (count == NO_WORD)
+          {
+            stop = true;
+            break;
+          }
+          if (!serve_request(in,&out,response_name,count))
+          {
+            if (!output_failed)
+              container.error_output("Invalid request received\n");
+            break;
+          }
+        }
+        if (out)
+          container.close_output_file(out);
+        container.close_input_file(in);
+      }
+      container.progress(1,"Served %lu requests for %lu words (%lu found in"
+                           " the response cache)\n",nr_requests,nr_words,
+                         nr_cache_hits);
+      return !output_failed;
+    }
+  private:
+    bool serve_request(Input_Stream * in,Output_Stream ** out,
+                       String response_name,unsigned long count)
+    {
+      /* The words that are not in the cache are put into a list that is
+         reduced in one go. found[i] is the cache entry for word i, or
+         INVALID_ID if it has to be reduced, or -1 if it would not parse */
+      Word_List words(maf.alphabet);
+      Word_List answers(maf.alphabet);
+      /* found[] grows as the words arrive, rather than being allocated
+         from count, which has not been checked */
+      unsigned long allocated = count < 1024 ? count : 1024;
+      Element_ID * found = new Element_ID[allocated ? allocated : 1];
+      String_Buffer sb;
+      Quiet_Parse quiet;
+      bool ok = true;
+      unsigned long i;
+      for (i = 0; i < count;i++)
+      {
+        unsigned long length;
+        if (!read_number(in,&length) || length > MAX_TEXT)
+        {
+          ok = false;
+          break;
+        }
+        if (i == allocated)
+        {
+          Element_ID * new_found = new Element_ID[allocated*2];
+          memcpy(new_found,found,allocated*sizeof(Element_ID));
+          delete [] found;
+          found = new_found;
+          allocated *= 2;
+        }
+        Letter * text = sb.reserve(String_Length(length));
+        if (!read_bytes(in,(Byte *) text,length))
+        {
+          ok = false;
+          break;
+        }
+        text[length] = 0;
+        Ordinal_Word * word = maf.parse(text,String_Length(length),quiet);
+        if (!word)
+          found[i] = Element_ID(-1);
+        else if (cache && cache->find(*word,&found[i]))
+          nr_cache_hits++;
+        else
+        {
+          found[i] = INVALID_ID;
+          words.add(*word);
+        }
+        if (word)
+          delete word;
+      }
+      /* The response file is not opened until the whole of the first
+         request has been read, because the client may not open it until it
+         has finished writing the request */
+      if (ok && !*out)
+      {
+        *out = container.open_binary_output_file(response_name);
+        output_failed = !*out;
+      }
+      if (ok && *out)
+      {
+        pool.reduce(&answers,words);
+        nr_requests++;
+        nr_words += count;
+        ok = write_number(*out,count);
+        Ordinal_Word word(maf.alphabet);
+        Element_ID next = 0;
+        for (i = 0; ok && i < count;i++)
+        {
+          if (found[i] == Element_ID(-1))
+          {
+            ok = write_number(*out,NO_WORD);
+            continue;
+          }
+          if (found[i] != INVALID_ID)
+            cache->get_rhs(&word,found[i]);
+          else
+            answers.get(&word,next++);
+          word.format(&sb);
+          size_t length = sb.get().length();
+          ok = write_number(*out,length) &&
+               container.write(*out,(const Byte *) sb.get().string(),
+                               length) == length;
+        }
+        ok = ok && container.flush(*out);
+        /* The new answers are only added to the cache now, since adding
+           them can empty it */
+        if (cache)
+          for (Element_ID j = 0; j < next;j++)
+            add_to_cache(Entry_Word(words,j),Entry_Word(answers,j));
+      }
+      delete [] found;
+      return ok && !output_failed;
+    }
+    void add_to_cache(const Word & word,const Word & answer)
+    {
+      if (cache->count() >= cache_size)
+      {
+        delete cache;
+        cache = new Equation_DB(maf.alphabet,1024);
+      }
+      Element_ID id;
+      cache->insert(word,&id);
+      cache->update_rhs(id,answer);
+    }
+    bool read_bytes(Input_Stream * in,Byte * buffer,size_t size)
+    {
+      while (size)
+      {
+        size_t got = container.read(in,buffer,size);
+        if (!got)
+          return false;
+        buffer += got;
+        size -= got;
+      }
+      return true;
+    }
+    bool read_number(Input_Stream * in,unsigned long * value)
+    {
+      Byte buffer[4];
+      if (!read_bytes(in,buffer,4))
+        return false;
+      *value = (unsigned long) buffer[0] << 24 | (unsigned long) buffer[1] << 16 |
+               (unsigned long) buffer[2] << 8 | buffer[3];
+      return true;
+    }
+    bool write_number(Output_Stream * out,unsigned long value)
+    {
+      Byte buffer[4];
+      buffer[0] = Byte(value >> 24);
+      buffer[1] = Byte(value >> 16);
+      buffer[2] = Byte(value >> 8);
+      buffer[3] = Byte(value);
+      return container.write(out,buffer,4) == 4;
+    }
+};
+
+/**/
 
 int main(int argc,char ** argv)
 {
@@ -58,9 +541,15 @@ int main(int argc,char ** argv)
   String output_name = 0;
   String one_word = 0;
   String words_file = 0;
+  String request_file = 0;
+  String response_file = 0;
   bool cosets = false;
   bool steps = false;
   bool gap_interface = false;
+  unsigned repeats = 0;
+  unsigned threads = 1;
+  unsigned response_cache = 0;
+  int exit_code = 0;
   Container * container = MAF::create_container();
   Standard_Options so(*container,SO_STDIN|SO_STDOUT|
                                  SO_REDUCTION_METHOD|SO_PROVISIONAL|SO_WORDUTIL);
@@ -87,11 +576,38 @@ int main(int argc,char ** argv)
         steps = true;
         i++;
       }
+      else if (arg.is_equal("-benchmark"))
+      {
+        if (!so.parse_natural(&repeats,argv[i+1],0,"-benchmark"))
+          bad_usage = true;
+        i += 2;
+      }
+      else if (arg.is_equal("-threads"))
+      {
+        if (!so.parse_natural(&threads,argv[i+1],256,"-threads"))
+          bad_usage = true;
+        i += 2;
+      }
       else if (arg.is_equal("-read"))
       {
         words_file = argv[i+1];
         i += 2;
       }
+      else if (arg.is_equal("-server"))
+      {
+        request_file = argv[i+1];
+        if (request_file)
+          response_file = argv[i+2];
+        if (!response_file)
+          bad_usage = true;
+        i += 3;
+      }
+      else if (arg.is_equal("-response_cache"))
+      {
+        if (!so.parse_natural(&response_cache,argv[i+1],0,"-response_cache"))
+          bad_usage = true;
+        i += 2;
+      }
       else if (!so.recognised(argv,i))
         bad_usage = true;
     }
@@ -101,7 +617,7 @@ int main(int argc,char ** argv)
         group_filename = argv[i];
       else if (cosets && subgroup_suffix == 0)
         subgroup_suffix = argv[i];
-      else if (!so.use_stdin && !words_file)
+      else if (!so.use_stdin && !words_file && !request_file)
         one_word = argv[i];
       else if (!output_name && words_file)
         output_name = argv[i];
@@ -112,15 +628,18 @@ int main(int argc,char ** argv)
   }
 
   if (!bad_usage && group_filename &&
-       (one_word!=0) + so.use_stdin + (words_file!=0)==1 &&
-       !(gap_interface && !so.use_stdin))
+       (one_word!=0) + so.use_stdin + (words_file!=0) + (request_file!=0)==1 &&
+       !(gap_interface && !so.use_stdin) && !(repeats && !words_file) &&
+       !(steps && request_file) && !(response_cache && !request_file))
   {
     MAF * maf = 0;
     if (so.use_stdin || so.use_stdout)
       container->set_gap_stdout(true);
     maf = MAF::create_from_input(cosets,group_filename,subgroup_suffix,
                                  container);
-    if (!maf->load_reduction_method(so.reduction_method))
+    maf->options.threads = threads;
+    if (!maf->load_reduction_method(so.reduction_method,so.use_trie,
+                                    so.prefix_cache))
     {
       cprintf("Unable to reduce words using selected mechanism\n");
       delete maf;
@@ -225,6 +744,14 @@ int main(int argc,char ** argv)
         container->output(os,"Word is not reducible: %s\n",sb.get().string());
       delete ow;
     }
+    else if (request_file)
+    {
+      Reduction_Pool pool(*maf,threads,cosets,group_filename,subgroup_suffix,
+                          so);
+      Reduction_Server server(*maf,pool,response_cache);
+      if (!server.serve(request_file,response_file))
+        exit_code = 1;
+    }
     else
     {
       Word_List wl(maf->alphabet);
@@ -235,14 +762,20 @@ int main(int argc,char ** argv)
       container->output(os,"reduced_words :=\n[\n  ");
 
       maf->read_word_list(&wl,words_file);
+      if (repeats)
+      {
+        benchmark(maf,wl,so.reduction_method,repeats);
+        maf->load_reduction_method(so.reduction_method,so.use_trie,
+                                   so.prefix_cache);
+      }
       Element_Count count = wl.count();
-      for (Element_ID i = 0; i < count;i++)
+      if (steps)
       {
-        if (i)
-          container->output(os,",\n  ");
-        wl.get(&test,i);
-        if (steps)
+        for (Element_ID i = 0; i < count;i++)
         {
+          if (i)
+            container->output(os,",\n  ");
+          wl.get(&test,i);
           container->output(os,"[\n    ");
           bool started = false;
           do
@@ -255,10 +788,32 @@ int main(int argc,char ** argv)
           while (maf->reduce(&test,test,WR_ONCE));
           container->output(os,"\n  ]");
         }
-        else
+      }
+      else
+      {
+        /* When there are several threads the words are reduced a piece at
+           a time, and the answers for each piece are output before the
+           next piece is reduced, so that the answers for a very long list
+           do not all have to be kept in memory at once */
+        Reduction_Pool pool(*maf,threads,cosets,group_filename,
+                            subgroup_suffix,so);
+        Element_Count piece = count;
+        if (pool.thread_count() > 1 &&
+            count/pool.thread_count() > READ_PIECE_SIZE)
+          piece = pool.thread_count()*READ_PIECE_SIZE;
+        Word_List answers(maf->alphabet,piece);
+        for (Element_ID from = 0; from < count;from += piece)
         {
-          maf->reduce(&test,test);
-          test.print(*container,os);
+          Element_ID to = count - from > piece ? from + piece : count;
+          answers.empty();
+          pool.reduce(&answers,wl,from,to);
+          for (Element_ID i = from; i < to;i++)
+          {
+            if (i)
+              container->output(os,",\n  ");
+            answers.get(&test,i-from);
+            test.print(*container,os);
+          }
         }
       }
       container->output(os,"\n];\n");
@@ -270,7 +825,9 @@ int main(int argc,char ** argv)
   {
     cprintf("Usage:\n"
             "reduce [loglevel] [reduction_method] [-steps] [-interface] rwsname [-cos [subsuffix]]"
-            " word | -i | -read input_file [output_file]\n"
+            " word | -i | [-benchmark n] [-threads n] -read input_file"
+            " [output_file] |\n[-threads n] [-response_cache n] -server"
+            " request_file response_file\n"
             "where rwsname is a GASP rewriting system and, if the -cos option"
             " is used,\nrwsname.subsuffix is a substructure file.\n"
             "An automaton that can peform word reduction must previously have"
@@ -283,13 +840,27 @@ int main(int argc,char ** argv)
             " named reduced_words).\n"
             "The -steps option causes each step of the reduction to be printed.\n"
             "The -interface option (for -i only) outputs words in GAP letter"
-            " representation.\n");
+            " representation.\n"
+            "-benchmark n (for -read only) reduces the words n times using"
+            " the index automaton\nand n times using an Aho-Corasick trie"
+            " (see -trie), and reports the time taken\nby each.\n"
+            "-threads n (for -read) reduces the words in n threads, each"
+            " with its own copy of\nthe automata. The answers are output in"
+            " the same order as the words.\n"
+            "If the -server option is specified reduce keeps running and"
+            " reduces lists of words\nsent to request_file, which is"
+            " normally a FIFO, writing the answers to\nresponse_file. See"
+            " the documentation for a description of the protocol.\n"
+            "-threads n (for -server) uses n threads, each with its own"
+            " copy of the automata.\n"
+            "-response_cache n (for -server) remembers the answers for up"
+            " to n words.\n");
     so.usage(".reduced");
     delete container;
     return 1;
   }
 
   delete container;
-  return 0;
+  return exit_code;
 }
 
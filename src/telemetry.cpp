@@ -0,0 +1,161 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// $Log: telemetry.cpp $
+//
+
+/* Implementation of the classes declared in telemetry.h */
+
+#include "awcc.h"
+#include "telemetry.h"
+#include "container.h"
+#include "heap.h"
+
+/* The names of the fields, in the order they appear in each record.
+   mafstat relies on these names, so they should not be changed */
+static const char * const field_names[TF_Count] =
+{
+  "time",
+  "phase_time",
+  "status_count",
+  "nodes_l0",
+  "nodes_l1",
+  "nodes_l2",
+  "nodes_bad",
+  "depth",
+  "nodes_dense",
+  "nodes_sorted",
+  "nodes_hashed",
+  "equations",
+  "adopted",
+  "visible",
+  "pool",
+  "differences",
+  "primary_differences",
+  "pool_limit",
+  "max_expanded",
+  "visible_limit",
+  "auto_expand_limit",
+  "complete",
+  "primary_complete",
+  "g_complete",
+  "h_complete",
+  "coset_complete",
+  "heap_in_use",
+  "heap_reserved",
+  "heap_peak"
+};
+
+/**/
+
+Telemetry::Telemetry(Container & container_,Output_Stream * stream_,
+                     bool csv_,unsigned interval_) :
+  container(container_),
+  stream(stream_),
+  interval((unsigned long long) interval_*1000),
+  csv(csv_)
+{
+  phase = String("start");
+  start_time = phase_start = last_record = container.elapsed_time();
+  if (csv)
+  {
+    container.output(stream,"kind,phase");
+    for (int i = 0; i < TF_Count;i++)
+      container.output(stream,",%s",field_names[i]);
+    container.output(stream,"\n");
+    container.flush(stream);
+  }
+}
+
+/**/
+
+Telemetry * Telemetry::create(Container & container,String filename,
+                              unsigned interval)
+{
+  Output_Stream * stream = container.open_text_output_file(filename,false);
+  if (!stream)
+    return 0;
+  String_Length length = filename.length();
+  bool csv = length >= 4 &&
+             String(filename.string()+length-4).is_equal(".csv",true);
+  return new Telemetry(container,stream,csv,interval);
+}
+
+/**/
+
+Telemetry::~Telemetry()
+{
+  container.close_output_file(stream);
+}
+
+/**/
+
+String Telemetry::field_name(Telemetry_Field field)
+{
+  return field_names[field];
+}
+
+/**/
+
+bool Telemetry::sample_due() const
+{
+  return container.elapsed_time() >= last_record + interval;
+}
+
+/**/
+
+void Telemetry::set_phase(String new_phase,Telemetry_Sample * sample)
+{
+  if (sample)
+    record("phase",*sample);
+  phase = new_phase;
+  phase_start = container.elapsed_time();
+}
+
+/**/
+
+void Telemetry::record(String kind,Telemetry_Sample & sample)
+{
+  unsigned long long now = container.elapsed_time();
+  last_record = now;
+  sample.value[TF_Time] = Telemetry_Value(now - start_time);
+  sample.value[TF_Phase_Time] = Telemetry_Value(now - phase_start);
+  const Heap_Status * hs = Heap::get_global_heap()->status(false);
+  if (hs)
+  {
+    sample.value[TF_Heap_In_Use] = Telemetry_Value(hs->total_allocation);
+    sample.value[TF_Heap_Reserved] = Telemetry_Value(hs->os_allocation);
+    sample.value[TF_Heap_Peak] = Telemetry_Value(hs->peak_allocation);
+  }
+
+  if (csv)
+  {
+    container.output(stream,"%s,%s",kind.string(),phase.string().string());
+    for (int i = 0; i < TF_Count;i++)
+      container.output(stream,",%lld",sample.value[i]);
+  }
+  else
+  {
+    container.output(stream,"{\"kind\":\"%s\",\"phase\":\"%s\"",
+                     kind.string(),phase.string().string());
+    for (int i = 0; i < TF_Count;i++)
+      container.output(stream,",\"%s\":%lld",field_names[i],sample.value[i]);
+    container.output(stream,"}");
+  }
+  container.output(stream,"\n");
+  container.flush(stream);
+}
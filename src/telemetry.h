@@ -0,0 +1,135 @@
+/*
+  Copyright 2008,2009,2010 Alun Williams
+  This file is part of MAF.
+  MAF is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  MAF is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with MAF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+$Log: telemetry.h $
+*/
+#pragma once
+#ifndef TELEMETRY_INCLUDED
+#define TELEMETRY_INCLUDED 1
+
+/* A Telemetry object writes a machine readable record of the progress
+   of a Rewriter_Machine to a file, so that a program watching a large
+   number of MAF jobs can tell how each of them is getting on without
+   having to make sense of the free text progress messages.
+
+   Every record has the same fields, so the file can be written either as
+   "JSON lines" (one JSON object per line), or as CSV with a header line.
+   CSV is used if the filename ends in ".csv". The file is flushed after
+   every record so that it can be read while MAF is still running.
+
+   The Rewriter_Machine fills in a Telemetry_Sample with the values of its
+   counters, and the Telemetry object adds the elapsed time, the current
+   phase and the heap usage. Records are written at most once per interval,
+   except that a record is always written when the phase changes and when
+   the file is closed, so that the last record in the file describes the
+   final state of the run. The mafstat utility summarises the output.
+*/
+
+#ifndef AWDEFS_INCLUDED
+#include "awdefs.h"
+#endif
+#ifndef MAFBASE_INCLUDED
+#include "mafbase.h"
+#endif
+
+// Classes referred to but defined elsewhere
+class Container;
+class Output_Stream;
+
+enum Telemetry_Field
+{
+  TF_Time,                 // milliseconds since the file was opened
+  TF_Phase_Time,           // milliseconds since the current phase began
+  TF_Status_Count,         // Rewriter_Machine::Status::status_count
+  TF_Nodes_L0,             // Node_Manager::Node_Stats::nc[] values
+  TF_Nodes_L1,
+  TF_Nodes_L2,
+  TF_Nodes_Bad,
+  TF_Depth,
+  TF_Nodes_Dense,          // Node_Manager::Node_Stats::nrc[] values
+  TF_Nodes_Sorted,
+  TF_Nodes_Hashed,
+  TF_Equations,            // Equation_Stats values
+  TF_Adopted,
+  TF_Visible,
+  TF_Pool,
+  TF_Differences,          // Difference_Tracker::Status values
+  TF_Primary_Differences,
+  TF_Pool_Limit,           // Rewriter_Machine::Status values
+  TF_Max_Expanded,
+  TF_Visible_Limit,
+  TF_Auto_Expand_Limit,
+  TF_Complete,
+  TF_Primary_Complete,
+  TF_G_Complete,
+  TF_H_Complete,
+  TF_Coset_Complete,
+  TF_Heap_In_Use,          // Heap_Status values
+  TF_Heap_Reserved,
+  TF_Heap_Peak,
+  TF_Count
+};
+
+typedef long long Telemetry_Value;
+
+struct Telemetry_Sample
+{
+  Telemetry_Value value[TF_Count];
+  Telemetry_Sample()
+  {
+    for (int i = 0; i < TF_Count;i++)
+      value[i] = 0;
+  }
+};
+
+class Telemetry
+{
+  BLOCKED(Telemetry)
+  private:
+    Container & container;
+    Output_Stream * stream;
+    Owned_String phase;
+    unsigned long long start_time;
+    unsigned long long phase_start;
+    unsigned long long last_record;
+    unsigned long long interval;
+    bool csv;
+    Telemetry(Container & container_,Output_Stream * stream_,bool csv_,
+              unsigned interval_);
+  public:
+    /* create() returns 0 if the file cannot be opened. interval is the
+       minimum number of seconds between "sample" records */
+    static Telemetry * create(Container & container,String filename,
+                              unsigned interval);
+    ~Telemetry();
+    static String field_name(Telemetry_Field field);
+    // sample_due() returns true if it is time for another sample record
+    bool sample_due() const;
+    String current_phase() const
+    {
+      return phase;
+    }
+    /* set_phase() starts a new phase. If sample is not 0 a "phase" record
+       is written for the end of the previous phase first */
+    void set_phase(String new_phase,Telemetry_Sample * sample);
+    /* record() writes a record of the specified kind. The Telemetry object
+       fills in the time and heap fields of sample itself */
+    void record(String kind,Telemetry_Sample & sample);
+};
+
+#endif